@@ -3,7 +3,8 @@
  Name        : TCP_client.c
  Author      : Cristian Biallo.
  Version     : 1.0.0
- Description : A TCP client implementation in C that communicates with a password generation server.
+ Description : A TCP client implementation in C that communicates with password generation servers,
+               balancing its requests over one or more of them.
  ============================================================================
  */
 
@@ -16,12 +17,18 @@
 #include <sys/types.h>   /**< Include for socket types */
 #include <netinet/in.h>  /**< Include for internet address family structures */
 #include <netdb.h>  /**< Include for host and network databases */
+#include <signal.h>  /**< Include for signal() */
 #define closesocket close  /**< Define closesocket to close for UNIX systems */
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <time.h>
 #include <stdbool.h>
+#include "libs/endpoint/endpoint.h"  /**< Include the header for the server pool */
+#include "libs/loadgen/loadgen.h"  /**< Include the header for the load generator */
 #include "libs/protocol/protocol.h"  /**< Include protocol header for message structures and communication formats */
 #include "libs/utils/utils.h"	   /**< Include the utils.h library for utility functions */
 
@@ -47,7 +54,86 @@ void errorhandler(char *errorMessage) {
 }
 
 
-int main() {
+/**
+ * @brief Usage:
+ *   TCP_client [servers]            interactive password generation
+ *   TCP_client --health [servers]   health probe: prints the health of every server,
+ *                                   exits with 0 if at least one server is ready
+ *   TCP_client --hedge [servers]    interactive, hedging requests slower than the p95 latency
+ *   TCP_client --trace-rate R ...   sends a share R (0 to 1) of the interactive or load requests with
+ *                                   a sampled trace context, whose trace id is printed
+ *   TCP_client --load N [--request "t len"] [servers]
+ *                                   load generator: sends N requests ("m 16" by default) one
+ *                                   after the other and prints throughput and latency percentiles
+ *   TCP_client --stream N [--credits C] [--request "t len"] [servers]
+ *                                   prints N passwords streamed by one server, which never runs
+ *                                   more than C (32 by default) passwords ahead of the client
+ *   TCP_client --udp N [--window W] [--request "t len"] [server]
+ *                                   UDP load generator: sends N datagram requests to a server
+ *                                   running its UDP mode, W (32 by default) outstanding at a time
+ *   TCP_client --batch N [--encoding E] [--request "t len"] [servers]
+ *                                   prints a batch of N passwords sent by one server in encoding E
+ *                                   (plain, bcd, decimal, alpha or mixed; the most compact fitting
+ *                                   the type by default) and the bytes saved over plain text
+ *   TCP_client --soak SECONDS [--sessions S] [--interval I] [--server-pid PID] [--request "t len"] [server]
+ *                                   soak test: keeps S (16 by default) sessions open against a server,
+ *                                   ending and replacing them with quits, closes and resets, prints
+ *                                   latency percentiles and, for a server process on this host,
+ *                                   its memory and descriptors every I (60 by default) seconds, and
+ *                                   exits with 1 if memory, descriptors or latency keep growing
+ * `servers` is a comma-separated list of `host:port` entries, `DEFAULT_IP:DEFAULT_PORT` by default.
+ * Requests are balanced over the servers and fail over when a server stops answering.
+ */
+int main(int argc, char *argv[]) {
+	bool health_probe = false;  /**< Whether to run a health probe */
+	bool hedging = false;  /**< Whether to hedge slow requests */
+	double trace_rate = 0;  /**< Share of the requests sent with a sampled trace context */
+	int load_requests = 0;  /**< Requests sent by the load generator, 0 for interactive use */
+	const char *load_request = "m 16";  /**< Type and length requested by the load generator */
+	int stream_count = 0;  /**< Passwords to stream, 0 for no stream */
+	int stream_credits = 32;  /**< Credit window of the stream */
+	int udp_requests = 0;  /**< Datagram requests sent by the UDP load generator, 0 for none */
+	int udp_window = 32;  /**< Outstanding datagram requests of the UDP load generator */
+	int batch_count = 0;  /**< Passwords of the batch, 0 for no batch */
+	const char *batch_encoding = NULL;  /**< Encoding of the batch, NULL for the most compact one */
+	SoakOptions soak = { 0, 60, 16, 0 };  /**< Settings of the soak test, none unless `seconds` is set */
+	char server_list[BUFFER_SIZE];  /**< Comma-separated list of servers */
+	snprintf(server_list, sizeof(server_list), "%s:%d", DEFAULT_IP, DEFAULT_PORT);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--health") == 0) {
+			health_probe = true;
+		} else if (strcmp(argv[i], "--hedge") == 0) {
+			hedging = true;
+		} else if (strcmp(argv[i], "--trace-rate") == 0 && i + 1 < argc) {
+			trace_rate = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+			load_requests = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+			stream_count = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--credits") == 0 && i + 1 < argc) {
+			stream_credits = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--udp") == 0 && i + 1 < argc) {
+			udp_requests = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+			udp_window = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+			batch_count = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--encoding") == 0 && i + 1 < argc) {
+			batch_encoding = argv[++i];
+		} else if (strcmp(argv[i], "--soak") == 0 && i + 1 < argc) {
+			soak.seconds = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+			soak.sessions = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+			soak.interval = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--server-pid") == 0 && i + 1 < argc) {
+			soak.server_pid = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--request") == 0 && i + 1 < argc) {
+			load_request = argv[++i];
+		} else {
+			snprintf(server_list, sizeof(server_list), "%s", argv[i]);
+		}
+	}
 
 #if defined WIN32
 	// Initialize Winsock
@@ -62,30 +148,77 @@ int main() {
 	}
 #endif
 
-	// Create the client socket for communication with the server
-	int c_socket;
-	c_socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);  /**< Create the client socket */
-	if (c_socket < 0) {
-		errorhandler("Client socket creation failed.\n");
-		closesocket(c_socket);  /**< Close socket if creation failed */
+	// Parse the servers to balance the requests over
+	EndpointPool pool;  /**< Servers of the client */
+	if (parse_endpoints(&pool, server_list) <= 0) {
+		errorhandler("Invalid server list, expected host:port[,host:port...].\n");
 		clearwinsock();  /**< Clean up Winsock */
-		#if defined WIN32
-			Sleep(3000);  /**< Wait before exiting */
-		#endif
 		return -1;
 	}
+	srand((unsigned int) time(NULL));  /**< Seed the server selection */
+#if !defined WIN32
+	signal(SIGPIPE, SIG_IGN);  /**< A server that reset the connection fails the send(), the client goes on */
+#endif
+	pool.hedging = hedging;
+	pool.trace_rate = trace_rate;
+
+	// Probe the health of every server and exit
+	if (health_probe) {
+		bool any_ready = false;
+		for (int i = 0; i < pool.count; i++) {
+			HealthResponse health_msg;  /**< Health reported by the server */
+			printf("%s:%d ", pool.endpoints[i].host, pool.endpoints[i].port);
+			if (probe_endpoint(&pool.endpoints[i], &health_msg)) {
+				printf("live=%d ready=%d loop=%d rng=%d capacity=%d\n", health_msg.live, health_msg.ready,
+						(health_msg.checks & HEALTH_LOOP) != 0, (health_msg.checks & HEALTH_RNG) != 0,
+						(health_msg.checks & HEALTH_CAPACITY) != 0);
+				any_ready = any_ready || health_msg.ready;
+			} else {
+				printf("unreachable\n");
+			}
+		}
+		clearwinsock();  /**< Clean up Winsock */
+		return any_ready ? 0 : 1;
+	}
 
-	// Set up the server connection settings
-	struct sockaddr_in sad;  /**< Socket address structure for the server */
-	memset(&sad, 0, sizeof(sad));  /**< Clear the structure */
-	sad.sin_family = AF_INET;  /**< Set address family to AF_INET (IPv4) */
-	sad.sin_addr.s_addr = inet_addr(DEFAULT_IP);  /**< Set server IP address */
-	sad.sin_port = htons(DEFAULT_PORT);  /**< Set server port, converting to network byte order */
+	// Run the UDP load generator against the first server and exit: datagrams need no connection
+	if (udp_requests > 0) {
+		PasswordRequest load_msg;  /**< Request sent by the load generator */
+		LoadReport report;  /**< Throughput and latency of the run */
+		memset(&load_msg, 0, sizeof(load_msg));
+		if (sscanf(load_request, " %c %s", &load_msg.type, load_msg.length) != 2 || udp_window < 1) {
+			errorhandler("Invalid request \"type length\" or window.\n");
+			clearwinsock();  /**< Clean up Winsock */
+			return -1;
+		}
+		bool completed = run_udp_load(&pool.endpoints[0], &load_msg, udp_requests, udp_window, &report);
+		print_load_report(&report);
+		clearwinsock();  /**< Clean up Winsock */
+		return completed ? 0 : 1;
+	}
 
-	// Establish the connection to the server
-	if (connect(c_socket, (struct sockaddr*) &sad, sizeof(sad)) < 0) {
+	// Soak the first server with its own sessions and exit
+	if (soak.seconds > 0) {
+		PasswordRequest soak_msg;  /**< Request sent by the soak test */
+		memset(&soak_msg, 0, sizeof(soak_msg));
+		if (sscanf(load_request, " %c %s", &soak_msg.type, soak_msg.length) != 2 || soak.interval < 1
+				|| soak.sessions < 1 || soak.sessions > SOAK_MAX_SESSIONS) {
+			errorhandler("Invalid request \"type length\", interval or sessions.\n");
+			clearwinsock();  /**< Clean up Winsock */
+			return -1;
+		}
+		bool stable = run_soak(&pool.endpoints[0], &soak_msg, &soak);
+		clearwinsock();  /**< Clean up Winsock */
+		return stable ? 0 : 1;
+	}
+
+	// Establish the connections to the servers
+	int connected = 0;
+	for (int i = 0; i < pool.count; i++) {
+		connected += connect_endpoint(&pool.endpoints[i]);
+	}
+	if (connected == 0) {
 		errorhandler("Connection failed.\n");
-		closesocket(c_socket);  /**< Close the socket */
 		clearwinsock();  /**< Clean up Winsock */
 		#if defined WIN32
 			Sleep(3000);  /**< Wait before exiting */
@@ -93,35 +226,76 @@ int main() {
 		return -1;
 	}
 
-	// Indicate successful connection
-	print_with_color("Connection completed\n\n", BLUE);
+	// Request a batch and exit
+	if (batch_count > 0) {
+		PasswordRequest batch_msg;  /**< Type and length of the batch */
+		PackEncoding encoding;  /**< Encoding of the batch */
+		memset(&batch_msg, 0, sizeof(batch_msg));
+		bool valid = sscanf(load_request, " %c %s", &batch_msg.type, batch_msg.length) == 2
+				&& batch_count <= BATCH_MAX_PASSWORDS;
+		if (valid && batch_encoding == NULL) {
+			encoding = best_encoding(batch_msg.type);
+		} else if (valid) {
+			valid = parse_encoding(batch_encoding, &encoding);
+		}
+		if (!valid) {
+			errorhandler("Invalid request \"type length\", batch size or encoding.\n");
+			close_endpoints(&pool);
+			clearwinsock();  /**< Clean up Winsock */
+			return -1;
+		}
+		bool completed = run_batch(pick_endpoint(&pool), &batch_msg, batch_count, encoding, true);
+		close_endpoints(&pool);
+		clearwinsock();  /**< Clean up Winsock */
+		return completed ? 0 : 1;
+	}
 
-	// Receive the menu message from the server
-	MenuMessage menu_msg;  /**< Message structure for the menu */
-	if (recv(c_socket, &menu_msg, sizeof(menu_msg), 0) <= 0) {
-		errorhandler("recv() failed or connection closed prematurely (Menu).\n");
-		closesocket(c_socket);  /**< Close the socket */
+	// Run the load generator or the stream consumer and exit
+	if (load_requests > 0 || stream_count > 0) {
+		PasswordRequest load_msg;  /**< Request sent by the load generator */
+		LoadReport report;  /**< Throughput and latency of the run */
+		memset(&load_msg, 0, sizeof(load_msg));
+		if (sscanf(load_request, " %c %s", &load_msg.type, load_msg.length) != 2
+				|| stream_credits < 1 || stream_credits > STREAM_MAX_CREDITS) {
+			errorhandler("Invalid request \"type length\" or credits.\n");
+			close_endpoints(&pool);
+			clearwinsock();  /**< Clean up Winsock */
+			return -1;
+		}
+		bool completed = (stream_count > 0)
+				? run_stream(pick_endpoint(&pool), &load_msg, stream_count, stream_credits, true, &report)
+				: run_load(&pool, &load_msg, load_requests, &report);
+		print_load_report(&report);
+		close_endpoints(&pool);
 		clearwinsock();  /**< Clean up Winsock */
-		#if defined WIN32
-			Sleep(3000);  /**< Wait before exiting */
-		#endif
-		return -1;
+		return completed ? 0 : 1;
 	}
 
+	// Indicate successful connection
+	print_with_color("Connection completed\n\n", BLUE);
+
 	// Start password generation process
 	PasswordRequest password_msg;   /**< Structure to hold password request (type and length) */
 	PasswordResponse response_msg;  /**< Structure to hold server's response */
 	char input[BUFFER_SIZE];
+	memset(&password_msg, 0, sizeof(password_msg));  /**< No trace context unless the request is sampled */
 	do {
-		// Display the menu and prompt the user to input password type and length
-		print_with_color(menu_msg.menu_text, YELLOW);	 /**< Print the server's menu */
+		// Display the menu of a healthy server and prompt the user to input password type and length
+		Endpoint *menu_endpoint = pick_endpoint(&pool);
+		if (menu_endpoint == NULL) {
+			errorhandler("No server available.\n");
+			break;
+		}
+		print_with_color(menu_endpoint->menu.menu_text, YELLOW);	 /**< Print the server's menu */
 
 	    // Read all input row
-		fgets(input, sizeof(input), stdin); /**< Read user input for password type and length */
+		if (fgets(input, sizeof(input), stdin) == NULL) { /**< Read user input for password type and length */
+			strcpy(input, "q");  /**< End of input closes the connection */
+		}
 		input[BUFFER_SIZE-1] = '\0';	/**< Ensure null termination for the length string */
 
-		int arguments = sscanf(input," %c %s %s",&password_msg.type, password_msg.length, input); /**< Read user input for password type and length */
-		password_msg.length[BUFFER_SIZE-1] = '\0';	/**< Ensure null termination for the length string */
+		int arguments = sscanf(input," %c %31s %s",&password_msg.type, password_msg.length, input); /**< Read user input for password type and length; a longer length is left over and rejected */
+		password_msg.length[sizeof(password_msg.length)-1] = '\0';	/**< Ensure null termination for the length string */
 
         // Check if only the type is entered (no length)
         if (arguments == 1) {
@@ -133,26 +307,24 @@ int main() {
             continue;  // Continue the cycle if the input is not legit
         }
 
-		// Send the password request to the server
-		if (send(c_socket, &password_msg, sizeof(password_msg), 0) != sizeof(password_msg)) {
-			errorhandler("send() sent a different number of bytes than expected (Password settings).\n");
-			closesocket(c_socket);  /**< Close the socket */
-			clearwinsock();  /**< Clean up Winsock */
-			#if defined WIN32
-				Sleep(3000);  /**< Wait before exiting */
-			#endif
-			return -1;
+		// The quit request closes the connections to every server
+		if (tolower(password_msg.type) == 'q') {
+			response_msg.keep_going = false;
+			continue;
 		}
 
-		// Receive the server's password generation response
-		if (recv(c_socket, &response_msg, sizeof(response_msg), 0) <= 0) {
+		// Send the password request to the least loaded server and receive its response
+		if (start_trace(&password_msg.trace, pool.trace_rate)) {
+			char trace_id[2 * TRACE_ID_SIZE + 1];
+			format_trace_id(&password_msg.trace, trace_id);
+			printf("Trace id: %s\n", trace_id);
+		}
+		revive_endpoints(&pool);
+		bool answered = pool.hedging ? hedged_request(&pool, &password_msg, &response_msg)
+				: balanced_request(&pool, &password_msg, &response_msg);
+		if (!answered) {
 			errorhandler("recv() failed or connection closed prematurely (Password generation response).\n");
-			closesocket(c_socket);  /**< Close the socket */
-			clearwinsock();  /**< Clean up Winsock */
-			#if defined WIN32
-				Sleep(3000);  /**< Wait before exiting */
-			#endif
-			return -1;
+			break;
 		}
 
 		if(response_msg.keep_going){
@@ -177,8 +349,11 @@ int main() {
 	} while(response_msg.keep_going); /**< Continue until the server indicates to stop */
 
 
-	// Close the connection with the server and clean up
-	closesocket(c_socket);  /**< Close the socket */
+	// Close the connections with the servers and clean up
+	if (pool.hedging) {
+		printf("Hedged requests: %lu, answered first by the hedge: %lu\n", pool.hedges, pool.hedge_wins);
+	}
+	close_endpoints(&pool);  /**< Close the sockets */
 	clearwinsock();  /**< Clean up Winsock */
 	return 0;
 }
@@ -0,0 +1,94 @@
+/*
+ ============================================================================
+ Name        : alloc.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Counting wrappers of the C library allocator.
+ ============================================================================
+ */
+
+#include <stdlib.h>  /* Defines __GLIBC__ and declares the replaced functions */
+#include "alloc.h"
+
+#if defined ALLOC_COUNT && defined __GLIBC__
+#define COUNTING_ALLOCATOR  /**< The wrappers below replace the allocator */
+#endif
+
+
+/* - - - - - - - - - - - - - - - - - - - - ALLOC - - - - - - - - - - - - - - - - - - - - - */
+
+#if defined COUNTING_ALLOCATOR
+
+// Entry points of the glibc allocator, still reachable once malloc() and friends are replaced
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *memory, size_t size);
+extern void __libc_free(void *memory);
+
+static unsigned long long allocations;  /**< Allocation calls since the start */
+static unsigned long long frees;        /**< Free calls since the start */
+
+void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *memory, size_t size) {
+    allocations++;
+    return __libc_realloc(memory, size);
+}
+
+void free(void *memory) {
+    if (memory != NULL) {
+        frees++;
+    }
+    __libc_free(memory);
+}
+
+#endif
+
+
+/**
+ * @brief Tells whether allocations are counted in this build.
+ * @return `true` if the allocator is replaced by the counting wrappers.
+ */
+bool allocations_counted(void) {
+#if defined COUNTING_ALLOCATOR
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Returns the number of heap allocations since the start.
+ * @return the number of allocations, 0 if allocations are not counted.
+ */
+unsigned long long allocation_count(void) {
+#if defined COUNTING_ALLOCATOR
+    return allocations;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * @brief Returns the number of `free` calls with a non-NULL pointer since the start.
+ * @return the number of frees, 0 if allocations are not counted.
+ */
+unsigned long long free_count(void) {
+#if defined COUNTING_ALLOCATOR
+    return frees;
+#else
+    return 0;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - END ALLOC - - - - - - - - - - - - - - - - - - - */
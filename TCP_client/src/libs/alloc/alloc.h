@@ -0,0 +1,46 @@
+/*
+ ============================================================================
+ Name        : alloc.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing heap allocation counting. When the
+               program is compiled with -DALLOC_COUNT on glibc, malloc(),
+               calloc(), realloc() and free() are replaced by wrappers that
+               count every call before forwarding it to the C library, so the
+               request path can be checked to be allocation-free. Otherwise
+               nothing is interposed and the counters stay at zero.
+ ============================================================================
+ */
+
+#ifndef ALLOC_H_
+#define ALLOC_H_
+
+#include <stdbool.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - - ALLOC - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Tells whether allocations are counted in this build.
+ * @return `true` if the program was compiled with `ALLOC_COUNT` on glibc.
+ */
+bool allocations_counted(void);
+
+
+/**
+ * @brief Returns the number of heap allocations since the start.
+ * Every successful or failed `malloc`, `calloc` and `realloc` call counts as one.
+ * @return the number of allocations, 0 if allocations are not counted.
+ */
+unsigned long long allocation_count(void);
+
+
+/**
+ * @brief Returns the number of `free` calls with a non-NULL pointer since the start.
+ * @return the number of frees, 0 if allocations are not counted.
+ */
+unsigned long long free_count(void);
+
+/* - - - - - - - - - - - - - - - - - - - END ALLOC - - - - - - - - - - - - - - - - - - - */
+
+#endif /* ALLOC_H_ */
@@ -0,0 +1,212 @@
+/*
+ ============================================================================
+ Name        : auth.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing pre-shared-key authentication based on
+               HMAC-SHA256 over a server nonce. Functions include SHA-256 and
+               HMAC computation, key table management and constant-time
+               verification of the client proof.
+ ============================================================================
+ */
+
+#ifndef AUTH_H_
+#define AUTH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Size in bytes of a SHA-256 digest, and therefore of an HMAC-SHA256 tag.
+ */
+#define SHA256_DIGEST_SIZE 32   /**< SHA-256 digest size */
+
+/**
+ * @brief Size in bytes of a SHA-256 input block.
+ */
+#define SHA256_BLOCK_SIZE 64    /**< SHA-256 block size */
+
+/**
+ * @brief Maximum length of a key identifier, null terminator included.
+ */
+#define AUTH_KEY_ID_SIZE 32     /**< Key identifier size */
+
+/**
+ * @brief Maximum length in bytes of a pre-shared secret.
+ * Secrets longer than a SHA-256 block are hashed first, as required by HMAC.
+ */
+#define AUTH_MAX_SECRET_SIZE 128    /**< Maximum secret size */
+
+/**
+ * @brief Number of slots in the key table. Must be a power of two.
+ */
+#define AUTH_TABLE_SIZE 256     /**< Key table capacity */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @struct Sha256Context
+ * @brief Running state of a SHA-256 computation.
+ */
+typedef struct {
+    uint32_t state[8];                      /**< Intermediate hash value */
+    uint64_t total;                         /**< Number of bytes absorbed so far */
+    uint8_t block[SHA256_BLOCK_SIZE];       /**< Partial input block */
+    size_t block_len;                       /**< Number of bytes in `block` */
+} Sha256Context;
+
+
+/**
+ * @struct ApiKey
+ * @brief A pre-shared key, stored with its precomputed HMAC states.
+ *
+ * The inner and outer contexts already absorbed `secret ^ ipad` and `secret ^ opad`,
+ * so a verification only costs the compression of the message and of the inner digest.
+ * The `requests` counter attributes usage to the key, and `tenant` names the policy set
+ * the key belongs to (empty for the default one).
+ */
+typedef struct {
+    bool used;                          /**< Whether the slot holds a key */
+    char key_id[AUTH_KEY_ID_SIZE];      /**< Public identifier of the key */
+    char tenant[AUTH_KEY_ID_SIZE];      /**< Name of the tenant owning the key, empty for the default */
+    int tenant_index;                   /**< Index of the tenant, resolved by the server */
+    Sha256Context inner;                /**< HMAC state after `secret ^ ipad` */
+    Sha256Context outer;                /**< HMAC state after `secret ^ opad` */
+    unsigned long requests;             /**< Requests served under this key */
+} ApiKey;
+
+
+/**
+ * @struct KeyTable
+ * @brief Open-addressing hash table of API keys, indexed by key identifier.
+ */
+typedef struct {
+    ApiKey slots[AUTH_TABLE_SIZE];      /**< Key slots */
+    int count;                          /**< Number of keys stored */
+} KeyTable;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - HASHING - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Initializes a SHA-256 context.
+ * @param[out] ctx: the context to initialize.
+ */
+void sha256_init(Sha256Context *ctx);
+
+
+/**
+ * @brief Absorbs data into a SHA-256 context.
+ * @param[in/out] ctx: the running context.
+ * @param[in] data: the bytes to absorb.
+ * @param[in] len: the number of bytes in `data`.
+ */
+void sha256_update(Sha256Context *ctx, const void *data, size_t len);
+
+
+/**
+ * @brief Finalizes a SHA-256 computation.
+ * @param[in/out] ctx: the running context, unusable afterwards.
+ * @param[out] digest: receives the `SHA256_DIGEST_SIZE` bytes of the digest.
+ */
+void sha256_final(Sha256Context *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+
+/**
+ * @brief Computes HMAC-SHA256 of a message.
+ * @param[in] secret: the key bytes.
+ * @param[in] secret_len: the number of bytes in `secret`.
+ * @param[in] message: the message bytes.
+ * @param[in] message_len: the number of bytes in `message`.
+ * @param[out] mac: receives the `SHA256_DIGEST_SIZE` bytes of the tag.
+ */
+void hmac_sha256(const uint8_t *secret, size_t secret_len, const void *message, size_t message_len,
+                 uint8_t mac[SHA256_DIGEST_SIZE]);
+
+/* - - - - - - - - - - - - - - - - - - - END HASHING - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - KEYS - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Decodes a hexadecimal secret.
+ * @param[in] hex: the hexadecimal string.
+ * @param[out] secret: receives the decoded bytes, at most `AUTH_MAX_SECRET_SIZE`.
+ * @return the number of decoded bytes, or -1 if `hex` is not valid.
+ */
+int decode_hex_secret(const char *hex, uint8_t secret[AUTH_MAX_SECRET_SIZE]);
+
+
+/**
+ * @brief Adds a key to the table, precomputing its HMAC states.
+ * @param[in/out] table: the key table.
+ * @param[in] key_id: the public identifier of the key.
+ * @param[in] secret: the key bytes.
+ * @param[in] secret_len: the number of bytes in `secret`.
+ * @return a pointer to the stored key, or NULL if the table is full or the identifier is too long.
+ */
+ApiKey *add_key(KeyTable *table, const char *key_id, const uint8_t *secret, size_t secret_len);
+
+
+/**
+ * @brief Loads keys from a file with one `<key_id> <hex secret> [tenant]` entry per line.
+ * Empty lines and lines starting with `#` are ignored.
+ * @param[out] table: the key table, cleared before loading.
+ * @param[in] path: the path of the key file.
+ * @return the number of keys loaded, or -1 if the file cannot be opened.
+ */
+int load_keys(KeyTable *table, const char *path);
+
+
+/**
+ * @brief Looks up a key by identifier.
+ * @param[in] table: the key table.
+ * @param[in] key_id: the identifier to look up.
+ * @return a pointer to the key, or NULL if it is not present.
+ */
+ApiKey *find_key(KeyTable *table, const char *key_id);
+
+
+/**
+ * @brief Verifies the HMAC proof sent by a client.
+ *
+ * The expected tag is computed even for unknown identifiers and compared in constant time,
+ * so the response time does not reveal which keys exist or how many bytes of the tag matched.
+ *
+ * @param[in] table: the key table.
+ * @param[in] key_id: the identifier claimed by the client.
+ * @param[in] message: the authenticated message (nonce and identifier).
+ * @param[in] message_len: the number of bytes in `message`.
+ * @param[in] mac: the tag sent by the client.
+ * @return a pointer to the authenticated key, or NULL if verification failed.
+ */
+ApiKey *verify_key(KeyTable *table, const char *key_id, const void *message, size_t message_len,
+                   const uint8_t mac[SHA256_DIGEST_SIZE]);
+
+
+/**
+ * @brief Fills a buffer with unpredictable bytes for nonces and seeds.
+ *
+ * Uses getrandom() on Linux, `/dev/urandom` (kept open after the first call) on other Unix
+ * systems and rand_s() on Windows. There is no weaker fallback: predictable nonces would let
+ * a recorded handshake be replayed.
+ *
+ * @param[out] buffer: the buffer to fill.
+ * @param[in] len: the number of bytes to write.
+ * @return `true` if the buffer was filled, `false` if no entropy source is available, in which
+ *         case the buffer must not be used.
+ */
+bool fill_random(void *buffer, size_t len);
+
+/* - - - - - - - - - - - - - - - - - - - END KEYS - - - - - - - - - - - - - - - - - - - - */
+
+#endif /* AUTH_H_ */
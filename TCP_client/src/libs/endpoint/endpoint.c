@@ -0,0 +1,760 @@
+/*
+ ============================================================================
+ Name        : endpoint.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Pool of password generation servers with least-outstanding-requests
+               routing, failover, health-checked re-admission and budgeted
+               request hedging.
+ ============================================================================
+ */
+
+#if defined WIN32
+#include <winsock.h>
+#else
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#define closesocket close
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "endpoint.h"
+#include "../auth/auth.h"
+#include "../pack/pack.h"
+#include "../utils/utils.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - CONNECTIONS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Receives exactly `size` bytes.
+ * @param[in] socket: the connected socket.
+ * @param[out] buffer: receives the bytes.
+ * @param[in] size: the number of bytes to receive.
+ * @return `true` if every byte was received, `false` on error or closed connection.
+ */
+static bool receive_all(int socket, void *buffer, int size) {
+    int received = 0;
+    while (received < size) {
+        int chunk = recv(socket, (char *) buffer + received, size - received, 0);
+        if (chunk <= 0) {
+            return false;
+        }
+        received += chunk;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Resolves the address of a server.
+ * @param[in] endpoint: the server.
+ * @param[out] sad: receives the address and port of the server.
+ * @return `true` if the host was resolved.
+ */
+static bool resolve_endpoint(const Endpoint *endpoint, struct sockaddr_in *sad) {
+    memset(sad, 0, sizeof(*sad));
+    sad->sin_family = AF_INET;
+    sad->sin_port = htons(endpoint->port);
+    sad->sin_addr.s_addr = inet_addr(endpoint->host);
+    if (sad->sin_addr.s_addr == INADDR_NONE) {
+        // Not a dotted address: resolve the host name
+        struct hostent *host = gethostbyname(endpoint->host);
+        if (host == NULL || host->h_addrtype != AF_INET) {
+            return false;
+        }
+        memcpy(&sad->sin_addr, host->h_addr_list[0], sizeof(sad->sin_addr));
+    }
+    return true;
+}
+
+
+/**
+ * @brief Opens a TCP connection to a server.
+ * @param[in] endpoint: the server.
+ * @param[in] timeout: the seconds the connection, and every later send or receive, may take;
+ *            0 to wait indefinitely.
+ * @return the connected socket, or -1 on failure.
+ */
+static int open_connection(const Endpoint *endpoint, int timeout) {
+    struct sockaddr_in sad;  /**< Socket address structure for the server */
+    if (!resolve_endpoint(endpoint, &sad)) {
+        return -1;
+    }
+
+    int c_socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (c_socket < 0) {
+        return -1;
+    }
+    if (timeout > 0) {
+#if defined WIN32
+        DWORD wait = (DWORD) timeout * 1000;
+#else
+        struct timeval wait = { timeout, 0 };  /**< On Linux the send timeout bounds connect() too */
+#endif
+        setsockopt(c_socket, SOL_SOCKET, SO_RCVTIMEO, (const char *) &wait, sizeof(wait));
+        setsockopt(c_socket, SOL_SOCKET, SO_SNDTIMEO, (const char *) &wait, sizeof(wait));
+    }
+    if (connect(c_socket, (struct sockaddr*) &sad, sizeof(sad)) < 0) {
+        closesocket(c_socket);
+        return -1;
+    }
+    return c_socket;
+}
+
+
+/**
+ * @brief Receives the challenge of a server and answers it.
+ * @param[in] c_socket: the connected socket.
+ * @param[in] opcode: `HELLO_SESSION` or `HELLO_HEALTH`.
+ * @return `true` if the answer was sent.
+ */
+static bool answer_challenge(int c_socket, unsigned char opcode) {
+    HelloChallenge hello_msg;  /**< Challenge sent by the server */
+    if (!receive_all(c_socket, &hello_msg, sizeof(hello_msg))) {
+        return false;
+    }
+
+    // Answer with the API key identifier and the HMAC of the nonce, if a key is configured
+    HelloResponse auth_msg;  /**< Proof of ownership of the API key */
+    memset(&auth_msg, 0, sizeof(auth_msg));
+    auth_msg.version = PROTOCOL_VERSION;
+    auth_msg.opcode = opcode;
+    const char *key_id = getenv(KEY_ID_ENV);
+    const char *key_hex = getenv(KEY_SECRET_ENV);
+    if (hello_msg.auth_required && opcode == HELLO_SESSION) {
+        uint8_t secret[AUTH_MAX_SECRET_SIZE];
+        int secret_len = (key_hex != NULL) ? decode_hex_secret(key_hex, secret) : -1;
+        if (key_id == NULL || secret_len < 0) {
+            print_with_color("The server requires an API key: set " KEY_ID_ENV " and " KEY_SECRET_ENV ".\n", MAGENTA);
+        } else {
+            strncpy(auth_msg.key_id, key_id, KEY_ID_SIZE - 1);
+            unsigned char proof_msg[NONCE_SIZE + KEY_ID_SIZE];  /**< Authenticated message: nonce and key identifier */
+            memcpy(proof_msg, hello_msg.nonce, NONCE_SIZE);
+            memcpy(proof_msg + NONCE_SIZE, auth_msg.key_id, KEY_ID_SIZE);
+            hmac_sha256(secret, secret_len, proof_msg, sizeof(proof_msg), auth_msg.mac);
+        }
+    }
+    return send(c_socket, (const char *) &auth_msg, sizeof(auth_msg), 0) == sizeof(auth_msg);
+}
+
+/* - - - - - - - - - - - - - - - - - - - END CONNECTIONS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - ENDPOINTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Parses a comma-separated list of `host:port` servers.
+ * @param[out] pool: the pool.
+ * @param[in] list: the list of servers.
+ * @return the number of servers parsed, or -1 if an entry is not valid.
+ * @post Every parsed server is disconnected and unhealthy until `connect_endpoint` succeeds.
+ */
+int parse_endpoints(EndpointPool *pool, const char *list) {
+    memset(pool, 0, sizeof(*pool));
+    const char *entry = list;
+    while (*entry != '\0') {
+        const char *end = strchr(entry, ',');
+        size_t entry_len = (end != NULL) ? (size_t) (end - entry) : strlen(entry);
+        if (entry_len == 0 || entry_len >= HOST_SIZE || pool->count >= MAX_ENDPOINTS) {
+            return -1;
+        }
+
+        Endpoint *endpoint = &pool->endpoints[pool->count];
+        memcpy(endpoint->host, entry, entry_len);
+        endpoint->host[entry_len] = '\0';
+        endpoint->port = DEFAULT_PORT;
+        char *colon = strchr(endpoint->host, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            endpoint->port = atoi(colon + 1);
+            if (endpoint->port <= 0 || endpoint->port > 65535) {
+                return -1;
+            }
+        }
+        endpoint->socket = -1;
+        pool->count++;
+
+        entry += entry_len;
+        if (*entry == ',') {
+            entry++;
+        }
+    }
+    return pool->count;
+}
+
+
+/**
+ * @brief Connects to a server, completes the handshake and receives the menu.
+ * @param[in/out] endpoint: the server.
+ * @return `true` if the server is connected and healthy.
+ */
+bool connect_endpoint(Endpoint *endpoint) {
+    endpoint->socket = open_connection(endpoint, 0);
+    if (endpoint->socket < 0) {
+        eject_endpoint(endpoint);
+        return false;
+    }
+
+    HelloResult result_msg;  /**< Outcome of the authentication */
+    if (!answer_challenge(endpoint->socket, HELLO_SESSION)
+            || !receive_all(endpoint->socket, &result_msg, sizeof(result_msg))) {
+        eject_endpoint(endpoint);
+        return false;
+    }
+    if (!result_msg.authenticated) {
+        print_with_color("Bad request: ", RED);
+        print_with_color(result_msg.error_msg, RED);
+        eject_endpoint(endpoint);
+        return false;
+    }
+
+    if (!receive_all(endpoint->socket, &endpoint->menu, sizeof(endpoint->menu))) {
+        eject_endpoint(endpoint);
+        return false;
+    }
+    endpoint->menu.menu_text[BUFFER_SIZE - 1] = '\0';
+    endpoint->healthy = true;
+    endpoint->outstanding = 0;
+    endpoint->stale = 0;
+    endpoint->checked_at = monotonic_seconds();
+    return true;
+}
+
+
+/**
+ * @brief Runs a health probe on a separate connection.
+ * @param[in] endpoint: the server.
+ * @param[out] health: receives the health reported by the server.
+ * @return `true` if the server answered the probe.
+ */
+bool probe_endpoint(const Endpoint *endpoint, HealthResponse *health) {
+    int c_socket = open_connection(endpoint, PROBE_TIMEOUT_SECONDS);
+    if (c_socket < 0) {
+        return false;
+    }
+    bool answered = answer_challenge(c_socket, HELLO_HEALTH) && receive_all(c_socket, health, sizeof(*health));
+    closesocket(c_socket);
+    return answered;
+}
+
+
+/**
+ * @brief Closes the connection to a server and excludes it from routing.
+ * @param[in/out] endpoint: the server.
+ * @post The server is probed again by `revive_endpoints` after `EJECT_RETRY_SECONDS`.
+ */
+void eject_endpoint(Endpoint *endpoint) {
+    if (endpoint->socket >= 0) {
+        closesocket(endpoint->socket);
+        endpoint->socket = -1;
+    }
+    endpoint->healthy = false;
+    endpoint->outstanding = 0;
+    endpoint->stale = 0;
+    endpoint->ejected_at = monotonic_seconds();
+    endpoint->failures++;
+}
+
+
+/**
+ * @brief Probes the connected servers, ejecting the ones not ready, and reconnects the ejected ones once ready.
+ * @param[in/out] pool: the pool.
+ */
+void revive_endpoints(EndpointPool *pool) {
+    double now = monotonic_seconds();
+    int healthy_count = 0;
+    for (int i = 0; i < pool->count; i++) {
+        healthy_count += pool->endpoints[i].healthy;
+    }
+    for (int i = 0; i < pool->count; i++) {
+        Endpoint *endpoint = &pool->endpoints[i];
+        HealthResponse health;
+        if (endpoint->healthy) {
+            if (now - endpoint->checked_at < HEALTH_CHECK_SECONDS) {
+                continue;
+            }
+            endpoint->checked_at = now;
+            if (!(probe_endpoint(endpoint, &health) && health.ready) && healthy_count > 1) {
+                eject_endpoint(endpoint);
+                healthy_count--;
+            }
+        } else if (now - endpoint->ejected_at >= EJECT_RETRY_SECONDS) {
+            if (probe_endpoint(endpoint, &health) && health.ready) {
+                healthy_count += connect_endpoint(endpoint);
+            } else {
+                endpoint->ejected_at = now;
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Selects the server a request is routed to.
+ * @param[in/out] pool: the pool.
+ * @return the selected server, or NULL if no server is healthy.
+ */
+Endpoint *pick_endpoint(EndpointPool *pool) {
+    Endpoint *healthy[MAX_ENDPOINTS];
+    int healthy_count = 0;
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->endpoints[i].healthy) {
+            healthy[healthy_count++] = &pool->endpoints[i];
+        }
+    }
+    if (healthy_count == 0) {
+        return NULL;
+    }
+
+    // Power of two choices: compare two distinct random servers
+    Endpoint *first = healthy[rand() % healthy_count];
+    if (healthy_count == 1) {
+        return first;
+    }
+    Endpoint *second = first;
+    while (second == first) {
+        second = healthy[rand() % healthy_count];
+    }
+    return (second->outstanding < first->outstanding) ? second : first;
+}
+
+
+/**
+ * @brief Sends a request to a server without waiting for the response.
+ * @param[in/out] endpoint: the server.
+ * @param[in] request: the request.
+ * @return `true` if the request was sent, `false` if the server was ejected.
+ */
+bool send_request(Endpoint *endpoint, const PasswordRequest *request) {
+    if (send(endpoint->socket, (const char *) request, sizeof(*request), 0) != sizeof(*request)) {
+        eject_endpoint(endpoint);
+        return false;
+    }
+    endpoint->outstanding++;
+    return true;
+}
+
+
+/**
+ * @brief Receives the next response of a server, whether it is stale or not.
+ * @param[in/out] endpoint: the server.
+ * @param[out] response: receives the response.
+ * @return `true` if a response was received, `false` if the server was ejected.
+ * @post If the response belonged to a cancelled hedge, `stale` was decremented.
+ */
+static bool receive_next(Endpoint *endpoint, PasswordResponse *response) {
+    if (!receive_all(endpoint->socket, response, sizeof(*response))) {
+        eject_endpoint(endpoint);
+        return false;
+    }
+    endpoint->outstanding--;
+    if (endpoint->stale > 0) {
+        endpoint->stale--;
+    } else {
+        endpoint->requests++;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Receives the response to the oldest outstanding request of a server.
+ * Responses to cancelled hedges are discarded first.
+ * @param[in/out] endpoint: the server.
+ * @param[out] response: receives the response.
+ * @return `true` if a response was received, `false` if the server was ejected.
+ */
+bool receive_response(Endpoint *endpoint, PasswordResponse *response) {
+    while (endpoint->stale > 0) {
+        if (!receive_next(endpoint, response)) {
+            return false;
+        }
+    }
+    return receive_next(endpoint, response);
+}
+
+
+/**
+ * @brief Stores a request latency in the ring the hedging delay is computed from.
+ * @param[in/out] pool: the pool.
+ * @param[in] latency: the latency in seconds.
+ * @post The pool earned `HEDGE_BUDGET` hedges, up to `HEDGE_BURST`.
+ */
+static void record_latency(EndpointPool *pool, double latency) {
+    pool->latencies[pool->latency_next] = latency;
+    pool->latency_next = (pool->latency_next + 1) % LATENCY_WINDOW;
+    if (pool->latency_count < LATENCY_WINDOW) {
+        pool->latency_count++;
+    }
+    pool->hedge_tokens += HEDGE_BUDGET;
+    if (pool->hedge_tokens > HEDGE_BURST) {
+        pool->hedge_tokens = HEDGE_BURST;
+    }
+}
+
+
+/**
+ * @brief Orders two latencies for `qsort`.
+ */
+static int compare_latencies(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Returns the 95th percentile of the recent request latencies.
+ * @param[in] pool: the pool.
+ * @return the latency in seconds, or -1 before `HEDGE_MIN_SAMPLES` latencies were observed.
+ */
+double latency_p95(const EndpointPool *pool) {
+    if (pool->latency_count < HEDGE_MIN_SAMPLES) {
+        return -1;
+    }
+    double sorted[LATENCY_WINDOW];
+    memcpy(sorted, pool->latencies, pool->latency_count * sizeof(double));
+    qsort(sorted, pool->latency_count, sizeof(double), compare_latencies);
+    return sorted[(pool->latency_count * 95) / 100];
+}
+
+
+/**
+ * @brief Sends a request to the least loaded healthy server and waits for the response.
+ * @param[in/out] pool: the pool.
+ * @param[in] request: the request.
+ * @param[out] response: receives the response.
+ * @return `true` if a server answered, `false` if every server failed.
+ */
+bool balanced_request(EndpointPool *pool, const PasswordRequest *request, PasswordResponse *response) {
+    for (int attempt = 0; attempt < pool->count; attempt++) {
+        Endpoint *endpoint = pick_endpoint(pool);
+        if (endpoint == NULL) {
+            return false;
+        }
+        double start = monotonic_seconds();
+        if (send_request(endpoint, request) && receive_response(endpoint, response)) {
+            record_latency(pool, monotonic_seconds() - start);
+            return true;
+        }
+        print_with_color("Server ", MAGENTA);
+        print_with_color(endpoint->host, MAGENTA);
+        print_with_color(" failed, trying another one.\n", MAGENTA);
+    }
+    return false;
+}
+
+
+/**
+ * @brief Waits until the socket of one of two servers is readable.
+ * @param[in] first: the first server.
+ * @param[in] second: the second server, or NULL to wait on the first only.
+ * @param[in] timeout: the maximum wait in seconds, negative to wait indefinitely.
+ * @return the readable server, or NULL on timeout or error.
+ */
+static Endpoint *wait_readable(Endpoint *first, Endpoint *second, double timeout) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(first->socket, &readable);
+    int max_socket = first->socket;
+    if (second != NULL) {
+        FD_SET(second->socket, &readable);
+        if (second->socket > max_socket) {
+            max_socket = second->socket;
+        }
+    }
+
+    struct timeval tv;
+    tv.tv_sec = (long) timeout;
+    tv.tv_usec = (long) ((timeout - (double) tv.tv_sec) * 1e6);
+    if (select(max_socket + 1, &readable, NULL, NULL, (timeout < 0) ? NULL : &tv) <= 0) {
+        return NULL;
+    }
+    return FD_ISSET(first->socket, &readable) ? first : second;
+}
+
+
+/**
+ * @brief Sends a request and hedges it on a second server if it is slow.
+ * @param[in/out] pool: the pool.
+ * @param[in] request: the request.
+ * @param[out] response: receives the response.
+ * @return `true` if a server answered, `false` if every server failed.
+ */
+bool hedged_request(EndpointPool *pool, const PasswordRequest *request, PasswordResponse *response) {
+    double delay = latency_p95(pool);
+    Endpoint *primary = pick_endpoint(pool);
+    if (primary == NULL || delay < 0) {
+        return balanced_request(pool, request, response);
+    }
+
+    double start = monotonic_seconds();
+    if (!send_request(primary, request)) {
+        return balanced_request(pool, request, response);
+    }
+
+    // Discard the late responses of earlier hedges, then give the primary its p95 to answer
+    Endpoint *ready = NULL;
+    while (primary->stale > 0) {
+        if (!receive_next(primary, response)) {
+            return balanced_request(pool, request, response);
+        }
+    }
+    double remaining = delay - (monotonic_seconds() - start);
+    ready = wait_readable(primary, NULL, (remaining > 0) ? remaining : 0);
+
+    // Duplicate the request on another server if the budget allows it
+    Endpoint *hedge = NULL;
+    if (ready == NULL && pool->hedge_tokens >= 1) {
+        for (int attempt = 0; attempt < pool->count && (hedge == NULL || hedge == primary); attempt++) {
+            hedge = pick_endpoint(pool);
+        }
+        if (hedge == primary || (hedge != NULL && !send_request(hedge, request))) {
+            hedge = NULL;
+        }
+        if (hedge != NULL) {
+            pool->hedge_tokens -= 1;
+            pool->hedges++;
+        }
+    }
+
+    // Take the first answer; the other one becomes stale and is discarded when it arrives
+    while (primary->socket >= 0 || (hedge != NULL && hedge->socket >= 0)) {
+        if (ready == NULL) {
+            Endpoint *first = (primary->socket >= 0) ? primary : hedge;
+            Endpoint *second = (first == primary && hedge != NULL && hedge->socket >= 0) ? hedge : NULL;
+            ready = wait_readable(first, second, -1);
+            if (ready == NULL) {
+                break;
+            }
+        }
+        if (ready == hedge && hedge->stale > 0) {
+            receive_next(hedge, response);
+        } else if (receive_next(ready, response)) {
+            Endpoint *loser = (ready == primary) ? hedge : primary;
+            if (loser != NULL && loser->socket >= 0) {
+                loser->stale++;
+            }
+            if (ready == hedge) {
+                pool->hedge_wins++;
+            }
+            record_latency(pool, monotonic_seconds() - start);
+            return true;
+        }
+        ready = NULL;
+    }
+    return balanced_request(pool, request, response);
+}
+
+
+/**
+ * @brief Starts the trace context of a request, sampled with a given probability.
+ * @param[out] context: receives the context.
+ * @param[in] rate: the probability of sampling.
+ * @return `true` if the request is sampled.
+ */
+bool start_trace(TraceContext *context, double rate) {
+    memset(context, 0, sizeof(*context));
+    if (rate <= 0 || rand() >= rate * ((double) RAND_MAX + 1)) {
+        return false;
+    }
+    for (int i = 0; i < TRACE_ID_SIZE; i++) {
+        context->trace_id[i] = (unsigned char) (rand() >> 7);
+    }
+    for (int i = 0; i < SPAN_ID_SIZE; i++) {
+        context->span_id[i] = (unsigned char) (rand() >> 7);
+    }
+    context->trace_id[0] |= 1;  /**< Never the all-zero invalid identifiers */
+    context->span_id[0] |= 1;
+    context->flags = TRACE_SAMPLED;
+    return true;
+}
+
+
+/**
+ * @brief Formats the trace identifier of a context.
+ * @param[in] context: the trace context.
+ * @param[out] text: receives the identifier.
+ */
+void format_trace_id(const TraceContext *context, char *text) {
+    for (int i = 0; i < TRACE_ID_SIZE; i++) {
+        sprintf(text + 2 * i, "%02x", context->trace_id[i]);
+    }
+}
+
+
+/**
+ * @brief Sends a stream control or batch request to a server, without expecting an answer.
+ * @param[in/out] endpoint: the server; it is ejected on failure.
+ * @param[in] type: `STREAM_OPEN`, `STREAM_CREDIT`, `STREAM_CLOSE` or `BATCH_REQUEST`.
+ * @param[in] argument: the content of the `length` field.
+ * @return `true` if the request was sent.
+ */
+static bool send_control(Endpoint *endpoint, char type, const char *argument) {
+    PasswordRequest control_msg;
+    memset(&control_msg, 0, sizeof(control_msg));
+    control_msg.type = type;
+    snprintf(control_msg.length, sizeof(control_msg.length), "%s", argument);
+    if (send(endpoint->socket, (const char *) &control_msg, sizeof(control_msg), 0) != sizeof(control_msg)) {
+        eject_endpoint(endpoint);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Opens a password stream on a server.
+ * @param[in/out] endpoint: the server.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length.
+ * @param[in] credits: the initial credits.
+ * @param[out] response: receives the answer of the server.
+ * @return `true` if an answer was received.
+ */
+bool open_stream(Endpoint *endpoint, char type, const char *length, int credits, PasswordResponse *response) {
+    char argument[BUFFER_SIZE];
+    snprintf(argument, sizeof(argument), "%c %s %d", type, length, credits);
+    int no_delay = 1;  /**< Credit grants must not wait for the acknowledgement of the previous one */
+    setsockopt(endpoint->socket, IPPROTO_TCP, TCP_NODELAY, (const char *) &no_delay, sizeof(no_delay));
+    return send_control(endpoint, STREAM_OPEN, argument) && receive_stream(endpoint, response);
+}
+
+
+/**
+ * @brief Grants more credits to the open stream of a server.
+ * @param[in/out] endpoint: the server.
+ * @param[in] credits: the additional credits.
+ * @return `true` if the grant was sent.
+ */
+bool grant_credits(Endpoint *endpoint, int credits) {
+    char argument[16];
+    snprintf(argument, sizeof(argument), "%d", credits);
+    return send_control(endpoint, STREAM_CREDIT, argument);
+}
+
+
+/**
+ * @brief Asks a server to close its open stream.
+ * @param[in/out] endpoint: the server.
+ * @return `true` if the request was sent.
+ */
+bool close_stream(Endpoint *endpoint) {
+    return send_control(endpoint, STREAM_CLOSE, "");
+}
+
+
+/**
+ * @brief Receives the next message of a server, whatever its kind.
+ * @param[in/out] endpoint: the server.
+ * @param[out] message: receives the message.
+ * @return `true` if a message was received.
+ */
+bool receive_stream(Endpoint *endpoint, PasswordResponse *message) {
+    if (!receive_all(endpoint->socket, message, sizeof(*message))) {
+        eject_endpoint(endpoint);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Requests a batch of passwords and unpacks it.
+ * @param[in/out] endpoint: the server.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length.
+ * @param[in] count: the number of passwords.
+ * @param[in] encoding: the encoding of the payload.
+ * @param[out] response: receives the answer of the server.
+ * @param[out] header: receives the header of the batch.
+ * @param[out] passwords: receives the passwords.
+ * @return `true` if the answer, and the batch if accepted, were received.
+ */
+bool request_batch(Endpoint *endpoint, char type, const char *length, int count, PackEncoding encoding,
+                   PasswordResponse *response, BatchHeader *header, char *passwords) {
+    static unsigned char payload[BATCH_MAX_PASSWORDS * MAX_PASSWORD_LENGTH];  /**< Payload of the last batch */
+    char argument[BUFFER_SIZE];
+    snprintf(argument, sizeof(argument), "%c %s %d %s", type, length, count, encoding_name(encoding));
+    memset(header, 0, sizeof(*header));
+    if (!send_control(endpoint, BATCH_REQUEST, argument) || !receive_stream(endpoint, response)) {
+        return false;
+    }
+    if (response->request_error) {
+        return true;
+    }
+
+    // A header announcing more than was asked for cannot belong to this batch
+    if (!receive_all(endpoint->socket, header, sizeof(*header)) || header->count > count
+        || header->length > MAX_PASSWORD_LENGTH || header->size > sizeof(payload)
+        || !receive_all(endpoint->socket, payload, (int) header->size)
+        || !unpack_passwords((PackEncoding) header->encoding, payload, header->size, header->count, header->length,
+                             passwords)) {
+        eject_endpoint(endpoint);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Opens a UDP socket connected to a server.
+ * @param[in] endpoint: the server.
+ * @return the connected socket, or -1 on failure.
+ */
+int open_datagram(const Endpoint *endpoint) {
+    struct sockaddr_in sad;  /**< Socket address structure for the server */
+    if (!resolve_endpoint(endpoint, &sad)) {
+        return -1;
+    }
+
+    int c_socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (c_socket < 0) {
+        return -1;
+    }
+    if (connect(c_socket, (struct sockaddr*) &sad, sizeof(sad)) < 0) {
+        closesocket(c_socket);
+        return -1;
+    }
+    return c_socket;
+}
+
+
+/**
+ * @brief Closes every connection of the pool.
+ * @param[in/out] pool: the pool.
+ * @post Every connected server received a `q` request before its connection was closed.
+ */
+void close_endpoints(EndpointPool *pool) {
+    PasswordRequest quit_msg;
+    PasswordResponse response_msg;
+    memset(&quit_msg, 0, sizeof(quit_msg));
+    quit_msg.type = 'q';
+    for (int i = 0; i < pool->count; i++) {
+        Endpoint *endpoint = &pool->endpoints[i];
+        if (endpoint->socket >= 0) {
+            // Drain the responses still in flight, then say goodbye
+            endpoint->stale = 0;
+            while (endpoint->outstanding > 0 && receive_response(endpoint, &response_msg)) {
+            }
+            if (endpoint->socket >= 0 && send_request(endpoint, &quit_msg)) {
+                receive_response(endpoint, &response_msg);
+            }
+            if (endpoint->socket >= 0) {
+                closesocket(endpoint->socket);
+                endpoint->socket = -1;
+            }
+            endpoint->healthy = false;
+        }
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - END ENDPOINTS - - - - - - - - - - - - - - - - - - - */
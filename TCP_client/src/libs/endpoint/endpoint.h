@@ -0,0 +1,326 @@
+/*
+ ============================================================================
+ Name        : endpoint.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing a pool of password generation servers.
+               The client keeps a connection to every server, routes each
+               request to the server with the fewest outstanding requests,
+               ejects servers that fail and re-admits them once a health
+               probe reports them ready. Slow requests can be hedged on a
+               second server within a load budget.
+ ============================================================================
+ */
+
+#ifndef ENDPOINT_H_
+#define ENDPOINT_H_
+
+#include <stdbool.h>
+#include "../pack/pack.h"
+#include "../protocol/protocol.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Maximum number of servers in a pool.
+ */
+#define MAX_ENDPOINTS 16        /**< Endpoint pool capacity */
+
+/**
+ * @brief Maximum length of a server host name, null terminator included.
+ */
+#define HOST_SIZE 64            /**< Host name size */
+
+/**
+ * @brief Seconds an ejected server waits before it is probed again.
+ */
+#define EJECT_RETRY_SECONDS 5.0 /**< Ejection period */
+
+/**
+ * @brief Seconds between two health probes of a connected server.
+ */
+#define HEALTH_CHECK_SECONDS 2.0 /**< Health check period */
+
+/**
+ * @brief Seconds a health probe may wait for the connection and for each message.
+ * A draining or full server leaves new connections in its backlog unanswered.
+ */
+#define PROBE_TIMEOUT_SECONDS 1 /**< Health probe timeout */
+
+/**
+ * @brief Number of recent request latencies the hedging delay is computed from.
+ */
+#define LATENCY_WINDOW 128      /**< Latency ring size */
+
+/**
+ * @brief Latencies observed before requests are hedged.
+ */
+#define HEDGE_MIN_SAMPLES 20    /**< Hedging warm-up */
+
+/**
+ * @brief Extra load hedging may add, as a fraction of the requests.
+ */
+#define HEDGE_BUDGET 0.05       /**< Hedging budget */
+
+/**
+ * @brief Hedges that may be saved up while requests are fast.
+ */
+#define HEDGE_BURST 10.0        /**< Hedging burst */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @struct Endpoint
+ * @brief A password generation server and the client connection to it.
+ */
+typedef struct {
+    char host[HOST_SIZE];       /**< Host name or IPv4 address */
+    int port;                   /**< TCP port */
+    int socket;                 /**< Connected socket, -1 if disconnected */
+    bool healthy;               /**< Whether requests may be routed to the server */
+    int outstanding;            /**< Requests sent and not yet answered */
+    int stale;                  /**< Outstanding requests whose response is discarded */
+    double ejected_at;          /**< Time the server was ejected */
+    double checked_at;          /**< Time of the last health probe of the connected server */
+    unsigned long requests;     /**< Requests answered by the server */
+    unsigned long failures;     /**< Failed connections, requests and health checks */
+    MenuMessage menu;           /**< Menu received from the server */
+} Endpoint;
+
+
+/**
+ * @struct EndpointPool
+ * @brief The servers a client balances its requests over.
+ */
+typedef struct {
+    Endpoint endpoints[MAX_ENDPOINTS];  /**< Servers of the pool */
+    int count;                          /**< Number of servers */
+    double latencies[LATENCY_WINDOW];   /**< Recent request latencies in seconds */
+    int latency_count;                  /**< Number of latencies stored */
+    int latency_next;                   /**< Next slot of the latency ring */
+    bool hedging;                       /**< Whether slow requests are hedged */
+    double trace_rate;                  /**< Share of the requests sent with a sampled trace context */
+    double hedge_tokens;                /**< Hedges currently allowed by the budget */
+    unsigned long hedges;               /**< Hedged requests sent */
+    unsigned long hedge_wins;           /**< Hedged requests answered first */
+} EndpointPool;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - ENDPOINTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Parses a comma-separated list of `host:port` servers.
+ *
+ * A server without a port uses `DEFAULT_PORT`.
+ *
+ * @param[out] pool: the pool, cleared before parsing.
+ * @param[in] list: the list of servers, e.g. "10.0.0.1:8080,10.0.0.2:8080".
+ * @return the number of servers parsed, or -1 if an entry is not valid.
+ */
+int parse_endpoints(EndpointPool *pool, const char *list);
+
+
+/**
+ * @brief Connects to a server, completes the handshake and receives the menu.
+ *
+ * The API key is read from `KEY_ID_ENV` and `KEY_SECRET_ENV` when the server requires it.
+ *
+ * @param[in/out] endpoint: the server.
+ * @return `true` if the server is connected and healthy.
+ */
+bool connect_endpoint(Endpoint *endpoint);
+
+
+/**
+ * @brief Runs a health probe on a separate connection.
+ * @param[in] endpoint: the server.
+ * @param[out] health: receives the health reported by the server.
+ * @return `true` if the server answered the probe.
+ */
+bool probe_endpoint(const Endpoint *endpoint, HealthResponse *health);
+
+
+/**
+ * @brief Closes the connection to a server and excludes it from routing.
+ * @param[in/out] endpoint: the server.
+ */
+void eject_endpoint(Endpoint *endpoint);
+
+
+/**
+ * @brief Runs the due health probes of the pool.
+ *
+ * Connected servers are probed every `HEALTH_CHECK_SECONDS` and ejected when they do not answer
+ * or report they are not ready, e.g. draining or full; the last connected server is kept, as a
+ * busy server beats none. Servers ejected for at least `EJECT_RETRY_SECONDS` are probed and the
+ * ready ones reconnected.
+ *
+ * @param[in/out] pool: the pool.
+ */
+void revive_endpoints(EndpointPool *pool);
+
+
+/**
+ * @brief Selects the server a request is routed to.
+ *
+ * Two healthy servers are drawn at random and the one with fewer outstanding requests
+ * is chosen (power of two choices); with two or fewer servers this is least-outstanding routing.
+ *
+ * @param[in/out] pool: the pool.
+ * @return the selected server, or NULL if no server is healthy.
+ */
+Endpoint *pick_endpoint(EndpointPool *pool);
+
+
+/**
+ * @brief Sends a request to a server without waiting for the response.
+ * @param[in/out] endpoint: the server; it is ejected on failure.
+ * @param[in] request: the request.
+ * @return `true` if the request was sent.
+ */
+bool send_request(Endpoint *endpoint, const PasswordRequest *request);
+
+
+/**
+ * @brief Receives the response to the oldest outstanding request of a server.
+ * @param[in/out] endpoint: the server; it is ejected on failure.
+ * @param[out] response: receives the response.
+ * @return `true` if a response was received.
+ */
+bool receive_response(Endpoint *endpoint, PasswordResponse *response);
+
+
+/**
+ * @brief Sends a request to the least loaded healthy server and waits for the response,
+ * failing over to the other servers if one fails.
+ * @param[in/out] pool: the pool.
+ * @param[in] request: the request.
+ * @param[out] response: receives the response.
+ * @return `true` if a server answered.
+ */
+bool balanced_request(EndpointPool *pool, const PasswordRequest *request, PasswordResponse *response);
+
+
+/**
+ * @brief Returns the 95th percentile of the recent request latencies.
+ * @param[in] pool: the pool.
+ * @return the latency in seconds, or a negative value before `HEDGE_MIN_SAMPLES` latencies were observed.
+ */
+double latency_p95(const EndpointPool *pool);
+
+
+/**
+ * @brief Sends a request and hedges it on a second server if it is slow.
+ *
+ * If the first server has not answered within the observed p95 latency and the budget allows it,
+ * the request is duplicated on another server; the first response wins and the other one is
+ * discarded when it arrives. Every request earns `HEDGE_BUDGET` hedges, so hedging adds at most
+ * about 5% load. Falls back to `balanced_request` when the pool cannot hedge.
+ *
+ * @param[in/out] pool: the pool.
+ * @param[in] request: the request.
+ * @param[out] response: receives the response.
+ * @return `true` if a server answered.
+ */
+bool hedged_request(EndpointPool *pool, const PasswordRequest *request, PasswordResponse *response);
+
+
+/**
+ * @brief Starts the trace context of a request, sampled with a given probability.
+ * @param[out] context: receives a new trace and span identifier if sampled, zeros otherwise.
+ * @param[in] rate: the probability of sampling, between 0 and 1.
+ * @return `true` if the request is sampled.
+ */
+bool start_trace(TraceContext *context, double rate);
+
+
+/**
+ * @brief Formats the trace identifier of a context as lowercase hexadecimal, as in OTLP.
+ * @param[in] context: the trace context.
+ * @param[out] text: receives the identifier; it must hold `2 * TRACE_ID_SIZE + 1` characters.
+ */
+void format_trace_id(const TraceContext *context, char *text);
+
+
+/**
+ * @brief Opens a password stream on a server.
+ * @param[in/out] endpoint: the server, with no outstanding request; it is ejected on failure.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length.
+ * @param[in] credits: the passwords the server may send before more credits are granted.
+ * @param[out] response: receives the answer of the server, which may reject the stream.
+ * @return `true` if an answer was received.
+ */
+bool open_stream(Endpoint *endpoint, char type, const char *length, int credits, PasswordResponse *response);
+
+
+/**
+ * @brief Grants more credits to the open stream of a server.
+ * @param[in/out] endpoint: the server; it is ejected on failure.
+ * @param[in] credits: the additional passwords the server may send.
+ * @return `true` if the grant was sent.
+ */
+bool grant_credits(Endpoint *endpoint, int credits);
+
+
+/**
+ * @brief Asks a server to close its open stream. Items already sent keep arriving until `STREAM_END`.
+ * @param[in/out] endpoint: the server; it is ejected on failure.
+ * @return `true` if the request was sent.
+ */
+bool close_stream(Endpoint *endpoint);
+
+
+/**
+ * @brief Receives the next message of a server, whatever its kind.
+ * @param[in/out] endpoint: the server; it is ejected on failure.
+ * @param[out] message: receives the message; `message->stream` tells its kind.
+ * @return `true` if a message was received.
+ */
+bool receive_stream(Endpoint *endpoint, PasswordResponse *message);
+
+
+/**
+ * @brief Requests a batch of passwords and unpacks it.
+ *
+ * The payload is received into a buffer of the library and decoded into `passwords`, so the
+ * caller only deals with plain null-terminated passwords whatever the encoding.
+ *
+ * @param[in/out] endpoint: the server, with no outstanding request; it is ejected on failure.
+ * @param[in] type: the password type.
+ * @param[in] length: the password length.
+ * @param[in] count: the number of passwords, between 1 and `BATCH_MAX_PASSWORDS`.
+ * @param[in] encoding: the encoding of the payload, which must fit the password type.
+ * @param[out] response: receives the answer of the server, which may reject the batch.
+ * @param[out] header: receives the header of the batch, cleared if the batch is rejected.
+ * @param[out] passwords: receives `header->count` passwords spaced `header->length + 1` characters
+ *                        apart; it must hold `count * (MAX_PASSWORD_LENGTH + 1)` characters.
+ * @return `true` if the answer, and the batch if accepted, were received and decoded.
+ */
+bool request_batch(Endpoint *endpoint, char type, const char *length, int count, PackEncoding encoding,
+                   PasswordResponse *response, BatchHeader *header, char *passwords);
+
+
+/**
+ * @brief Opens a UDP socket connected to a server, for the UDP request mode.
+ * @param[in] endpoint: the server.
+ * @return the connected socket, or -1 if the host cannot be resolved or the socket opened.
+ */
+int open_datagram(const Endpoint *endpoint);
+
+
+/**
+ * @brief Closes every connection of the pool, telling the servers the client is leaving.
+ * @param[in/out] pool: the pool.
+ */
+void close_endpoints(EndpointPool *pool);
+
+/* - - - - - - - - - - - - - - - - - - - END ENDPOINTS - - - - - - - - - - - - - - - - - - - */
+
+#endif /* ENDPOINT_H_ */
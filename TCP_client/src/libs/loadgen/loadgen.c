@@ -0,0 +1,633 @@
+/*
+ ============================================================================
+ Name        : loadgen.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Closed-loop load generator with client-side latency percentiles,
+               credit-based stream consumer, windowed UDP load generator and
+               soak test with connection churn.
+ ============================================================================
+ */
+
+#if defined WIN32
+#include <winsock.h>
+#else
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#define closesocket close
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "loadgen.h"
+#include "../alloc/alloc.h"
+#include "../utils/utils.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - LOAD - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Orders two latencies for `qsort`.
+ */
+static int compare_latencies(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Returns a percentile of sorted latencies.
+ * @param[in] sorted: the latencies, in ascending order.
+ * @param[in] count: the number of latencies, at least one.
+ * @param[in] percentile: the percentile, between 0 and 100.
+ * @return the latency at the percentile (nearest rank).
+ */
+static double sorted_percentile(const double *sorted, int count, double percentile) {
+    int rank = (int) (percentile / 100.0 * count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > count) {
+        rank = count;
+    }
+    return sorted[rank - 1];
+}
+
+
+/**
+ * @brief Computes the percentiles of a report from its latencies.
+ * @param[in/out] report: the report.
+ * @param[in/out] latencies: the latencies, sorted in place.
+ * @param[in] count: the number of latencies.
+ */
+static void summarize_latencies(LoadReport *report, double *latencies, int count) {
+    qsort(latencies, count, sizeof(double), compare_latencies);
+    if (count > 0) {
+        report->p50 = sorted_percentile(latencies, count, 50);
+        report->p90 = sorted_percentile(latencies, count, 90);
+        report->p99 = sorted_percentile(latencies, count, 99);
+        report->p999 = sorted_percentile(latencies, count, 99.9);
+        report->max = latencies[count - 1];
+    }
+}
+
+
+/**
+ * @brief Sends `count` requests, each after the previous response, and measures them.
+ * @param[in/out] pool: the connected pool.
+ * @param[in] request: the request sent every time.
+ * @param[in] count: the number of requests.
+ * @param[out] report: receives the outcome.
+ * @return `true` if the run completed.
+ */
+bool run_load(EndpointPool *pool, const PasswordRequest *request, int count, LoadReport *report) {
+    memset(report, 0, sizeof(*report));
+    double *latencies = malloc(count * sizeof(double));
+    if (latencies == NULL) {
+        return false;
+    }
+
+    PasswordResponse response;
+    PasswordRequest traced_request = *request;  /**< The request with the trace context of each send */
+    bool completed = true;
+    unsigned long long allocations = allocation_count();
+    double begin = monotonic_seconds();
+    for (int i = 0; i < count; i++) {
+        bool sampled = start_trace(&traced_request.trace, pool->trace_rate);
+        double start = monotonic_seconds();
+        bool answered = pool->hedging ? hedged_request(pool, &traced_request, &response)
+                                      : balanced_request(pool, &traced_request, &response);
+        latencies[report->requests++] = monotonic_seconds() - start;
+        if (sampled) {
+            // The slowest sampled request is the one worth following into the server spans
+            report->traced++;
+            if (latencies[report->requests - 1] > report->slowest_traced) {
+                report->slowest_traced = latencies[report->requests - 1];
+                format_trace_id(&traced_request.trace, report->slowest_trace);
+            }
+        }
+        if (!answered) {
+            report->errors++;
+            completed = false;
+            break;
+        }
+        if (response.request_error) {
+            report->errors++;
+        } else {
+            report->completed++;
+        }
+    }
+    report->seconds = monotonic_seconds() - begin;
+    report->allocations = allocation_count() - allocations;
+
+    // Percentiles over every request sent, failed ones included
+    summarize_latencies(report, latencies, report->requests);
+    free(latencies);
+    return completed;
+}
+
+
+/**
+ * @brief Consumes `count` passwords from a stream, replenishing credits as they are consumed.
+ * @param[in/out] endpoint: the connected server.
+ * @param[in] request: the type and length of the passwords.
+ * @param[in] count: the number of passwords.
+ * @param[in] credits: the credit window.
+ * @param[in] print: whether every password is printed.
+ * @param[out] report: receives the outcome.
+ * @return `true` if every password was received and the stream was closed.
+ */
+bool run_stream(Endpoint *endpoint, const PasswordRequest *request, int count, int credits, bool print,
+                LoadReport *report) {
+    memset(report, 0, sizeof(*report));
+    double *latencies = malloc(count * sizeof(double));
+    if (latencies == NULL) {
+        return false;
+    }
+
+    // Never grant more than the passwords still wanted, so the stream ends exactly at `count`
+    int granted = (credits < count) ? credits : count;
+    PasswordResponse message;
+    double begin = monotonic_seconds();
+    if (!open_stream(endpoint, request->type, request->length, granted, &message)) {
+        free(latencies);
+        return false;
+    }
+    if (message.request_error) {
+        print_with_color("Bad request: ", RED);
+        print_with_color(message.error_msg, RED);
+        free(latencies);
+        return false;
+    }
+
+    int consumed = 0;   /**< Passwords consumed since the last grant */
+    unsigned long long allocations = allocation_count();
+    double previous = monotonic_seconds();
+    while (report->requests < count) {
+        if (!receive_stream(endpoint, &message)) {
+            break;
+        }
+        if (message.stream != STREAM_ITEM) {
+            continue;   /**< Not part of the stream */
+        }
+        double now = monotonic_seconds();
+        latencies[report->requests++] = now - previous;
+        previous = now;
+        if (message.request_error) {
+            report->errors++;
+        } else {
+            report->completed++;
+            if (print) {
+                printf("%s\n", message.password);
+            }
+        }
+
+        // Replenish the consumed half of the window
+        consumed++;
+        if (consumed * 2 >= credits && granted < count) {
+            int grant = (consumed < count - granted) ? consumed : count - granted;
+            if (!grant_credits(endpoint, grant)) {
+                break;
+            }
+            granted += grant;
+            consumed = 0;
+        }
+    }
+
+    // Close the stream and wait for its end, so the connection is clean for later requests
+    bool closed = endpoint->socket >= 0 && close_stream(endpoint);
+    while (closed && receive_stream(endpoint, &message) && message.stream != STREAM_END) {
+    }
+    closed = closed && endpoint->socket >= 0;
+    report->seconds = monotonic_seconds() - begin;
+    report->allocations = allocation_count() - allocations;
+    summarize_latencies(report, latencies, report->requests);
+    free(latencies);
+    return closed && report->requests == count;
+}
+
+
+/**
+ * @brief Requests one batch of passwords and reports the size of its payload.
+ * @param[in/out] endpoint: the connected server.
+ * @param[in] request: the type and length of the passwords.
+ * @param[in] count: the number of passwords.
+ * @param[in] encoding: the encoding of the payload.
+ * @param[in] print: whether every password is printed on its own line.
+ * @return `true` if the whole batch was received.
+ */
+bool run_batch(Endpoint *endpoint, const PasswordRequest *request, int count, PackEncoding encoding, bool print) {
+    static char passwords[BATCH_MAX_PASSWORDS * (MAX_PASSWORD_LENGTH + 1)];  /**< Passwords of the batch */
+    PasswordResponse response;
+    BatchHeader header;
+    double begin = monotonic_seconds();
+    if (!request_batch(endpoint, request->type, request->length, count, encoding, &response, &header, passwords)) {
+        return false;
+    }
+    double seconds = monotonic_seconds() - begin;
+    if (response.request_error) {
+        print_with_color("Bad request: ", RED);
+        print_with_color(response.error_msg, RED);
+        return false;
+    }
+
+    for (int i = 0; print && i < header.count; i++) {
+        printf("%s\n", passwords + (size_t) i * (header.length + 1));
+    }
+    size_t plain = (size_t) header.count * header.length;
+    printf("passwords=%d encoding=%s payload_bytes=%u plain_bytes=%zu saved_pct=%.1f seconds=%.6f\n",
+           header.count, encoding_name((PackEncoding) header.encoding), header.size, plain,
+           (plain > 0) ? 100.0 * (1.0 - (double) header.size / plain) : 0.0, seconds);
+    return header.count == count;
+}
+
+
+/**
+ * @brief Marks as lost the requests still outstanding when the server went quiet.
+ * @param[in/out] sent_at: the send time of every request, 0 once answered or lost.
+ * @param[in/out] oldest: the oldest request that may be outstanding, advanced past the lost ones.
+ * @param[in] next: the next request to send.
+ * @param[in/out] report: counts the lost requests as errors.
+ */
+static void drop_outstanding(double *sent_at, int *oldest, int next, LoadReport *report) {
+    for (; *oldest < next; (*oldest)++) {
+        if (sent_at[*oldest] > 0) {
+            sent_at[*oldest] = 0;
+            report->errors++;
+            report->lost++;
+        }
+    }
+}
+
+
+/**
+ * @brief Sends `count` UDP requests, keeping up to `window` of them outstanding, and measures them.
+ * @param[in] endpoint: the server, which must run its UDP mode.
+ * @param[in] request: the request sent every time.
+ * @param[in] count: the number of requests.
+ * @param[in] window: the requests kept outstanding.
+ * @param[out] report: receives the outcome.
+ * @return `true` if every request was answered.
+ */
+bool run_udp_load(const Endpoint *endpoint, const PasswordRequest *request, int count, int window,
+                  LoadReport *report) {
+    memset(report, 0, sizeof(*report));
+    int u_socket = open_datagram(endpoint);
+    if (u_socket < 0) {
+        return false;
+    }
+    double *latencies = malloc(count * sizeof(double));
+    double *sent_at = calloc(count, sizeof(double));
+    if (latencies == NULL || sent_at == NULL) {
+        free(latencies);
+        free(sent_at);
+        closesocket(u_socket);
+        return false;
+    }
+
+    UdpRequest datagram;    /**< Request sent, with its identifier changed every time */
+    UdpResponse answer;     /**< Answer received */
+    memset(&datagram, 0, sizeof(datagram));
+    datagram.type = request->type;
+    datagram.length = (unsigned char) atoi(request->length);
+
+    int next = 0;           /**< Next request to send */
+    int oldest = 0;         /**< Oldest request that may be outstanding */
+    int outstanding = 0;    /**< Requests sent and not yet answered or lost */
+    int answered = 0;       /**< Requests answered, whose latencies are stored */
+    unsigned long long allocations = allocation_count();
+    double begin = monotonic_seconds();
+    while (answered + report->lost < count) {
+        // Fill the window
+        while (outstanding < window && next < count) {
+            datagram.id = (unsigned int) next;
+            sent_at[next] = monotonic_seconds();
+            if (send(u_socket, (const char*) &datagram, sizeof(datagram), 0) != sizeof(datagram)) {
+                sent_at[next] = 0;
+                report->errors++;
+                report->lost++;
+            } else {
+                outstanding++;
+            }
+            report->requests++;
+            next++;
+        }
+        if (outstanding == 0) {
+            continue;
+        }
+
+        // Wait for an answer; a quiet server loses whatever is outstanding
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(u_socket, &read_set);
+        struct timeval timeout = {0, UDP_LOSS_TIMEOUT_US};
+        int ready = select(u_socket + 1, &read_set, NULL, NULL, &timeout);
+        if (ready < 0) {
+            break;
+        }
+        if (ready == 0) {
+            drop_outstanding(sent_at, &oldest, next, report);
+            outstanding = 0;
+            continue;
+        }
+
+        // Drain the answers already queued
+        int flags = 0;
+        while (recv(u_socket, (char*) &answer, sizeof(answer), flags) == sizeof(answer)) {
+            unsigned int id = answer.id;
+            if (id < (unsigned int) next && sent_at[id] > 0) {
+                latencies[answered++] = monotonic_seconds() - sent_at[id];
+                sent_at[id] = 0;
+                outstanding--;
+                if (answer.request_error) {
+                    report->errors++;
+                } else {
+                    report->completed++;
+                }
+            }
+#if defined(MSG_DONTWAIT)
+            flags = MSG_DONTWAIT;
+#else
+            break;
+#endif
+        }
+    }
+    report->seconds = monotonic_seconds() - begin;
+    report->allocations = allocation_count() - allocations;
+
+    // Percentiles over the answered requests only
+    summarize_latencies(report, latencies, answered);
+    free(latencies);
+    free(sent_at);
+    closesocket(u_socket);
+    return report->lost == 0 && report->requests == count;
+}
+
+
+/**
+ * @enum SoakEnd
+ * @brief How a soak session ends once its requests are sent.
+ */
+typedef enum {
+    SOAK_END_QUIT,          /**< Sends the quit request and closes */
+    SOAK_END_CLOSE,         /**< Closes without a quit request */
+    SOAK_END_ABORT,         /**< Sends one more request and resets the connection before its response */
+    SOAK_END_TRUNCATE       /**< Sends half of one more request and resets the connection */
+} SoakEnd;
+
+
+/**
+ * @struct SoakSession
+ * @brief A connection of the soak test.
+ */
+typedef struct {
+    Endpoint endpoint;      /**< Connection to the server */
+    int remaining;          /**< Requests left before the session ends */
+    SoakEnd end;            /**< How the session ends */
+} SoakSession;
+
+
+/**
+ * @brief Draws how many requests a new soak session sends and how it ends.
+ */
+static void draw_soak_session(SoakSession *session) {
+    int draw = rand() % 100;
+    if (draw < SOAK_SHORT_PCT) {
+        session->end = SOAK_END_QUIT;
+        session->remaining = 1 + rand() % 5;
+    } else if (draw < SOAK_SHORT_PCT + SOAK_LONG_PCT) {
+        session->end = SOAK_END_CLOSE;
+        session->remaining = 100 + rand() % 900;
+    } else {
+        session->end = (draw < SOAK_SHORT_PCT + SOAK_LONG_PCT + SOAK_ABORT_PCT) ? SOAK_END_ABORT : SOAK_END_TRUNCATE;
+        session->remaining = rand() % 5;
+    }
+}
+
+
+/**
+ * @brief Closes a connection with a reset instead of a graceful shutdown.
+ */
+static void reset_connection(Endpoint *endpoint) {
+    struct linger linger = {1, 0};  /**< Zero linger time: close() sends RST */
+    setsockopt(endpoint->socket, SOL_SOCKET, SO_LINGER, (const char*) &linger, sizeof(linger));
+    closesocket(endpoint->socket);
+    endpoint->socket = -1;
+}
+
+
+/**
+ * @brief Ends a soak session the way it was drawn.
+ * @param[in/out] session: the session, whose requests are all sent.
+ * @param[in] request: the request of the run.
+ * @param[in/out] sample: counts the resets.
+ */
+static void end_soak_session(SoakSession *session, const PasswordRequest *request, SoakSample *sample) {
+    Endpoint *endpoint = &session->endpoint;
+    PasswordRequest quit_msg;
+    PasswordResponse response;
+    switch (session->end) {
+    case SOAK_END_QUIT:
+        memset(&quit_msg, 0, sizeof(quit_msg));
+        quit_msg.type = 'q';
+        if (send_request(endpoint, &quit_msg)) {
+            receive_response(endpoint, &response);
+        }
+        break;
+    case SOAK_END_CLOSE:
+        break;
+    case SOAK_END_ABORT:
+        send(endpoint->socket, (const char*) request, sizeof(*request), 0);
+        reset_connection(endpoint);
+        sample->aborted++;
+        break;
+    case SOAK_END_TRUNCATE:
+        send(endpoint->socket, (const char*) request, sizeof(*request) / 2, 0);
+        reset_connection(endpoint);
+        sample->truncated++;
+        break;
+    }
+    if (endpoint->socket >= 0) {
+        closesocket(endpoint->socket);
+        endpoint->socket = -1;
+    }
+}
+
+
+/**
+ * @brief Waits a moment before connecting again to a server that refused a connection.
+ */
+static void soak_backoff(void) {
+#if defined WIN32
+    Sleep(100);
+#else
+    usleep(100000);
+#endif
+}
+
+
+/**
+ * @brief Closes an interval of a soak test: computes its percentiles, samples the server and prints it.
+ * @param[in/out] sample: the interval, completed in place.
+ * @param[in/out] latencies: the latencies kept for the interval, sorted in place.
+ * @param[in] kept: the number of latencies kept.
+ * @param[in] options: the settings of the run.
+ */
+static void close_soak_interval(SoakSample *sample, double *latencies, int kept, const SoakOptions *options) {
+    LoadReport report;
+    memset(&report, 0, sizeof(report));
+    summarize_latencies(&report, latencies, kept);
+    sample->p50 = report.p50;
+    sample->p99 = report.p99;
+    sample->p999 = report.p999;
+    sample->max = report.max;
+    if (options->server_pid <= 0 || !sample_process(options->server_pid, &sample->rss_kb, &sample->fds)) {
+        sample->rss_kb = -1;
+        sample->fds = -1;
+    }
+    printf("soak elapsed_s=%.0f requests=%lu errors=%lu opened=%lu aborted=%lu truncated=%lu connect_failures=%lu "
+           "p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f rss_kb=%ld fds=%d\n",
+           sample->elapsed, sample->requests, sample->errors, sample->opened, sample->aborted, sample->truncated,
+           sample->connect_failures, sample->p50 * 1e6, sample->p99 * 1e6, sample->p999 * 1e6, sample->max * 1e6,
+           sample->rss_kb, sample->fds);
+    fflush(stdout);
+}
+
+
+/**
+ * @brief Soaks a server with connection churn, sampling it every interval.
+ * @param[in] server: the server.
+ * @param[in] request: the request sent every time.
+ * @param[in] options: the settings of the run.
+ * @return `true` if the run raised no flag.
+ */
+bool run_soak(const Endpoint *server, const PasswordRequest *request, const SoakOptions *options) {
+    int intervals = (options->seconds + options->interval - 1) / options->interval;
+    SoakSession *sessions = calloc(options->sessions, sizeof(SoakSession));
+    SoakSample *samples = calloc(intervals, sizeof(SoakSample));
+    double *latencies = malloc(SOAK_MAX_LATENCIES * sizeof(double));
+    if (sessions == NULL || samples == NULL || latencies == NULL) {
+        free(sessions);
+        free(samples);
+        free(latencies);
+        return false;
+    }
+    for (int i = 0; i < options->sessions; i++) {
+        sessions[i].endpoint = *server;
+        sessions[i].endpoint.socket = -1;
+    }
+
+    PasswordResponse response;
+    unsigned int reported = 0;  /**< Flags already reported */
+    int count = 0;              /**< Intervals closed */
+    unsigned long seen = 0;     /**< Latencies measured in the interval */
+    double begin = monotonic_seconds();
+    double interval_end = begin + options->interval;
+    for (int next = 0; count < intervals; next = (next + 1) % options->sessions) {
+        SoakSample *sample = &samples[count];
+        SoakSession *session = &sessions[next];
+        Endpoint *endpoint = &session->endpoint;
+
+        // Replace an ended session; a refusing server is retried after a pause
+        if (endpoint->socket < 0) {
+            if (connect_endpoint(endpoint)) {
+                sample->opened++;
+                draw_soak_session(session);
+            } else {
+                sample->connect_failures++;
+                soak_backoff();
+            }
+        } else if (session->remaining == 0) {
+            end_soak_session(session, request, sample);
+        } else {
+            double start = monotonic_seconds();
+            bool answered = send_request(endpoint, request) && receive_response(endpoint, &response);
+            double latency = monotonic_seconds() - start;
+            session->remaining--;
+            sample->requests++;
+            if (!answered || response.request_error) {
+                sample->errors++;
+            }
+
+            // Reservoir sampling keeps a uniform sample of the interval once the buffer is full
+            unsigned long slot = seen;
+            if (seen >= SOAK_MAX_LATENCIES) {
+                slot = ((unsigned long) rand() * ((unsigned long) RAND_MAX + 1) + (unsigned long) rand()) % (seen + 1);
+            }
+            if (slot < SOAK_MAX_LATENCIES) {
+                latencies[slot] = latency;
+            }
+            seen++;
+        }
+
+        double now = monotonic_seconds();
+        if (now < interval_end) {
+            continue;
+        }
+        sample->elapsed = now - begin;
+        close_soak_interval(sample, latencies, (seen < SOAK_MAX_LATENCIES) ? (int) seen : SOAK_MAX_LATENCIES, options);
+        count++;
+        seen = 0;
+        interval_end += options->interval;
+
+        unsigned int flags = check_soak(samples, count);
+        if (flags & ~reported) {
+            char names[64];
+            format_soak_flags(flags & ~reported, names, sizeof(names));
+            print_with_color("Soak test flagged: ", RED);
+            print_with_color(names, RED);
+            printf("\n");
+            reported |= flags;
+        }
+        if (flags & SOAK_SERVER_GONE) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < options->sessions; i++) {
+        if (sessions[i].endpoint.socket >= 0) {
+            closesocket(sessions[i].endpoint.socket);
+        }
+    }
+    unsigned int flags = check_soak(samples, count);
+    char names[64];
+    format_soak_flags(flags, names, sizeof(names));
+    const SoakSample *first = (count > 1) ? &samples[1] : &samples[0];
+    const SoakSample *last = &samples[(count > 0) ? count - 1 : 0];
+    printf("soak_result=%s samples=%d rss_kb_first=%ld rss_kb_last=%ld fds_first=%d fds_last=%d "
+           "p99_us_first=%.1f p99_us_last=%.1f\n", names, count, first->rss_kb, last->rss_kb, first->fds, last->fds,
+           first->p99 * 1e6, last->p99 * 1e6);
+    free(sessions);
+    free(samples);
+    free(latencies);
+    return flags == 0;
+}
+
+
+/**
+ * @brief Prints a load report as a single `key=value` line.
+ * @param[in] report: the report.
+ */
+void print_load_report(const LoadReport *report) {
+    printf("requests=%d completed=%d errors=%d seconds=%.3f throughput=%.0f p50_us=%.1f p90_us=%.1f "
+           "p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+           report->requests, report->completed, report->errors, report->seconds,
+           (report->seconds > 0) ? report->requests / report->seconds : 0,
+           report->p50 * 1e6, report->p90 * 1e6, report->p99 * 1e6, report->p999 * 1e6, report->max * 1e6);
+    if (report->lost > 0) {
+        printf("lost=%d\n", report->lost);
+    }
+    if (report->traced > 0) {
+        printf("traced=%d slowest_trace=%s slowest_traced_us=%.1f\n", report->traced, report->slowest_trace,
+               report->slowest_traced * 1e6);
+    }
+    if (allocations_counted()) {
+        printf("allocations=%llu allocs_per_request=%.4f\n", report->allocations,
+               (report->requests > 0) ? (double) report->allocations / report->requests : 0.0);
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - END LOAD - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,190 @@
+/*
+ ============================================================================
+ Name        : loadgen.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the load generator of the client. It
+               sends a fixed number of requests through an endpoint pool,
+               one at a time, and reports throughput and latency percentiles
+               measured at the client. It also consumes credit-based password
+               streams and drives the UDP request mode with a window of
+               outstanding datagrams, requests packed batches and soaks a
+               server with connection churn for hours.
+ ============================================================================
+ */
+
+#ifndef LOADGEN_H_
+#define LOADGEN_H_
+
+#include <stdbool.h>
+#include "../endpoint/endpoint.h"
+#include "../pack/pack.h"
+#include "../protocol/protocol.h"
+#include "../soak/soak.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Microseconds without answers after which the outstanding UDP requests are counted as lost.
+ */
+#define UDP_LOSS_TIMEOUT_US 200000  /**< UDP loss timeout */
+
+/**
+ * @brief Most sessions a soak test keeps open.
+ */
+#define SOAK_MAX_SESSIONS 1024      /**< Soak session cap */
+
+/**
+ * @brief Latencies kept per soak interval; beyond them a uniform sample of the interval is kept.
+ */
+#define SOAK_MAX_LATENCIES (1 << 20)    /**< Soak latency reservoir */
+
+/**
+ * @brief Shares of the soak sessions, in percent, by how they end: after a few requests with a
+ * quit request, after hundreds of requests with a plain close, reset right after a request
+ * without reading its response, or reset in the middle of a request. The rest are truncated.
+ */
+#define SOAK_SHORT_PCT 60           /**< Short sessions */
+#define SOAK_LONG_PCT 20            /**< Long sessions */
+#define SOAK_ABORT_PCT 10           /**< Sessions reset before their response */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @struct LoadReport
+ * @brief Outcome of a load run.
+ */
+typedef struct {
+    int requests;           /**< Requests sent */
+    int completed;          /**< Requests answered with a password */
+    int errors;             /**< Requests answered with an error or not answered */
+    int lost;               /**< UDP requests never answered */
+    int traced;             /**< Requests sent with a sampled trace context */
+    double slowest_traced;  /**< Latency of the slowest traced request, in seconds */
+    char slowest_trace[2 * TRACE_ID_SIZE + 1];  /**< Trace identifier of the slowest traced request */
+    double seconds;         /**< Duration of the run */
+    double p50;             /**< Median latency, in seconds */
+    double p90;             /**< 90th percentile latency, in seconds */
+    double p99;             /**< 99th percentile latency, in seconds */
+    double p999;            /**< 99.9th percentile latency, in seconds */
+    double max;             /**< Largest latency, in seconds */
+    unsigned long long allocations; /**< Heap allocations made by the client during the run */
+} LoadReport;
+
+
+/**
+ * @struct SoakOptions
+ * @brief Settings of a soak test.
+ */
+typedef struct {
+    int seconds;            /**< Duration of the run, rounded up to whole intervals */
+    int interval;           /**< Seconds between two samples */
+    int sessions;           /**< Sessions kept open, between 1 and `SOAK_MAX_SESSIONS` */
+    int server_pid;         /**< Server process sampled on this host, 0 if not sampled */
+} SoakOptions;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - LOAD - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Sends `count` requests, each after the previous response, and measures them.
+ *
+ * Requests are balanced over the pool, hedged if `pool->hedging` is set. A share `pool->trace_rate`
+ * of them carries a sampled trace context; the report names the slowest of those. The run stops
+ * early if every server of the pool fails.
+ *
+ * @param[in/out] pool: the connected pool.
+ * @param[in] request: the request sent every time.
+ * @param[in] count: the number of requests.
+ * @param[out] report: receives the outcome.
+ * @return `true` if the run completed, `false` if it stopped early or memory ran out.
+ */
+bool run_load(EndpointPool *pool, const PasswordRequest *request, int count, LoadReport *report);
+
+
+/**
+ * @brief Consumes `count` passwords from a stream, replenishing credits as they are consumed.
+ *
+ * The stream opens with `credits` credits; every time half of them are consumed, the consumed
+ * credits are granted again, so the server never runs more than `credits` passwords ahead.
+ * The latencies of the report are the gaps between consecutive passwords.
+ *
+ * @param[in/out] endpoint: the connected server, with no outstanding request.
+ * @param[in] request: the type and length of the passwords.
+ * @param[in] count: the number of passwords.
+ * @param[in] credits: the credit window, between 1 and `STREAM_MAX_CREDITS`.
+ * @param[in] print: whether every password is printed on its own line.
+ * @param[out] report: receives the outcome.
+ * @return `true` if every password was received and the stream was closed.
+ */
+bool run_stream(Endpoint *endpoint, const PasswordRequest *request, int count, int credits, bool print,
+                LoadReport *report);
+
+
+/**
+ * @brief Requests one batch of `count` passwords and reports its payload against one byte per character.
+ *
+ * Prints a `key=value` line with the payload size, the size of the same passwords unpacked and
+ * the share saved by the encoding. A batch cut short by the rate limit holds fewer passwords.
+ *
+ * @param[in/out] endpoint: the connected server, with no outstanding request.
+ * @param[in] request: the type and length of the passwords.
+ * @param[in] count: the number of passwords, between 1 and `BATCH_MAX_PASSWORDS`.
+ * @param[in] encoding: the encoding of the payload, which must fit the password type.
+ * @param[in] print: whether every password is printed on its own line.
+ * @return `true` if the whole batch was received.
+ */
+bool run_batch(Endpoint *endpoint, const PasswordRequest *request, int count, PackEncoding encoding, bool print);
+
+
+/**
+ * @brief Sends `count` UDP requests, keeping up to `window` of them outstanding, and measures them.
+ *
+ * Each datagram carries its index as identifier, so answers may arrive in any order. When no
+ * answer arrives for `UDP_LOSS_TIMEOUT_US`, the outstanding requests are counted as lost and
+ * the window is filled again. The latencies of the report cover the answered requests.
+ *
+ * @param[in] endpoint: the server, which must run its UDP mode (`--udp` or `--xdp`).
+ * @param[in] request: the type and length of the passwords.
+ * @param[in] count: the number of requests.
+ * @param[in] window: the requests kept outstanding, at least one.
+ * @param[out] report: receives the outcome.
+ * @return `true` if every request was answered, `false` if some were lost or memory ran out.
+ */
+bool run_udp_load(const Endpoint *endpoint, const PasswordRequest *request, int count, int window,
+                  LoadReport *report);
+
+
+/**
+ * @brief Soaks a server with connection churn, sampling it every interval.
+ *
+ * `options->sessions` sessions are kept open and served in turn, one request at a time; each
+ * ends as drawn from the `SOAK_*_PCT` shares and is replaced by a new one. Every interval
+ * prints a `soak` line with the latency percentiles of the interval, the churn and, if
+ * `options->server_pid` is set, the resident memory and open descriptors of the server; flags
+ * raised by `check_soak` are reported as soon as they appear. The run stops early if the
+ * server process exits, and ends with a `soak_result` line.
+ *
+ * @param[in] server: the server, whose connection settings every session copies.
+ * @param[in] request: the request sent every time.
+ * @param[in] options: the settings of the run.
+ * @return `true` if the run raised no flag, `false` if it did or memory ran out.
+ */
+bool run_soak(const Endpoint *server, const PasswordRequest *request, const SoakOptions *options);
+
+
+/**
+ * @brief Prints a load report as a single `key=value` line.
+ * @param[in] report: the report.
+ */
+void print_load_report(const LoadReport *report);
+
+/* - - - - - - - - - - - - - - - - - - - END LOAD - - - - - - - - - - - - - - - - - - - */
+
+#endif /* LOADGEN_H_ */
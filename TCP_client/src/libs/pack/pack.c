@@ -0,0 +1,333 @@
+/*
+ ============================================================================
+ Name        : pack.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Compact encodings of batch responses.
+ ============================================================================
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "pack.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - BITS - - - - - - - - - - - - - - - - - - - - */
+
+static const char *const ALPHABETS[PACK_COUNT] = {
+    NULL, "0123456789", "0123456789", "abcdefghijklmnopqrstuvwxyz", "abcdefghijklmnopqrstuvwxyz0123456789"
+};  /**< Symbols of every encoding, in code order; the plain encoding stores characters as they are */
+
+static const int SYMBOL_BITS[PACK_COUNT] = { 8, 4, 0, 5, 6 };  /**< Bits per symbol, 0 for grouped digits */
+static const int TAIL_BITS[3] = { 0, 4, 7 };    /**< Bits of the last 0, 1 or 2 digits of a decimal payload */
+
+/**
+ * @struct BitStream
+ * @brief Cursor over a payload, filled and drained least significant bit first.
+ */
+typedef struct {
+    unsigned char *bytes;       /**< Payload being written, NULL while reading */
+    const unsigned char *in;    /**< Payload being read */
+    size_t size;                /**< Bytes written or read */
+    size_t limit;               /**< Bytes available to read */
+    uint64_t window;            /**< Bits not yet written or already read */
+    int bits;                   /**< Valid bits of the window */
+} BitStream;
+
+
+/**
+ * @brief Appends the low `count` bits of a value to a payload.
+ */
+static void put_bits(BitStream *stream, uint32_t value, int count) {
+    stream->window |= (uint64_t) value << stream->bits;
+    stream->bits += count;
+    while (stream->bits >= 8) {
+        stream->bytes[stream->size++] = (unsigned char) stream->window;
+        stream->window >>= 8;
+        stream->bits -= 8;
+    }
+}
+
+
+/**
+ * @brief Takes the next `count` bits of a payload.
+ * @return the bits, or -1 if the payload is exhausted.
+ */
+static int32_t get_bits(BitStream *stream, int count) {
+    while (stream->bits < count) {
+        if (stream->size >= stream->limit) {
+            return -1;
+        }
+        stream->window |= (uint64_t) stream->in[stream->size++] << stream->bits;
+        stream->bits += 8;
+    }
+    int32_t value = (int32_t) (stream->window & ((1u << count) - 1));
+    stream->window >>= count;
+    stream->bits -= count;
+    return value;
+}
+
+
+/**
+ * @brief Returns the code of a character in the alphabet of an encoding, or -1 if it is not part of it.
+ */
+static int symbol_code(PackEncoding encoding, char symbol) {
+    if (encoding == PACK_PLAIN) {
+        return (unsigned char) symbol;
+    }
+    if (symbol >= '0' && symbol <= '9') {
+        return (encoding == PACK_MIXED) ? 26 + symbol - '0'
+               : (encoding == PACK_BCD || encoding == PACK_DECIMAL) ? symbol - '0' : -1;
+    }
+    if (symbol >= 'a' && symbol <= 'z' && (encoding == PACK_ALPHA || encoding == PACK_MIXED)) {
+        return symbol - 'a';
+    }
+    return -1;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END BITS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - TABLES - - - - - - - - - - - - - - - - - - - - */
+
+static char digit_pairs[256][2];     /**< BCD byte to its two digits, low nibble first; 0 if a nibble is not a digit */
+static char digit_triples[1000][3];  /**< 10-bit decimal group to its three digits, least significant first */
+static bool tables_ready;            /**< Whether the decoding tables are filled */
+
+/**
+ * @brief Fills the decoding tables on first use.
+ */
+static void init_tables(void) {
+    if (tables_ready) {
+        return;
+    }
+    memset(digit_pairs, 0, sizeof(digit_pairs));
+    for (int high = 0; high < 10; high++) {
+        for (int low = 0; low < 10; low++) {
+            digit_pairs[high << 4 | low][0] = '0' + low;
+            digit_pairs[high << 4 | low][1] = '0' + high;
+        }
+    }
+    for (int group = 0; group < 1000; group++) {
+        digit_triples[group][0] = '0' + group % 10;
+        digit_triples[group][1] = '0' + group / 10 % 10;
+        digit_triples[group][2] = '0' + group / 100;
+    }
+    tables_ready = true;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END TABLES - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - PACKING - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns the name of an encoding.
+ * @param[in] encoding: the encoding.
+ * @return the name of the encoding.
+ */
+const char *encoding_name(PackEncoding encoding) {
+    static const char *const names[PACK_COUNT] = { "plain", "bcd", "decimal", "alpha", "mixed" };
+    return (encoding >= 0 && encoding < PACK_COUNT) ? names[encoding] : "unknown";
+}
+
+
+/**
+ * @brief Looks up an encoding by name.
+ * @param[in] name: the name of the encoding.
+ * @param[out] encoding: receives the encoding.
+ * @return `true` if the name is known.
+ */
+bool parse_encoding(const char *name, PackEncoding *encoding) {
+    for (int i = 0; i < PACK_COUNT; i++) {
+        if (strcmp(name, encoding_name((PackEncoding) i)) == 0) {
+            *encoding = (PackEncoding) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Checks that every password of a type can be written in an encoding.
+ * @param[in] encoding: the encoding.
+ * @param[in] type: the password type requested.
+ * @return `true` if the encoding covers the alphabet of the type.
+ */
+bool encoding_fits(PackEncoding encoding, char type) {
+    switch (encoding) {
+    case PACK_PLAIN:
+        return true;
+    case PACK_BCD:
+    case PACK_DECIMAL:
+        return type == 'n' || type == 'l' || type == 'i';
+    case PACK_ALPHA:
+        return type == 'a';
+    case PACK_MIXED:
+        return type == 'a' || type == 'm';
+    default:
+        return false;
+    }
+}
+
+
+/**
+ * @brief Returns the smallest encoding covering a password type.
+ * @param[in] type: the password type requested.
+ * @return the encoding.
+ */
+PackEncoding best_encoding(char type) {
+    switch (type) {
+    case 'n':
+    case 'l':
+    case 'i':
+        return PACK_DECIMAL;
+    case 'a':
+        return PACK_ALPHA;
+    case 'm':
+        return PACK_MIXED;
+    default:
+        return PACK_PLAIN;
+    }
+}
+
+
+/**
+ * @brief Returns the size of a packed batch.
+ * @param[in] encoding: the encoding.
+ * @param[in] count: the number of passwords.
+ * @param[in] length: the length of every password.
+ * @return the payload size in bytes.
+ */
+size_t packed_size(PackEncoding encoding, int count, int length) {
+    size_t symbols = (size_t) count * length;
+    size_t bits = (encoding == PACK_DECIMAL) ? symbols / 3 * 10 + TAIL_BITS[symbols % 3]
+                                             : symbols * SYMBOL_BITS[encoding];
+    return (bits + 7) / 8;
+}
+
+
+/**
+ * @brief Packs a batch of passwords.
+ * @param[in] encoding: the encoding.
+ * @param[in] passwords: the passwords, spaced `length + 1` characters apart.
+ * @param[in] count: the number of passwords.
+ * @param[in] length: the length of every password.
+ * @param[out] payload: receives the payload.
+ * @return the payload size in bytes.
+ */
+size_t pack_passwords(PackEncoding encoding, const char *passwords, int count, int length, unsigned char *payload) {
+    BitStream stream = { .bytes = payload };
+    uint32_t group = 0;     /**< Decimal group being assembled */
+    uint32_t scale = 1;     /**< Weight of the next digit of the group */
+    int grouped = 0;        /**< Digits in the group */
+    for (int p = 0; p < count; p++) {
+        const char *password = passwords + (size_t) p * (length + 1);
+        for (int c = 0; c < length; c++) {
+            int code = symbol_code(encoding, password[c]);
+            if (code < 0) {
+                code = 0;   /**< Not reachable for an encoding that fits the type */
+            }
+            if (encoding != PACK_DECIMAL) {
+                put_bits(&stream, (uint32_t) code, SYMBOL_BITS[encoding]);
+                continue;
+            }
+            group += code * scale;
+            scale *= 10;
+            if (++grouped == 3) {
+                put_bits(&stream, group, 10);
+                group = 0;
+                scale = 1;
+                grouped = 0;
+            }
+        }
+    }
+    if (grouped > 0) {
+        put_bits(&stream, group, TAIL_BITS[grouped]);
+    }
+    if (stream.bits > 0) {
+        put_bits(&stream, 0, 8 - stream.bits);
+    }
+    return stream.size;
+}
+
+
+/**
+ * @brief Unpacks a batch of passwords.
+ * @param[in] encoding: the encoding.
+ * @param[in] payload: the payload.
+ * @param[in] size: the payload size in bytes.
+ * @param[in] count: the number of passwords.
+ * @param[in] length: the length of every password.
+ * @param[out] passwords: receives the null-terminated passwords, spaced `length + 1` characters apart.
+ * @return `true` if the payload holds exactly the batch.
+ */
+bool unpack_passwords(PackEncoding encoding, const unsigned char *payload, size_t size, int count, int length,
+                      char *passwords) {
+    if (encoding < 0 || encoding >= PACK_COUNT || length < 1 || size != packed_size(encoding, count, length)) {
+        return false;
+    }
+    init_tables();
+
+    // Decode the whole symbol stream, then spread it over the passwords from the end, so it can be done in place
+    size_t symbols = (size_t) count * length;
+    char *stream_out = passwords;
+    size_t decoded = 0;
+    if (encoding == PACK_PLAIN) {
+        memcpy(stream_out, payload, symbols);
+        decoded = symbols;
+    } else if (encoding == PACK_BCD) {
+        // Two digits per byte: one table lookup per byte
+        for (size_t i = 0; i < size && decoded < symbols; i++) {
+            const char *pair = digit_pairs[payload[i]];
+            if (pair[0] == 0) {
+                return false;
+            }
+            stream_out[decoded++] = pair[0];
+            if (decoded < symbols) {
+                stream_out[decoded++] = pair[1];
+            }
+        }
+    } else if (encoding == PACK_DECIMAL) {
+        BitStream stream = { .in = payload, .limit = size };
+        for (; decoded + 3 <= symbols; decoded += 3) {
+            int32_t group = get_bits(&stream, 10);
+            if (group < 0 || group >= 1000) {
+                return false;
+            }
+            memcpy(stream_out + decoded, digit_triples[group], 3);
+        }
+        int tail = (int) (symbols - decoded);
+        if (tail > 0) {
+            int32_t group = get_bits(&stream, TAIL_BITS[tail]);
+            if (group < 0 || group >= (tail == 1 ? 10 : 100)) {
+                return false;
+            }
+            memcpy(stream_out + decoded, digit_triples[group], tail);
+            decoded += tail;
+        }
+    } else {
+        BitStream stream = { .in = payload, .limit = size };
+        const char *alphabet = ALPHABETS[encoding];
+        int32_t symbol_count = (int32_t) strlen(alphabet);
+        for (; decoded < symbols; decoded++) {
+            int32_t code = get_bits(&stream, SYMBOL_BITS[encoding]);
+            if (code < 0 || code >= symbol_count) {
+                return false;
+            }
+            stream_out[decoded] = alphabet[code];
+        }
+    }
+    if (decoded != symbols) {
+        return false;
+    }
+
+    for (int p = count - 1; p >= 0; p--) {
+        memmove(passwords + (size_t) p * (length + 1), stream_out + (size_t) p * length, length);
+        passwords[(size_t) p * (length + 1) + length] = '\0';
+    }
+    return true;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END PACKING - - - - - - - - - - - - - - - - - - - */
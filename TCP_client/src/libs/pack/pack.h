@@ -0,0 +1,114 @@
+/*
+ ============================================================================
+ Name        : pack.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the compact encodings of batch
+               responses. The passwords of a batch are concatenated into one
+               symbol stream and packed little-endian, least significant bit
+               first: digits as BCD (4 bits) or in groups of three per 10 bits,
+               lowercase letters in 5 bits and lowercase letters and digits in
+               6 bits. Decoding is table-driven. The server and the client
+               keep the same copy of this library.
+ ============================================================================
+ */
+
+#ifndef PACK_H_
+#define PACK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum PackEncoding
+ * @brief Encodings of a batch payload.
+ */
+typedef enum {
+    PACK_PLAIN,     /**< One byte per character, any password type */
+    PACK_BCD,       /**< 4 bits per digit, numeric types */
+    PACK_DECIMAL,   /**< 10 bits per three digits, numeric types */
+    PACK_ALPHA,     /**< 5 bits per lowercase letter, alphabetic type */
+    PACK_MIXED,     /**< 6 bits per lowercase letter or digit, alphabetic and mixed types */
+    PACK_COUNT      /**< Number of encodings */
+} PackEncoding;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - PACKING - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns the name of an encoding.
+ * @param[in] encoding: the encoding.
+ * @return "plain", "bcd", "decimal", "alpha" or "mixed".
+ */
+const char *encoding_name(PackEncoding encoding);
+
+
+/**
+ * @brief Looks up an encoding by name.
+ * @param[in] name: the name of the encoding.
+ * @param[out] encoding: receives the encoding.
+ * @return `true` if the name is known.
+ */
+bool parse_encoding(const char *name, PackEncoding *encoding);
+
+
+/**
+ * @brief Checks that every password of a type can be written in an encoding.
+ * @param[in] encoding: the encoding.
+ * @param[in] type: the password type requested ('n', 'l', 'i', 'a', 'm' or 's').
+ * @return `true` if the encoding covers the alphabet of the type.
+ */
+bool encoding_fits(PackEncoding encoding, char type);
+
+
+/**
+ * @brief Returns the smallest encoding covering a password type.
+ * @param[in] type: the password type requested.
+ * @return the encoding, `PACK_PLAIN` for secure passwords.
+ */
+PackEncoding best_encoding(char type);
+
+
+/**
+ * @brief Returns the size of a packed batch.
+ * @param[in] encoding: the encoding.
+ * @param[in] count: the number of passwords.
+ * @param[in] length: the length of every password.
+ * @return the payload size in bytes.
+ */
+size_t packed_size(PackEncoding encoding, int count, int length);
+
+
+/**
+ * @brief Packs a batch of passwords.
+ * @param[in] encoding: the encoding, which must fit the passwords.
+ * @param[in] passwords: `count` passwords of `length` characters, spaced `length + 1` characters apart.
+ * @param[in] count: the number of passwords.
+ * @param[in] length: the length of every password.
+ * @param[out] payload: receives `packed_size(encoding, count, length)` bytes.
+ * @return the payload size in bytes.
+ */
+size_t pack_passwords(PackEncoding encoding, const char *passwords, int count, int length, unsigned char *payload);
+
+
+/**
+ * @brief Unpacks a batch of passwords.
+ * @param[in] encoding: the encoding of the payload.
+ * @param[in] payload: the payload.
+ * @param[in] size: the payload size in bytes.
+ * @param[in] count: the number of passwords.
+ * @param[in] length: the length of every password.
+ * @param[out] passwords: receives `count` null-terminated passwords spaced `length + 1` characters apart.
+ * @return `true` if the payload holds exactly the batch, `false` if it is truncated or holds an invalid symbol.
+ */
+bool unpack_passwords(PackEncoding encoding, const unsigned char *payload, size_t size, int count, int length,
+                      char *passwords);
+
+/* - - - - - - - - - - - - - - - - - - - END PACKING - - - - - - - - - - - - - - - - - - - */
+
+#endif /* PACK_H_ */
@@ -0,0 +1,180 @@
+/*
+ ============================================================================
+ Name        : soak.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Server process sampling and leak and drift detection of the
+               soak test.
+ ============================================================================
+ */
+
+#if defined(__linux__)
+#include <dirent.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "soak.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - - SOAK - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Reads the resident memory and the open descriptors of a process on the same host.
+ * @param[in] pid: the process.
+ * @param[out] rss_kb: receives the resident memory in KiB.
+ * @param[out] fds: receives the number of open descriptors.
+ * @return `true` if the process exists and could be read.
+ */
+bool sample_process(int pid, long *rss_kb, int *fds) {
+    *rss_kb = -1;
+    *fds = -1;
+#if defined(__linux__)
+    char path[64];
+    char line[128];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *status = fopen(path, "r");
+    if (status == NULL) {
+        return false;
+    }
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (sscanf(line, "VmRSS: %ld", rss_kb) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    DIR *directory = opendir(path);
+    if (directory == NULL) {
+        return false;
+    }
+    int count = 0;
+    for (struct dirent *entry = readdir(directory); entry != NULL; entry = readdir(directory)) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(directory);
+    *fds = count;
+    return *rss_kb >= 0;
+#else
+    (void) pid;
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Orders two values for `qsort`.
+ */
+static int compare_values(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Returns the median of a few values, sorting them in place.
+ */
+static double median(double *values, int count) {
+    qsort(values, count, sizeof(double), compare_values);
+    return (count % 2 == 1) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+
+/**
+ * @brief Tells whether a resource sampled in both windows rose for good.
+ * @param[in] early: the values of the first window, negative if not sampled.
+ * @param[in] late: the values of the last window, negative if not sampled.
+ * @param[in] count: the values of each window.
+ * @param[in] slack: the growth tolerated.
+ * @return `true` if every late value exceeds every early one by more than `slack`.
+ */
+static bool grew(const double *early, const double *late, int count, double slack) {
+    double highest = early[0];
+    double lowest = late[0];
+    for (int i = 0; i < count; i++) {
+        if (early[i] < 0 || late[i] < 0) {
+            return false;
+        }
+        highest = (early[i] > highest) ? early[i] : highest;
+        lowest = (late[i] < lowest) ? late[i] : lowest;
+    }
+    return lowest > highest + slack;
+}
+
+
+/**
+ * @brief Judges the samples of a run.
+ * @param[in] samples: the samples, in order.
+ * @param[in] count: the number of samples.
+ * @return the `SOAK_*` flags raised.
+ */
+unsigned int check_soak(const SoakSample *samples, int count) {
+    unsigned int flags = 0;
+    if (count >= 2 && samples[0].rss_kb >= 0 && samples[count - 1].rss_kb < 0) {
+        flags |= SOAK_SERVER_GONE;
+    }
+    if (count < SOAK_MIN_SAMPLES) {
+        return flags;
+    }
+
+    // Windows of a third of the samples after the warm-up, the first and the last
+    int window = (count - 1) / 3;
+    const SoakSample *first = samples + 1;
+    const SoakSample *last = samples + count - window;
+    double *values = malloc(4 * window * sizeof(double));
+    if (values == NULL) {
+        return flags;
+    }
+    double *early = values;
+    double *late = values + window;
+    double *early_p99 = values + 2 * window;
+    double *late_p99 = values + 3 * window;
+
+    for (int i = 0; i < window; i++) {
+        early[i] = (double) first[i].rss_kb;
+        late[i] = (double) last[i].rss_kb;
+    }
+    if (grew(early, late, window, SOAK_RSS_SLACK_KB)) {
+        flags |= SOAK_RSS_GROWTH;
+    }
+    for (int i = 0; i < window; i++) {
+        early[i] = first[i].fds;
+        late[i] = last[i].fds;
+        early_p99[i] = first[i].p99;
+        late_p99[i] = last[i].p99;
+    }
+    if (grew(early, late, window, SOAK_FD_SLACK)) {
+        flags |= SOAK_FD_GROWTH;
+    }
+    double early_median = median(early_p99, window);
+    double late_median = median(late_p99, window);
+    if (late_median > early_median * SOAK_DRIFT_RATIO && late_median - early_median > SOAK_DRIFT_MIN) {
+        flags |= SOAK_LATENCY_DRIFT;
+    }
+    free(values);
+    return flags;
+}
+
+
+/**
+ * @brief Writes the names of flags as a comma-separated list, `stable` for none.
+ * @param[in] flags: the `SOAK_*` flags.
+ * @param[out] text: receives the names.
+ * @param[in] size: the size of `text`.
+ */
+void format_soak_flags(unsigned int flags, char *text, int size) {
+    static const char *const names[] = { "rss_growth", "fd_growth", "latency_drift", "server_gone" };
+    int length = snprintf(text, size, "%s", (flags == 0) ? "stable" : "");
+    for (int i = 0; i < 4 && length < size; i++) {
+        if (flags & (1u << i)) {
+            length += snprintf(text + length, size - length, "%s%s", (length > 0) ? "," : "", names[i]);
+        }
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - END SOAK - - - - - - - - - - - - - - - - - - - */
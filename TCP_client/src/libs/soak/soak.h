@@ -0,0 +1,128 @@
+/*
+ ============================================================================
+ Name        : soak.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the samples of a soak test and the
+               detection of leaks and drift in them. Every interval the soak
+               test records the latency percentiles it measured and, when the
+               server runs on the same host, the resident memory and open
+               descriptors of the server process. A run is flagged when the
+               last third of its samples stays above the first third: growth
+               that no quiet moment undoes is a leak, not a burst.
+ ============================================================================
+ */
+
+#ifndef SOAK_H_
+#define SOAK_H_
+
+#include <stdbool.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Resident memory the server may gain over a run before it is flagged, in KiB.
+ */
+#define SOAK_RSS_SLACK_KB 1024  /**< RSS growth tolerance */
+
+/**
+ * @brief Open descriptors the server may gain over a run before it is flagged.
+ * Sessions opening and closing around a sample move the count by a few.
+ */
+#define SOAK_FD_SLACK 4         /**< Descriptor growth tolerance */
+
+/**
+ * @brief Ratio of the late p99 latency to the early one beyond which latency has drifted.
+ */
+#define SOAK_DRIFT_RATIO 1.5    /**< Latency drift ratio */
+
+/**
+ * @brief Smallest p99 increase counted as drift, in seconds, so jitter on fast requests is ignored.
+ */
+#define SOAK_DRIFT_MIN 0.0001   /**< Latency drift floor */
+
+/**
+ * @brief Samples needed to judge a run: the warm-up one and three more.
+ */
+#define SOAK_MIN_SAMPLES 4      /**< Samples of a verdict */
+
+/**
+ * @brief Flags of a soak run.
+ */
+#define SOAK_RSS_GROWTH    0x01 /**< Resident memory of the server keeps growing */
+#define SOAK_FD_GROWTH     0x02 /**< Open descriptors of the server keep growing */
+#define SOAK_LATENCY_DRIFT 0x04 /**< The p99 latency keeps rising */
+#define SOAK_SERVER_GONE   0x08 /**< The server process exited */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @struct SoakSample
+ * @brief What a soak test observed over one interval.
+ */
+typedef struct {
+    double elapsed;                 /**< Seconds since the start of the run, at the end of the interval */
+    unsigned long requests;         /**< Requests sent in the interval */
+    unsigned long errors;           /**< Requests answered with an error or not answered */
+    unsigned long opened;           /**< Sessions opened */
+    unsigned long aborted;          /**< Sessions reset right after a request, without its response */
+    unsigned long truncated;        /**< Sessions reset in the middle of a request */
+    unsigned long connect_failures; /**< Connections or handshakes that failed */
+    double p50;                     /**< Median latency, in seconds */
+    double p99;                     /**< 99th percentile latency, in seconds */
+    double p999;                    /**< 99.9th percentile latency, in seconds */
+    double max;                     /**< Largest latency, in seconds */
+    long rss_kb;                    /**< Resident memory of the server, in KiB, -1 if not sampled */
+    int fds;                        /**< Open descriptors of the server, -1 if not sampled */
+} SoakSample;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - SOAK - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Reads the resident memory and the open descriptors of a process on the same host.
+ *
+ * Linux only: the values come from `/proc/PID/status` and `/proc/PID/fd`, which need the
+ * process to belong to the same user.
+ *
+ * @param[in] pid: the process.
+ * @param[out] rss_kb: receives the resident memory in KiB.
+ * @param[out] fds: receives the number of open descriptors.
+ * @return `true` if the process exists and could be read.
+ */
+bool sample_process(int pid, long *rss_kb, int *fds);
+
+
+/**
+ * @brief Judges the samples of a run.
+ *
+ * The first sample is the warm-up and is ignored. Memory and descriptors are flagged when the
+ * lowest value of the last third of the samples exceeds the highest of the first third by more
+ * than the slack; latency when the median p99 of the last third exceeds the one of the first
+ * third by `SOAK_DRIFT_RATIO` and by `SOAK_DRIFT_MIN`. A process that could be sampled and no
+ * longer can is flagged as gone.
+ *
+ * @param[in] samples: the samples, in order.
+ * @param[in] count: the number of samples.
+ * @return the `SOAK_*` flags raised, 0 for a stable run or too few samples.
+ */
+unsigned int check_soak(const SoakSample *samples, int count);
+
+
+/**
+ * @brief Writes the names of flags as a comma-separated list, `stable` for none.
+ * @param[in] flags: the `SOAK_*` flags.
+ * @param[out] text: receives the names.
+ * @param[in] size: the size of `text`.
+ */
+void format_soak_flags(unsigned int flags, char *text, int size);
+
+/* - - - - - - - - - - - - - - - - - - - END SOAK - - - - - - - - - - - - - - - - - - - */
+
+#endif /* SOAK_H_ */
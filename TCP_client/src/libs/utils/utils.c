@@ -8,9 +8,17 @@
  Utilities included:
      - COLORS:
           1. print_with_color: Prints the specified text in the specified color.
+     - TIME:
+          1. monotonic_seconds: Returns a monotonic timestamp in seconds.
  ============================================================================
  */
 
+#if defined WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include <stdio.h>
 #include "utils.h"
 
@@ -59,3 +67,25 @@ void print_with_color(const char *text, textColor color) {
 }
 
 /* - - - - - - - - - - - - - - - - END COLORS - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - TIME - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns a monotonic timestamp.
+ * @return the number of seconds elapsed since an arbitrary fixed point.
+ */
+double monotonic_seconds(void) {
+#if defined WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double) counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - END TIME - - - - - - - - - - - - - - - - - */
@@ -8,6 +8,8 @@
  Utilities included:
      - COLORS:
           1. print_with_color: Prints the specified text in the specified color.
+     - TIME:
+          1. monotonic_seconds: Returns a monotonic timestamp in seconds.
  ============================================================================
  */
 
@@ -48,4 +50,19 @@ void print_with_color(const char *text, textColor color);
 
 /* - - - - - - - - - - - - - - - - END COLORS - - - - - - - - - - - - - - - - */
 
+
+/* - - - - - - - - - - - - - - - - - - TIME - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns a monotonic timestamp.
+ *
+ * The value is not related to the wall clock and is only meaningful as a
+ * difference between two calls.
+ *
+ * @return The number of seconds elapsed since an arbitrary fixed point.
+ */
+double monotonic_seconds(void);
+
+/* - - - - - - - - - - - - - - - - - END TIME - - - - - - - - - - - - - - - - - */
+
 #endif /* UTILS_H_ */
@@ -6,6 +6,9 @@
  Copyright   : Your copyright notice
  Description : TCP server implementation in C that handles password generation requests from a client.
                It listens for incoming connections, processes password requests, and sends responses.
+               Clients are served concurrently by a single select() event loop, which also serves
+               the admin control channel. In proxy mode the server forwards its clients to a pool
+               of backend servers instead.
  ============================================================================
  */
 
@@ -14,10 +17,16 @@
 #else
 #include <unistd.h>  /**< Include UNIX standard header for close() */
 #include <sys/socket.h>  /**< Include socket library for UNIX */
+#include <sys/select.h>  /**< Include for select() */
 #include <arpa/inet.h>  /**< Include ARP and Internet address family libraries */
 #include <sys/types.h>   /**< Include for socket types */
 #include <netinet/in.h>  /**< Include for internet address family structures */
+#include <netinet/tcp.h>  /**< Include for TCP_NODELAY */
 #include <netdb.h>  /**< Include for host and network databases */
+#include <signal.h>  /**< Include for sigaction() */
+#include <errno.h>  /**< Include for EINTR */
+#include <fcntl.h>  /**< Include for O_NONBLOCK */
+#include <sys/wait.h>  /**< Include for waitpid() */
 #define closesocket close  /**< Define closesocket to close for UNIX systems */
 #endif
 
@@ -26,9 +35,77 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "libs/admin/admin.h"  /**< Include the header for the admin control channel */
+#include "libs/alloc/alloc.h"  /**< Include the header for heap allocation counting */
+#include "libs/auth/auth.h"  /**< Include the header for API key authentication */
+#include "libs/cpu/cpu.h"  /**< Include the header for CPU pinning and busy polling */
+#include "libs/pack/pack.h"  /**< Include the header for the compact encodings of batches */
 #include "libs/password/password.h"  /**< Include the header for password generation functions */
+#include "libs/perf/perf.h"  /**< Include the header for hardware performance counters */
+#include "libs/profile/profile.h"  /**< Include the header for the sampling profiler */
 #include "libs/protocol/protocol.h"  /**< Include the protocol definitions for communication */
+#include "libs/proxy/proxy.h"  /**< Include the header for the proxy mode */
+#include "libs/session/session.h"  /**< Include the header for the session table */
+#include "libs/shard/shard.h"  /**< Include the header for the sharded listener mode */
+#include "libs/span/span.h"  /**< Include the header for the spans of sampled requests */
+#include "libs/stats/stats.h"  /**< Include the header for latency histograms */
+#include "libs/tenant/tenant.h"  /**< Include the header for tenant policies */
+#include "libs/udp/udp.h"  /**< Include the header for the UDP request mode */
 #include "libs/utils/utils.h"     /**< Include the utils.h library for utility functions */
+#include "libs/xdp/xdp.h"  /**< Include the header for the AF_XDP fast path */
+
+
+/**
+ * @struct ServerConfig
+ * @brief Settings that can be changed at runtime through the admin channel.
+ *
+ * The event loop reads the settings through the `config` pointer. The admin channel never
+ * modifies the active copy: it fills the spare copy and swaps the pointer, so a request
+ * always sees a consistent set of settings.
+ */
+typedef struct {
+	int session_limit;  /**< Maximum number of concurrent client sessions, at most `MAX_SESSIONS` */
+	bool trace_enabled;  /**< Whether every request is recorded in `TRACE_FILE` */
+	bool draining;  /**< Whether new connections are refused until the last session ends */
+	bool busy_poll;  /**< Whether the event loop spins instead of sleeping in select() */
+	double idle_timeout;  /**< Seconds a session may stay silent before it is closed, 0 for no limit */
+} ServerConfig;
+
+static ServerConfig configs[2] = { { MAX_SESSIONS, false, false, false, SESSION_IDLE_SECONDS } };  /**< Active and spare settings */
+static const ServerConfig *config = &configs[0];  /**< Settings read by the event loop */
+
+static KeyTable key_table;  /**< Table of the pre-shared API keys loaded from `KEYS_FILE` */
+static TenantTable tenant_table;  /**< Table of the tenants loaded from `TENANTS_FILE` */
+static SessionTable *session_table;  /**< Table of the client sessions, allocated on the node of the event loop */
+static Histogram stage_histograms[STAGE_COUNT];  /**< Latency of every stage of request processing */
+static AdminConnection admin_connections[MAX_ADMIN_CONNECTIONS];  /**< Admin channel connections */
+static bool auth_enabled;  /**< Whether clients must authenticate */
+static volatile sig_atomic_t running = true;  /**< Whether the event loop keeps running, cleared by SIGINT and SIGTERM */
+static double started;  /**< Time the server started */
+static unsigned long accepted_connections;  /**< Connections accepted since the start */
+static unsigned long accept_errors;  /**< Failed accepts since the start */
+static double accept_paused_until;  /**< Time the listener is watched again after running out of descriptors */
+static FILE *trace_file;  /**< Trace capture file, open while trace capture is enabled */
+static double last_turn;  /**< Duration of the last event loop turn, waiting excluded */
+static LoopStats loop_stats;  /**< Turns of the event loop and time spent waiting and working */
+static char trace_buffer[BUFSIZ];  /**< Buffer of `trace_file`, so tracing a request never allocates */
+static unsigned long served_messages;  /**< Requests and stream items served since the start */
+static unsigned long measured_messages;  /**< Messages served after `ALLOC_WARMUP_MESSAGES` */
+static unsigned long long request_allocations;  /**< Heap allocations made while serving the measured messages */
+static bool alloc_check;  /**< Whether an allocation while serving a measured message aborts the server */
+static PerfCounters perf_counters;  /**< Hardware counters of the event loop, open while sampling is enabled */
+static PerfStats perf_stages[STAGE_COUNT];  /**< Counter deltas of the sampled requests, per stage */
+static unsigned long perf_tick;  /**< Requests seen while sampling, to pick one in `PERF_SAMPLE_PERIOD` */
+static UdpServer udp_server = { .socket = -1 };  /**< UDP request mode, off unless `--udp` is given */
+static XdpPort xdp_port = { .socket = -1 };  /**< AF_XDP fast path of the UDP mode, off unless `--xdp` is given */
+static ShardGroup shard_group;  /**< Listeners of the sharded mode, one per shard */
+static int shard = -1;  /**< Index of the shard served by this process, -1 if not sharded */
+static HandoffStats handoff_stats;  /**< Connections of the shard received by its CPU or another one */
+static SpanRing span_ring;  /**< Spans of the sampled requests, drained by the exporter once per turn */
+static SpanExporter span_exporter = { .socket = -1 };  /**< Destination of the spans, closed unless `--spans` is given */
+static double turn_began;  /**< Time the current event loop turn began, start of the queueing span */
+static int profile_requester = -1;  /**< Admin connection waiting for the running profile, -1 if none */
+static int profile_requester_socket = -1;  /**< Socket of that connection, to notice it was closed and reused */
 
 
 /**
@@ -51,7 +128,1414 @@ void errorhandler(char *errorMessage) {
 	print_with_color(errorMessage, MAGENTA);  /**< Print the error message in Magenta */
 }
 
-int main() {
+
+#if !defined WIN32
+/**
+ * @brief Stops the event loop on SIGINT or SIGTERM, so the server exits through its normal cleanup.
+ * @param[in] signal_number: the signal received.
+ */
+static void stop_server(int signal_number) {
+	(void) signal_number;
+	running = false;
+}
+#endif
+
+
+/**
+ * @brief Publishes new runtime settings.
+ * The settings are copied into the spare slot, then the active pointer is swapped.
+ * @param[in] next: the settings to publish.
+ */
+static void update_config(const ServerConfig *next) {
+	ServerConfig *spare = (config == &configs[0]) ? &configs[1] : &configs[0];
+	*spare = *next;
+	config = spare;
+}
+
+
+/* - - - - - - - - - - - - - - - - - - - - HEALTH - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Evaluates the liveness and readiness checks.
+ * Only reads counters kept by the event loop, so a probe costs no generation and no I/O.
+ * @return the health of the server.
+ */
+static HealthResponse check_health(void) {
+	HealthResponse health_msg;
+	health_msg.live = running;
+	health_msg.checks = 0;
+	if (last_turn <= HEALTH_MAX_TURN) {
+		health_msg.checks |= HEALTH_LOOP;
+	}
+	if (password_generator_seeded()) {
+		health_msg.checks |= HEALTH_RNG;
+	}
+	if (config->session_limit - session_table->active >= config->session_limit * HEALTH_LOW_WATER && !config->draining) {
+		health_msg.checks |= HEALTH_CAPACITY;
+	}
+	health_msg.ready = health_msg.live && health_msg.checks == (HEALTH_LOOP | HEALTH_RNG | HEALTH_CAPACITY);
+	return health_msg;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END HEALTH - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - SESSIONS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Closes the connection of a session and releases its slot.
+ * @param[in] slot: the slot of the session to end.
+ */
+static void end_session(int slot) {
+	Session *session = &session_table->sessions[slot];
+	closesocket(session_table->sockets[slot]);  /**< Close the socket */
+	log_with_color(LEVEL_INFO, "Connection with the client closed.\n", BLUE);
+	if (get_log_level() >= LEVEL_INFO) {
+		if (session->key != NULL) {
+			printf("Passwords generated with key %s: %lu\n", session->key->key_id, session->key->requests);
+		}
+		if (session->tenant != NULL) {
+			printf("Tenant %s: %lu requests, %lu generated, %lu rejected, %lu rate limited\n\n", session->tenant->name,
+					session->tenant->metrics.requests, session->tenant->metrics.generated,
+					session->tenant->metrics.rejected, session->tenant->metrics.rate_limited);
+		}
+	}
+	release_session(session_table, slot);
+}
+
+
+/**
+ * @brief Makes the calls on a client socket return at once instead of waiting for the client.
+ * @param[in] socket: the socket connected to the client.
+ */
+static void set_nonblocking(int socket) {
+#if defined WIN32
+	u_long mode = 1;
+	ioctlsocket(socket, FIONBIO, &mode);
+#else
+	fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+
+/**
+ * @brief Tells whether the last socket call failed only because it would have blocked.
+ */
+static bool would_block(void) {
+#if defined WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+
+/**
+ * @brief Sends a message to the client of a session, ending the session on failure.
+ *
+ * Client sockets never block: the bytes the socket cannot take at once are queued behind the
+ * bytes already waiting and sent by `flush_session` once the client reads. A client whose backlog
+ * would pass `SESSION_OUTPUT_SIZE` is disconnected, so it cannot hold the event loop or the memory.
+ *
+ * @param[in] slot: the slot of the session.
+ * @param[in] message: the message to send.
+ * @param[in] size: the size of the message.
+ * @param[in] error_message: the error printed if the connection failed.
+ * @return `true` if the message was sent or queued, `false` if the session was ended.
+ */
+static bool send_to_session(int slot, const void *message, int size, char *error_message) {
+	int sent = 0;
+	if (session_table->outputs[slot] == NULL) {
+		sent = send(session_table->sockets[slot], message, size, 0);
+		if (sent < 0 && !would_block()) {
+			errorhandler(error_message);
+			end_session(slot);
+			return false;
+		}
+		sent = (sent < 0) ? 0 : sent;
+		session_table->bytes_out[slot] += sent;
+	}
+	if (sent < size && !queue_output(session_table, slot, (const char *) message + sent, size - sent)) {
+		errorhandler("The client does not read its responses, connection closed.\n");
+		session_table->overflows++;
+		end_session(slot);
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * @brief Sends the queued responses of a session, as far as its socket takes them.
+ * The send buffer goes back to the pool once every byte is sent.
+ * @param[in] slot: the slot of the session, whose socket is writable.
+ */
+static void flush_session(int slot) {
+	unsigned int start = session_table->output_starts[slot];
+	int sent = send(session_table->sockets[slot], (const char *) session_table->outputs[slot]->data + start,
+			session_table->output_ends[slot] - start, 0);
+	if (sent < 0) {
+		if (!would_block()) {
+			errorhandler("send() failed (Queued responses).\n");
+			end_session(slot);
+		}
+		return;
+	}
+	session_table->bytes_out[slot] += sent;
+	session_table->output_starts[slot] += sent;
+	if (session_table->output_starts[slot] == session_table->output_ends[slot]) {
+		detach_output(session_table, slot);
+	}
+}
+
+
+/**
+ * @brief Accepts a client connection and sends it the authentication challenge.
+ * @param[in] server_socket: the listening socket.
+ */
+static void accept_client(int server_socket) {
+	struct sockaddr_in cad;  /**< Client address structure */
+	int client_len = sizeof(cad);  /**< Size of the client address structure */
+
+	// Accept a client connection
+	int client_socket = accept(server_socket, (struct sockaddr*) &cad, &client_len);
+	if (client_socket < 0) {
+		// A failed accept concerns one connection, never the server: count it and keep serving
+		accept_errors++;
+#if !defined WIN32
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED || errno == EINTR) {
+			return;  /**< Taken by another shard or reset before it was accepted */
+		}
+		if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+			// The connection stays in the backlog: stop watching the listener for a while instead of spinning on it
+			accept_paused_until = monotonic_seconds() + ACCEPT_BACKOFF_SECONDS;
+		}
+#endif
+		errorhandler("Accept failed (Client connection).\n");
+		return;
+	}
+
+	set_nonblocking(client_socket);
+	if (config->busy_poll) {
+		enable_busy_poll(client_socket);
+	}
+	if (shard >= 0) {
+		record_handoff(&handoff_stats, client_socket, current_cpu());
+	}
+
+	// A challenge without a fresh nonce could be answered with a recorded proof: refuse the connection instead
+	HelloChallenge hello_msg;
+	hello_msg.version = PROTOCOL_VERSION;
+	hello_msg.auth_required = auth_enabled;
+	if (!fill_random(hello_msg.nonce, sizeof(hello_msg.nonce))) {
+		errorhandler("No entropy for the challenge nonce, connection refused.\n");
+		closesocket(client_socket);
+		return;
+	}
+
+	char peer[PEER_SIZE];
+	snprintf(peer, sizeof(peer), "%s:%d", inet_ntoa(cad.sin_addr), ntohs(cad.sin_port));
+	int slot = open_session(session_table, client_socket, peer, monotonic_seconds());
+	if (slot < 0) {
+		errorhandler("Session table full, connection refused.\n");
+		closesocket(client_socket);
+		return;
+	}
+
+	// Send the authentication challenge to the client
+	memcpy(session_table->sessions[slot].nonce, hello_msg.nonce, NONCE_SIZE);
+	send_to_session(slot, &hello_msg, sizeof(hello_msg),
+			"send() sent a different number of bytes than expected (Challenge).\n");
+}
+
+
+/**
+ * @brief Verifies the authentication proof of a session and sends the menu.
+ * The proof is verified once per connection: requests on an authenticated connection are not checked again.
+ * @param[in] slot: the slot of the session, whose buffer holds a complete `HelloResponse`.
+ */
+static void complete_handshake(int slot) {
+	Session *session = &session_table->sessions[slot];
+	HelloResponse *auth_msg = &session_table->inputs[slot]->input.hello;
+	auth_msg->key_id[KEY_ID_SIZE - 1] = '\0';  /**< Ensure null termination for the key identifier */
+
+	// Answer health probes and close: no authentication, menu, generation, metrics or logging.
+	// Probes never count against the session limit: at the limit they get in through the handshake reserve.
+	if (auth_msg->opcode == HELLO_HEALTH) {
+		HealthResponse health_msg = check_health();
+		send(session_table->sockets[slot], &health_msg, sizeof(health_msg), 0);
+		closesocket(session_table->sockets[slot]);
+		release_session(session_table, slot);
+		return;
+	}
+
+	// Print client's IP address and port number
+	accepted_connections++;
+	log_with_color(LEVEL_INFO, "New connection from ", GREEN);
+	log_with_color(LEVEL_INFO, session->peer, YELLOW);
+	log_with_color(LEVEL_INFO, "\n", RESET);
+	double begin = monotonic_seconds();
+
+	HelloResult result_msg;
+	if (auth_msg->version != PROTOCOL_VERSION) {
+		result_msg.authenticated = false;
+		strcpy(result_msg.error_msg, "Unsupported protocol version.\n");
+	} else if (session_table->active >= config->session_limit) {
+		result_msg.authenticated = false;
+		strcpy(result_msg.error_msg, "Server full, retry later.\n");
+	} else if (auth_enabled) {
+		unsigned char proof_msg[NONCE_SIZE + KEY_ID_SIZE];  /**< Authenticated message: nonce and key identifier */
+		memcpy(proof_msg, session->nonce, NONCE_SIZE);
+		memcpy(proof_msg + NONCE_SIZE, auth_msg->key_id, KEY_ID_SIZE);
+		session->key = verify_key(&key_table, auth_msg->key_id, proof_msg, sizeof(proof_msg), auth_msg->mac);
+		result_msg.authenticated = session->key != NULL;
+		strcpy(result_msg.error_msg, result_msg.authenticated ? "" : "Authentication failed.\n");
+	} else {
+		result_msg.authenticated = true;
+		strcpy(result_msg.error_msg, "");
+	}
+	record_sample(&stage_histograms[STAGE_HANDSHAKE], monotonic_seconds() - begin);
+
+	if (!send_to_session(slot, &result_msg, sizeof(result_msg),
+			"send() sent a different number of bytes than expected (Authentication result).\n")) {
+		return;
+	}
+	if (!result_msg.authenticated) {
+		errorhandler(result_msg.error_msg);
+		end_session(slot);
+		return;
+	}
+	if (session->key != NULL) {
+		log_with_color(LEVEL_INFO, "Authenticated with key ", GREEN);
+		log_with_color(LEVEL_INFO, session->key->key_id, YELLOW);
+		log_with_color(LEVEL_INFO, "\n", RESET);
+	}
+
+	// Resolve the policy set of the connection once
+	session->tenant = &tenant_table.tenants[(session->key != NULL) ? session->key->tenant_index : DEFAULT_TENANT];
+	activate_session(session_table, slot, monotonic_seconds(), config->idle_timeout);
+
+	// Create the menu to send to the client
+	MenuMessage menu_msg;
+	snprintf(menu_msg.menu_text, sizeof(menu_msg.menu_text),
+			"Insert the type of password and its length (between %d and %d):\n"
+			"  n: numeric password (only digits)\n"
+			"  l: numeric code ending with a Luhn check digit\n"
+			"  i: numeric code ending with two ISO 7064 mod 97-10 check digits\n"
+			"  a: alphabetic password (only lowercase letters)\n"
+			"  m: mixed password (lowercase letters and digits)\n"
+			"  s: secure password (uppercase letters, lowercase letters, digits, and symbols)\n"
+			"  q: to close the connection\n"
+			"? ", session->tenant->min_length, session->tenant->max_length);
+
+	// Send the menu to the client
+	send_to_session(slot, &menu_msg, sizeof(menu_msg),
+			"send() sent a different number of bytes than expected (Menu).\n");
+}
+
+
+/**
+ * @brief Maps a requested type to the password type generated for it.
+ * @param[in] type: the type requested by the client, already validated.
+ * @return the password type.
+ */
+static PasswordType password_type_of(char type) {
+	switch (tolower(type)) {
+		case 'n':
+			return NUMERIC;
+		case 'l':
+			return NUMERIC_LUHN;
+		case 'i':
+			return NUMERIC_MOD97;
+		case 'a':
+			return ALPHA;
+		case 'm':
+			return MIXED;
+		case 's':
+		default:
+			return SECURE;
+	}
+}
+
+
+/**
+ * @brief Validates a requested length against the tenant bounds and the shortest password of the type.
+ * @param[in] tenant: the tenant of the request.
+ * @param[in] type: the type requested, already validated.
+ * @param[in] length: the length requested, as text.
+ * @return `true` if passwords of that type and length may be generated for the tenant.
+ */
+static bool length_allowed(const Tenant *tenant, char type, const char *length) {
+	return control_length(length, tenant->min_length, tenant->max_length)
+			&& atoi(length) >= shortest_length(password_type_of(type));
+}
+
+
+/**
+ * @brief Serves a stream control request: opens the stream, grants credits or closes it.
+ * Only the opening is answered; a close is acknowledged by a `STREAM_END` message.
+ * @param[in] slot: the slot of the session.
+ * @param[in] control_msg: the request, whose type is `STREAM_OPEN`, `STREAM_CREDIT` or `STREAM_CLOSE`.
+ */
+static void serve_stream_control(int slot, const PasswordRequest *control_msg) {
+	Session *session = &session_table->sessions[slot];
+	Tenant *tenant = session->tenant;
+	PasswordResponse response_msg;
+	memset(&response_msg, 0, sizeof(response_msg));
+	response_msg.keep_going = true;
+
+	if (control_msg->type == STREAM_CREDIT) {
+		// Credits for a stream closed in the meantime are ignored
+		if (session->stream_type != 0) {
+			long credits = session_table->credits[slot] + atol(control_msg->length);
+			session_table->credits[slot] = (credits < 0) ? 0 : (credits > STREAM_MAX_CREDITS) ? STREAM_MAX_CREDITS : credits;
+		}
+		return;
+	}
+
+	if (control_msg->type == STREAM_CLOSE) {
+		session->stream_type = 0;
+		session_table->credits[slot] = 0;
+		response_msg.stream = STREAM_END;
+		send_to_session(slot, &response_msg, sizeof(response_msg),
+				"send() sent a different number of bytes than expected (Stream end).\n");
+		return;
+	}
+
+	// Open a stream with the same validation as a single request
+	char type = 0;
+	char length[16] = "";
+	long credits = 0;
+	response_msg.stream = STREAM_NONE;
+	tenant->metrics.requests++;
+	if (sscanf(control_msg->length, " %c %15s %ld", &type, length, &credits) != 3 || credits < 0) {
+		strcpy(response_msg.error_msg, "Expected: type length credits.\n");
+		response_msg.request_error = true;
+	} else if (!tenant->allowed_type[(unsigned char) type]) {
+		strcpy(response_msg.error_msg, "The type inserted is not valid.\n");
+		response_msg.request_error = true;
+	} else if (!length_allowed(tenant, type, length)) {
+		strcpy(response_msg.error_msg, "The length for the password is not valid.\n");
+		response_msg.request_error = true;
+	} else {
+		// Items are small writes: do not let Nagle hold them back waiting for delayed acknowledgements
+		int no_delay = 1;
+		setsockopt(session_table->sockets[slot], IPPROTO_TCP, TCP_NODELAY, (const char *) &no_delay, sizeof(no_delay));
+		session->stream_type = type;
+		session->stream_length = (unsigned char) atoi(length);
+		session_table->credits[slot] = (credits > STREAM_MAX_CREDITS) ? STREAM_MAX_CREDITS : credits;
+	}
+	if (response_msg.request_error) {
+		tenant->metrics.rejected++;
+	}
+	send_to_session(slot, &response_msg, sizeof(response_msg),
+			"send() sent a different number of bytes than expected (Stream response).\n");
+}
+
+
+/**
+ * @brief Serves a batch request: validates it, generates the passwords and sends them packed.
+ *
+ * The batch is validated like a single request, plus its count and encoding, and answered by a
+ * regular response; an accepted batch follows as a `BatchHeader` and its payload, all three in a
+ * single write so Nagle never holds the payload back behind the response. Every password
+ * takes a token from the tenant rate limit: a batch running out of tokens is cut short, and one
+ * granted no token at all is refused with the rate limit error of a single request.
+ * Numeric batches are generated by `generate_numeric_batch`, the others one password at a time.
+ *
+ * @param[in] slot: the slot of the session.
+ * @param[in] batch_msg: the request, whose type is `BATCH_REQUEST`.
+ */
+static void serve_batch(int slot, const PasswordRequest *batch_msg) {
+	static char passwords[BATCH_MAX_PASSWORDS * (MAX_PASSWORD_LENGTH + 1)];  /**< Passwords of the batch */
+	static unsigned char message[sizeof(PasswordResponse) + sizeof(BatchHeader)
+			+ BATCH_MAX_PASSWORDS * MAX_PASSWORD_LENGTH];  /**< Response, header and payload, sent in one write */
+	Session *session = &session_table->sessions[slot];
+	Tenant *tenant = session->tenant;
+	PasswordResponse response_msg;
+	memset(&response_msg, 0, sizeof(response_msg));
+	response_msg.keep_going = true;
+	response_msg.stream = STREAM_NONE;
+
+	char type = 0;
+	char length[16] = "";
+	int count = 0;
+	char encoding_text[16] = "";
+	PackEncoding encoding = PACK_PLAIN;
+	tenant->metrics.requests++;
+	if (sscanf(batch_msg->length, " %c %15s %d %15s", &type, length, &count, encoding_text) != 4) {
+		strcpy(response_msg.error_msg, "Expected: type length count encoding.\n");
+		response_msg.request_error = true;
+	} else if (!tenant->allowed_type[(unsigned char) type]) {
+		strcpy(response_msg.error_msg, "The type inserted is not valid.\n");
+		response_msg.request_error = true;
+	} else if (!length_allowed(tenant, type, length) || atoi(length) > MAX_PASSWORD_LENGTH) {
+		strcpy(response_msg.error_msg, "The length for the password is not valid.\n");
+		response_msg.request_error = true;
+	} else if (count < 1 || count > BATCH_MAX_PASSWORDS) {
+		strcpy(response_msg.error_msg, "The batch size is not valid.\n");
+		response_msg.request_error = true;
+	} else if (!parse_encoding(encoding_text, &encoding) || !encoding_fits(encoding, (char) tolower((unsigned char) type))) {
+		strcpy(response_msg.error_msg, "The encoding does not fit the password type.\n");
+		response_msg.request_error = true;
+	}
+	if (response_msg.request_error) {
+		tenant->metrics.rejected++;
+		send_to_session(slot, &response_msg, sizeof(response_msg),
+				"send() sent a different number of bytes than expected (Batch response).\n");
+		return;
+	}
+
+	// Take the tokens first, so a limited batch is generated and packed at its final size
+	int granted = 0;
+	while (granted < count && take_tenant_token(tenant)) {
+		granted++;
+	}
+	if (granted < count) {
+		tenant->metrics.rate_limited++;
+	}
+	if (granted == 0) {
+		strcpy(response_msg.error_msg, "Rate limit exceeded, retry later.\n");
+		response_msg.request_error = true;
+		send_to_session(slot, &response_msg, sizeof(response_msg),
+				"send() sent a different number of bytes than expected (Batch response).\n");
+		return;
+	}
+
+	double begin = monotonic_seconds();
+	int password_length = atoi(length);
+	type = (char) tolower((unsigned char) type);
+	CheckDigitMode mode = (type == 'l') ? CHECK_LUHN : (type == 'i') ? CHECK_MOD97 : CHECK_NONE;
+	bool numeric = (type == 'n' || type == 'l' || type == 'i')
+			&& generate_numeric_batch(passwords, granted, password_length, NULL, mode);
+	for (int i = 0; !numeric && i < granted; i++) {
+		// Other types are generated like single requests
+		generate_password(passwords + (size_t) i * (password_length + 1), password_type_of(type), password_length);
+	}
+	record_sample(&stage_histograms[STAGE_GENERATE], monotonic_seconds() - begin);
+
+	BatchHeader header;
+	memset(&header, 0, sizeof(header));  // Padding included: the header is sent as it is
+	header.count = (unsigned short) granted;
+	header.length = (unsigned char) password_length;
+	header.encoding = (unsigned char) encoding;
+	header.size = (unsigned int) pack_passwords(encoding, passwords, granted, password_length,
+			message + sizeof(response_msg) + sizeof(header));
+	memcpy(message, &response_msg, sizeof(response_msg));
+	memcpy(message + sizeof(response_msg), &header, sizeof(header));
+	if (session->key != NULL) {
+		session->key->requests += granted;
+	}
+	tenant->metrics.generated += granted;
+	session_table->requests[slot] += granted;
+	send_to_session(slot, message, (int) (sizeof(response_msg) + sizeof(header) + header.size),
+			"send() sent a different number of bytes than expected (Batch).\n");
+}
+
+
+/**
+ * @brief Accounts the heap allocations made while serving messages.
+ *
+ * The first `ALLOC_WARMUP_MESSAGES` messages are not measured: they fill the buffer pool and the
+ * stdio buffers. Past them the request path must not allocate; with `--alloc-check` an allocation
+ * is reported and the server aborts, so a load run fails at the first offending request.
+ *
+ * @param[in] before: the allocation count before the messages were served.
+ * @param[in] served: the number of messages served.
+ */
+static void account_allocations(unsigned long long before, unsigned long served) {
+	served_messages += served;
+	if (served_messages <= ALLOC_WARMUP_MESSAGES) {
+		return;
+	}
+	unsigned long long allocations = allocation_count() - before;
+	measured_messages += served;
+	request_allocations += allocations;
+	if (allocations > 0 && alloc_check) {
+		fprintf(stderr, "%llu heap allocations while serving message %lu.\n", allocations, served_messages);
+		abort();
+	}
+}
+
+
+/**
+ * @brief Sends the next items of the open stream of a session, within its credits.
+ *
+ * At most `STREAM_BURST` items are sent per call, so one stream cannot monopolize the event loop,
+ * and none once the socket stops taking them: the rest waits for the queued items to be read.
+ * Every item takes a token from the tenant rate limit; a limited item is sent as an error and still
+ * consumes a credit, so a rate-limited stream slows down to the pace of its client.
+ *
+ * @param[in] slot: the slot of the session, whose socket is writable.
+ */
+static void serve_stream(int slot) {
+	Session *session = &session_table->sessions[slot];
+	unsigned long long allocations = allocation_count();
+	Tenant *tenant = session->tenant;
+	PasswordResponse item_msg;
+	memset(&item_msg, 0, sizeof(item_msg));
+	item_msg.keep_going = true;
+	item_msg.stream = STREAM_ITEM;
+
+	// Count the items here: a failed send releases the slot, whose columns must not be read again
+	int served = 0;
+	while (served < STREAM_BURST && session_table->credits[slot] > 0 && session_table->outputs[slot] == NULL) {
+		double begin = monotonic_seconds();
+		if (take_tenant_token(tenant)) {
+			generate_password(item_msg.password, password_type_of(session->stream_type), session->stream_length);
+			item_msg.request_error = false;
+			item_msg.error_msg[0] = '\0';
+			record_sample(&stage_histograms[STAGE_GENERATE], monotonic_seconds() - begin);
+			if (session->key != NULL) {
+				session->key->requests++;
+			}
+			tenant->metrics.generated++;
+			session_table->requests[slot]++;
+		} else {
+			item_msg.password[0] = '\0';
+			item_msg.request_error = true;
+			strcpy(item_msg.error_msg, "Rate limit exceeded, retry later.\n");
+			tenant->metrics.rate_limited++;
+		}
+		session_table->credits[slot]--;
+		served++;
+		if (!send_to_session(slot, &item_msg, sizeof(item_msg),
+				"send() sent a different number of bytes than expected (Stream item).\n")) {
+			break;
+		}
+	}
+	account_allocations(allocations, served);
+}
+
+
+/**
+ * @brief Records the spans of a sampled request.
+ *
+ * The server span covers the request from the turn of the event loop that picked it up to the
+ * response being sent, and is parented to the span of the client; queueing, validation, generation
+ * and send are its children. A request rejected during validation has no generation span.
+ *
+ * @param[in] slot: the slot of the session.
+ * @param[in] request: the request, whose trace context is sampled.
+ * @param[in] length: the length requested, 0 if invalid.
+ * @param[in] error: whether the request was answered with an error.
+ * @param[in] marks: the turn start, the request start, the end of validation, of generation and of the send.
+ */
+static void record_request_spans(int slot, const PasswordRequest *request, int length, bool error, const double marks[5]) {
+	Span span;
+	memset(&span, 0, sizeof(span));
+	memcpy(span.trace_id, request->trace.trace_id, TRACE_ID_SIZE);
+	memcpy(span.parent_id, request->trace.span_id, SPAN_ID_SIZE);
+	new_span_id(&span_ring, span.span_id);
+	span.kind = SPAN_REQUEST;
+	span.error = error;
+	span.type = request->type;
+	span.length = length;
+	span.session = session_handle(session_table, slot);
+	snprintf(span.tenant, sizeof(span.tenant), "%s", session_table->sessions[slot].tenant->name);
+	span.start = marks[0];
+	span.end = marks[4];
+	record_span(&span_ring, &span);
+
+	// Children only carry their timing
+	memcpy(span.parent_id, span.span_id, SPAN_ID_SIZE);
+	for (int kind = SPAN_QUEUE; kind < SPAN_KINDS; kind++) {
+		if (kind == SPAN_GENERATE && marks[3] == marks[2]) {
+			continue;
+		}
+		new_span_id(&span_ring, span.span_id);
+		span.kind = (unsigned char) kind;
+		span.start = marks[kind - 1];
+		span.end = marks[kind];
+		record_span(&span_ring, &span);
+	}
+}
+
+
+/**
+ * @brief Serves a password request and sends the response.
+ * @param[in] slot: the slot of the session, whose buffer holds a complete `PasswordRequest`.
+ */
+static void serve_request(int slot) {
+	Session *session = &session_table->sessions[slot];
+	PasswordRequest *password_msg = &session_table->inputs[slot]->input.request;
+	password_msg->length[sizeof(password_msg->length) - 1] = '\0';  /**< Ensure null termination for the length string */
+	if (password_msg->type == STREAM_OPEN || password_msg->type == STREAM_CREDIT || password_msg->type == STREAM_CLOSE) {
+		serve_stream_control(slot, password_msg);
+		return;
+	}
+	if (password_msg->type == BATCH_REQUEST) {
+		serve_batch(slot, password_msg);
+		return;
+	}
+	Tenant *tenant = session->tenant;
+	PasswordResponse response_msg;
+	response_msg.stream = STREAM_NONE;
+	int numerical_length = 0;
+	PerfSample marks[STAGE_COUNT];  /**< Counters at the start of every stage of a sampled request */
+	bool sampled = perf_counters.leader >= 0 && ++perf_tick % PERF_SAMPLE_PERIOD == 0;
+	if (sampled) {
+		read_perf_counters(&perf_counters, &marks[STAGE_VALIDATE]);
+	}
+	double begin = monotonic_seconds();
+	double validated = begin;
+	double generated = begin;
+
+	// Check if the server should continue generating passwords
+	response_msg.keep_going = keep_generating(password_msg->type, 'q');
+	if(response_msg.keep_going) {
+		tenant->metrics.requests++;
+	}
+	// Validate the type and the length first: a rejected request does not spend a token of the tenant
+	if(response_msg.keep_going && !tenant->allowed_type[(unsigned char) password_msg->type]) {
+		// Handle invalid type error
+		strcpy(response_msg.password, ""); // No password generated
+		strcpy(response_msg.error_msg, "The type inserted is not valid.\n"); // Error message for the type
+		response_msg.request_error = true;	// Error found for the type
+		tenant->metrics.rejected++;
+	}
+	else if(response_msg.keep_going && !length_allowed(tenant, password_msg->type, password_msg->length)) {
+		// Handle invalid length error
+		strcpy(response_msg.password, "");  // No password generated
+		strcpy(response_msg.error_msg, "The length for the password is not valid.\n"); // Error message for the length
+		response_msg.request_error = true;	// Error found for the password length
+		tenant->metrics.rejected++;
+	}
+	else if(response_msg.keep_going && !take_tenant_token(tenant)) {
+		// Handle rate limit error
+		strcpy(response_msg.password, ""); // No password generated
+		strcpy(response_msg.error_msg, "Rate limit exceeded, retry later.\n"); // Error message for the rate limit
+		response_msg.request_error = true;	// Error found for the rate limit
+		tenant->metrics.rate_limited++;
+	}
+	else if(response_msg.keep_going) {
+		numerical_length = atoi(password_msg->length); // Convert the string containing the length without the initial space
+		// Determine the password type
+		PasswordType password_type = password_type_of(password_msg->type);
+		// Generate password
+		validated = monotonic_seconds();
+		record_sample(&stage_histograms[STAGE_VALIDATE], validated - begin);
+		if (sampled) {
+			read_perf_counters(&perf_counters, &marks[STAGE_GENERATE]);
+		}
+		generate_password(response_msg.password, password_type, numerical_length);
+		if (sampled) {
+			read_perf_counters(&perf_counters, &marks[STAGE_SEND]);
+		}
+		generated = monotonic_seconds();
+		record_sample(&stage_histograms[STAGE_GENERATE], generated - validated);
+		strcpy(response_msg.error_msg, ""); // Error message absent
+		response_msg.request_error = false;	// No error found
+		if (session->key != NULL) {
+			session->key->requests++;  /**< Attribute the generated password to the API key */
+		}
+		tenant->metrics.generated++;
+		session_table->requests[slot]++;
+	}
+	else  {
+		// No error, close connection
+		strcpy(response_msg.password, ""); // No password generated
+		strcpy(response_msg.error_msg, ""); // No error message
+		response_msg.request_error = false;	// No error found
+	}
+	if (response_msg.request_error) {
+		generated = monotonic_seconds();
+		validated = generated;
+		record_sample(&stage_histograms[STAGE_VALIDATE], generated - begin);
+	}
+
+	// Send password generation response to the client
+	if (!send_to_session(slot, &response_msg, sizeof(response_msg),
+			"send() sent a different number of bytes than expected (Password response).\n")) {
+		return;
+	}
+	double sent = monotonic_seconds();
+	record_sample(&stage_histograms[STAGE_SEND], sent - generated);
+	record_sample(&stage_histograms[STAGE_REQUEST], sent - begin);
+	if (sampled && response_msg.keep_going && !response_msg.request_error) {
+		// Only requests that produced a password are sampled, so the figures are per password
+		PerfSample end;
+		read_perf_counters(&perf_counters, &end);
+		record_perf_sample(&perf_stages[STAGE_VALIDATE], &marks[STAGE_VALIDATE], &marks[STAGE_GENERATE], 1);
+		record_perf_sample(&perf_stages[STAGE_GENERATE], &marks[STAGE_GENERATE], &marks[STAGE_SEND], 1);
+		record_perf_sample(&perf_stages[STAGE_SEND], &marks[STAGE_SEND], &end, 1);
+		record_perf_sample(&perf_stages[STAGE_REQUEST], &marks[STAGE_VALIDATE], &end, 1);
+	}
+
+	if (response_msg.keep_going && span_exporter_open(&span_exporter) && trace_sampled(&password_msg->trace)) {
+		double span_marks[5] = { turn_began, begin, validated, generated, sent };
+		record_request_spans(slot, password_msg, numerical_length, response_msg.request_error, span_marks);
+	}
+
+	if (config->trace_enabled && trace_file != NULL && response_msg.keep_going) {
+		fprintf(trace_file, "%.6f session=%08x peer=%s tenant=%s type=%c length=%d error=%d latency_us=%.2f\n",
+				sent - started, session_handle(session_table, slot), session->peer, tenant->name,
+				isprint((unsigned char) password_msg->type) ? password_msg->type : '?', numerical_length,
+				response_msg.request_error, (sent - begin) * 1e6);
+	}
+
+	if (!response_msg.keep_going) {
+		end_session(slot);
+	}
+}
+
+
+/**
+ * @brief Receives the available bytes of a session and serves the message once it is complete.
+ * @param[in] slot: the slot of the session whose socket is readable.
+ */
+static void serve_session(int slot) {
+	unsigned long long allocations = allocation_count();
+	size_t expected = expected_input(session_table, slot);
+	if (attach_buffer(session_table, slot) == NULL) {
+		errorhandler("Out of memory for the receive buffer.\n");
+		end_session(slot);
+		return;
+	}
+	unsigned short *input_len = &session_table->input_lens[slot];
+	int received = recv(session_table->sockets[slot], (char *) &session_table->inputs[slot]->input + *input_len,
+			expected - *input_len, 0);
+	if (received < 0 && would_block()) {
+		if (*input_len == 0) {
+			detach_buffer(session_table, slot);  /**< Woken without data: stay idle */
+		}
+		return;
+	}
+	if (received <= 0) {
+		errorhandler(session_table->states[slot] == SESSION_HANDSHAKE
+				? "recv() failed or connection closed prematurely (Authentication).\n"
+				: "recv() failed or connection closed prematurely (Password settings).\n");
+		end_session(slot);
+		return;
+	}
+	touch_session(session_table, slot, monotonic_seconds(), config->idle_timeout);
+	session_table->bytes_in[slot] += received;
+	*input_len += received;
+	if (*input_len < expected) {
+		return;  /**< Wait for the rest of the message, keeping the buffer */
+	}
+
+	*input_len = 0;
+	if (session_table->states[slot] == SESSION_HANDSHAKE) {
+		complete_handshake(slot);
+		detach_buffer(session_table, slot);  /**< The session is idle again: give the buffer back */
+	} else {
+		serve_request(slot);
+		detach_buffer(session_table, slot);
+		account_allocations(allocations, 1);  /**< Connection setup is not part of the request path */
+	}
+}
+
+/* - - - - - - - - - - - - - - - - - - - END SESSIONS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - UDP - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Answers a UDP request, from the UDP socket or the AF_XDP fast path.
+ * UDP requests are not authenticated: they are charged to the default tenant and checked against its policy.
+ * @param[in] request: the request.
+ * @param[out] response: receives the answer.
+ */
+static void answer_udp_request(const UdpRequest *request, UdpResponse *response) {
+	Tenant *tenant = &tenant_table.tenants[DEFAULT_TENANT];
+	// The whole answer is sent: clear what is left of the answer to the previous peer
+	memset(response, 0, sizeof(*response));
+	response->id = request->id;
+	tenant->metrics.requests++;
+	if (!tenant->allowed_type[(unsigned char) request->type]
+			|| request->length < tenant->min_length || request->length > tenant->max_length
+			|| request->length < shortest_length(password_type_of(request->type))) {
+		response->request_error = true;
+		tenant->metrics.rejected++;
+	} else if (!take_tenant_token(tenant)) {
+		response->request_error = true;
+		tenant->metrics.rate_limited++;
+	} else {
+		generate_password(response->password, password_type_of(request->type), request->length);
+		response->request_error = false;
+		tenant->metrics.generated++;
+	}
+}
+
+/* - - - - - - - - - - - - - - - - - - - END UDP - - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - ADMIN - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Replies to the `sessions` admin command: one line per open session.
+ * @param[in] connection: the admin connection.
+ */
+static void admin_sessions(AdminConnection *connection) {
+	double now = monotonic_seconds();
+	admin_reply(connection, "%-8s %-21s %-9s %-16s %-16s %10s %10s %10s %10s %8s %8s\n", "handle", "peer", "state",
+			"tenant", "key", "age_s", "expires_s", "bytes_in", "bytes_out", "requests", "pending");
+	for (int slot = 0; slot < SESSION_SLOTS; slot++) {
+		if (session_table->states[slot] != SESSION_FREE) {
+			Session *session = &session_table->sessions[slot];
+			admin_reply(connection, "%08x %-21s %-9s %-16s %-16s %10.1f %10.1f %10lu %10lu %8lu %8u\n",
+					session_handle(session_table, slot), session->peer,
+					session_table->states[slot] == SESSION_HANDSHAKE ? "handshake" : "active",
+					session->tenant != NULL ? session->tenant->name : "-",
+					session->key != NULL ? session->key->key_id : "-",
+					now - session->opened, session_table->deadlines[slot] - now, session_table->bytes_in[slot],
+					session_table->bytes_out[slot], session_table->requests[slot],
+					(session_table->outputs[slot] != NULL)
+							? session_table->output_ends[slot] - session_table->output_starts[slot] : 0);
+		}
+	}
+}
+
+
+/**
+ * @brief Replies to the `stats` admin command: counters, stage histograms and tenant metrics.
+ * @param[in] connection: the admin connection.
+ */
+static void admin_stats(AdminConnection *connection) {
+	char histogram_text[ADMIN_REPLY_SIZE];
+	admin_reply(connection, "uptime_s=%.1f sessions=%d limit=%d accepted=%lu accept_errors=%lu idle_timeout_s=%.0f expired=%lu draining=%d "
+			"trace=%d log=%d cpu=%d node=%d\n",
+			monotonic_seconds() - started, session_table->count, config->session_limit, accepted_connections, accept_errors,
+			config->idle_timeout, session_table->expired,
+			config->draining, config->trace_enabled, get_log_level(), current_cpu(), current_node());
+	format_loop_stats(&loop_stats, config->busy_poll, histogram_text, sizeof(histogram_text));
+	admin_reply(connection, "%s", histogram_text);
+	admin_reply(connection, "memory session_bytes=%zu bytes_per_connection=%.1f buffer_bytes=%zu buffers=%d "
+			"buffers_in_use=%d buffers_peak=%d\n", SESSION_SLOT_SIZE, bytes_per_session(session_table), sizeof(InputBuffer),
+			session_table->buffers.allocated, session_table->buffers.in_use, session_table->buffers.peak);
+	admin_reply(connection, "backlog buffer_bytes=%zu buffers=%d buffers_in_use=%d buffers_peak=%d overflows=%lu\n",
+			sizeof(OutputBuffer), session_table->output_buffers.allocated, session_table->output_buffers.in_use,
+			session_table->output_buffers.peak, session_table->overflows);
+	if (allocations_counted()) {
+		admin_reply(connection, "allocations total=%llu frees=%llu warmup=%d measured=%lu in_requests=%llu "
+				"per_request=%.4f check=%d\n", allocation_count(), free_count(), ALLOC_WARMUP_MESSAGES,
+				measured_messages, request_allocations,
+				(measured_messages > 0) ? (double) request_allocations / measured_messages : 0.0, alloc_check);
+	}
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		format_histogram(&stage_histograms[stage], stage_name(stage), histogram_text, sizeof(histogram_text));
+		admin_reply(connection, "%s", histogram_text);
+	}
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		if (perf_stages[stage].passwords > 0) {
+			admin_reply(connection, "perf ");
+			format_perf_stats(&perf_stages[stage], &perf_counters, stage_name(stage), histogram_text, sizeof(histogram_text));
+			admin_reply(connection, "%s", histogram_text);
+		}
+	}
+	if (shard >= 0) {
+		admin_reply(connection, "shard index=%d of=%d cpu=%d steering=%s accepted=%lu local=%lu handoffs=%lu unknown=%lu "
+				"handoff_rate=%.4f\n", shard, shard_group.count, shard_cpu(shard), steering_name(shard_group.steering),
+				handoff_stats.accepted, handoff_stats.local, handoff_stats.handoffs, handoff_stats.unknown,
+				(handoff_stats.local + handoff_stats.handoffs > 0)
+						? (double) handoff_stats.handoffs / (handoff_stats.local + handoff_stats.handoffs) : 0.0);
+	}
+	if (span_ring.recorded > 0 || span_exporter_open(&span_exporter)) {
+		admin_reply(connection, "spans target=%s recorded=%lu dropped=%lu exported=%lu failed=%lu\n",
+				span_exporter_open(&span_exporter) ? span_exporter.target : "off", span_ring.recorded, span_ring.dropped,
+				span_exporter.exported, span_exporter.failed);
+	}
+	if (udp_server.socket >= 0) {
+		admin_reply(connection, "udp received=%llu sent=%llu dropped=%llu per_call=%.2f\n", udp_server.received,
+				udp_server.sent, udp_server.dropped,
+				(udp_server.calls > 0) ? (double) udp_server.received / udp_server.calls : 0.0);
+	}
+	if (xdp_port.socket >= 0) {
+		admin_reply(connection, "xdp ifindex=%d queue=%d received=%llu sent=%llu dropped=%llu per_call=%.2f\n",
+				xdp_port.ifindex, xdp_port.queue, xdp_port.received, xdp_port.sent, xdp_port.dropped,
+				(xdp_port.calls > 0) ? (double) xdp_port.received / xdp_port.calls : 0.0);
+	}
+	for (int i = 0; i < tenant_table.count; i++) {
+		Tenant *tenant = &tenant_table.tenants[i];
+		admin_reply(connection, "tenant %s requests=%lu generated=%lu rejected=%lu rate_limited=%lu\n", tenant->name,
+				tenant->metrics.requests, tenant->metrics.generated, tenant->metrics.rejected, tenant->metrics.rate_limited);
+	}
+	for (int i = 0; i < AUTH_TABLE_SIZE; i++) {
+		if (key_table.slots[i].used) {
+			admin_reply(connection, "key %s requests=%lu\n", key_table.slots[i].key_id, key_table.slots[i].requests);
+		}
+	}
+}
+
+
+/**
+ * @brief Sends one folded stack of a profile to an admin connection.
+ * @param[in] stack: the frames, outermost first.
+ * @param[in] count: the samples of the stack.
+ * @param[in] context: the admin connection.
+ */
+static void write_folded_stack(const char *stack, unsigned long count, void *context) {
+	admin_reply((AdminConnection *) context, "%s %lu\n", stack, count);
+}
+
+
+/**
+ * @brief Stops the running profile and sends its folded stacks to the admin connection that started it.
+ * The counters go to stderr, as the reply must stay a valid folded stack file.
+ */
+static void finish_profile(void) {
+	unsigned long samples, dropped;
+	stop_profile();
+	profile_counters(&samples, &dropped);
+	fprintf(stderr, "Profile done: %lu samples, %lu dropped.\n", samples, dropped);
+	if (profile_requester >= 0 && admin_connections[profile_requester].socket == profile_requester_socket) {
+		dump_profile(write_folded_stack, &admin_connections[profile_requester]);
+	}
+	profile_requester = -1;
+	profile_requester_socket = -1;
+}
+
+
+/**
+ * @brief Answers an HTTP request line received on the admin channel.
+ * Only `GET /healthz` is served: 200 when the server is ready, 503 otherwise. The admin channel is a
+ * Unix domain socket, so this endpoint is local to the host; remote balancers probe the service port
+ * with the `HELLO_HEALTH` opcode instead.
+ * @param[in] connection: the admin connection.
+ * @param[in] path: the requested path.
+ */
+static void admin_http(AdminConnection *connection, const char *path) {
+	if (strcmp(path, "/healthz") != 0) {
+		admin_reply(connection, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		return;
+	}
+	HealthResponse health_msg = check_health();
+	char body[128];
+	int body_len = snprintf(body, sizeof(body), "{\"live\":%s,\"ready\":%s,\"loop\":%s,\"rng\":%s,\"capacity\":%s}\n",
+			health_msg.live ? "true" : "false", health_msg.ready ? "true" : "false",
+			(health_msg.checks & HEALTH_LOOP) ? "true" : "false", (health_msg.checks & HEALTH_RNG) ? "true" : "false",
+			(health_msg.checks & HEALTH_CAPACITY) ? "true" : "false");
+	admin_reply(connection, "HTTP/1.0 %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+			"Connection: close\r\n\r\n%s", health_msg.ready ? "200 OK" : "503 Service Unavailable", body_len, body);
+}
+
+
+/**
+ * @brief Parses and runs an admin command, then sends `ok` or an `error:` line.
+ * @param[in/out] connection: the admin connection, whose `line` holds the command.
+ * @param[in] admin_token: the token required before other commands, NULL if none.
+ * @return `true` if the connection stays open, `false` if it must be closed.
+ */
+static bool run_admin_command(AdminConnection *connection, const char *admin_token) {
+	char command[32] = "";
+	char argument[ADMIN_LINE_SIZE] = "";
+	sscanf(connection->line, "%31s %255s", command, argument);
+	ServerConfig next = *config;
+
+	// HTTP health checks are answered without authentication, then the connection is closed
+	if (strcmp(command, "GET") == 0) {
+		admin_http(connection, argument);
+		return false;
+	}
+
+	if (strcmp(command, "auth") == 0) {
+		connection->authenticated = admin_token == NULL || check_admin_token(admin_token, argument);
+		admin_reply(connection, connection->authenticated ? "ok\n" : "error: invalid token\n");
+		return true;
+	}
+	if (!connection->authenticated) {
+		admin_reply(connection, "error: authentication required\n");
+		return true;
+	}
+
+	if (strcmp(command, "help") == 0) {
+		admin_reply(connection,
+				"auth <token>             authenticate the admin connection\n"
+				"sessions                 list the open sessions\n"
+				"kick <handle>            close the session of a handle listed by sessions\n"
+				"idle <seconds>           close sessions silent for longer, 0 to keep them\n"
+				"stats                    dump counters, stage histograms and tenant metrics\n"
+				"limit <n>                set the maximum number of concurrent sessions\n"
+				"log <error|info|debug>   set the log level\n"
+				"trace <on|off>           start or stop trace capture to " TRACE_FILE "\n"
+				"spans <target|off>       export spans of sampled requests to a file or udp:host:port\n"
+				"poll <busy|block>        spin the event loop or sleep in select()\n"
+				"perf <on|off>            sample hardware counters per stage, one request in 16\n"
+				"profile <seconds>        sample the event loop stacks, then reply with folded stacks\n"
+				"profile dump             reply again with the folded stacks of the last profile\n"
+				"drain                    refuse new connections and exit after the last session\n"
+				"shutdown                 close every session and exit\n");
+	} else if (strcmp(command, "sessions") == 0) {
+		admin_sessions(connection);
+	} else if (strcmp(command, "stats") == 0) {
+		admin_stats(connection);
+	} else if (strcmp(command, "kick") == 0) {
+		// Handles come from the `sessions` listing: a session ended since then is not mistaken for a new one
+		int slot = session_slot(session_table, (SessionHandle) strtoul(argument, NULL, 16));
+		if (slot < 0) {
+			admin_reply(connection, "error: no such session, it may have ended\n");
+			return true;
+		}
+		end_session(slot);
+	} else if (strcmp(command, "idle") == 0) {
+		double idle_timeout = atof(argument);
+		if (idle_timeout < 0) {
+			admin_reply(connection, "error: the idle timeout must be 0 or more seconds\n");
+			return true;
+		}
+		next.idle_timeout = idle_timeout;
+		update_config(&next);
+		// Deadlines follow the new timeout from the next byte received; reset them now so it applies at once
+		double now = monotonic_seconds();
+		for (int slot = 0; slot < SESSION_SLOTS; slot++) {
+			touch_session(session_table, slot, now, idle_timeout);
+		}
+	} else if (strcmp(command, "limit") == 0) {
+		int limit = atoi(argument);
+		if (limit < 1 || limit > MAX_SESSIONS) {
+			admin_reply(connection, "error: limit must be between 1 and %d\n", MAX_SESSIONS);
+			return true;
+		}
+		next.session_limit = limit;
+		update_config(&next);
+	} else if (strcmp(command, "log") == 0) {
+		if (strcmp(argument, "error") == 0) {
+			set_log_level(LEVEL_ERROR);
+		} else if (strcmp(argument, "info") == 0) {
+			set_log_level(LEVEL_INFO);
+		} else if (strcmp(argument, "debug") == 0) {
+			set_log_level(LEVEL_DEBUG);
+		} else {
+			admin_reply(connection, "error: unknown log level\n");
+			return true;
+		}
+	} else if (strcmp(command, "trace") == 0) {
+		if (strcmp(argument, "on") == 0) {
+			if (trace_file == NULL) {
+				trace_file = fopen(TRACE_FILE, "a");
+				if (trace_file != NULL) {
+					setvbuf(trace_file, trace_buffer, _IOFBF, sizeof(trace_buffer));
+				}
+			}
+			if (trace_file == NULL) {
+				admin_reply(connection, "error: cannot open " TRACE_FILE "\n");
+				return true;
+			}
+			next.trace_enabled = true;
+		} else if (strcmp(argument, "off") == 0) {
+			next.trace_enabled = false;
+			if (trace_file != NULL) {
+				fclose(trace_file);
+				trace_file = NULL;
+			}
+		} else {
+			admin_reply(connection, "error: expected on or off\n");
+			return true;
+		}
+		update_config(&next);
+	} else if (strcmp(command, "spans") == 0) {
+		// Spans still in the ring go to the new target; with the exporter off they are discarded
+		close_span_exporter(&span_exporter);
+		if (strcmp(argument, "off") != 0 && !open_span_exporter(&span_exporter, argument, monotonic_seconds())) {
+			admin_reply(connection, "error: cannot open the span target\n");
+			return true;
+		}
+	} else if (strcmp(command, "profile") == 0) {
+		if (strcmp(argument, "dump") == 0) {
+			if (profile_running()) {
+				admin_reply(connection, "error: a profile is running\n");
+				return true;
+			}
+			dump_profile(write_folded_stack, connection);
+			return true;
+		}
+		char reason[96];
+		if (!start_profile(atoi(argument), monotonic_seconds(), reason, sizeof(reason))) {
+			admin_reply(connection, "error: %s\n", reason);
+			return true;
+		}
+		// The folded stacks are the reply, sent by the event loop once the profile is over
+		profile_requester = (int) (connection - admin_connections);
+		profile_requester_socket = connection->socket;
+		return true;
+	} else if (strcmp(command, "poll") == 0) {
+		if (strcmp(argument, "busy") == 0) {
+			next.busy_poll = true;
+		} else if (strcmp(argument, "block") == 0) {
+			next.busy_poll = false;
+		} else {
+			admin_reply(connection, "error: expected busy or block\n");
+			return true;
+		}
+		update_config(&next);
+	} else if (strcmp(command, "perf") == 0) {
+		if (strcmp(argument, "on") == 0) {
+			if (perf_counters.leader < 0) {
+				memset(perf_stages, 0, sizeof(perf_stages));
+				if (open_perf_counters(&perf_counters) == 0) {
+					admin_reply(connection, "error: perf_event_open() failed, check kernel.perf_event_paranoid\n");
+					return true;
+				}
+			}
+		} else if (strcmp(argument, "off") == 0) {
+			close_perf_counters(&perf_counters);
+		} else {
+			admin_reply(connection, "error: expected on or off\n");
+			return true;
+		}
+	} else if (strcmp(command, "drain") == 0) {
+		next.draining = true;
+		update_config(&next);
+	} else if (strcmp(command, "shutdown") == 0) {
+		running = false;
+	} else {
+		admin_reply(connection, "error: unknown command, try help\n");
+		return true;
+	}
+	admin_reply(connection, "ok\n");
+	return true;
+}
+
+
+/**
+ * @brief Accepts an admin connection.
+ * @param[in] admin_socket: the listening admin socket.
+ * @param[in] admin_token: the token required before other commands, NULL if none.
+ */
+static void accept_admin(int admin_socket, const char *admin_token) {
+	int connection_socket = accept(admin_socket, NULL, NULL);
+	if (connection_socket < 0) {
+		return;
+	}
+	for (int i = 0; i < MAX_ADMIN_CONNECTIONS; i++) {
+		if (admin_connections[i].socket < 0) {
+			admin_connections[i].socket = connection_socket;
+			admin_connections[i].authenticated = admin_token == NULL;
+			admin_connections[i].input_len = 0;
+			return;
+		}
+	}
+	closesocket(connection_socket);  /**< Every admin slot is busy */
+}
+
+/* - - - - - - - - - - - - - - - - - - - END ADMIN - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - BENCHMARK - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Checks the arguments of `--bench-generate`.
+ * @param[in] type: the password type, a single character of `DEFAULT_TYPES`.
+ * @param[in] length: the password length, between 1 and `MAX_PASSWORD_LENGTH`.
+ * @param[in] count: the number of measured passwords, at least 1.
+ * @return `true` if every argument is valid.
+ */
+static bool bench_arguments_valid(const char *type, const char *length, const char *count) {
+	int password_length = atoi(length);
+	return strlen(type) == 1 && strchr(DEFAULT_TYPES, type[0]) != NULL
+			&& password_length >= 1 && password_length <= MAX_PASSWORD_LENGTH && atol(count) >= 1;
+}
+
+
+/**
+ * @brief Measures password generation alone, without sockets.
+ *
+ * A tenth of `count` passwords warms the caches and the branch predictors, then `count` passwords
+ * are generated between two reads of the hardware counters. Time and counters are printed per
+ * password on a single `key=value` line.
+ *
+ * @param[in] type: the password type character, as sent by clients.
+ * @param[in] length: the password length.
+ * @param[in] count: the number of measured passwords.
+ * @return `true` if the parameters are valid.
+ */
+static bool run_generate_bench(char type, int length, long count) {
+	if (length < 1 || length > MAX_PASSWORD_LENGTH || count < 1) {
+		return false;
+	}
+	char password[MAX_PASSWORD_LENGTH + 1];
+	PasswordType password_type = password_type_of(type);
+	unsigned char seed[CHACHA_KEY_SIZE];
+	if (!fill_random(seed, sizeof(seed))) {
+		errorhandler("No entropy source available to seed the password generator.\n");
+		return false;
+	}
+	seed_password_generator(seed);
+
+	unsigned long checksum = 0;  /**< Consumes every password, so no generation can be optimized away */
+	for (long i = 0; i < count / 10; i++) {
+		generate_password(password, password_type, length);
+		checksum += (unsigned char) password[0];
+	}
+
+	PerfCounters counters;
+	PerfStats bench_stats;
+	PerfSample begin, end;
+	memset(&bench_stats, 0, sizeof(bench_stats));
+	open_perf_counters(&counters);
+	double begin_time = monotonic_seconds();
+	read_perf_counters(&counters, &begin);
+	for (long i = 0; i < count; i++) {
+		generate_password(password, password_type, length);
+		checksum += (unsigned char) password[0];
+	}
+	read_perf_counters(&counters, &end);
+	double seconds = monotonic_seconds() - begin_time;
+	record_perf_sample(&bench_stats, &begin, &end, count);
+
+	char line[ADMIN_REPLY_SIZE];
+	format_perf_stats(&bench_stats, &counters, "generate", line, sizeof(line));
+	printf("bench type=%c length=%d kernel=%s ns_per_password=%.1f checksum=%lu\n%s", type, length,
+			chacha_kernel_name(), seconds * 1e9 / count, checksum, line);
+	if (counters.leader < 0) {
+		printf("Hardware counters unavailable, check kernel.perf_event_paranoid\n");
+	}
+	close_perf_counters(&counters);
+	return true;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END BENCHMARK - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - SHARDS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Forks one process per shard of `shard_group`, then waits for them in the parent.
+ * SIGINT and SIGTERM received by the parent are forwarded to every shard.
+ * @return the index of the shard in a shard process, -1 in the parent once every shard has exited.
+ */
+static int fork_shards(void) {
+#if !defined WIN32
+	pid_t children[MAX_SHARDS];
+	int alive = 0;
+	for (int i = 0; i < shard_group.count; i++) {
+		children[i] = fork();
+		if (children[i] == 0) {
+			return i;
+		}
+		if (children[i] < 0) {
+			errorhandler("Cannot fork a shard.\n");
+		} else {
+			alive++;
+		}
+	}
+	keep_shard(&shard_group, -1);
+
+	struct sigaction stop_action;
+	memset(&stop_action, 0, sizeof(stop_action));
+	stop_action.sa_handler = stop_server;  /**< No SA_RESTART: sleep() returns at once */
+	sigaction(SIGINT, &stop_action, NULL);
+	sigaction(SIGTERM, &stop_action, NULL);
+
+	// Poll rather than block in waitpid(), so a stop signal is never missed between the check and the wait
+	bool forwarded = false;
+	while (alive > 0) {
+		if (!running && !forwarded) {
+			for (int i = 0; i < shard_group.count; i++) {
+				if (children[i] > 0) {
+					kill(children[i], SIGTERM);
+				}
+			}
+			forwarded = true;
+		}
+		pid_t exited = waitpid(-1, NULL, WNOHANG);
+		if (exited > 0) {
+			alive--;
+		} else if (exited < 0 && errno != EINTR) {
+			break;
+		} else if (exited == 0) {
+			sleep(1);
+		}
+	}
+#endif
+	return -1;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END SHARDS - - - - - - - - - - - - - - - - - - - - */
+
+
+/**
+ * @brief Usage:
+ *   TCP_server [--port N] [--busy-poll] [--cpu N] [--alloc-check]
+ *                                                password generation server; --busy-poll spins the
+ *                                                event loop instead of sleeping, --cpu pins it to a core,
+ *                                                --alloc-check aborts if a request allocates after warmup
+ *                                                (needs a build with -DALLOC_COUNT)
+ *   TCP_server [--port N] --proxy host:port,...  proxy forwarding every client to the healthy
+ *                                                backend with the fewest connections
+ *   TCP_server --bench-generate TYPE LENGTH N    time N passwords of a type and length and print
+ *                                                hardware counters per password
+ *   --rng-kernel scalar|avx2|avx512 forces the ChaCha20 kernel, which is otherwise the fastest the CPU runs
+ *   --address IP listens on IP instead of DEFAULT_IP; --udp also answers UdpRequest datagrams on the
+ *   same port; --xdp IFACE[:QUEUE] takes them from the interface through AF_XDP instead (implies --udp)
+ *   --shards N forks N event loops, each pinned to its own CPU and listening on the port through
+ *   SO_REUSEPORT; new connections are steered to the shard of the CPU that received them. Admin
+ *   channels are per shard, at ADMIN_SOCKET_PATH.<shard>. Not combined with --proxy, --udp or --xdp.
+ *   --idle SECONDS closes the sessions silent for that long, which are otherwise kept open for good
+ *   (the admin `idle` command changes it while running)
+ *   --spans TARGET exports the spans of requests carrying a sampled trace context as OTLP/JSON lines,
+ *   appended to the file TARGET or sent to a local collector given as udp:HOST:PORT
+ * Health: remote probes send the HELLO_HEALTH opcode on the service port, which is answered even when
+ * every session is taken; GET /healthz is served on the admin channel only, so it is local to the host.
+ */
+int main(int argc, char *argv[]) {
+	int port = DEFAULT_PORT;  /**< Listening port */
+	const char *backend_list = NULL;  /**< Backends of the proxy mode, NULL to generate passwords */
+	int cpu = -1;  /**< CPU the event loop is pinned to, -1 to let the scheduler choose */
+	const char *address = DEFAULT_IP;  /**< Listening address */
+	bool udp_mode = false;  /**< Whether UDP requests are served */
+	const char *xdp_interface = NULL;  /**< Interface of the AF_XDP fast path, NULL if off */
+	int xdp_queue = 0;  /**< Receive queue of the AF_XDP fast path */
+	int shards = 0;  /**< Event loops forked by the sharded mode, 0 for a single unforked loop */
+	char admin_path[sizeof(ADMIN_SOCKET_PATH) + 8];  /**< Path of the admin channel, per shard when sharded */
+	const char *span_target = NULL;  /**< Destination of the spans of sampled requests, NULL if off */
+	init_perf_counters(&perf_counters);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+			port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--proxy") == 0 && i + 1 < argc) {
+			backend_list = argv[++i];
+		} else if (strcmp(argv[i], "--busy-poll") == 0) {
+			configs[0].busy_poll = true;
+		} else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+			cpu = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--alloc-check") == 0) {
+			alloc_check = true;
+		} else if (strcmp(argv[i], "--address") == 0 && i + 1 < argc) {
+			address = argv[++i];
+		} else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+			shards = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--udp") == 0) {
+			udp_mode = true;
+		} else if (strcmp(argv[i], "--idle") == 0 && i + 1 < argc && atof(argv[i + 1]) >= 0) {
+			configs[0].idle_timeout = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--spans") == 0 && i + 1 < argc) {
+			span_target = argv[++i];
+		} else if (strcmp(argv[i], "--xdp") == 0 && i + 1 < argc) {
+			static char interface[64];
+			snprintf(interface, sizeof(interface), "%s", argv[++i]);
+			char *queue = strchr(interface, ':');
+			if (queue != NULL) {
+				*queue = '\0';
+				xdp_queue = atoi(queue + 1);
+			}
+			xdp_interface = interface;
+			udp_mode = true;
+		} else if (strcmp(argv[i], "--rng-kernel") == 0 && i + 1 < argc) {
+			if (!select_chacha_kernel(argv[++i])) {
+				printf("ChaCha20 kernel %s not supported by this CPU or build\n", argv[i]);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "--bench-generate") == 0 && i + 3 < argc
+				&& bench_arguments_valid(argv[i + 1], argv[i + 2], argv[i + 3])) {
+			bool valid = run_generate_bench(argv[i + 1][0], atoi(argv[i + 2]), atol(argv[i + 3]));
+			return valid ? 0 : -1;
+		} else {
+			printf("Usage: %s [--port N] [--address IP] [--busy-poll] [--cpu N] [--alloc-check] [--rng-kernel NAME]\n"
+					"       [--idle SECONDS] [--udp] [--xdp IFACE[:QUEUE]] [--shards N] [--spans TARGET] [--proxy host:port,...]\n"
+					"       %s [--rng-kernel NAME] --bench-generate TYPE LENGTH N\n", argv[0], argv[0]);
+			return -1;
+		}
+	}
+	if (alloc_check && !allocations_counted()) {
+		errorhandler("--alloc-check needs a build with -DALLOC_COUNT.\n");
+		return -1;
+	}
+	if (shards < 0 || shards > MAX_SHARDS || (shards > 0 && (backend_list != NULL || udp_mode))) {
+		errorhandler("--shards takes 1 to MAX_SHARDS event loops and excludes --proxy, --udp and --xdp.\n");
+		return -1;
+	}
 
 #if defined WIN32
 	// Initialize Winsock
@@ -66,178 +1550,369 @@ int main() {
 	}
 #endif
 
-	// Create a welcome socket for the server to listen for incoming client connections
-	int my_socket;
-	my_socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);  /**< Create the server socket */
-	if (my_socket < 0) {
-		closesocket(my_socket);  /**< Close the socket */
-		clearwinsock();  /**< Clean up Winsock */
-		#if defined WIN32
-			Sleep(3000);  /**< Wait before exiting */
-		#endif
-		return -1;
-	}
-
-	// Set up the socket address structure for binding the socket
-	struct sockaddr_in sad;  /**< Socket address structure for binding */
-	memset(&sad, 0, sizeof(sad));  /**< Clear the structure */
-	sad.sin_family = AF_INET;  /**< Set the address family to AF_INET (IPv4) */
-	sad.sin_addr.s_addr = inet_addr(DEFAULT_IP);  /**< Set the server's IP address */
-	sad.sin_port = htons(DEFAULT_PORT);  /**< Convert port number to network byte order */
-
-	// Bind the socket to the IP address and port
-	if (bind(my_socket, (struct sockaddr*) &sad, sizeof(sad)) < 0) {
-		errorhandler("Bind failed.\n");
-		closesocket(my_socket);  /**< Close the socket */
-		clearwinsock();  /**< Clean up Winsock */
-		#if defined WIN32
-			Sleep(3000);  /**< Wait before exiting */
-		#endif
-		return -1;
-	}
+	int my_socket;  /**< Listening socket of the event loop */
+	snprintf(admin_path, sizeof(admin_path), "%s", ADMIN_SOCKET_PATH);
+	if (shards > 0) {
+		// Open every shard listener before forking, so the steering sees the whole group
+		if (!open_shard_listeners(&shard_group, address, port, shards, QLEN)) {
+			errorhandler("Cannot open the shard listeners.\n");
+			clearwinsock();  /**< Clean up Winsock */
+			return -1;
+		}
+		char reason[128];
+		ShardSteering steering = steer_shards(&shard_group, reason, sizeof(reason));
+		printf("%d shards on port %d, steering: %s", shards, port, steering_name(steering));
+		if (steering != STEERING_BPF) {
+			printf(" (eBPF steering unavailable: %s)", reason);
+		}
+		printf("\n");
+		fflush(stdout);  /**< Do not let the shards inherit buffered output */
 
-	// Listen for incoming connections on the socket with a queue length of QLEN
-	if (listen(my_socket, QLEN) < 0) {
-		errorhandler("Listen failed.\n");
-		closesocket(my_socket);  /**< Close the socket */
-		clearwinsock();  /**< Clean up Winsock */
-		#if defined WIN32
-			Sleep(3000);  /**< Wait before exiting */
-		#endif
-		return -1;
-	}
+		shard = fork_shards();
+		if (shard < 0) {
+			clearwinsock();  /**< Clean up Winsock */
+			return 0;
+		}
+		my_socket = keep_shard(&shard_group, shard);
+		cpu = shard_cpu(shard);
+		snprintf(admin_path, sizeof(admin_path), "%s.%d", ADMIN_SOCKET_PATH, shard);
+	} else {
+		// Create a welcome socket for the server to listen for incoming client connections
+		my_socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);  /**< Create the server socket */
+		if (my_socket < 0) {
+			closesocket(my_socket);  /**< Close the socket */
+			clearwinsock();  /**< Clean up Winsock */
+			#if defined WIN32
+				Sleep(3000);  /**< Wait before exiting */
+			#endif
+			return -1;
+		}
 
-	// Accept new client connections in an infinite loop
-	struct sockaddr_in cad;  /**< Client address structure */
-	int client_socket;  /**< Socket descriptor for the client */
-	int client_len;  /**< Size of the client address structure */
-	print_with_color("Waiting for a client to connect...\n\n", BLUE);
+	#if !defined WIN32
+		// Allow a restarted server to bind while connections of the previous one are in TIME_WAIT
+		int reuse = 1;
+		setsockopt(my_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	#endif
 
-	while (1) {
-		client_len = sizeof(cad); /**< Set the size of the client address structure */
+		// Set up the socket address structure for binding the socket
+		struct sockaddr_in sad;  /**< Socket address structure for binding */
+		memset(&sad, 0, sizeof(sad));  /**< Clear the structure */
+		sad.sin_family = AF_INET;  /**< Set the address family to AF_INET (IPv4) */
+		sad.sin_addr.s_addr = inet_addr(address);  /**< Set the server's IP address */
+		sad.sin_port = htons(port);  /**< Convert port number to network byte order */
 
-		// Accept a client connection
-		if ((client_socket = accept(my_socket, (struct sockaddr*) &cad, &client_len)) < 0) {
-			errorhandler("Accept failed (Client connection).\n");
-			closesocket(client_socket);  /**< Close the socket */
+		// Bind the socket to the IP address and port
+		if (bind(my_socket, (struct sockaddr*) &sad, sizeof(sad)) < 0) {
+			errorhandler("Bind failed.\n");
+			closesocket(my_socket);  /**< Close the socket */
 			clearwinsock();  /**< Clean up Winsock */
 			#if defined WIN32
 				Sleep(3000);  /**< Wait before exiting */
 			#endif
-			return 0;
+			return -1;
 		}
 
-		// Print client's IP address and port number
-		print_with_color("New connection from ", GREEN);
-		print_with_color(inet_ntoa(cad.sin_addr),YELLOW);
-		print_with_color(":", CYAN);
-		printf("%d\n",ntohs(cad.sin_port));
-
-		// Create the menu to send to the client
-		MenuMessage menu_msg;
-		snprintf(menu_msg.menu_text, sizeof(menu_msg.menu_text),
-				"Insert the type of password and its length (between 6 and 32):\n"
-				"  n: numeric password (only digits)\n"
-				"  a: alphabetic password (only lowercase letters)\n"
-				"  m: mixed password (lowercase letters and digits)\n"
-				"  s: secure password (uppercase letters, lowercase letters, digits, and symbols)\n"
-				"  q: to close the connection\n"
-				"? ");
-
-		// Send the menu to the client
-		if (send(client_socket, &menu_msg, sizeof(menu_msg), 0) != sizeof(menu_msg)) {
-			errorhandler("send() sent a different number of bytes than expected (Menu).\n");
-			closesocket(client_socket);  /**< Close the socket */
+		// Listen for incoming connections on the socket with a queue length of QLEN
+		if (listen(my_socket, QLEN) < 0) {
+			errorhandler("Listen failed.\n");
+			closesocket(my_socket);  /**< Close the socket */
 			clearwinsock();  /**< Clean up Winsock */
 			#if defined WIN32
 				Sleep(3000);  /**< Wait before exiting */
 			#endif
 			return -1;
 		}
+	}
+
+	// Pin the event loop to its core: a spinning loop must not migrate or share the core
+	if (cpu >= 0) {
+		if (pin_to_cpu(cpu)) {
+			printf("Event loop pinned to CPU %d\n", cpu);
+			// Every table is first touched after this point, so its pages come from the node of the CPU
+			if (use_local_memory()) {
+				printf("Memory placed on NUMA node %d\n", current_node());
+			}
+		} else {
+			printf("Cannot pin the event loop to CPU %d\n", cpu);
+		}
+	}
 
+#if !defined WIN32
+	// Leave the event loop on SIGINT and SIGTERM, so sessions and proxied links are closed and profiles are written at exit
+	struct sigaction stop_action;
+	memset(&stop_action, 0, sizeof(stop_action));
+	stop_action.sa_handler = stop_server;  /**< No SA_RESTART: select() returns at once */
+	sigaction(SIGINT, &stop_action, NULL);
+	sigaction(SIGTERM, &stop_action, NULL);
 
-		// Handle password generation in a loop
-		PasswordRequest password_msg;
-		PasswordResponse response_msg;
-		do{
-			// Receive password type and length from the client
-			if (recv(client_socket, &password_msg, sizeof(password_msg), 0) <= 0) {
-				errorhandler("recv() failed or connection closed prematurely (Password settings).\n");
-				closesocket(client_socket);  /**< Close the socket */
-				clearwinsock();  /**< Clean up Winsock */
-				#if defined WIN32
-					Sleep(3000);  /**< Wait before exiting */
-				#endif
-				return -1;
+	// A client resetting its connection before reading a response must fail that send() or splice(),
+	// not kill the server or the proxy
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	// Forward the clients to the backends: authentication and generation are left to them
+	if (backend_list != NULL) {
+		static Proxy proxy;  /**< Backends and forwarded connections */
+		if (parse_backends(&proxy, backend_list) <= 0) {
+			errorhandler("Invalid backend list, expected host:port[,host:port...].\n");
+		} else {
+			printf("Proxy mode, forwarding to %d backends\n", proxy.backend_count);
+			run_proxy(&proxy, my_socket, &running);
+		}
+		closesocket(my_socket);
+		clearwinsock();  /**< Clean up Winsock */
+		return 0;
+	}
+
+	// Allocate the session table, faulting its pages in before the first client
+	session_table = alloc_local(sizeof(SessionTable));
+	if (session_table == NULL) {
+		errorhandler("Cannot allocate the session table.\n");
+		closesocket(my_socket);
+		clearwinsock();  /**< Clean up Winsock */
+		return -1;
+	}
+
+	// Load the API keys: authentication is required only if the key file exists
+	auth_enabled = load_keys(&key_table, KEYS_FILE) >= 0;
+	if (auth_enabled) {
+		printf("Authentication enabled, %d API keys loaded from %s\n", key_table.count, KEYS_FILE);
+	} else {
+		print_with_color("Key file not found, authentication disabled.\n", CYAN);
+	}
+
+	// Load the tenants and bind every API key to its tenant
+	int tenants_loaded = load_tenants(&tenant_table, TENANTS_FILE, DEFAULT_TYPES);
+	if (tenants_loaded == -2) {
+		errorhandler("Invalid tenant file, refusing to start.\n");
+		closesocket(my_socket);
+		clearwinsock();  /**< Clean up Winsock */
+		return -1;
+	}
+	if (tenants_loaded >= 0) {
+		printf("%d tenants loaded from %s\n", tenants_loaded, TENANTS_FILE);
+	}
+	for (int i = 0; i < AUTH_TABLE_SIZE; i++) {
+		ApiKey *key = &key_table.slots[i];
+		if (key->used) {
+			key->tenant_index = (key->tenant[0] != '\0') ? find_tenant(&tenant_table, key->tenant) : DEFAULT_TENANT;
+			if (key->tenant_index < 0) {
+				printf("Unknown tenant %s for key %s, using the default tenant\n", key->tenant, key->key_id);
+				key->tenant_index = DEFAULT_TENANT;
 			}
+		}
+	}
+
+	// Seed the password generator from an unpredictable source
+	unsigned char seed[CHACHA_KEY_SIZE];
+	if (!fill_random(seed, sizeof(seed))) {
+		errorhandler("No entropy source available to seed the password generator, refusing to start.\n");
+		closesocket(my_socket);
+		clearwinsock();  /**< Clean up Winsock */
+		return -1;
+	}
+	seed_password_generator(seed);
+	printf("Password generator: ChaCha20, %s kernel\n", chacha_kernel_name());
 
-			// Check if the server should continue generating passwords
-			response_msg.keep_going = keep_generating(password_msg.type, 'q');
-			if(response_msg.keep_going) {
-				// Validate password type and length using control functions from password.h
-				if(control_type("nams", password_msg.type)) {
-					if(control_length(password_msg.length, MIN_PASSWORD_LENGTH, MAX_PASSWORD_LENGTH)) {
-						int numerical_length = atoi(password_msg.length); // Convert the string containing the length without the initial space
-						// Determine the password type
-						PasswordType password_type;
-						switch (tolower(password_msg.type)) {
-							case 'n':
-								password_type = NUMERIC;
-								break;
-							case 'a':
-								password_type = ALPHA;
-								break;
-							case 'm':
-								password_type = MIXED;
-								break;
-							case 's':
-								password_type = SECURE;
-								break;
-						}
-						// Generate password
-						generate_password(response_msg.password, password_type, numerical_length);
-						strcpy(response_msg.error_msg, ""); // Error message absent
-						response_msg.request_error = false;	// No error found
+	// Open the admin control channel
+	const char *admin_token = getenv(ADMIN_TOKEN_ENV);  /**< Token required on admin connections, NULL if none */
+	int admin_socket = open_admin_socket(admin_path);
+	for (int i = 0; i < MAX_ADMIN_CONNECTIONS; i++) {
+		admin_connections[i].socket = -1;
+	}
+	if (admin_socket >= 0) {
+		printf("Admin channel listening on %s\n", admin_path);
+	}
 
-					}
-					else {
-						// Handle invalid length error
-						strcpy(response_msg.password, "");  // No password generated
-						strcpy(response_msg.error_msg, "The length for the password is not valid.\n"); // Error message for the length
-						response_msg.request_error = true;	// Error found for the password length
+	// Open the UDP request mode and its AF_XDP fast path
+	if (udp_mode) {
+		if (open_udp_server(&udp_server, address, port)) {
+			printf("UDP requests served on %s:%d\n", address, port);
+		} else {
+			errorhandler("Cannot open the UDP socket.\n");
+		}
+	}
+	if (xdp_interface != NULL) {
+		char reason[128];
+		if (open_xdp_port(&xdp_port, xdp_interface, xdp_queue, port, reason, sizeof(reason))) {
+			printf("AF_XDP fast path on %s queue %d\n", xdp_interface, xdp_queue);
+		} else {
+			printf("AF_XDP fast path unavailable (%s), UDP requests use the socket\n", reason);
+		}
+	}
+
+	// Every shard records into its own ring, with identifiers seeded by its process id
+	init_span_ring(&span_ring);
+	if (span_target != NULL && !open_span_exporter(&span_exporter, span_target, monotonic_seconds())) {
+		printf("Cannot open the span target %s, spans are not exported\n", span_target);
+	}
+
+	// Serve client and admin connections in an event loop
+	started = monotonic_seconds();
+	double next_sweep = started;  /**< Time of the next idle timeout sweep */
+	print_with_color("Waiting for a client to connect...\n\n", BLUE);
+
+	while (running) {
+		fd_set read_set;  /**< Sockets watched for incoming data */
+		fd_set write_set;  /**< Sessions with queued responses or stream credits, watched for room in their send buffer */
+		int max_socket = -1;
+		FD_ZERO(&read_set);
+		FD_ZERO(&write_set);
+		bool accept_paused = accept_paused_until > monotonic_seconds();
+		// Past the limit only handshakes are accepted, into the reserve: probes are answered, clients refused
+		if (!config->draining && session_table->count < config->session_limit + HANDSHAKE_SLOTS && !accept_paused) {
+			FD_SET(my_socket, &read_set);
+			max_socket = my_socket;
+		}
+		if (admin_socket >= 0) {
+			FD_SET(admin_socket, &read_set);
+			max_socket = (admin_socket > max_socket) ? admin_socket : max_socket;
+		}
+		if (udp_server.socket >= 0) {
+			FD_SET(udp_server.socket, &read_set);
+			max_socket = (udp_server.socket > max_socket) ? udp_server.socket : max_socket;
+		}
+		if (xdp_port.socket >= 0) {
+			FD_SET(xdp_port.socket, &read_set);
+			max_socket = (xdp_port.socket > max_socket) ? xdp_port.socket : max_socket;
+		}
+		for (int i = 0; i < MAX_ADMIN_CONNECTIONS; i++) {
+			if (admin_connections[i].socket >= 0) {
+				FD_SET(admin_connections[i].socket, &read_set);
+				max_socket = (admin_connections[i].socket > max_socket) ? admin_connections[i].socket : max_socket;
+			}
+		}
+		for (int slot = 0; slot < SESSION_SLOTS; slot++) {
+			if (session_table->states[slot] != SESSION_FREE) {
+				int socket = session_table->sockets[slot];
+				if (session_table->outputs[slot] != NULL) {
+					FD_SET(socket, &write_set);  /**< A client behind on its responses sends nothing more until it catches up */
+				} else {
+					FD_SET(socket, &read_set);
+					if (session_table->credits[slot] > 0) {
+						FD_SET(socket, &write_set);
 					}
 				}
-				else {
-					// Handle invalid type error
-					strcpy(response_msg.password, ""); // No password generated
-					strcpy(response_msg.error_msg, "The type inserted is not valid.\n"); // Error message for the type
-					response_msg.request_error = true;	// Error found for the type
+				max_socket = (socket > max_socket) ? socket : max_socket;
+			}
+		}
+
+		// Busy polling checks the sockets without sleeping; otherwise wake up every second to notice drain completion
+		struct timeval timeout = { config->busy_poll ? 0 : 1, 0 };
+		if (accept_paused && !config->busy_poll) {
+			timeout.tv_sec = 0;
+			timeout.tv_usec = (long) (ACCEPT_BACKOFF_SECONDS * 1e6);
+		}
+		double wait_begin = monotonic_seconds();
+		int ready = select(max_socket + 1, &read_set, &write_set, NULL, &timeout);
+		if (ready < 0) {
+#if !defined WIN32
+			if (errno == EINTR) {
+				continue;  /**< Interrupted by a signal: the loop condition decides */
+			}
+#endif
+			errorhandler("select() failed.\n");
+			break;
+		}
+		double turn_begin = monotonic_seconds();
+		turn_began = turn_begin;
+
+		if (FD_ISSET(my_socket, &read_set)) {
+			accept_client(my_socket);
+		}
+		for (int slot = 0; slot < SESSION_SLOTS; slot++) {
+			if (session_table->states[slot] != SESSION_FREE && session_table->outputs[slot] != NULL
+					&& FD_ISSET(session_table->sockets[slot], &write_set)) {
+				flush_session(slot);
+			} else if (session_table->states[slot] != SESSION_FREE && FD_ISSET(session_table->sockets[slot], &read_set)) {
+				serve_session(slot);
+			}
+			if (session_table->states[slot] == SESSION_ACTIVE && session_table->credits[slot] > 0
+					&& session_table->outputs[slot] == NULL && FD_ISSET(session_table->sockets[slot], &write_set)) {
+				serve_stream(slot);
+			}
+		}
+		for (int i = 0; i < MAX_ADMIN_CONNECTIONS; i++) {
+			AdminConnection *connection = &admin_connections[i];
+			if (connection->socket >= 0 && FD_ISSET(connection->socket, &read_set)) {
+				// Run every command of the bytes received, as the socket will not signal them again
+				int status = read_admin_line(connection);
+				while (status > 0) {
+					status = run_admin_command(connection, admin_token) ? next_admin_line(connection) : -1;
+				}
+				if (status < 0) {
+					closesocket(connection->socket);
+					connection->socket = -1;
 				}
 			}
-			else  {
-				// No error, close connection
-				strcpy(response_msg.password, ""); // No password generated
-				strcpy(response_msg.error_msg, ""); // No error message
-				response_msg.request_error = false;	// No error found
-			}
-
-			// Send password generation response to the client
-			if (send(client_socket, &response_msg, sizeof(response_msg), 0) != sizeof(response_msg)) {
-				errorhandler("send() sent a different number of bytes than expected (Password response).\n");
-				closesocket(client_socket);  /**< Close the socket */
-				clearwinsock();  /**< Clean up Winsock */
-				#if defined WIN32
-					Sleep(3000);  /**< Wait before exiting */
-				#endif
-				return -1;
+		}
+		if (admin_socket >= 0 && FD_ISSET(admin_socket, &read_set)) {
+			accept_admin(admin_socket, admin_token);
+		}
+
+		// Drain a bounded number of full batches per turn, so UDP floods cannot starve the sessions
+		if (udp_server.socket >= 0 && FD_ISSET(udp_server.socket, &read_set)) {
+			for (int batch = 0; batch < UDP_TURN_BATCHES && serve_udp_batch(&udp_server, answer_udp_request) == UDP_BATCH; batch++) {
+			}
+		}
+		if (xdp_port.socket >= 0 && FD_ISSET(xdp_port.socket, &read_set)) {
+			for (int batch = 0; batch < UDP_TURN_BATCHES && serve_xdp_batch(&xdp_port, answer_udp_request) == UDP_BATCH; batch++) {
+			}
+		}
+
+		// Close the sessions silent, or still in their handshake, past their deadline, walking the
+		// deadline column once a second at most
+		if (turn_begin >= next_sweep) {
+			for (int slot = next_expired_session(session_table, 0, turn_begin); slot >= 0;
+					slot = next_expired_session(session_table, slot + 1, turn_begin)) {
+				bool handshake = session_table->states[slot] == SESSION_HANDSHAKE;
+				log_with_color(LEVEL_INFO, handshake ? "Handshake timeout: " : "Idle timeout: ", CYAN);
+				end_session(slot);
+				session_table->expired++;
 			}
+			next_sweep = turn_begin + 1.0;
+		}
+
+		if (profile_due(turn_begin)) {
+			finish_profile();
+		}
+
+		// One line of spans per turn at most: a burst of sampled requests is spread over the next turns
+		export_spans(&span_ring, &span_exporter, "TCP_server");
+
+		last_turn = monotonic_seconds() - turn_begin;
+		record_turn(&loop_stats, turn_begin - wait_begin, last_turn, ready);
 
-		} while(response_msg.keep_going);
+		if (config->draining && session_table->count == 0) {
+			print_with_color("Drain completed.\n", BLUE);
+			running = false;
+		}
+	}
 
-		// Closing the connection with the client
-		closesocket(client_socket); /**< Close the socket */
-		print_with_color("Connection with the client closed.\n\n", BLUE);
+	// Close every remaining connection before exit
+	for (int slot = 0; slot < SESSION_SLOTS; slot++) {
+		if (session_table->states[slot] != SESSION_FREE) {
+			end_session(slot);
+		}
+	}
+	for (int i = 0; i < MAX_ADMIN_CONNECTIONS; i++) {
+		if (admin_connections[i].socket >= 0) {
+			closesocket(admin_connections[i].socket);
+		}
+	}
+	close_admin_socket(admin_socket, admin_path);
+	if (trace_file != NULL) {
+		fclose(trace_file);
+	}
+	while (export_spans(&span_ring, &span_exporter, "TCP_server") > 0) {
 	}
+	close_span_exporter(&span_exporter);
+	closesocket(my_socket);
+	close_udp_server(&udp_server);
+	close_xdp_port(&xdp_port);
+	free_buffers(session_table);
+	free(session_table);
+	close_perf_counters(&perf_counters);
 
 	// Clean up Winsock before exit (for Windows only)
 	clearwinsock(); /**< Clean up Winsock */
@@ -0,0 +1,158 @@
+/*
+ ============================================================================
+ Name        : admin.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Admin control channel over a Unix domain socket.
+ ============================================================================
+ */
+
+#if defined WIN32
+#include <winsock.h>
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#define closesocket close
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "admin.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - ADMIN - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Creates the admin socket.
+ * @param[in] path: the filesystem path of the socket.
+ * @return the listening socket, or -1 if it cannot be created.
+ * @post The socket file has mode 0600, so only the user running the server can connect.
+ */
+int open_admin_socket(const char *path) {
+#if defined WIN32
+    (void) path;
+    return -1;
+#else
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int admin_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (admin_socket < 0) {
+        return -1;
+    }
+    unlink(path);   // Remove the socket file of a previous run
+    mode_t previous_mask = umask(0077);
+    int bound = bind(admin_socket, (struct sockaddr*) &address, sizeof(address));
+    umask(previous_mask);
+    if (bound < 0 || listen(admin_socket, MAX_ADMIN_CONNECTIONS) < 0) {
+        closesocket(admin_socket);
+        return -1;
+    }
+    return admin_socket;
+#endif
+}
+
+
+/**
+ * @brief Closes the admin socket and removes its file.
+ * @param[in] admin_socket: the listening socket.
+ * @param[in] path: the filesystem path of the socket.
+ */
+void close_admin_socket(int admin_socket, const char *path) {
+    if (admin_socket >= 0) {
+        closesocket(admin_socket);
+#if !defined WIN32
+        unlink(path);
+#endif
+    }
+}
+
+
+/**
+ * @brief Receives the available bytes of an admin connection and extracts its first command.
+ * @param[in/out] connection: the admin connection.
+ * @return 1 if a complete command is available, 0 if more bytes are needed, -1 on close or overflow.
+ */
+int read_admin_line(AdminConnection *connection) {
+    int received = recv(connection->socket, connection->input + connection->input_len,
+                        (int) (sizeof(connection->input) - connection->input_len), 0);
+    if (received <= 0) {
+        return -1;
+    }
+    connection->input_len += received;
+    return next_admin_line(connection);
+}
+
+
+/**
+ * @brief Extracts the next command already received on an admin connection.
+ * @param[in/out] connection: the admin connection.
+ * @return 1 if a complete command is available, 0 if more bytes are needed, -1 on overflow.
+ * @post When 1 is returned, the command and its terminator are removed from `connection->input`.
+ */
+int next_admin_line(AdminConnection *connection) {
+    const char *end = memchr(connection->input, '\n', connection->input_len);
+    if (end == NULL) {
+        // A full buffer without a terminator holds a line longer than any command
+        return (connection->input_len == sizeof(connection->input)) ? -1 : 0;
+    }
+    size_t length = (size_t) (end - connection->input);
+    size_t consumed = length + 1;
+    if (length > 0 && connection->input[length - 1] == '\r') {
+        length--;
+    }
+    memcpy(connection->line, connection->input, length);
+    connection->line[length] = '\0';
+    connection->input_len -= consumed;
+    memmove(connection->input, connection->input + consumed, connection->input_len);
+    return 1;
+}
+
+
+/**
+ * @brief Sends formatted text to an admin connection.
+ * @param[in] connection: the admin connection.
+ * @param[in] format: a printf-style format string.
+ * @return `true` if the text was sent entirely, `false` otherwise.
+ */
+bool admin_reply(AdminConnection *connection, const char *format, ...) {
+    char reply[ADMIN_REPLY_SIZE];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(reply, sizeof(reply), format, arguments);
+    va_end(arguments);
+    if (length < 0) {
+        return false;
+    }
+    if (length >= (int) sizeof(reply)) {
+        length = sizeof(reply) - 1;
+    }
+    return send(connection->socket, reply, length, 0) == length;
+}
+
+
+/**
+ * @brief Checks an admin token in constant time.
+ * @param[in] expected: the configured token.
+ * @param[in] presented: the token sent by the admin client.
+ * @return `true` if the tokens are equal, `false` otherwise.
+ */
+bool check_admin_token(const char *expected, const char *presented) {
+    size_t expected_len = strlen(expected);
+    size_t presented_len = strlen(presented);
+    unsigned char difference = (expected_len != presented_len);
+    for (size_t i = 0; i < expected_len; i++) {
+        difference |= (unsigned char) (expected[i] ^ presented[i < presented_len ? i : 0]);
+    }
+    return difference == 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END ADMIN - - - - - - - - - - - - - - - - - - - */
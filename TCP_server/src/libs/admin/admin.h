@@ -0,0 +1,123 @@
+/*
+ ============================================================================
+ Name        : admin.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the admin control channel: a Unix domain
+               socket accepting newline-terminated text commands, used to
+               inspect and tune the server while it runs. The channel is not
+               available on Windows.
+ ============================================================================
+ */
+
+#ifndef ADMIN_H_
+#define ADMIN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Maximum length of an admin command line, null terminator included.
+ */
+#define ADMIN_LINE_SIZE 256     /**< Admin command size */
+
+/**
+ * @brief Maximum number of admin connections served at once.
+ */
+#define MAX_ADMIN_CONNECTIONS 4     /**< Admin connection capacity */
+
+/**
+ * @brief Maximum length of a single admin reply chunk.
+ */
+#define ADMIN_REPLY_SIZE 4096   /**< Admin reply size */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @struct AdminConnection
+ * @brief State of a connection to the admin socket.
+ */
+typedef struct {
+    int socket;                         /**< Connected socket, -1 if the slot is unused */
+    bool authenticated;                 /**< Whether the connection presented the admin token */
+    char line[ADMIN_LINE_SIZE];         /**< Last complete command line */
+    char input[ADMIN_LINE_SIZE];        /**< Bytes received and not consumed yet */
+    size_t input_len;                   /**< Bytes of `input` received so far */
+} AdminConnection;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - ADMIN - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Creates the admin socket, readable and writable by the owner only.
+ *
+ * A stale socket file left by a previous run is removed first.
+ *
+ * @param[in] path: the filesystem path of the socket.
+ * @return the listening socket, or -1 if it cannot be created or the platform has no Unix domain sockets.
+ */
+int open_admin_socket(const char *path);
+
+
+/**
+ * @brief Closes the admin socket and removes its file.
+ * @param[in] admin_socket: the listening socket.
+ * @param[in] path: the filesystem path of the socket.
+ */
+void close_admin_socket(int admin_socket, const char *path);
+
+
+/**
+ * @brief Receives the available bytes of an admin connection and extracts its first command.
+ *
+ * The bytes are received in one call; commands behind the first one stay in `connection->input`
+ * and are extracted by `next_admin_line` without receiving again.
+ *
+ * @param[in/out] connection: the admin connection.
+ * @return 1 if `connection->line` holds a complete command, without its line terminator.
+ * @return 0 if more bytes are needed.
+ * @return -1 if the connection was closed or the line is too long.
+ */
+int read_admin_line(AdminConnection *connection);
+
+
+/**
+ * @brief Extracts the next command already received on an admin connection.
+ * @param[in/out] connection: the admin connection.
+ * @return 1 if `connection->line` holds a complete command, 0 if more bytes are needed, -1 if the
+ *         line is too long.
+ */
+int next_admin_line(AdminConnection *connection);
+
+
+/**
+ * @brief Sends formatted text to an admin connection.
+ *
+ * Replies longer than `ADMIN_REPLY_SIZE` are truncated.
+ *
+ * @param[in] connection: the admin connection.
+ * @param[in] format: a printf-style format string.
+ * @return `true` if the text was sent entirely.
+ */
+bool admin_reply(AdminConnection *connection, const char *format, ...);
+
+
+/**
+ * @brief Checks an admin token in constant time.
+ * @param[in] expected: the configured token.
+ * @param[in] presented: the token sent by the admin client.
+ * @return `true` if the tokens are equal.
+ */
+bool check_admin_token(const char *expected, const char *presented);
+
+/* - - - - - - - - - - - - - - - - - - - END ADMIN - - - - - - - - - - - - - - - - - - - */
+
+#endif /* ADMIN_H_ */
@@ -0,0 +1,439 @@
+/*
+ ============================================================================
+ Name        : auth.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Pre-shared-key authentication based on HMAC-SHA256.
+ ============================================================================
+ */
+
+#if defined WIN32
+#define _CRT_RAND_S  /**< Declares rand_s(), backed by the system generator */
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include "auth.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - HASHING - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief SHA-256 round constants (FIPS 180-4).
+ */
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))  /**< 32-bit right rotation */
+
+
+/**
+ * @brief Compresses one 64-byte block into the hash state.
+ * @param[in/out] state: the intermediate hash value.
+ * @param[in] block: the input block.
+ */
+static void sha256_compress(uint32_t state[8], const uint8_t block[SHA256_BLOCK_SIZE]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16 |
+               (uint32_t) block[4 * i + 2] << 8 | (uint32_t) block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+
+/**
+ * @brief Initializes a SHA-256 context.
+ * @param[out] ctx: the context to initialize.
+ * @post `ctx` holds the SHA-256 initial hash value and no buffered input.
+ */
+void sha256_init(Sha256Context *ctx) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->total = 0;
+    ctx->block_len = 0;
+}
+
+
+/**
+ * @brief Absorbs data into a SHA-256 context.
+ * @param[in/out] ctx: the running context.
+ * @param[in] data: the bytes to absorb.
+ * @param[in] len: the number of bytes in `data`.
+ */
+void sha256_update(Sha256Context *ctx, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    ctx->total += len;
+    while (len > 0) {
+        size_t chunk = SHA256_BLOCK_SIZE - ctx->block_len;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(ctx->block + ctx->block_len, bytes, chunk);
+        ctx->block_len += chunk;
+        bytes += chunk;
+        len -= chunk;
+        if (ctx->block_len == SHA256_BLOCK_SIZE) {
+            sha256_compress(ctx->state, ctx->block);
+            ctx->block_len = 0;
+        }
+    }
+}
+
+
+/**
+ * @brief Finalizes a SHA-256 computation.
+ * @param[in/out] ctx: the running context.
+ * @param[out] digest: receives the digest.
+ * @post `ctx` must be re-initialized before being used again.
+ */
+void sha256_final(Sha256Context *ctx, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    uint64_t bits = ctx->total * 8;
+    uint8_t padding[SHA256_BLOCK_SIZE + 8] = { 0x80 };
+    size_t pad_len = (ctx->block_len < 56) ? 56 - ctx->block_len : 120 - ctx->block_len;
+    for (int i = 0; i < 8; i++) {
+        padding[pad_len + i] = (uint8_t) (bits >> (56 - 8 * i));
+    }
+    sha256_update(ctx, padding, pad_len + 8);
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t) (ctx->state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t) (ctx->state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t) (ctx->state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t) ctx->state[i];
+    }
+}
+
+
+/**
+ * @brief Prepares the HMAC inner and outer contexts for a secret.
+ * @param[in] secret: the key bytes.
+ * @param[in] secret_len: the number of bytes in `secret`.
+ * @param[out] inner: receives the state after absorbing `secret ^ ipad`.
+ * @param[out] outer: receives the state after absorbing `secret ^ opad`.
+ */
+static void hmac_prepare(const uint8_t *secret, size_t secret_len, Sha256Context *inner, Sha256Context *outer) {
+    uint8_t key[SHA256_BLOCK_SIZE] = { 0 };
+    if (secret_len > SHA256_BLOCK_SIZE) {
+        Sha256Context ctx;
+        sha256_init(&ctx);
+        sha256_update(&ctx, secret, secret_len);
+        sha256_final(&ctx, key);
+    } else {
+        memcpy(key, secret, secret_len);
+    }
+
+    uint8_t pad[SHA256_BLOCK_SIZE];
+    for (int i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        pad[i] = key[i] ^ 0x36;
+    }
+    sha256_init(inner);
+    sha256_update(inner, pad, sizeof(pad));
+    for (int i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        pad[i] = key[i] ^ 0x5c;
+    }
+    sha256_init(outer);
+    sha256_update(outer, pad, sizeof(pad));
+}
+
+
+/**
+ * @brief Completes an HMAC from precomputed inner and outer contexts.
+ * @param[in] inner: the state after absorbing `secret ^ ipad`.
+ * @param[in] outer: the state after absorbing `secret ^ opad`.
+ * @param[in] message: the message bytes.
+ * @param[in] message_len: the number of bytes in `message`.
+ * @param[out] mac: receives the tag.
+ */
+static void hmac_finish(const Sha256Context *inner, const Sha256Context *outer,
+                        const void *message, size_t message_len, uint8_t mac[SHA256_DIGEST_SIZE]) {
+    Sha256Context ctx = *inner;
+    uint8_t inner_digest[SHA256_DIGEST_SIZE];
+    sha256_update(&ctx, message, message_len);
+    sha256_final(&ctx, inner_digest);
+    ctx = *outer;
+    sha256_update(&ctx, inner_digest, sizeof(inner_digest));
+    sha256_final(&ctx, mac);
+}
+
+
+/**
+ * @brief Computes HMAC-SHA256 of a message.
+ * @param[in] secret: the key bytes.
+ * @param[in] secret_len: the number of bytes in `secret`.
+ * @param[in] message: the message bytes.
+ * @param[in] message_len: the number of bytes in `message`.
+ * @param[out] mac: receives the tag.
+ */
+void hmac_sha256(const uint8_t *secret, size_t secret_len, const void *message, size_t message_len,
+                 uint8_t mac[SHA256_DIGEST_SIZE]) {
+    Sha256Context inner, outer;
+    hmac_prepare(secret, secret_len, &inner, &outer);
+    hmac_finish(&inner, &outer, message, message_len, mac);
+}
+
+/* - - - - - - - - - - - - - - - - - - - END HASHING - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - KEYS - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Hashes a key identifier to a table slot (FNV-1a).
+ * @param[in] key_id: the identifier.
+ * @return the index of the first slot to probe.
+ */
+static unsigned int key_slot(const char *key_id) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < AUTH_KEY_ID_SIZE && key_id[i] != '\0'; i++) {
+        hash = (hash ^ (uint8_t) key_id[i]) * 16777619u;
+    }
+    return hash & (AUTH_TABLE_SIZE - 1);
+}
+
+
+/**
+ * @brief Decodes a hexadecimal secret.
+ * @param[in] hex: the hexadecimal string.
+ * @param[out] secret: receives the decoded bytes.
+ * @return the number of decoded bytes, or -1 if `hex` is empty, of odd length, too long or not hexadecimal.
+ */
+int decode_hex_secret(const char *hex, uint8_t secret[AUTH_MAX_SECRET_SIZE]) {
+    size_t len = strlen(hex);
+    if (len == 0 || len % 2 != 0 || len / 2 > AUTH_MAX_SECRET_SIZE) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i += 2) {
+        if (!isxdigit((unsigned char) hex[i]) || !isxdigit((unsigned char) hex[i + 1])) {
+            return -1;
+        }
+        char byte[3] = { hex[i], hex[i + 1], '\0' };
+        secret[i / 2] = (uint8_t) strtoul(byte, NULL, 16);
+    }
+    return (int) (len / 2);
+}
+
+
+/**
+ * @brief Adds a key to the table, precomputing its HMAC states.
+ * @param[in/out] table: the key table.
+ * @param[in] key_id: the public identifier of the key.
+ * @param[in] secret: the key bytes.
+ * @param[in] secret_len: the number of bytes in `secret`.
+ * @return a pointer to the stored key, or NULL if the table is full or the identifier is invalid.
+ * @post An existing key with the same identifier is replaced.
+ */
+ApiKey *add_key(KeyTable *table, const char *key_id, const uint8_t *secret, size_t secret_len) {
+    size_t id_len = strlen(key_id);
+    if (id_len == 0 || id_len >= AUTH_KEY_ID_SIZE) {
+        return NULL;
+    }
+    ApiKey *key = find_key(table, key_id);
+    if (key == NULL) {
+        if (table->count >= AUTH_TABLE_SIZE - 1) {
+            return NULL;    // Keep one slot free so unsuccessful lookups terminate
+        }
+        unsigned int slot = key_slot(key_id);
+        while (table->slots[slot].used) {
+            slot = (slot + 1) & (AUTH_TABLE_SIZE - 1);
+        }
+        key = &table->slots[slot];
+        table->count++;
+    }
+    memset(key, 0, sizeof(*key));
+    key->used = true;
+    strcpy(key->key_id, key_id);
+    hmac_prepare(secret, secret_len, &key->inner, &key->outer);
+    return key;
+}
+
+
+/**
+ * @brief Loads keys from a file with one `<key_id> <hex secret> [tenant]` entry per line.
+ * @param[out] table: the key table.
+ * @param[in] path: the path of the key file.
+ * @return the number of keys loaded, or -1 if the file cannot be opened.
+ * @post Malformed lines are skipped.
+ */
+int load_keys(KeyTable *table, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    memset(table, 0, sizeof(*table));
+
+    char line[512];
+    char key_id[AUTH_KEY_ID_SIZE];
+    char hex[2 * AUTH_MAX_SECRET_SIZE + 1];
+    char tenant[AUTH_KEY_ID_SIZE];
+    uint8_t secret[AUTH_MAX_SECRET_SIZE];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        tenant[0] = '\0';
+        if (sscanf(line, "%31s %256s %31s", key_id, hex, tenant) < 2) {
+            continue;
+        }
+        int secret_len = decode_hex_secret(hex, secret);
+        if (secret_len > 0) {
+            ApiKey *key = add_key(table, key_id, secret, secret_len);
+            if (key != NULL) {
+                strcpy(key->tenant, tenant);
+            }
+        }
+    }
+    fclose(file);
+    memset(secret, 0, sizeof(secret));
+    return table->count;
+}
+
+
+/**
+ * @brief Looks up a key by identifier.
+ * @param[in] table: the key table.
+ * @param[in] key_id: the identifier to look up.
+ * @return a pointer to the key, or NULL if it is not present.
+ */
+ApiKey *find_key(KeyTable *table, const char *key_id) {
+    unsigned int slot = key_slot(key_id);
+    while (table->slots[slot].used) {
+        if (strncmp(table->slots[slot].key_id, key_id, AUTH_KEY_ID_SIZE) == 0) {
+            return &table->slots[slot];
+        }
+        slot = (slot + 1) & (AUTH_TABLE_SIZE - 1);
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Verifies the HMAC proof sent by a client.
+ * @param[in] table: the key table.
+ * @param[in] key_id: the identifier claimed by the client.
+ * @param[in] message: the authenticated message.
+ * @param[in] message_len: the number of bytes in `message`.
+ * @param[in] mac: the tag sent by the client.
+ * @return a pointer to the authenticated key, or NULL if verification failed.
+ */
+ApiKey *verify_key(KeyTable *table, const char *key_id, const void *message, size_t message_len,
+                   const uint8_t mac[SHA256_DIGEST_SIZE]) {
+    static Sha256Context dummy_inner, dummy_outer;
+    static bool dummy_ready = false;
+    if (!dummy_ready) {
+        hmac_prepare((const uint8_t *) "", 0, &dummy_inner, &dummy_outer);
+        dummy_ready = true;
+    }
+
+    ApiKey *key = find_key(table, key_id);
+    uint8_t expected[SHA256_DIGEST_SIZE];
+    if (key != NULL) {
+        hmac_finish(&key->inner, &key->outer, message, message_len, expected);
+    } else {
+        hmac_finish(&dummy_inner, &dummy_outer, message, message_len, expected);
+    }
+
+    // Constant-time comparison: accumulate every difference before deciding
+    uint8_t difference = 0;
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        difference |= expected[i] ^ mac[i];
+    }
+    return (difference == 0 && key != NULL) ? key : NULL;
+}
+
+
+#if !defined WIN32
+static int urandom_fd = -1;  /**< `/dev/urandom`, opened once where getrandom() is missing */
+#endif
+
+/**
+ * @brief Fills a buffer with unpredictable bytes for nonces and seeds.
+ * @param[out] buffer: the buffer to fill.
+ * @param[in] len: the number of bytes to write.
+ * @return `true` if the buffer was filled from the system generator.
+ */
+bool fill_random(void *buffer, size_t len) {
+    uint8_t *bytes = buffer;
+    size_t filled = 0;
+#if defined WIN32
+    while (filled < len) {
+        unsigned int value;
+        if (rand_s(&value) != 0) {
+            return false;
+        }
+        size_t chunk = (len - filled < sizeof(value)) ? len - filled : sizeof(value);
+        memcpy(bytes + filled, &value, chunk);
+        filled += chunk;
+    }
+    return true;
+#else
+#if defined(__linux__)
+    while (filled < len) {
+        ssize_t got = getrandom(bytes + filled, len - filled, 0);
+        if (got > 0) {
+            filled += (size_t) got;
+        } else if (got < 0 && errno != EINTR) {
+            break;  /**< A kernel without getrandom(): read the device instead */
+        }
+    }
+#endif
+    if (filled < len && urandom_fd < 0) {
+        urandom_fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    }
+    while (filled < len && urandom_fd >= 0) {
+        ssize_t got = read(urandom_fd, bytes + filled, len - filled);
+        if (got > 0) {
+            filled += (size_t) got;
+        } else if (got == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+    return filled == len;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - END KEYS - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,350 @@
+/*
+ ============================================================================
+ Name        : chacha.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : ChaCha20 keystream with scalar, AVX2 and AVX-512 kernels.
+ ============================================================================
+ */
+
+#include <string.h>
+#include "chacha.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CHACHA_X86_KERNELS  /**< Build the vector kernels and dispatch with __builtin_cpu_supports() */
+#include <immintrin.h>
+#endif
+
+
+/* - - - - - - - - - - - - - - - - - - - - KERNELS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Rotates every 32-bit lane left; works on scalars and on GCC vectors alike.
+ */
+#define ROTATE(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+ * @brief ChaCha quarter round.
+ */
+#define QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTATE(d, 16); \
+    c += d; b ^= c; b = ROTATE(b, 12); \
+    a += b; d ^= a; d = ROTATE(d, 8);  \
+    c += d; b ^= c; b = ROTATE(b, 7)
+
+/**
+ * @brief ChaCha double round: four column rounds, then four diagonal rounds.
+ */
+#define DOUBLE_ROUND(x) \
+    QUARTER_ROUND(x[0], x[4], x[8],  x[12]); \
+    QUARTER_ROUND(x[1], x[5], x[9],  x[13]); \
+    QUARTER_ROUND(x[2], x[6], x[10], x[14]); \
+    QUARTER_ROUND(x[3], x[7], x[11], x[15]); \
+    QUARTER_ROUND(x[0], x[5], x[10], x[15]); \
+    QUARTER_ROUND(x[1], x[6], x[11], x[12]); \
+    QUARTER_ROUND(x[2], x[7], x[8],  x[13]); \
+    QUARTER_ROUND(x[3], x[4], x[9],  x[14])
+
+
+/**
+ * @brief A kernel computing consecutive keystream blocks.
+ * @param[in] state: the state of the first block.
+ * @param[out] out: receives `blocks` blocks.
+ * @param[in] blocks: the number of blocks, a multiple of `CHACHA_BUFFER_BLOCKS`.
+ */
+typedef void (*ChaChaKernel)(const uint32_t state[16], unsigned char *out, int blocks);
+
+
+/**
+ * @brief Stores a 32-bit word in little-endian order.
+ * @param[out] out: the destination.
+ * @param[in] word: the word.
+ */
+static void store_le32(unsigned char *out, uint32_t word) {
+    out[0] = (unsigned char) word;
+    out[1] = (unsigned char) (word >> 8);
+    out[2] = (unsigned char) (word >> 16);
+    out[3] = (unsigned char) (word >> 24);
+}
+
+
+/**
+ * @brief Computes the blocks one at a time.
+ */
+static void chacha_blocks_scalar(const uint32_t state[16], unsigned char *out, int blocks) {
+    uint64_t counter = state[12] | ((uint64_t) state[13] << 32);
+    for (int block = 0; block < blocks; block++) {
+        uint32_t input[16];
+        uint32_t x[16];
+        memcpy(input, state, sizeof(input));
+        input[12] = (uint32_t) (counter + block);
+        input[13] = (uint32_t) ((counter + block) >> 32);
+        memcpy(x, input, sizeof(x));
+        for (int round = 0; round < 10; round++) {
+            DOUBLE_ROUND(x);
+        }
+        for (int i = 0; i < 16; i++) {
+            store_le32(out + block * CHACHA_BLOCK_SIZE + 4 * i, x[i] + input[i]);
+        }
+    }
+}
+
+
+#if defined(CHACHA_X86_KERNELS)
+/**
+ * @brief Body of a vector kernel: lane `j` of every state word belongs to block `j` of a group
+ * of `lanes` blocks, so one vector instruction advances all the blocks of the group. `store`
+ * transposes the words back into consecutive blocks.
+ */
+#define VECTOR_BLOCKS(vector, lanes, store) \
+    uint64_t counter = state[12] | ((uint64_t) state[13] << 32); \
+    for (int first = 0; first < blocks; first += lanes) { \
+        vector input[16]; \
+        vector x[16]; \
+        for (int i = 0; i < 16; i++) { \
+            input[i] = (vector) {} + state[i]; \
+        } \
+        for (int j = 0; j < lanes; j++) { \
+            input[12][j] = (uint32_t) (counter + first + j); \
+            input[13][j] = (uint32_t) ((counter + first + j) >> 32); \
+        } \
+        for (int i = 0; i < 16; i++) { \
+            x[i] = input[i]; \
+        } \
+        for (int round = 0; round < 10; round++) { \
+            DOUBLE_ROUND(x); \
+        } \
+        for (int i = 0; i < 16; i++) { \
+            x[i] += input[i]; \
+        } \
+        store(x, out + first * CHACHA_BLOCK_SIZE); \
+    }
+
+typedef uint32_t Vector8 __attribute__((vector_size(32)));     /**< Eight 32-bit lanes, one AVX2 register */
+typedef uint32_t Vector16 __attribute__((vector_size(64)));    /**< Sixteen 32-bit lanes, one AVX-512 register */
+
+/**
+ * @brief Stores eight blocks held one per lane, as two 8x8 transposes of 32-bit words.
+ *
+ * Unpacking pairs of words, then pairs of pairs, leaves every 128-bit half holding four words
+ * of one block; swapping the halves across registers completes the rows, stored 32 bytes at a time.
+ * x86 is little-endian, so the lanes are already in the byte order of the keystream.
+ */
+__attribute__((target("avx2")))
+static inline void store_blocks_avx2(const Vector8 x[16], unsigned char *out) {
+    for (int half = 0; half < 2; half++) {
+        const __m256i *r = (const __m256i *) (x + 8 * half);
+        __m256i t[8];
+        __m256i u[8];
+        for (int i = 0; i < 8; i += 2) {
+            t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+        }
+        for (int i = 0; i < 8; i += 4) {
+            u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+            u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+            u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+            u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+        }
+        for (int j = 0; j < 4; j++) {
+            _mm256_storeu_si256((__m256i *) (out + j * CHACHA_BLOCK_SIZE + 32 * half),
+                                _mm256_permute2x128_si256(u[j], u[j + 4], 0x20));
+            _mm256_storeu_si256((__m256i *) (out + (j + 4) * CHACHA_BLOCK_SIZE + 32 * half),
+                                _mm256_permute2x128_si256(u[j], u[j + 4], 0x31));
+        }
+    }
+}
+
+/**
+ * @brief Stores sixteen blocks held one per lane, as a 16x16 transpose of 32-bit words.
+ *
+ * The unpacks gather, in every 128-bit lane, four words of one block; two rounds of 128-bit lane
+ * shuffles then bring the four quarters of each block into one register.
+ */
+__attribute__((target("avx512f")))
+static inline void store_blocks_avx512(const Vector16 x[16], unsigned char *out) {
+    const __m512i *r = (const __m512i *) x;
+    __m512i t[16];
+    __m512i u[16];
+    for (int i = 0; i < 16; i += 2) {
+        t[i] = _mm512_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    // u[4 * g + s]: words 4g to 4g + 3 of block 4q + s in 128-bit lane q
+    for (int g = 0; g < 4; g++) {
+        u[4 * g] = _mm512_unpacklo_epi64(t[4 * g], t[4 * g + 2]);
+        u[4 * g + 1] = _mm512_unpackhi_epi64(t[4 * g], t[4 * g + 2]);
+        u[4 * g + 2] = _mm512_unpacklo_epi64(t[4 * g + 1], t[4 * g + 3]);
+        u[4 * g + 3] = _mm512_unpackhi_epi64(t[4 * g + 1], t[4 * g + 3]);
+    }
+    for (int s = 0; s < 4; s++) {
+        __m512i even_low = _mm512_shuffle_i32x4(u[s], u[4 + s], _MM_SHUFFLE(2, 0, 2, 0));
+        __m512i odd_low = _mm512_shuffle_i32x4(u[s], u[4 + s], _MM_SHUFFLE(3, 1, 3, 1));
+        __m512i even_high = _mm512_shuffle_i32x4(u[8 + s], u[12 + s], _MM_SHUFFLE(2, 0, 2, 0));
+        __m512i odd_high = _mm512_shuffle_i32x4(u[8 + s], u[12 + s], _MM_SHUFFLE(3, 1, 3, 1));
+        _mm512_storeu_si512(out + s * CHACHA_BLOCK_SIZE,
+                            _mm512_shuffle_i32x4(even_low, even_high, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm512_storeu_si512(out + (4 + s) * CHACHA_BLOCK_SIZE,
+                            _mm512_shuffle_i32x4(odd_low, odd_high, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm512_storeu_si512(out + (8 + s) * CHACHA_BLOCK_SIZE,
+                            _mm512_shuffle_i32x4(even_low, even_high, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm512_storeu_si512(out + (12 + s) * CHACHA_BLOCK_SIZE,
+                            _mm512_shuffle_i32x4(odd_low, odd_high, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+}
+
+/**
+ * @brief Computes the blocks eight at a time with AVX2.
+ */
+__attribute__((target("avx2")))
+static void chacha_blocks_avx2(const uint32_t state[16], unsigned char *out, int blocks) {
+    VECTOR_BLOCKS(Vector8, 8, store_blocks_avx2)
+}
+
+/**
+ * @brief Computes the blocks sixteen at a time with AVX-512.
+ */
+__attribute__((target("avx512f")))
+static void chacha_blocks_avx512(const uint32_t state[16], unsigned char *out, int blocks) {
+    VECTOR_BLOCKS(Vector16, 16, store_blocks_avx512)
+}
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - END KERNELS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - CHACHA - - - - - - - - - - - - - - - - - - - - - */
+
+static ChaChaKernel kernel = NULL;      /**< Selected kernel, NULL until the first selection */
+static const char *kernel_name = "scalar";  /**< Name of the selected kernel */
+
+
+/**
+ * @brief Selects the kernel computing the keystream.
+ * @param[in] name: "scalar", "avx2" or "avx512", or NULL for the fastest one the CPU supports.
+ * @return `true` if the kernel is available on this CPU and build.
+ */
+bool select_chacha_kernel(const char *name) {
+    static const struct {
+        const char *name;
+        ChaChaKernel kernel;
+    } kernels[] = {
+#if defined(CHACHA_X86_KERNELS)
+        { "avx512", chacha_blocks_avx512 },
+        { "avx2", chacha_blocks_avx2 },
+#endif
+        { "scalar", chacha_blocks_scalar },
+    };
+#if defined(CHACHA_X86_KERNELS)
+    __builtin_cpu_init();
+#endif
+
+    // Kernels are listed fastest first: without a name, take the first one the CPU runs
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        bool supported = true;
+#if defined(CHACHA_X86_KERNELS)
+        if (kernels[i].kernel == chacha_blocks_avx512) {
+            supported = __builtin_cpu_supports("avx512f");
+        } else if (kernels[i].kernel == chacha_blocks_avx2) {
+            supported = __builtin_cpu_supports("avx2");
+        }
+#endif
+        if (supported && (name == NULL || strcmp(name, kernels[i].name) == 0)) {
+            kernel = kernels[i].kernel;
+            kernel_name = kernels[i].name;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Returns the name of the selected kernel.
+ * @return "scalar", "avx2" or "avx512".
+ */
+const char *chacha_kernel_name(void) {
+    return kernel_name;
+}
+
+
+/**
+ * @brief Keys a generator, with a zero nonce and the block counter at zero.
+ * @param[out] rng: the generator.
+ * @param[in] key: the key.
+ */
+void chacha_seed(ChaChaRng *rng, const unsigned char key[CHACHA_KEY_SIZE]) {
+    if (kernel == NULL) {
+        select_chacha_kernel(NULL);
+    }
+    memset(rng, 0, sizeof(*rng));
+    rng->state[0] = 0x61707865;     /* "expand 32-byte k" */
+    rng->state[1] = 0x3320646e;
+    rng->state[2] = 0x79622d32;
+    rng->state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) {
+        rng->state[4 + i] = key[4 * i] | ((uint32_t) key[4 * i + 1] << 8) | ((uint32_t) key[4 * i + 2] << 16)
+                            | ((uint32_t) key[4 * i + 3] << 24);
+    }
+    rng->used = sizeof(rng->buffer);  /**< Empty: the first draw refills */
+}
+
+
+/**
+ * @brief Refills the buffer with the next `CHACHA_BUFFER_BLOCKS` blocks.
+ * @param[in/out] rng: the keyed generator.
+ */
+static void refill(ChaChaRng *rng) {
+    kernel(rng->state, rng->buffer, CHACHA_BUFFER_BLOCKS);
+    uint64_t counter = (rng->state[12] | ((uint64_t) rng->state[13] << 32)) + CHACHA_BUFFER_BLOCKS;
+    rng->state[12] = (uint32_t) counter;
+    rng->state[13] = (uint32_t) (counter >> 32);
+    rng->used = 0;
+}
+
+
+/**
+ * @brief Copies the next bytes of the keystream.
+ * @param[in/out] rng: the keyed generator.
+ * @param[out] out: receives the bytes.
+ * @param[in] size: the number of bytes.
+ */
+void chacha_fill(ChaChaRng *rng, void *out, size_t size) {
+    unsigned char *bytes = out;
+    while (size > 0) {
+        if (rng->used == sizeof(rng->buffer)) {
+            refill(rng);
+        }
+        size_t chunk = sizeof(rng->buffer) - rng->used;
+        chunk = (chunk < size) ? chunk : size;
+        memcpy(bytes, rng->buffer + rng->used, chunk);
+        rng->used += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+
+/**
+ * @brief Draws a uniformly distributed integer below a bound.
+ * @param[in/out] rng: the keyed generator.
+ * @param[in] bound: the exclusive upper bound, between 1 and 256.
+ * @return an integer between 0 and `bound - 1`.
+ */
+unsigned int chacha_below(ChaChaRng *rng, unsigned int bound) {
+    // Multiply-and-shift maps a byte to [0, bound) without a division (Lemire's method on 8 bits).
+    // Only a low product below `bound` may be biased, so the remainder is computed for those alone.
+    for (;;) {
+        if (rng->used == sizeof(rng->buffer)) {
+            refill(rng);
+        }
+        unsigned int product = rng->buffer[rng->used++] * bound;
+        unsigned int low = product & 0xff;
+        if (low < bound && low < 256 % bound) {
+            continue;
+        }
+        return product >> 8;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - END CHACHA - - - - - - - - - - - - - - - - - - - */
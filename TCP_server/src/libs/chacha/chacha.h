@@ -0,0 +1,106 @@
+/*
+ ============================================================================
+ Name        : chacha.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing a ChaCha20 random generator. The
+               keystream is produced 16 blocks at a time into a buffer that
+               the generator then hands out byte by byte. On x86 the blocks
+               are computed in parallel by an 8-way AVX2 or a 16-way AVX-512
+               kernel, selected at run time; elsewhere a portable scalar
+               kernel computes them one by one.
+ ============================================================================
+ */
+
+#ifndef CHACHA_H_
+#define CHACHA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Size in bytes of a ChaCha20 key.
+ */
+#define CHACHA_KEY_SIZE 32      /**< Key size */
+
+/**
+ * @brief Size in bytes of a ChaCha20 block.
+ */
+#define CHACHA_BLOCK_SIZE 64    /**< Block size */
+
+/**
+ * @brief Blocks computed by one refill of the buffer.
+ * A multiple of the widest kernel, so every kernel runs full width.
+ */
+#define CHACHA_BUFFER_BLOCKS 16 /**< Blocks per refill */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @struct ChaChaRng
+ * @brief A ChaCha20 keystream and the unused part of its last refill.
+ */
+typedef struct {
+    uint32_t state[16];     /**< Constants, key, 64-bit block counter and 64-bit nonce */
+    unsigned char buffer[CHACHA_BUFFER_BLOCKS * CHACHA_BLOCK_SIZE];  /**< Keystream of the last refill */
+    size_t used;            /**< Bytes of `buffer` already handed out */
+} ChaChaRng;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - CHACHA - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Selects the kernel computing the keystream.
+ * @param[in] name: "scalar", "avx2" or "avx512", or NULL for the fastest one the CPU supports.
+ * @return `true` if the kernel is available on this CPU and build.
+ */
+bool select_chacha_kernel(const char *name);
+
+
+/**
+ * @brief Returns the name of the selected kernel.
+ * @return "scalar", "avx2" or "avx512".
+ */
+const char *chacha_kernel_name(void);
+
+
+/**
+ * @brief Keys a generator, with a zero nonce and the block counter at zero.
+ * @param[out] rng: the generator.
+ * @param[in] key: the key, which should come from an unpredictable source.
+ * @post The first bytes handed out are the first keystream block.
+ */
+void chacha_seed(ChaChaRng *rng, const unsigned char key[CHACHA_KEY_SIZE]);
+
+
+/**
+ * @brief Copies the next bytes of the keystream.
+ * @param[in/out] rng: the keyed generator.
+ * @param[out] out: receives the bytes.
+ * @param[in] size: the number of bytes.
+ */
+void chacha_fill(ChaChaRng *rng, void *out, size_t size);
+
+
+/**
+ * @brief Draws a uniformly distributed integer below a bound.
+ * Bytes that would bias the result are rejected, so most draws take a single keystream byte.
+ * @param[in/out] rng: the keyed generator.
+ * @param[in] bound: the exclusive upper bound.
+ * @return an integer between 0 and `bound - 1`.
+ * @pre 1 <= `bound` <= 256.
+ */
+unsigned int chacha_below(ChaChaRng *rng, unsigned int bound);
+
+/* - - - - - - - - - - - - - - - - - - - END CHACHA - - - - - - - - - - - - - - - - - - - */
+
+#endif /* CHACHA_H_ */
@@ -0,0 +1,118 @@
+/*
+ ============================================================================
+ Name        : cpu.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : CPU pinning, NUMA-local memory and socket busy polling.
+ ============================================================================
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE     /**< Required for sched_setaffinity() and sched_getcpu() */
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - - CPU - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Pins the calling thread to a CPU.
+ * @param[in] cpu: the index of the CPU.
+ * @return `true` if the thread is pinned.
+ */
+bool pin_to_cpu(int cpu) {
+#if defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Returns the CPU the calling thread is running on.
+ * @return the index of the CPU, or -1 if it cannot be determined.
+ */
+int current_cpu(void) {
+#if defined(__linux__)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+
+/**
+ * @brief Returns the NUMA node of the CPU the calling thread is running on.
+ * @return the index of the node, or -1 if it cannot be determined.
+ */
+int current_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned int cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+        return (int) node;
+    }
+#endif
+    return -1;
+}
+
+
+/**
+ * @brief Makes the pages the calling thread faults in from now on come from its local NUMA node.
+ * @return `true` if the policy is set.
+ */
+bool use_local_memory(void) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    // MPOL_LOCAL from <linux/mempolicy.h>, called directly so the server does not need libnuma
+    const int mpol_local = 4;
+    return syscall(SYS_set_mempolicy, mpol_local, NULL, 0) == 0;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Allocates zeroed memory and faults every page in immediately.
+ * @param[in] size: the number of bytes.
+ * @return the memory, or NULL if it cannot be allocated.
+ */
+void *alloc_local(size_t size) {
+    void *memory = malloc(size);
+    if (memory != NULL) {
+        memset(memory, 0, size);    /**< calloc() could map zero pages lazily */
+    }
+    return memory;
+}
+
+
+/**
+ * @brief Enables kernel busy polling on a socket.
+ * @param[in] socket: the socket.
+ * @return `true` if busy polling is enabled.
+ */
+bool enable_busy_poll(int socket) {
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    int usec = BUSY_POLL_USEC;
+    return setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == 0;
+#else
+    (void) socket;
+    return false;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - END CPU - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,91 @@
+/*
+ ============================================================================
+ Name        : cpu.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing CPU and memory placement helpers for
+               the event loop: pinning the process to a core, keeping its
+               memory on the NUMA node of that core and enabling kernel busy
+               polling on sockets. These are Linux features; elsewhere the
+               functions report that they are not supported.
+ ============================================================================
+ */
+
+#ifndef CPU_H_
+#define CPU_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Microseconds the kernel busy-polls the device queue of a socket before sleeping.
+ */
+#define BUSY_POLL_USEC 50       /**< SO_BUSY_POLL budget */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - CPU - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Pins the calling thread to a CPU.
+ * @param[in] cpu: the index of the CPU.
+ * @return `true` if the thread is pinned, `false` if the CPU is not valid or pinning is not supported.
+ */
+bool pin_to_cpu(int cpu);
+
+
+/**
+ * @brief Returns the CPU the calling thread is running on.
+ * @return the index of the CPU, or -1 if it cannot be determined.
+ */
+int current_cpu(void);
+
+
+/**
+ * @brief Returns the NUMA node of the CPU the calling thread is running on.
+ * @return the index of the node, or -1 if it cannot be determined.
+ */
+int current_node(void);
+
+
+/**
+ * @brief Makes the pages the calling thread faults in from now on come from its local NUMA node.
+ *
+ * Meant to be called right after `pin_to_cpu`, before the tables of the event loop are allocated:
+ * the local node is then the node of the pinned CPU. Memory already faulted in does not move.
+ *
+ * @return `true` if the policy is set, `false` if NUMA policies are not supported.
+ */
+bool use_local_memory(void);
+
+
+/**
+ * @brief Allocates zeroed memory and faults every page in immediately.
+ *
+ * Touching the pages at allocation time places them on the node chosen by the memory policy
+ * of the calling thread, and keeps page faults out of the request path.
+ *
+ * @param[in] size: the number of bytes.
+ * @return the memory, to release with `free`, or NULL if it cannot be allocated.
+ */
+void *alloc_local(size_t size);
+
+
+/**
+ * @brief Enables kernel busy polling on a socket.
+ *
+ * Blocking receives on the socket spin on the device queue for `BUSY_POLL_USEC` instead of
+ * sleeping. Raising the value above the `net.core.busy_read` sysctl requires `CAP_NET_ADMIN`.
+ *
+ * @param[in] socket: the socket.
+ * @return `true` if busy polling is enabled.
+ */
+bool enable_busy_poll(int socket);
+
+/* - - - - - - - - - - - - - - - - - - - END CPU - - - - - - - - - - - - - - - - - - - */
+
+#endif /* CPU_H_ */
@@ -16,18 +16,193 @@
 
 /* - - - - - - - - - - - - - - - - - PASSWORD GENERATION - - - - - - - - - - - - - - - - - */
 
+/**
+ * @brief Whether the random generator was seeded.
+ */
+static bool generator_seeded = false;
+
+/**
+ * @brief ChaCha20 keystream every password character is drawn from.
+ */
+static ChaChaRng password_rng;
+
+
+/**
+ * @brief Seeds the random generator used for passwords.
+ * @param[in] key: the ChaCha20 key.
+ * @post `password_generator_seeded` returns `true`.
+ */
+void seed_password_generator(const unsigned char key[CHACHA_KEY_SIZE]) {
+    chacha_seed(&password_rng, key);
+    generator_seeded = true;
+}
+
+
+/**
+ * @brief Reports whether the random generator used for passwords was seeded.
+ * @return `true` if `seed_password_generator` was called.
+ */
+bool password_generator_seeded(void) {
+    return generator_seeded;
+}
+
+
+/**
+ * @brief Number of codes whose check digits are accumulated together by `generate_numeric_batch`.
+ * Digits are walked column by column over a block of codes so that the inner loop is a plain
+ * arithmetic pass over contiguous sums, which the compiler can vectorize.
+ */
+#define CHECK_DIGIT_BLOCK 64
+
+
+/**
+ * @brief Returns the number of trailing check digits used by a check digit mode.
+ * @param[in] mode: the check digit mode.
+ * @return 1 for `CHECK_LUHN`, 2 for `CHECK_MOD97`, 0 otherwise.
+ */
+static int check_digit_count(CheckDigitMode mode) {
+    switch(mode) {
+        case CHECK_LUHN:
+            return 1;
+        case CHECK_MOD97:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * @brief Returns the shortest password of a type: its check digits and at least one random digit.
+ * @param[in] type: the type of password.
+ * @return 2 for `NUMERIC_LUHN`, 3 for `NUMERIC_MOD97`, 1 otherwise.
+ */
+int shortest_length(PasswordType type) {
+    switch(type) {
+        case NUMERIC_LUHN:
+            return check_digit_count(CHECK_LUHN) + 1;
+        case NUMERIC_MOD97:
+            return check_digit_count(CHECK_MOD97) + 1;
+        default:
+            return 1;
+    }
+}
+
+
+/**
+ * @brief Generates a batch of numeric codes, optionally prefixed and terminated by check digits.
+ * @param[in/out] codes: a buffer of `count * (length + 1)` characters where the codes will be stored.
+ * @param[in] count: the number of codes to generate.
+ * @param[in] length: the total length of every code, prefix and check digits included.
+ * @param[in] prefix: a string of digits every code starts with (may be NULL or empty).
+ * @param[in] mode: the check digit scheme appended at the end of every code.
+ * @return `true` if the codes were generated.
+ * @return `false` if the prefix is not numeric or does not leave room for the check digits.
+ * @pre `count` and `length` should be positive integers.
+ * @post `codes` holds `count` NUL-terminated codes, one every `length + 1` characters.
+ */
+bool generate_numeric_batch(char *codes, int count, int length, const char *prefix, CheckDigitMode mode) {
+    int payload = length - check_digit_count(mode);
+    int prefix_len = (prefix != NULL) ? (int) strlen(prefix) : 0;
+    if (payload < prefix_len) {
+        return false;
+    }
+    for (int i = 0; i < prefix_len; i++) {
+        if (!isdigit((unsigned char) prefix[i])) {
+            return false;
+        }
+    }
+
+    // Contribution of the prefix to the check digits, shared by every code of the batch
+    int prefix_sum = 0;
+    bool doubled = true;        // Luhn doubles every second digit starting left of the check digit
+    int weight = 100 % 97;      // Mod 97-10 weight of the rightmost payload digit (payload * 100)
+    for (int i = payload - 1; i >= 0; i--) {
+        if (i < prefix_len) {
+            int digit = prefix[i] - '0';
+            if (mode == CHECK_LUHN) {
+                int value = doubled ? digit * 2 : digit;
+                prefix_sum += (value > 9) ? value - 9 : value;
+            } else if (mode == CHECK_MOD97) {
+                prefix_sum += digit * weight;
+            }
+        }
+        doubled = !doubled;
+        weight = (weight * 10) % 97;
+    }
+
+    const int stride = length + 1;
+    int sums[CHECK_DIGIT_BLOCK];
+    for (int first = 0; first < count; first += CHECK_DIGIT_BLOCK) {
+        int block = (count - first < CHECK_DIGIT_BLOCK) ? count - first : CHECK_DIGIT_BLOCK;
+        char *base = codes + (size_t) first * stride;
+
+        // Random digits after the prefix
+        for (int c = 0; c < block; c++) {
+            char *code = base + (size_t) c * stride;
+            if (prefix_len > 0) {
+                memcpy(code, prefix, prefix_len);
+            }
+            for (int i = prefix_len; i < payload; i++) {
+                code[i] = '0' + chacha_below(&password_rng, 10); // Generates a digit between 0 and 9
+            }
+            code[length] = '\0';
+            sums[c] = prefix_sum;
+        }
+
+        if (mode == CHECK_NONE) {
+            continue;
+        }
+
+        // Accumulate the check sums column by column, right to left
+        doubled = true;
+        weight = 100 % 97;
+        for (int i = payload - 1; i >= prefix_len; i--) {
+            const char *column = base + i;
+            if (mode == CHECK_LUHN) {
+                int factor = doubled ? 2 : 1;
+                for (int c = 0; c < block; c++) {
+                    int value = (column[(size_t) c * stride] - '0') * factor;
+                    sums[c] += value - 9 * (value > 9);
+                }
+            } else {
+                for (int c = 0; c < block; c++) {
+                    sums[c] += (column[(size_t) c * stride] - '0') * weight;
+                }
+            }
+            doubled = !doubled;
+            weight = (weight * 10) % 97;
+        }
+
+        // Append the check digits
+        for (int c = 0; c < block; c++) {
+            char *code = base + (size_t) c * stride;
+            if (mode == CHECK_LUHN) {
+                code[payload] = '0' + (10 - sums[c] % 10) % 10;
+            } else {
+                int check = 98 - sums[c] % 97;
+                code[payload] = '0' + check / 10;
+                code[payload + 1] = '0' + check % 10;
+            }
+        }
+    }
+    return true;
+}
+
+
 /**
  * @brief Generates a numeric password.
  * @param[in/out] password: a pointer where the generated numeric password will be stored.
  * @param[in] length: the desired length of the password.
+ * @param[in] prefix: a string of digits the password starts with (may be NULL or empty).
+ * @param[in] mode: the check digit scheme appended at the end of the password.
  * @pre `length` should be a positive integer.
  * @post `password` is populated with a numeric password of the specified length.
  */
-void generate_numeric(char *password, int length) {
-    for (int i = 0; i < length; i++) {
-        password[i] = '0' + rand() % 10; // Generates a digit between 0 and 9
+void generate_numeric(char *password, int length, const char *prefix, CheckDigitMode mode) {
+    if (!generate_numeric_batch(password, 1, length, prefix, mode)) {
+        strcpy(password, "");
     }
-    password[length] = '\0';
 }
 
 
@@ -40,7 +215,7 @@ void generate_numeric(char *password, int length) {
  */
 void generate_alpha(char *password, int length) {
     for (int i = 0; i < length; i++) {
-        password[i] = 'a' + rand() % 26; // Generates a lowercase letter between 'a' and 'z'
+        password[i] = 'a' + chacha_below(&password_rng, 26); // Generates a lowercase letter between 'a' and 'z'
     }
     password[length] = '\0';
 }
@@ -55,7 +230,7 @@ void generate_alpha(char *password, int length) {
  */
 void generate_mixed(char *password, int length) {
     for (int i = 0; i < length; i++) {
-        password[i] = (rand() % 2) ? 'a' + rand() % 26 : '0' + rand() % 10; // Generates either a digit or a lowercase letter
+        password[i] = chacha_below(&password_rng, 2) ? 'a' + chacha_below(&password_rng, 26) : '0' + chacha_below(&password_rng, 10); // Generates either a digit or a lowercase letter
     }
     password[length] = '\0';
 }
@@ -71,7 +246,7 @@ void generate_mixed(char *password, int length) {
 void generate_secure(char *password, int length) {
     const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*()";
     for (int i = 0; i < length; i++) {
-        password[i] = charset[rand() % (sizeof(charset) - 1)];
+        password[i] = charset[chacha_below(&password_rng, sizeof(charset) - 1)];
     }
     password[length] = '\0';
 }
@@ -80,7 +255,7 @@ void generate_secure(char *password, int length) {
 /**
  * @brief Generates a password based on the specified length and type.
  * @param[in/out] password: a pointer to store the generated password.
- * @param[in] type: the type of password to generate (NUMERIC, ALPHA, MIXED, or SECURE).
+ * @param[in] type: the type of password to generate (NUMERIC, NUMERIC_LUHN, NUMERIC_MOD97, ALPHA, MIXED, or SECURE).
  * @param[in] length: the length of the password to generate.
  * @pre `length` should be a positive integer, and `type` should be a valid PasswordType.
  * @post `password` is populated with the generated password.
@@ -88,7 +263,13 @@ void generate_secure(char *password, int length) {
 void generate_password(char *password, PasswordType type, int length) {
     switch(type) {
         case NUMERIC:
-            generate_numeric(password, length);
+            generate_numeric(password, length, NULL, CHECK_NONE);
+            break;
+        case NUMERIC_LUHN:
+            generate_numeric(password, length, NULL, CHECK_LUHN);
+            break;
+        case NUMERIC_MOD97:
+            generate_numeric(password, length, NULL, CHECK_MOD97);
             break;
         case ALPHA:
             generate_alpha(password, length);
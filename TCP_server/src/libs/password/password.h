@@ -13,6 +13,7 @@
 #define PASSWORD_H_
 
 #include <stdbool.h>
+#include "../chacha/chacha.h"
 
 
 /* - - - - - - - - - - - - - - - - - - - PASSWORD TYPES - - - - - - - - - - - - - - - - - */
@@ -22,29 +23,68 @@
  * @brief Enumerates the types of passwords that can be generated.
  *
  * - `NUMERIC`: Generates a password consisting of only numeric digits (0-9).
+ * - `NUMERIC_LUHN`: Generates a numeric code whose last digit is a Luhn check digit.
+ * - `NUMERIC_MOD97`: Generates a numeric code whose last two digits are ISO 7064 mod 97-10 check digits.
  * - `ALPHA`: Generates a password using lowercase alphabetic characters (a-z).
  * - `MIXED`: Generates a password with a mix of lowercase alphabetic characters and digits.
  * - `SECURE`: Generates a password with lowercase and uppercase alphabetic characters, digits, and symbols.
  */
 typedef enum {
     NUMERIC,   /**< Numeric password */
+    NUMERIC_LUHN,   /**< Numeric code with a Luhn check digit */
+    NUMERIC_MOD97,  /**< Numeric code with ISO 7064 mod 97-10 check digits */
     ALPHA,     /**< Lowercase alphabetic password */
     MIXED,     /**< Lowercase alphanumeric password */
     SECURE     /**< Secure password with uppercase, lowercase, numbers, and symbols */
 } PasswordType;
 
+
+/**
+ * @enum CheckDigitMode
+ * @brief Enumerates the check digit schemes that can terminate a numeric code.
+ *
+ * - `CHECK_NONE`: No check digit, every digit is random.
+ * - `CHECK_LUHN`: The last digit is a Luhn (mod 10) check digit, as used by card and voucher numbers.
+ * - `CHECK_MOD97`: The last two digits are ISO 7064 mod 97-10 check digits, as used by IBAN-style account numbers.
+ */
+typedef enum {
+    CHECK_NONE,    /**< No check digits */
+    CHECK_LUHN,    /**< One trailing Luhn check digit */
+    CHECK_MOD97    /**< Two trailing ISO 7064 mod 97-10 check digits */
+} CheckDigitMode;
+
 /* - - - - - - - - - - - - - - - - - - END PASSWORD TYPES - - - - - - - - - - - - - - - - */
 
 /* - - - - - - - - - - - - - - - - - - PASSWORD GENERATION - - - - - - - - - - - - - - - - - - */
 
+/**
+ * @brief Seeds the random generator used for passwords.
+ *
+ * Must be called once before the first password is generated, otherwise every
+ * run of the server generates the same sequence of passwords.
+ *
+ * @param[in] key: the ChaCha20 key, which should come from an unpredictable source.
+ */
+void seed_password_generator(const unsigned char key[CHACHA_KEY_SIZE]);
+
+
+/**
+ * @brief Reports whether the random generator used for passwords was seeded.
+ * @return `true` if `seed_password_generator` was called.
+ */
+bool password_generator_seeded(void);
+
+
 /**
  * @brief Generates a password based on the specified type and length.
  *
- * This function creates a password using the specified `type` (NUMERIC, ALPHA, MIXED, SECURE) and length.
+ * This function creates a password using the specified `type` (NUMERIC, NUMERIC_LUHN, NUMERIC_MOD97, ALPHA, MIXED, SECURE) and length.
  * The resulting password is stored in the `password` parameter, which should be allocated to hold
  * at least `length + 1` characters (to account for the null terminator).
  *
  * - `NUMERIC`: Only numeric digits (0-9).
+ * - `NUMERIC_LUHN`: Numeric digits, the last one being a Luhn check digit.
+ * - `NUMERIC_MOD97`: Numeric digits, the last two being ISO 7064 mod 97-10 check digits.
  * - `ALPHA`: Only lowercase alphabetic characters (a-z).
  * - `MIXED`: A mix of lowercase alphabetic characters and digits.
  * - `SECURE`: A combination of lowercase and uppercase alphabetic characters, digits, and symbols.
@@ -56,6 +96,37 @@ typedef enum {
  */
 void generate_password(char *password, PasswordType type, int length);
 
+
+/**
+ * @brief Returns the shortest password of a type.
+ *
+ * A code of the check digit types is generated only with room for at least one random digit
+ * before its check digits; shorter lengths must be rejected when the request is validated.
+ *
+ * @param[in] type: the type of password, as specified in the `PasswordType` enum.
+ * @return the minimum length, 1 for the types without check digits.
+ */
+int shortest_length(PasswordType type);
+
+
+/**
+ * @brief Generates a batch of numeric codes with an optional fixed prefix and trailing check digits.
+ *
+ * Every code is `length` characters long, prefix and check digits included, and is followed by a
+ * null terminator, so `codes` must hold at least `count * (length + 1)` characters. The check digits
+ * of the whole batch are computed column by column over blocks of codes, and the contribution of
+ * the prefix is computed once per batch, so large issuance runs only pay for the random digits.
+ *
+ * @param[out] codes: a pre-allocated array receiving `count` codes spaced `length + 1` characters apart.
+ * @param[in] count: the number of codes to generate.
+ * @param[in] length: the total length of every code.
+ * @param[in] prefix: a string of digits every code starts with, or NULL for no prefix.
+ * @param[in] mode: the check digit scheme, as specified in the `CheckDigitMode` enum.
+ * @return `true` if the codes were generated.
+ * @return `false` if `prefix` contains non-digits or leaves no room for the check digits.
+ */
+bool generate_numeric_batch(char *codes, int count, int length, const char *prefix, CheckDigitMode mode);
+
 /* - - - - - - - - - - - - - - - - - END PASSWORD GENERATION - - - - - - - - - - - - - - - - - */
 
 
@@ -0,0 +1,212 @@
+/*
+ ============================================================================
+ Name        : perf.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Hardware performance counters read through perf_event_open().
+ ============================================================================
+ */
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "perf.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - - PERF - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns the printable name of an event.
+ * @param[in] event: the event.
+ * @return a static string naming the event.
+ */
+const char *perf_event_name(PerfEvent event) {
+    static const char *names[PERF_EVENT_COUNT] = {
+        "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"
+    };
+    return (event >= 0 && event < PERF_EVENT_COUNT) ? names[event] : "?";
+}
+
+
+/**
+ * @brief Marks a group of counters as closed.
+ * @param[out] counters: the counters.
+ */
+void init_perf_counters(PerfCounters *counters) {
+    counters->leader = -1;
+    counters->opened = 0;
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        counters->fds[i] = -1;
+        counters->positions[i] = -1;
+    }
+}
+
+
+#if defined(__linux__)
+/**
+ * @brief Opens one event of the calling thread.
+ * @param[in] type: the perf event type.
+ * @param[in] config: the event of that type.
+ * @param[in] group: the group leader, -1 to open a new group.
+ * @return the descriptor of the event, or -1 on failure.
+ */
+static int open_event(unsigned int type, unsigned long long config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = (group < 0);    /**< The leader starts the whole group once it is complete */
+    attr.exclude_kernel = 1;        /**< Allowed with the default perf_event_paranoid setting */
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+
+/**
+ * @brief Opens the counters of the calling thread, user space only.
+ * @param[out] counters: the counters.
+ * @return the number of events available, 0 if none can be opened.
+ */
+int open_perf_counters(PerfCounters *counters) {
+    init_perf_counters(counters);
+#if defined(__linux__)
+    static const struct {
+        unsigned int type;
+        unsigned long long config;
+    } events[PERF_EVENT_COUNT] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                              | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    };
+
+    // The first event that opens leads the group; the others join it or are left out
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        int fd = open_event(events[i].type, events[i].config, counters->leader);
+        if (fd < 0) {
+            continue;
+        }
+        if (counters->leader < 0) {
+            counters->leader = fd;
+        }
+        counters->fds[i] = fd;
+        counters->positions[i] = counters->opened++;
+    }
+    if (counters->leader < 0) {
+        return 0;
+    }
+    ioctl(counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    return counters->opened;
+}
+
+
+/**
+ * @brief Reads every counter of the group with one system call.
+ * @param[in] counters: the open counters.
+ * @param[out] sample: receives the values.
+ * @return `true` if the counters were read.
+ */
+bool read_perf_counters(const PerfCounters *counters, PerfSample *sample) {
+    memset(sample, 0, sizeof(*sample));
+#if defined(__linux__)
+    if (counters->leader < 0) {
+        return false;
+    }
+    // Group read layout: number of events, then one value per event in opening order
+    unsigned long long values[1 + PERF_EVENT_COUNT];
+    ssize_t expected = (ssize_t) ((1 + counters->opened) * sizeof(unsigned long long));
+    if (read(counters->leader, values, sizeof(values)) < expected) {
+        return false;
+    }
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (counters->positions[i] >= 0) {
+            sample->values[i] = values[1 + counters->positions[i]];
+        }
+    }
+    return true;
+#else
+    (void) counters;
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Closes the counters.
+ * @param[in/out] counters: the counters, closed afterwards.
+ */
+void close_perf_counters(PerfCounters *counters) {
+#if defined(__linux__)
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+        }
+    }
+#endif
+    init_perf_counters(counters);
+}
+
+
+/**
+ * @brief Adds the counter deltas between two samples.
+ * @param[in/out] stats: the accumulated deltas.
+ * @param[in] begin: the sample taken before the measured work.
+ * @param[in] end: the sample taken after it.
+ * @param[in] passwords: the number of passwords produced by the measured work.
+ */
+void record_perf_sample(PerfStats *stats, const PerfSample *begin, const PerfSample *end, unsigned long passwords) {
+    stats->passwords += passwords;
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        stats->totals[i] += end->values[i] - begin->values[i];
+    }
+}
+
+
+/**
+ * @brief Formats the per-password figures of accumulated deltas as a single line.
+ * @param[in] stats: the accumulated deltas.
+ * @param[in] counters: the counters the deltas were read from.
+ * @param[in] name: the label of the line.
+ * @param[out] buffer: receives the null-terminated text, truncated if needed.
+ * @param[in] size: the size of `buffer`.
+ * @return the number of characters written.
+ */
+int format_perf_stats(const PerfStats *stats, const PerfCounters *counters, const char *name, char *buffer, size_t size) {
+    double passwords = (stats->passwords > 0) ? (double) stats->passwords : 1;
+    int written = snprintf(buffer, size, "%s passwords=%llu", name, stats->passwords);
+    size_t used = (written > 0) ? (size_t) written : 0;
+    for (int i = 0; i < PERF_EVENT_COUNT && used < size; i++) {
+        if (counters->positions[i] >= 0) {
+            written = snprintf(buffer + used, size - used, " %s=%.1f", perf_event_name(i), stats->totals[i] / passwords);
+        } else {
+            written = snprintf(buffer + used, size - used, " %s=-", perf_event_name(i));
+        }
+        used += (written > 0) ? (size_t) written : 0;
+    }
+    if (used < size) {
+        if (counters->positions[PERF_CYCLES] >= 0 && counters->positions[PERF_INSTRUCTIONS] >= 0
+                && stats->totals[PERF_CYCLES] > 0) {
+            written = snprintf(buffer + used, size - used, " ipc=%.2f\n",
+                               (double) stats->totals[PERF_INSTRUCTIONS] / stats->totals[PERF_CYCLES]);
+        } else {
+            written = snprintf(buffer + used, size - used, " ipc=-\n");
+        }
+        used += (written > 0) ? (size_t) written : 0;
+    }
+    return (int) (used < size ? used : size - 1);
+}
+
+/* - - - - - - - - - - - - - - - - - - - END PERF - - - - - - - - - - - - - - - - - - - */
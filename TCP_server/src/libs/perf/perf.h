@@ -0,0 +1,148 @@
+/*
+ ============================================================================
+ Name        : perf.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing hardware performance counters. On Linux
+               the counters are opened with perf_event_open() as one group,
+               so every read returns the cycles, instructions, branch misses
+               and L1/LLC misses of the calling thread from a single system
+               call. Counters the CPU or the kernel do not expose are left
+               out; elsewhere no counter is available.
+ ============================================================================
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief One request out of `PERF_SAMPLE_PERIOD` is sampled while counters are enabled.
+ * A sample reads the counters at every stage boundary, so sampling keeps the cost off most requests.
+ */
+#define PERF_SAMPLE_PERIOD 16   /**< Requests per sample */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum PerfEvent
+ * @brief Enumerates the hardware events counted.
+ */
+typedef enum {
+    PERF_CYCLES,            /**< CPU cycles */
+    PERF_INSTRUCTIONS,      /**< Retired instructions */
+    PERF_BRANCH_MISSES,     /**< Mispredicted branches */
+    PERF_L1D_MISSES,        /**< L1 data cache read misses */
+    PERF_LLC_MISSES,        /**< Last level cache misses */
+    PERF_EVENT_COUNT        /**< Number of events */
+} PerfEvent;
+
+
+/**
+ * @struct PerfCounters
+ * @brief A group of open hardware counters.
+ */
+typedef struct {
+    int leader;                         /**< Descriptor of the group leader, -1 if the counters are closed */
+    int fds[PERF_EVENT_COUNT];          /**< Descriptor of every event, -1 if it is not available */
+    int positions[PERF_EVENT_COUNT];    /**< Position of every event in a group read, -1 if it is not available */
+    int opened;                         /**< Number of events in the group */
+} PerfCounters;
+
+
+/**
+ * @struct PerfSample
+ * @brief Values of the counters at one instant.
+ */
+typedef struct {
+    unsigned long long values[PERF_EVENT_COUNT];    /**< Value of every event, 0 if it is not available */
+} PerfSample;
+
+
+/**
+ * @struct PerfStats
+ * @brief Counter deltas accumulated over a number of passwords.
+ */
+typedef struct {
+    unsigned long long passwords;               /**< Passwords measured */
+    unsigned long long totals[PERF_EVENT_COUNT];    /**< Sum of the deltas of every event */
+} PerfStats;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - PERF - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns the printable name of an event.
+ * @param[in] event: the event.
+ * @return a static string naming the event.
+ */
+const char *perf_event_name(PerfEvent event);
+
+
+/**
+ * @brief Marks a group of counters as closed.
+ * @param[out] counters: the counters.
+ */
+void init_perf_counters(PerfCounters *counters);
+
+
+/**
+ * @brief Opens the counters of the calling thread, user space only.
+ * @param[out] counters: the counters.
+ * @return the number of events available, 0 if none can be opened.
+ * @post If no event is available the counters stay closed.
+ */
+int open_perf_counters(PerfCounters *counters);
+
+
+/**
+ * @brief Reads every counter of the group with one system call.
+ * @param[in] counters: the open counters.
+ * @param[out] sample: receives the values.
+ * @return `true` if the counters were read.
+ */
+bool read_perf_counters(const PerfCounters *counters, PerfSample *sample);
+
+
+/**
+ * @brief Closes the counters.
+ * @param[in/out] counters: the counters, closed afterwards.
+ */
+void close_perf_counters(PerfCounters *counters);
+
+
+/**
+ * @brief Adds the counter deltas between two samples.
+ * @param[in/out] stats: the accumulated deltas.
+ * @param[in] begin: the sample taken before the measured work.
+ * @param[in] end: the sample taken after it.
+ * @param[in] passwords: the number of passwords produced by the measured work.
+ */
+void record_perf_sample(PerfStats *stats, const PerfSample *begin, const PerfSample *end, unsigned long passwords);
+
+
+/**
+ * @brief Formats the per-password figures of accumulated deltas as a single line.
+ * Unavailable events are printed as `-`.
+ * @param[in] stats: the accumulated deltas.
+ * @param[in] counters: the counters the deltas were read from.
+ * @param[in] name: the label of the line.
+ * @param[out] buffer: receives the null-terminated text, truncated if needed.
+ * @param[in] size: the size of `buffer`.
+ * @return the number of characters written.
+ */
+int format_perf_stats(const PerfStats *stats, const PerfCounters *counters, const char *name, char *buffer, size_t size);
+
+/* - - - - - - - - - - - - - - - - - - - END PERF - - - - - - - - - - - - - - - - - - - */
+
+#endif /* PERF_H_ */
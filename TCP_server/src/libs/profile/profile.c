@@ -0,0 +1,489 @@
+/*
+ ============================================================================
+ Name        : profile.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Built-in sampling profiler producing folded stacks.
+ ============================================================================
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE     /**< Required for gettid(), dladdr() and dl_iterate_phdr() */
+#include <dlfcn.h>
+#include <elf.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <link.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - SAMPLING - - - - - - - - - - - - - - - - - - - - */
+
+#if defined(__linux__)
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid  /**< Not exposed by older C libraries */
+#endif
+
+static uintptr_t (*frames)[PROFILE_MAX_DEPTH];  /**< Frames of every sample, innermost first */
+static unsigned char *depths;                   /**< Frames of every sample */
+static volatile sig_atomic_t sample_count;      /**< Samples taken, written by the handler only */
+static volatile sig_atomic_t dropped_count;     /**< Samples lost on a full buffer */
+static timer_t timer;                           /**< CPU time timer of the sampled thread */
+static bool running;                            /**< Whether the timer is armed */
+static double deadline;                         /**< Time the running profile stops */
+
+
+/**
+ * @brief SIGPROF handler: records the stack of the interrupted code.
+ *
+ * backtrace() starts in this handler; the frames up to the signal trampoline are dropped, so
+ * every sample starts at the interrupted instruction.
+ */
+static void take_sample(int signal_number, siginfo_t *info, void *context) {
+    (void) signal_number;
+    (void) info;
+    int saved_errno = errno;
+    int index = sample_count;
+    if (index >= PROFILE_MAX_SAMPLES) {
+        dropped_count++;
+        errno = saved_errno;
+        return;
+    }
+
+    void *stack[PROFILE_MAX_DEPTH + 4];
+    int depth = backtrace(stack, PROFILE_MAX_DEPTH + 4);
+    int first = (depth > 2) ? 2 : depth;
+#if defined(__x86_64__)
+    uintptr_t pc = (uintptr_t) ((ucontext_t *) context)->uc_mcontext.gregs[REG_RIP];
+    for (int i = 0; i < depth; i++) {
+        if ((uintptr_t) stack[i] == pc) {
+            first = i;
+            break;
+        }
+    }
+#else
+    (void) context;
+#endif
+    int kept = (depth - first > PROFILE_MAX_DEPTH) ? PROFILE_MAX_DEPTH : depth - first;
+    for (int i = 0; i < kept; i++) {
+        frames[index][i] = (uintptr_t) stack[first + i];
+    }
+    depths[index] = (unsigned char) kept;
+    sample_count = index + 1;
+    errno = saved_errno;
+}
+#endif
+
+
+/**
+ * @brief Starts sampling the calling thread.
+ * @param[in] seconds: the duration of the profile.
+ * @param[in] now: the current time of the monotonic clock.
+ * @param[out] reason: receives why the profile cannot start.
+ * @param[in] size: the size of `reason`.
+ * @return `true` if sampling started.
+ */
+bool start_profile(int seconds, double now, char *reason, size_t size) {
+#if defined(__linux__)
+    if (running) {
+        snprintf(reason, size, "a profile is running");
+        return false;
+    }
+    if (seconds < 1 || seconds > PROFILE_MAX_SECONDS) {
+        snprintf(reason, size, "expected 1 to %d seconds", PROFILE_MAX_SECONDS);
+        return false;
+    }
+    if (frames == NULL) {
+        frames = malloc(sizeof(*frames) * PROFILE_MAX_SAMPLES);
+        depths = malloc(PROFILE_MAX_SAMPLES);
+        if (frames == NULL || depths == NULL) {
+            free(frames);
+            free(depths);
+            frames = NULL;
+            depths = NULL;
+            snprintf(reason, size, "out of memory");
+            return false;
+        }
+        // The first backtrace() loads the unwinder, which must not happen inside the handler
+        void *warmup[1];
+        backtrace(warmup, 1);
+    }
+    sample_count = 0;
+    dropped_count = 0;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = take_sample;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) < 0) {
+        snprintf(reason, size, "sigaction: %s", strerror(errno));
+        return false;
+    }
+
+    // CPU time of this thread only: an idle event loop takes no samples, other threads none at all
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = gettid();
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) < 0) {
+        snprintf(reason, size, "timer_create: %s", strerror(errno));
+        return false;
+    }
+    struct itimerspec period;
+    memset(&period, 0, sizeof(period));
+    period.it_interval.tv_nsec = 1000000000L / PROFILE_HZ;
+    period.it_value = period.it_interval;
+    if (timer_settime(timer, 0, &period, NULL) < 0) {
+        snprintf(reason, size, "timer_settime: %s", strerror(errno));
+        timer_delete(timer);
+        return false;
+    }
+    running = true;
+    deadline = now + seconds;
+    return true;
+#else
+    (void) seconds;
+    (void) now;
+    snprintf(reason, size, "not supported");
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Tells whether a profile is being sampled.
+ * @return `true` if the timer is armed.
+ */
+bool profile_running(void) {
+#if defined(__linux__)
+    return running;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Tells whether the running profile has reached its duration.
+ * @param[in] now: the current time of the monotonic clock.
+ * @return `true` if the profile is due to stop.
+ */
+bool profile_due(double now) {
+#if defined(__linux__)
+    return running && now >= deadline;
+#else
+    (void) now;
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Stops sampling.
+ */
+void stop_profile(void) {
+#if defined(__linux__)
+    if (running) {
+        timer_delete(timer);
+        running = false;
+    }
+#endif
+}
+
+
+/**
+ * @brief Returns the counters of the last profile.
+ * @param[out] samples: receives the samples taken.
+ * @param[out] dropped: receives the samples lost.
+ */
+void profile_counters(unsigned long *samples, unsigned long *dropped) {
+#if defined(__linux__)
+    *samples = (unsigned long) sample_count;
+    *dropped = (unsigned long) dropped_count;
+#else
+    *samples = 0;
+    *dropped = 0;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - END SAMPLING - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - SYMBOLS - - - - - - - - - - - - - - - - - - - - */
+
+#if defined(__linux__)
+/**
+ * @struct Symbol
+ * @brief A function of the executable, at its address in memory.
+ */
+typedef struct {
+    uintptr_t start;    /**< First byte of the function */
+    uintptr_t end;      /**< First byte past the function */
+    const char *name;   /**< Name, pointing into `image` */
+} Symbol;
+
+static char *image;             /**< The executable file, kept for the names of its symbols */
+static Symbol *symbols;         /**< Functions of the executable, sorted by address */
+static int symbol_count;        /**< Number of functions */
+static bool symbols_loaded;     /**< Whether loading was attempted */
+
+
+/**
+ * @brief dl_iterate_phdr() callback stopping at the first object, the executable.
+ */
+static int executable_base(struct dl_phdr_info *info, size_t size, void *base) {
+    (void) size;
+    *(uintptr_t *) base = (uintptr_t) info->dlpi_addr;
+    return 1;
+}
+
+
+/**
+ * @brief Orders symbols by address.
+ */
+static int compare_symbols(const void *a, const void *b) {
+    uintptr_t first = ((const Symbol *) a)->start;
+    uintptr_t second = ((const Symbol *) b)->start;
+    return (first > second) - (first < second);
+}
+
+
+/**
+ * @brief Loads the functions of the symbol table of the executable, once.
+ *
+ * The symbol table lists static functions too, which the dynamic symbols used by dladdr() do not.
+ */
+static void load_symbols(void) {
+    if (symbols_loaded) {
+        return;
+    }
+    symbols_loaded = true;
+    FILE *file = fopen("/proc/self/exe", "rb");
+    if (file == NULL) {
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    image = (size > (long) sizeof(ElfW(Ehdr))) ? malloc(size) : NULL;
+    bool read = image != NULL && fread(image, 1, size, file) == (size_t) size;
+    fclose(file);
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *) image;
+    if (!read || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+        || header->e_shoff + (size_t) header->e_shnum * sizeof(ElfW(Shdr)) > (size_t) size) {
+        free(image);
+        image = NULL;
+        return;
+    }
+
+    uintptr_t base = 0;
+    dl_iterate_phdr(executable_base, &base);
+    ElfW(Shdr) *sections = (ElfW(Shdr) *) (image + header->e_shoff);
+    for (int s = 0; s < header->e_shnum; s++) {
+        if (sections[s].sh_type != SHT_SYMTAB || sections[s].sh_link >= header->e_shnum
+            || sections[s].sh_offset + sections[s].sh_size > (size_t) size) {
+            continue;
+        }
+        // The string table must lie in the file and end its last name, or names could run past it
+        const ElfW(Shdr) *strings = &sections[sections[s].sh_link];
+        if (strings->sh_size == 0 || strings->sh_offset + strings->sh_size > (size_t) size
+            || image[strings->sh_offset + strings->sh_size - 1] != '\0') {
+            continue;
+        }
+        ElfW(Sym) *entries = (ElfW(Sym) *) (image + sections[s].sh_offset);
+        size_t entry_count = sections[s].sh_size / sizeof(ElfW(Sym));
+        const char *names = image + strings->sh_offset;
+        symbols = malloc(entry_count * sizeof(Symbol));
+        if (symbols == NULL) {
+            return;
+        }
+        for (size_t i = 0; i < entry_count; i++) {
+            if (ELF64_ST_TYPE(entries[i].st_info) == STT_FUNC && entries[i].st_value != 0
+                && entries[i].st_name < strings->sh_size) {
+                symbols[symbol_count].start = base + entries[i].st_value;
+                symbols[symbol_count].end = base + entries[i].st_value + entries[i].st_size;
+                symbols[symbol_count].name = names + entries[i].st_name;
+                symbol_count++;
+            }
+        }
+        qsort(symbols, symbol_count, sizeof(Symbol), compare_symbols);
+        return;
+    }
+}
+
+
+/**
+ * @brief Names the function holding an address.
+ * @param[in] address: the address.
+ * @param[out] name: receives the name.
+ * @param[in] size: the size of `name`.
+ */
+static void symbolize(uintptr_t address, char *name, size_t size) {
+    int low = 0;
+    int high = symbol_count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (symbols[middle].start <= address) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    if (high >= 0 && address < symbols[high].end) {
+        snprintf(name, size, "%s", symbols[high].name);
+        return;
+    }
+
+    // Shared libraries: their exported symbols, or the library and offset
+    Dl_info info;
+    memset(&info, 0, sizeof(info));
+    bool found = dladdr((void *) address, &info) != 0;
+    if (found && info.dli_sname != NULL) {
+        snprintf(name, size, "%s", info.dli_sname);
+    } else if (found && info.dli_fname != NULL) {
+        const char *module = strrchr(info.dli_fname, '/');
+        snprintf(name, size, "[%s+0x%lx]", (module != NULL) ? module + 1 : info.dli_fname,
+                 (unsigned long) (address - (uintptr_t) info.dli_fbase));
+    } else {
+        snprintf(name, size, "[unknown]");
+    }
+}
+
+
+/**
+ * @brief Orders samples by their frames, so identical stacks end up next to each other.
+ */
+static int compare_samples(const void *a, const void *b) {
+    int first = *(const int *) a;
+    int second = *(const int *) b;
+    if (depths[first] != depths[second]) {
+        return depths[first] - depths[second];
+    }
+    for (int i = 0; i < depths[first]; i++) {
+        if (frames[first][i] != frames[second][i]) {
+            return (frames[first][i] > frames[second][i]) ? 1 : -1;
+        }
+    }
+    return 0;
+}
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - END SYMBOLS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - DUMP - - - - - - - - - - - - - - - - - - - - - */
+
+#if defined(__linux__)
+/**
+ * @struct FoldedStack
+ * @brief A symbolized stack and its samples.
+ */
+typedef struct {
+    char *text;             /**< Frames, outermost first, separated by ';' */
+    unsigned long count;    /**< Samples of the stack */
+} FoldedStack;
+
+
+/**
+ * @brief Orders folded stacks by text.
+ */
+static int compare_folded(const void *a, const void *b) {
+    return strcmp(((const FoldedStack *) a)->text, ((const FoldedStack *) b)->text);
+}
+
+
+/**
+ * @brief Symbolizes the frames of a sample, outermost first.
+ * Return addresses point past their call, so they are looked up one byte back.
+ */
+static char *fold_sample(int sample) {
+    char stack[PROFILE_MAX_DEPTH * 96];
+    size_t length = 0;
+    stack[0] = '\0';
+    for (int f = depths[sample] - 1; f >= 0 && length + 1 < sizeof(stack); f--) {
+        char name[96];
+        symbolize(frames[sample][f] - (f > 0), name, sizeof(name));
+        length += snprintf(stack + length, sizeof(stack) - length, "%s%s", (length > 0) ? ";" : "", name);
+    }
+    return strdup(stack);
+}
+#endif
+
+
+/**
+ * @brief Aggregates and symbolizes the samples of the last profile.
+ *
+ * Samples are first grouped by their addresses, then by their symbolized text, as different
+ * addresses of the same functions fold into the same stack.
+ *
+ * @param[in] writer: receives every distinct stack and its count.
+ * @param[in] context: passed to `writer`.
+ * @return the number of distinct stacks, or -1 if memory ran out.
+ */
+int dump_profile(FoldedWriter writer, void *context) {
+#if defined(__linux__)
+    int count = sample_count;
+    if (count == 0) {
+        return 0;
+    }
+    int *order = malloc(count * sizeof(int));
+    FoldedStack *folded = malloc(count * sizeof(FoldedStack));
+    if (order == NULL || folded == NULL) {
+        free(order);
+        free(folded);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    qsort(order, count, sizeof(int), compare_samples);
+    load_symbols();
+
+    int distinct = 0;
+    bool complete = true;
+    for (int i = 0; i < count && complete;) {
+        int same = i + 1;
+        while (same < count && compare_samples(&order[i], &order[same]) == 0) {
+            same++;
+        }
+        folded[distinct].text = fold_sample(order[i]);
+        folded[distinct].count = (unsigned long) (same - i);
+        complete = folded[distinct].text != NULL;
+        distinct += complete;
+        i = same;
+    }
+    qsort(folded, distinct, sizeof(FoldedStack), compare_folded);
+
+    int stacks = 0;
+    for (int i = 0; i < distinct; i++) {
+        if (i + 1 < distinct && strcmp(folded[i].text, folded[i + 1].text) == 0) {
+            folded[i + 1].count += folded[i].count;
+        } else if (complete) {
+            writer(folded[i].text, folded[i].count, context);
+            stacks++;
+        }
+        free(folded[i].text);
+    }
+    free(order);
+    free(folded);
+    return complete ? stacks : -1;
+#else
+    (void) writer;
+    (void) context;
+    return 0;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - END DUMP - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,120 @@
+/*
+ ============================================================================
+ Name        : profile.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the built-in sampling profiler. A CPU
+               time timer of the event loop thread raises SIGPROF at
+               `PROFILE_HZ`; the handler only copies the return addresses
+               of the interrupted stack into a buffer allocated when the
+               profile starts. Stacks are aggregated and symbolized when the
+               profile is dumped, from the symbol table of the executable
+               and the dynamic symbols of the shared libraries, and written
+               as folded stacks ready for flamegraph.pl or speedscope. The
+               profiler is Linux only.
+ ============================================================================
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Sampling frequency, in samples per CPU second.
+ * A prime, so sampling does not run in lockstep with periodic work.
+ */
+#define PROFILE_HZ 997          /**< Sampling frequency */
+
+/**
+ * @brief Longest profile, in seconds.
+ */
+#define PROFILE_MAX_SECONDS 30  /**< Profile duration cap */
+
+/**
+ * @brief Frames kept per sample, the innermost ones.
+ */
+#define PROFILE_MAX_DEPTH 32    /**< Stack depth cap */
+
+/**
+ * @brief Samples a profile can hold: `PROFILE_MAX_SECONDS` of a fully busy thread.
+ */
+#define PROFILE_MAX_SAMPLES (PROFILE_HZ * PROFILE_MAX_SECONDS)   /**< Sample capacity */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Receives one folded stack of a dump.
+ * @param[in] stack: the frames from the outermost to the innermost, separated by ';'.
+ * @param[in] count: the samples of the stack.
+ * @param[in] context: the context given to `dump_profile`.
+ */
+typedef void (*FoldedWriter)(const char *stack, unsigned long count, void *context);
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - PROFILE - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Starts sampling the calling thread, discarding the previous profile.
+ * @param[in] seconds: the duration of the profile, between 1 and `PROFILE_MAX_SECONDS`.
+ * @param[in] now: the current time of the monotonic clock.
+ * @param[out] reason: receives why the profile cannot start.
+ * @param[in] size: the size of `reason`.
+ * @return `true` if sampling started.
+ */
+bool start_profile(int seconds, double now, char *reason, size_t size);
+
+
+/**
+ * @brief Tells whether a profile is being sampled.
+ * @return `true` between `start_profile` and `stop_profile`.
+ */
+bool profile_running(void);
+
+
+/**
+ * @brief Tells whether the running profile has reached its duration.
+ * @param[in] now: the current time of the monotonic clock.
+ * @return `true` if a profile is running and is due to stop.
+ */
+bool profile_due(double now);
+
+
+/**
+ * @brief Stops sampling; the samples are kept for `dump_profile`.
+ */
+void stop_profile(void);
+
+
+/**
+ * @brief Returns the counters of the last profile.
+ * @param[out] samples: receives the samples taken.
+ * @param[out] dropped: receives the samples lost on a full buffer.
+ */
+void profile_counters(unsigned long *samples, unsigned long *dropped);
+
+
+/**
+ * @brief Aggregates and symbolizes the samples of the last profile, one folded stack per call.
+ *
+ * Symbols are loaded on the first dump. Frames that cannot be named are written as the module
+ * and offset, or as `[unknown]`.
+ *
+ * @param[in] writer: receives every distinct stack and its count.
+ * @param[in] context: passed to `writer`.
+ * @return the number of distinct stacks, or -1 if memory ran out.
+ */
+int dump_profile(FoldedWriter writer, void *context);
+
+/* - - - - - - - - - - - - - - - - - - - END PROFILE - - - - - - - - - - - - - - - - - - - */
+
+#endif /* PROFILE_H_ */
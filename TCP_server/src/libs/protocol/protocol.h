@@ -41,17 +41,184 @@
 #define QLEN 5                  /**< Size of request queue */
 
 /**
- * @brief Minimum allowable password length.
- * The server will only accept password lengths that are at least `MIN_PASSWORD_LENGTH`.
+ * @brief Minimum allowable password length of the default tenant.
+ * The server will only accept password lengths that are at least `MIN_PASSWORD_LENGTH`,
+ * unless the tenant of the connection defines its own bounds.
  */
 #define MIN_PASSWORD_LENGTH 6   /**< Minimum password length */
 
 /**
  * @brief Maximum allowable password length.
  * The server will only accept password lengths that do not exceed `MAX_PASSWORD_LENGTH`.
+ * It is the default for tenants and the upper bound of every tenant, as it sizes `PasswordResponse`.
  */
 #define MAX_PASSWORD_LENGTH 32  /**< Maximum password length */
 
+/**
+ * @brief Version of the protocol spoken by this build.
+ * Version 2 opens every connection with an authentication handshake (`HelloChallenge`,
+ * `HelloResponse`, `HelloResult`) before the menu is sent.
+ */
+#define PROTOCOL_VERSION 2      /**< Protocol version */
+
+/**
+ * @brief Size in bytes of the nonce sent by the server in the authentication challenge.
+ */
+#define NONCE_SIZE 16           /**< Challenge nonce size */
+
+/**
+ * @brief Size in bytes of the HMAC-SHA256 proof sent by the client.
+ */
+#define MAC_SIZE 32             /**< Authentication proof size */
+
+/**
+ * @brief Maximum length of an API key identifier, null terminator included.
+ */
+#define KEY_ID_SIZE 32          /**< API key identifier size */
+
+/**
+ * @brief Opcode of a `HelloResponse` opening a password generation session.
+ */
+#define HELLO_SESSION 0         /**< Open a session */
+
+/**
+ * @brief Opcode of a `HelloResponse` asking for a `HealthResponse`.
+ * The server answers and closes the connection without authentication, menu, generation or logging.
+ */
+#define HELLO_HEALTH 1          /**< Health probe */
+
+/**
+ * @brief `HealthResponse` check bit: the event loop is not stalled.
+ */
+#define HEALTH_LOOP 0x01        /**< Event loop check */
+
+/**
+ * @brief `HealthResponse` check bit: the password generator is seeded.
+ */
+#define HEALTH_RNG 0x02         /**< Generator check */
+
+/**
+ * @brief `HealthResponse` check bit: the free sessions are above the low-water mark.
+ */
+#define HEALTH_CAPACITY 0x04    /**< Capacity check */
+
+/**
+ * @brief `PasswordRequest` type opening a stream on the connection.
+ * The `length` field holds "<type> <length> <credits>": the server then sends up to `credits`
+ * passwords of that type and length as `STREAM_ITEM` responses, as fast as the client reads them.
+ * The request itself is answered by a regular response accepting or rejecting the stream.
+ */
+#define STREAM_OPEN '>'         /**< Open a stream */
+
+/**
+ * @brief `PasswordRequest` type granting more credits to the open stream.
+ * The `length` field holds the number of credits; the request is not answered.
+ */
+#define STREAM_CREDIT '+'       /**< Grant stream credits */
+
+/**
+ * @brief `PasswordRequest` type closing the open stream.
+ * The server stops generating and sends a `STREAM_END` response after the last item.
+ */
+#define STREAM_CLOSE '.'        /**< Close the stream */
+
+/**
+ * @brief Largest number of credits a stream may hold, bounding what the server generates ahead of the client.
+ */
+#define STREAM_MAX_CREDITS 1024 /**< Stream credit cap */
+
+/**
+ * @brief `PasswordRequest` type asking for a batch of passwords in a single response.
+ * The `length` field holds "<type> <length> <count> <encoding>", the encoding being the name of a
+ * `PackEncoding`. The request is answered by a regular response accepting or rejecting the batch;
+ * an accepted batch follows as a `BatchHeader` and its payload.
+ */
+#define BATCH_REQUEST '*'       /**< Request a batch */
+
+/**
+ * @brief Largest number of passwords in a batch.
+ */
+#define BATCH_MAX_PASSWORDS 1024    /**< Batch size cap */
+
+/**
+ * @brief Sizes of the identifiers of a `TraceContext`, as in W3C trace context.
+ */
+#define TRACE_ID_SIZE 16        /**< Trace identifier size */
+#define SPAN_ID_SIZE 8          /**< Span identifier size */
+
+/**
+ * @brief Flag of a `TraceContext` asking the server to record the spans of the request.
+ */
+#define TRACE_SAMPLED 0x01      /**< Sampled request */
+
+/**
+ * @brief Largest number of datagrams received or sent by one system call in UDP mode.
+ */
+#define UDP_BATCH 32            /**< UDP batch size */
+
+/**
+ * @brief `PasswordResponse` kind: the answer to a request.
+ */
+#define STREAM_NONE 0           /**< Regular response */
+
+/**
+ * @brief `PasswordResponse` kind: a password of the open stream, sent without a request.
+ */
+#define STREAM_ITEM 1           /**< Stream item */
+
+/**
+ * @brief `PasswordResponse` kind: the stream is closed, no more items follow.
+ */
+#define STREAM_END 2            /**< End of stream */
+
+/**
+ * @brief File holding the pre-shared API keys, one `<key_id> <hex secret>` pair per line.
+ * If the file is absent the server does not require authentication.
+ */
+#define KEYS_FILE "keys.txt"    /**< API key file */
+
+/**
+ * @brief File holding the tenants, one `<name> <types> <min> <max> [rate] [burst]` entry per line.
+ * If the file is absent every connection uses the default tenant.
+ */
+#define TENANTS_FILE "tenants.txt"  /**< Tenant file */
+
+/**
+ * @brief Password types allowed to the default tenant.
+ */
+#define DEFAULT_TYPES "nliams"  /**< Types allowed by default */
+
+/**
+ * @brief Path of the admin control socket (Unix domain, not available on Windows).
+ */
+#define ADMIN_SOCKET_PATH "pwgen_admin.sock"    /**< Admin socket path */
+
+/**
+ * @brief Environment variable holding the admin token.
+ * If it is set, admin connections must send `auth <token>` before any other command.
+ */
+#define ADMIN_TOKEN_ENV "PWGEN_ADMIN_TOKEN"     /**< Admin token variable */
+
+/**
+ * @brief Longest event loop turn, in seconds, for the loop to be reported healthy.
+ */
+#define HEALTH_MAX_TURN 0.1     /**< Event loop stall threshold */
+
+/**
+ * @brief Minimum fraction of free sessions for the server to be reported ready.
+ */
+#define HEALTH_LOW_WATER 0.1    /**< Session capacity low-water mark */
+
+/**
+ * @brief Seconds the listener is left alone after accept() ran out of descriptors or memory.
+ */
+#define ACCEPT_BACKOFF_SECONDS 0.1  /**< Accept backoff */
+
+/**
+ * @brief File receiving one line per request while trace capture is enabled.
+ */
+#define TRACE_FILE "trace.log"  /**< Trace capture file */
+
 /* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - */
 
 
@@ -70,6 +237,25 @@ typedef struct {
 } MenuMessage;
 
 
+/**
+ * @struct TraceContext
+ * @brief Trace context propagated by the client with a request.
+ *
+ * An all-zero context, as sent by clients that do not trace, means no context. The server
+ * records spans only for requests whose `flags` hold `TRACE_SAMPLED`, parented to `span_id`.
+ *
+ * This struct includes:
+ * - `trace_id`: The trace the request belongs to.
+ * - `span_id`: The span of the client that issued the request.
+ * - `flags`: `TRACE_SAMPLED` or 0.
+ */
+typedef struct {
+    unsigned char trace_id[TRACE_ID_SIZE];  /**< Trace of the request */
+    unsigned char span_id[SPAN_ID_SIZE];    /**< Parent span, on the client */
+    unsigned char flags;                    /**< Trace flags */
+} TraceContext;
+
+
 /**
  * @struct PasswordRequest
  * @brief Struct used to represent a password generation request from the client.
@@ -77,12 +263,16 @@ typedef struct {
  * This struct contains:
  * - `type`: Specifies the type of password the client requests.
  * - `length`: Specifies the desired length of the generated password.
+ * - `trace`: The trace context of the request, if the client traces it.
  *
  * The `length` field is stored as a string, allowing for validation to be done during processing.
+ * The trace context takes the tail of what used to be the `length` field, so the request keeps its
+ * size and a client unaware of tracing, which zeroes the field, sends no context.
  */
 typedef struct {
     char type;        				/**< Type of the password to generate */
-    char length[BUFFER_SIZE];       /**< Length of the password requested */
+    char length[BUFFER_SIZE - sizeof(TraceContext)];  /**< Length of the password requested */
+    TraceContext trace;             /**< Optional trace context, zero if the request is not traced */
 } PasswordRequest;
 
 
@@ -95,14 +285,137 @@ typedef struct {
  * - `password`: The actual generated password returned to the client.
  * - `request_error`: A flag indicating if there was an error in the password request.
  * - `error_msg`: A string that contains an error message if `request_error` is `true`.
+ * - `stream`: `STREAM_NONE` for the answer to a request, `STREAM_ITEM` or `STREAM_END` for stream messages,
+ *   which may arrive between the answers.
  */
 typedef struct {
     bool keep_going;            /**< Flag indicating if password generation should continue */
     char password[MAX_PASSWORD_LENGTH + 1];  /**< The generated password */
     bool request_error;         /**< Flag indicating if there was an error with the request */
     char error_msg[50];         /**< Error message if `request_error` is triggered */
+    unsigned char stream;       /**< Kind of response */
 } PasswordResponse;
 
+
+/**
+ * @struct HelloChallenge
+ * @brief Struct sent by the server as soon as a connection is accepted.
+ *
+ * This struct includes:
+ * - `version`: The protocol version spoken by the server.
+ * - `auth_required`: A flag indicating if the client must prove ownership of an API key.
+ * - `nonce`: Random bytes the client proof is computed over, fresh for every connection.
+ */
+typedef struct {
+    unsigned char version;                  /**< Protocol version of the server */
+    bool auth_required;                     /**< Flag indicating if authentication is required */
+    unsigned char nonce[NONCE_SIZE];        /**< Random challenge for this connection */
+} HelloChallenge;
+
+
+/**
+ * @struct HelloResponse
+ * @brief Struct sent by the client in answer to a `HelloChallenge`.
+ *
+ * This struct includes:
+ * - `version`: The protocol version spoken by the client.
+ * - `opcode`: `HELLO_SESSION` to open a session, `HELLO_HEALTH` for a health probe.
+ * - `key_id`: The identifier of the client API key, zero-padded.
+ * - `mac`: HMAC-SHA256 with the key secret over `nonce` followed by the `key_id` field.
+ */
+typedef struct {
+    unsigned char version;                  /**< Protocol version of the client */
+    unsigned char opcode;                   /**< Requested operation */
+    char key_id[KEY_ID_SIZE];               /**< Identifier of the API key */
+    unsigned char mac[MAC_SIZE];            /**< Proof of ownership of the API key */
+} HelloResponse;
+
+
+/**
+ * @struct HelloResult
+ * @brief Struct sent by the server to conclude the authentication handshake.
+ *
+ * This struct includes:
+ * - `authenticated`: A flag indicating if the connection may proceed to the menu.
+ * - `error_msg`: A string that contains an error message if `authenticated` is `false`.
+ */
+typedef struct {
+    bool authenticated;                     /**< Flag indicating if the handshake succeeded */
+    char error_msg[50];                     /**< Error message if the handshake failed */
+} HelloResult;
+
+
+/**
+ * @struct HealthResponse
+ * @brief Struct sent by the server in answer to a `HELLO_HEALTH` probe.
+ *
+ * This struct includes:
+ * - `live`: A flag indicating if the server process is serving connections.
+ * - `ready`: A flag indicating if every readiness check passed.
+ * - `checks`: The passed checks, a combination of `HEALTH_LOOP`, `HEALTH_RNG` and `HEALTH_CAPACITY`.
+ */
+typedef struct {
+    bool live;                              /**< Flag indicating if the server is alive */
+    bool ready;                             /**< Flag indicating if the server accepts work */
+    unsigned char checks;                   /**< Passed readiness checks */
+} HealthResponse;
+
+
+/**
+ * @struct BatchHeader
+ * @brief Header of a batch of passwords, followed by `size` bytes of payload.
+ *
+ * The payload holds the `count` passwords concatenated, in the encoding of the header.
+ * A batch cut short by the rate limit of the tenant holds fewer passwords than requested.
+ *
+ * This struct includes:
+ * - `count`: The number of passwords in the batch.
+ * - `length`: The length of every password.
+ * - `encoding`: The `PackEncoding` of the payload.
+ * - `size`: The size of the payload in bytes.
+ */
+typedef struct {
+    unsigned short count;                   /**< Passwords in the batch */
+    unsigned char length;                   /**< Length of every password */
+    unsigned char encoding;                 /**< Encoding of the payload */
+    unsigned int size;                      /**< Bytes of payload following the header */
+} BatchHeader;
+
+
+/**
+ * @struct UdpRequest
+ * @brief Datagram requesting a single password in UDP mode.
+ *
+ * UDP requests carry no session: they are served under the default tenant, without
+ * authentication, and each is answered by one `UdpResponse` datagram.
+ *
+ * This struct includes:
+ * - `id`: An identifier chosen by the client and echoed in the response.
+ * - `type`: The type of password requested.
+ * - `length`: The desired length of the password.
+ */
+typedef struct {
+    unsigned int id;                        /**< Request identifier, echoed by the server */
+    char type;                              /**< Type of the password to generate */
+    unsigned char length;                   /**< Length of the password requested */
+} UdpRequest;
+
+
+/**
+ * @struct UdpResponse
+ * @brief Datagram answering a `UdpRequest`.
+ *
+ * This struct includes:
+ * - `id`: The identifier of the request.
+ * - `request_error`: A flag indicating if the request was rejected or rate limited.
+ * - `password`: The generated password, empty on error.
+ */
+typedef struct {
+    unsigned int id;                        /**< Identifier of the request */
+    bool request_error;                     /**< Flag indicating if there was an error with the request */
+    char password[MAX_PASSWORD_LENGTH + 1]; /**< The generated password */
+} UdpResponse;
+
 /* - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - - */
 
 #endif // PROTOCOL_H
@@ -0,0 +1,626 @@
+/*
+ ============================================================================
+ Name        : proxy.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Proxy mode: health-aware backend selection and zero-copy
+               forwarding with splice(), with a copy loop where splice()
+               is not available.
+ ============================================================================
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE     /**< Required for splice() and pipe2() */
+#endif
+
+#if defined WIN32
+#include <winsock.h>
+#define SHUT_WR 1       /**< SD_SEND: no more sends on the socket */
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#define closesocket close
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "proxy.h"
+#include "../protocol/protocol.h"
+#include "../utils/utils.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - BACKENDS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Sets or clears the non-blocking mode of a socket.
+ * @param[in] socket: the socket.
+ * @param[in] enabled: whether calls on the socket must not block.
+ */
+static void set_nonblocking(int socket, bool enabled) {
+#if defined WIN32
+    u_long mode = enabled ? 1 : 0;
+    ioctlsocket(socket, FIONBIO, &mode);
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    fcntl(socket, F_SETFL, enabled ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+#endif
+}
+
+
+/**
+ * @brief Tells whether the last socket or pipe call failed only because it would have blocked.
+ */
+static bool would_block(void) {
+#if defined WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+
+/**
+ * @brief Starts a connection to a backend without waiting for it.
+ * @param[in] backend: the backend.
+ * @return the socket, connected or connecting, or -1 if the connection failed at once.
+ */
+static int start_connect(const Backend *backend) {
+    struct sockaddr_in sad;  /**< Socket address structure for the backend */
+    memset(&sad, 0, sizeof(sad));
+    sad.sin_family = AF_INET;
+    sad.sin_port = htons(backend->port);
+    sad.sin_addr.s_addr = backend->address;
+
+    int b_socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (b_socket < 0) {
+        return -1;
+    }
+    set_nonblocking(b_socket, true);
+    if (connect(b_socket, (struct sockaddr*) &sad, sizeof(sad)) < 0) {
+#if defined WIN32
+        bool in_progress = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        bool in_progress = errno == EINPROGRESS;
+#endif
+        if (!in_progress) {
+            closesocket(b_socket);
+            return -1;
+        }
+    }
+    return b_socket;
+}
+
+
+/**
+ * @brief Tells whether a connection started by `start_connect` was established.
+ * @param[in] b_socket: the socket, reported writable by select().
+ * @return `true` if the connection is established, `false` if it failed.
+ */
+static bool connect_succeeded(int b_socket) {
+    int error = 0;
+#if defined WIN32
+    int error_size = sizeof(error);
+#else
+    socklen_t error_size = sizeof(error);
+#endif
+    return getsockopt(b_socket, SOL_SOCKET, SO_ERROR, (char *) &error, &error_size) == 0 && error == 0;
+}
+
+
+/**
+ * @brief Records a failed connection to a backend: it is unhealthy until its next probe succeeds.
+ * @param[in/out] backend: the backend.
+ */
+static void backend_failed(Backend *backend) {
+    backend->healthy = false;
+    backend->failures++;
+    backend->next_check = monotonic_seconds() + PROXY_CHECK_SECONDS;
+}
+
+
+/**
+ * @brief Ends the health probe of a backend and records its outcome.
+ * @param[in/out] backend: the backend; `healthy` is updated with the outcome.
+ * @param[in] healthy: whether the backend answered the probe reporting it ready.
+ */
+static void finish_probe(Backend *backend, bool healthy) {
+    bool was_healthy = backend->healthy;
+    if (backend->probe_socket >= 0) {
+        closesocket(backend->probe_socket);
+        backend->probe_socket = -1;
+    }
+    backend->probe_state = PROBE_IDLE;
+    backend->healthy = healthy;
+    if (!healthy) {
+        backend->failures++;
+    }
+
+    if (backend->healthy != was_healthy) {
+        char line[BUFFER_SIZE];
+        snprintf(line, sizeof(line), "Backend %s:%d is %s\n", backend->host, backend->port,
+                 backend->healthy ? "healthy" : "unhealthy");
+        log_with_color(LEVEL_INFO, line, backend->healthy ? GREEN : MAGENTA);
+    }
+}
+
+
+/**
+ * @brief Starts the health probe of a backend.
+ * @param[in/out] backend: the backend.
+ * @param[in] now: the current monotonic time.
+ */
+static void start_probe(Backend *backend, double now) {
+    backend->next_check = now + PROXY_CHECK_SECONDS;
+    backend->probe_socket = start_connect(backend);
+    if (backend->probe_socket < 0) {
+        finish_probe(backend, false);
+        return;
+    }
+    backend->probe_state = PROBE_CONNECTING;
+    backend->probe_deadline = now + PROXY_CONNECT_TIMEOUT;
+    backend->probe_received = 0;
+}
+
+
+/**
+ * @brief Advances the health probe of a backend whose socket is ready.
+ *
+ * Once connected, the probe receives the challenge, sends a `HELLO_HEALTH` response and receives
+ * the health of the backend, each message possibly in several segments.
+ *
+ * @param[in/out] backend: the backend, writable while `PROBE_CONNECTING`, readable afterwards.
+ */
+static void advance_probe(Backend *backend) {
+    if (backend->probe_state == PROBE_CONNECTING) {
+        if (!connect_succeeded(backend->probe_socket)) {
+            finish_probe(backend, false);
+            return;
+        }
+        backend->probe_state = PROBE_CHALLENGE;
+        return;
+    }
+
+    size_t expected = (backend->probe_state == PROBE_CHALLENGE) ? sizeof(HelloChallenge) : sizeof(HealthResponse);
+    int received = recv(backend->probe_socket, (char *) &backend->probe_input + backend->probe_received,
+                        (int) (expected - backend->probe_received), 0);
+    if (received <= 0) {
+        if (received < 0 && would_block()) {
+            return;
+        }
+        finish_probe(backend, false);
+        return;
+    }
+    backend->probe_received += received;
+    if (backend->probe_received < expected) {
+        return;
+    }
+    backend->probe_received = 0;
+    if (backend->probe_state == PROBE_HEALTH) {
+        finish_probe(backend, backend->probe_input.health.ready);
+        return;
+    }
+
+    // The response fits in the empty send buffer of a fresh connection
+    HelloResponse probe_msg;
+    memset(&probe_msg, 0, sizeof(probe_msg));
+    probe_msg.version = PROTOCOL_VERSION;
+    probe_msg.opcode = HELLO_HEALTH;
+    if (send(backend->probe_socket, (const char *) &probe_msg, sizeof(probe_msg), 0) != sizeof(probe_msg)) {
+        finish_probe(backend, false);
+        return;
+    }
+    backend->probe_state = PROBE_HEALTH;
+}
+
+
+/**
+ * @brief Parses a comma-separated list of `host:port` backends.
+ * @param[out] proxy: the proxy.
+ * @param[in] list: the list of backends.
+ * @return the number of backends parsed, or -1 if an entry is not valid or cannot be resolved.
+ * @post Every backend is unhealthy and due for a probe.
+ */
+int parse_backends(Proxy *proxy, const char *list) {
+    memset(proxy, 0, sizeof(*proxy));
+    const char *entry = list;
+    while (*entry != '\0') {
+        const char *end = strchr(entry, ',');
+        size_t entry_len = (end != NULL) ? (size_t) (end - entry) : strlen(entry);
+        if (entry_len == 0 || entry_len >= BACKEND_HOST_SIZE || proxy->backend_count >= MAX_BACKENDS) {
+            return -1;
+        }
+
+        Backend *backend = &proxy->backends[proxy->backend_count];
+        memcpy(backend->host, entry, entry_len);
+        backend->host[entry_len] = '\0';
+        backend->port = DEFAULT_PORT;
+        char *colon = strchr(backend->host, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            backend->port = atoi(colon + 1);
+            if (backend->port <= 0 || backend->port > 65535) {
+                return -1;
+            }
+        }
+
+        // Resolve the host once: connections to the backend reuse the address
+        backend->address = inet_addr(backend->host);
+        if (backend->address == INADDR_NONE) {
+            struct hostent *host = gethostbyname(backend->host);
+            if (host == NULL || host->h_addrtype != AF_INET) {
+                return -1;
+            }
+            memcpy(&backend->address, host->h_addr_list[0], sizeof(backend->address));
+        }
+        backend->probe_socket = -1;
+        proxy->backend_count++;
+
+        entry += entry_len;
+        if (*entry == ',') {
+            entry++;
+        }
+    }
+    return proxy->backend_count;
+}
+
+
+/**
+ * @brief Starts the due health probes and fails the ones past their deadline.
+ * @param[in/out] proxy: the proxy.
+ */
+void check_backends(Proxy *proxy) {
+    double now = monotonic_seconds();
+    for (int i = 0; i < proxy->backend_count; i++) {
+        Backend *backend = &proxy->backends[i];
+        if (backend->probe_state != PROBE_IDLE && now >= backend->probe_deadline) {
+            finish_probe(backend, false);   /**< Too slow to be trusted with clients */
+        } else if (backend->probe_state == PROBE_IDLE && now >= backend->next_check) {
+            start_probe(backend, now);
+        }
+    }
+}
+
+
+/**
+ * @brief Selects the healthy backend with the fewest connections.
+ * @param[in] proxy: the proxy.
+ * @return the backend, or NULL if no backend is healthy.
+ */
+static Backend *pick_backend(Proxy *proxy) {
+    Backend *best = NULL;
+    for (int i = 0; i < proxy->backend_count; i++) {
+        Backend *backend = &proxy->backends[i];
+        if (backend->healthy && (best == NULL || backend->connections < best->connections)) {
+            best = backend;
+        }
+    }
+    return best;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END BACKENDS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - LINKS - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Closes the client connection and the pipes of a link and frees its slot.
+ * @param[in/out] proxy: the proxy.
+ * @param[in/out] link: the link, whose backend connection is already closed.
+ */
+static void release_link(Proxy *proxy, ProxyLink *link) {
+    closesocket(link->sockets[TO_CLIENT]);
+#if defined(__linux__)
+    for (int d = 0; d < DIRECTION_COUNT; d++) {
+        close(link->pipes[d][0]);
+        close(link->pipes[d][1]);
+    }
+#endif
+    link->backend = NULL;
+    proxy->link_count--;
+}
+
+
+/**
+ * @brief Closes both connections of a link and frees its slot.
+ * @param[in/out] proxy: the proxy.
+ * @param[in/out] link: the link.
+ */
+static void close_link(Proxy *proxy, ProxyLink *link) {
+    closesocket(link->sockets[TO_BACKEND]);
+    link->backend->connections--;
+    release_link(proxy, link);
+}
+
+
+/**
+ * @brief Starts the backend connection of a link, to the healthy backend with the fewest connections.
+ * A backend whose connection fails at once is marked unhealthy and the next one is tried.
+ * @param[in/out] proxy: the proxy.
+ * @param[in/out] link: the link.
+ * @return `true` if a connection was started, `false` if no backend is left.
+ */
+static bool connect_link(Proxy *proxy, ProxyLink *link) {
+    Backend *backend;
+    while ((backend = pick_backend(proxy)) != NULL) {
+        int backend_socket = start_connect(backend);
+        if (backend_socket >= 0) {
+            link->sockets[TO_BACKEND] = backend_socket;
+            link->backend = backend;
+            link->connecting = true;
+            link->connect_deadline = monotonic_seconds() + PROXY_CONNECT_TIMEOUT;
+            backend->connections++;
+            return true;
+        }
+        backend_failed(backend);
+    }
+    return false;
+}
+
+
+/**
+ * @brief Completes the backend connection of a link.
+ *
+ * A failed connection marks its backend unhealthy and the link moves on to the next healthy
+ * backend; the client is closed when none is left.
+ *
+ * @param[in/out] proxy: the proxy.
+ * @param[in/out] link: the link, whose backend connection is being established.
+ * @param[in] connected: whether the connection was established, `false` if it failed or timed out.
+ */
+static void complete_connect(Proxy *proxy, ProxyLink *link, bool connected) {
+    if (connected) {
+        link->connecting = false;
+        link->backend->forwarded++;
+        return;
+    }
+    closesocket(link->sockets[TO_BACKEND]);
+    link->backend->connections--;
+    backend_failed(link->backend);
+    if (!connect_link(proxy, link)) {
+        proxy->rejected++;
+        release_link(proxy, link);
+    }
+}
+
+
+/**
+ * @brief Accepts a client connection and links it to a backend.
+ * @param[in/out] proxy: the proxy.
+ * @param[in] listen_socket: the listening socket.
+ */
+void accept_link(Proxy *proxy, int listen_socket) {
+    int client_socket = accept(listen_socket, NULL, NULL);
+    if (client_socket < 0) {
+        return;
+    }
+
+    ProxyLink *link = NULL;
+    for (int i = 0; i < MAX_PROXY_LINKS && link == NULL; i++) {
+        if (proxy->links[i].backend == NULL) {
+            link = &proxy->links[i];
+        }
+    }
+    if (link == NULL) {
+        proxy->rejected++;
+        closesocket(client_socket);
+        return;
+    }
+
+    memset(link, 0, sizeof(*link));
+    link->sockets[TO_CLIENT] = client_socket;
+#if defined(__linux__)
+    for (int d = 0; d < DIRECTION_COUNT; d++) {
+        if (pipe2(link->pipes[d], O_NONBLOCK) < 0) {
+            if (d > 0) {
+                close(link->pipes[0][0]);
+                close(link->pipes[0][1]);
+            }
+            proxy->rejected++;
+            closesocket(client_socket);
+            return;
+        }
+    }
+#endif
+    set_nonblocking(client_socket, true);
+    proxy->link_count++;
+
+    // Try the healthy backends, least loaded first; run_proxy completes the connection
+    if (!connect_link(proxy, link)) {
+        proxy->rejected++;
+        release_link(proxy, link);
+    }
+}
+
+
+/**
+ * @brief Reads the bytes available on the source of a direction.
+ *
+ * A source that closed ends its direction only: the end is passed on to the destination and the
+ * other direction keeps forwarding, so a client that half-closes still gets its last replies.
+ *
+ * @param[in/out] link: the link; it starts closing when the source fails.
+ * @param[in] d: the direction.
+ * @pre No bytes of the direction are pending.
+ */
+static void fill_direction(ProxyLink *link, int d) {
+    int source = link->sockets[DIRECTION_COUNT - 1 - d];
+#if defined(__linux__)
+    // Move the bytes from the socket into the pipe without copying them to user space
+    ssize_t moved = splice(source, NULL, link->pipes[d][1], NULL, PROXY_CHUNK_SIZE,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+    int moved = recv(source, link->buffers[d], PROXY_BUFFER_SIZE, 0);
+    link->offset[d] = 0;
+#endif
+    if (moved > 0) {
+        link->pending[d] = moved;
+    } else if (moved == 0) {
+        link->finished[d] = true;
+        shutdown(link->sockets[d], SHUT_WR);
+    } else if (!would_block()) {
+        link->closing = true;
+    }
+}
+
+
+/**
+ * @brief Writes the pending bytes of a direction to its destination, as far as it accepts them.
+ * @param[in/out] proxy: the proxy.
+ * @param[in/out] link: the link; it starts closing when the destination fails.
+ * @param[in] d: the direction.
+ */
+static void flush_direction(Proxy *proxy, ProxyLink *link, int d) {
+    while (link->pending[d] > 0) {
+#if defined(__linux__)
+        ssize_t moved = splice(link->pipes[d][0], NULL, link->sockets[d], NULL, link->pending[d],
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+        int moved = send(link->sockets[d], link->buffers[d] + link->offset[d], (int) link->pending[d], 0);
+#endif
+        if (moved <= 0) {
+            if (moved == 0 || !would_block()) {
+                link->pending[d] = 0;   /**< The destination is gone: drop the bytes */
+                link->closing = true;
+            }
+            return;
+        }
+        link->pending[d] -= moved;
+#if !defined(__linux__)
+        link->offset[d] += moved;
+#endif
+        proxy->bytes[d] += moved;
+    }
+}
+
+
+/**
+ * @brief Closes every link and running probe of the proxy.
+ * @param[in/out] proxy: the proxy.
+ */
+static void close_proxy(Proxy *proxy) {
+    for (int i = 0; i < MAX_PROXY_LINKS; i++) {
+        if (proxy->links[i].backend != NULL) {
+            close_link(proxy, &proxy->links[i]);
+        }
+    }
+    for (int i = 0; i < proxy->backend_count; i++) {
+        if (proxy->backends[i].probe_state != PROBE_IDLE) {
+            closesocket(proxy->backends[i].probe_socket);
+            proxy->backends[i].probe_state = PROBE_IDLE;
+        }
+    }
+}
+
+
+/**
+ * @brief Forwards connections until `running` is cleared or the select() call fails.
+ * @param[in/out] proxy: the proxy.
+ * @param[in] listen_socket: the listening socket.
+ * @param[in] running: the stop flag of the server, cleared by SIGINT and SIGTERM.
+ */
+void run_proxy(Proxy *proxy, int listen_socket, volatile sig_atomic_t *running) {
+    while (*running) {
+        check_backends(proxy);
+
+        fd_set read_set;    /**< Sources whose bytes may be forwarded, probes waiting for a message */
+        fd_set write_set;   /**< Destinations with pending bytes, connections being established */
+        int max_socket = -1;
+        FD_ZERO(&read_set);
+        FD_ZERO(&write_set);
+        if (proxy->link_count < MAX_PROXY_LINKS) {
+            FD_SET(listen_socket, &read_set);
+            max_socket = listen_socket;
+        }
+        for (int i = 0; i < proxy->backend_count; i++) {
+            Backend *backend = &proxy->backends[i];
+            if (backend->probe_state != PROBE_IDLE) {
+                FD_SET(backend->probe_socket, (backend->probe_state == PROBE_CONNECTING) ? &write_set : &read_set);
+                max_socket = (backend->probe_socket > max_socket) ? backend->probe_socket : max_socket;
+            }
+        }
+        for (int i = 0; i < MAX_PROXY_LINKS; i++) {
+            ProxyLink *link = &proxy->links[i];
+            if (link->backend == NULL) {
+                continue;
+            }
+            if (link->connecting) {
+                FD_SET(link->sockets[TO_BACKEND], &write_set);
+                max_socket = (link->sockets[TO_BACKEND] > max_socket) ? link->sockets[TO_BACKEND] : max_socket;
+                continue;
+            }
+            for (int d = 0; d < DIRECTION_COUNT; d++) {
+                int source = link->sockets[DIRECTION_COUNT - 1 - d];
+                if (link->pending[d] > 0) {
+                    FD_SET(link->sockets[d], &write_set);
+                    max_socket = (link->sockets[d] > max_socket) ? link->sockets[d] : max_socket;
+                } else if (!link->closing && !link->finished[d]) {
+                    FD_SET(source, &read_set);
+                    max_socket = (source > max_socket) ? source : max_socket;
+                }
+            }
+        }
+
+        struct timeval timeout = { 1, 0 };  /**< Wake up every second to probe the backends and enforce the timeouts */
+        if (select(max_socket + 1, &read_set, &write_set, NULL, &timeout) < 0) {
+#if !defined WIN32
+            if (errno == EINTR) {
+                continue;   /**< A signal: the loop condition tells whether to stop */
+            }
+#endif
+            print_with_color("select() failed.\n", MAGENTA);
+            break;
+        }
+
+        for (int i = 0; i < proxy->backend_count; i++) {
+            Backend *backend = &proxy->backends[i];
+            if (backend->probe_state != PROBE_IDLE && FD_ISSET(backend->probe_socket,
+                    (backend->probe_state == PROBE_CONNECTING) ? &write_set : &read_set)) {
+                advance_probe(backend);
+            }
+        }
+        double now = monotonic_seconds();
+        for (int i = 0; i < MAX_PROXY_LINKS; i++) {
+            ProxyLink *link = &proxy->links[i];
+            if (link->backend == NULL) {
+                continue;
+            }
+            if (link->connecting) {
+                if (FD_ISSET(link->sockets[TO_BACKEND], &write_set)) {
+                    complete_connect(proxy, link, connect_succeeded(link->sockets[TO_BACKEND]));
+                } else if (now >= link->connect_deadline) {
+                    complete_connect(proxy, link, false);
+                }
+                continue;   /**< A new connection, if any, is watched from the next turn */
+            }
+            for (int d = 0; d < DIRECTION_COUNT; d++) {
+                int source = link->sockets[DIRECTION_COUNT - 1 - d];
+                if (link->pending[d] == 0 && !link->finished[d] && FD_ISSET(source, &read_set)) {
+                    fill_direction(link, d);
+                }
+                if (link->pending[d] > 0) {
+                    flush_direction(proxy, link, d);
+                }
+            }
+            bool flushed = link->pending[TO_BACKEND] == 0 && link->pending[TO_CLIENT] == 0;
+            if ((link->closing && flushed) || (link->finished[TO_BACKEND] && link->finished[TO_CLIENT])) {
+                close_link(proxy, link);
+            }
+        }
+
+        // Accept last: the connections it starts are not in this turn's sets
+        if (FD_ISSET(listen_socket, &read_set)) {
+            accept_link(proxy, listen_socket);
+        }
+    }
+    close_proxy(proxy);
+}
+
+/* - - - - - - - - - - - - - - - - - - - END LINKS - - - - - - - - - - - - - - - - - - - */
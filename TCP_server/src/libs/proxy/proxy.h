@@ -0,0 +1,213 @@
+/*
+ ============================================================================
+ Name        : proxy.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the proxy mode of the server. In this
+               mode the server does not generate passwords: it forwards every
+               client connection to the healthy backend server with the fewest
+               connections. On Linux the bytes are moved with splice() through
+               a pipe, so they never cross into user space. Backend
+               connections and health probes never block: they advance in
+               the same select() loop as the forwarded bytes.
+ ============================================================================
+ */
+
+#ifndef PROXY_H_
+#define PROXY_H_
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../protocol/protocol.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Maximum number of backend servers.
+ */
+#define MAX_BACKENDS 16         /**< Backend pool capacity */
+
+/**
+ * @brief Maximum number of client connections forwarded at once.
+ * Every link uses two sockets and, on Linux, four pipe descriptors, so the total stays below `FD_SETSIZE`.
+ */
+#define MAX_PROXY_LINKS 128     /**< Link table capacity */
+
+/**
+ * @brief Maximum length of a backend host name, null terminator included.
+ */
+#define BACKEND_HOST_SIZE 64    /**< Backend host name size */
+
+/**
+ * @brief Seconds between two health probes of a backend.
+ */
+#define PROXY_CHECK_SECONDS 2.0 /**< Health probe period */
+
+/**
+ * @brief Timeout in seconds of the connection to a backend, and of a whole health probe.
+ */
+#define PROXY_CONNECT_TIMEOUT 1 /**< Backend connection timeout */
+
+/**
+ * @brief Bytes moved from a socket into a pipe in one forwarding step.
+ */
+#define PROXY_CHUNK_SIZE 65536  /**< Forwarding chunk size */
+
+/**
+ * @brief Size of the copy buffers used where splice() is not available.
+ */
+#define PROXY_BUFFER_SIZE 4096  /**< Copy buffer size */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum ProbeState
+ * @brief Steps of the health probe of a backend.
+ *
+ * - `PROBE_IDLE`: No probe is running.
+ * - `PROBE_CONNECTING`: The connection is being established.
+ * - `PROBE_CHALLENGE`: Connected, waiting for the `HelloChallenge` of the backend.
+ * - `PROBE_HEALTH`: The `HELLO_HEALTH` probe was sent, waiting for the `HealthResponse`.
+ */
+typedef enum {
+    PROBE_IDLE,
+    PROBE_CONNECTING,
+    PROBE_CHALLENGE,
+    PROBE_HEALTH
+} ProbeState;
+
+
+/**
+ * @union ProbeInput
+ * @brief A message received from a backend during its health probe.
+ */
+typedef union {
+    HelloChallenge hello;               /**< Challenge of the backend */
+    HealthResponse health;              /**< Health of the backend */
+} ProbeInput;
+
+
+/**
+ * @struct Backend
+ * @brief A password generation server the proxy forwards connections to.
+ */
+typedef struct {
+    char host[BACKEND_HOST_SIZE];   /**< Host name or IPv4 address */
+    int port;                       /**< TCP port */
+    uint32_t address;               /**< Resolved IPv4 address, in network byte order */
+    bool healthy;                   /**< Whether the last probe reported the backend ready */
+    int connections;                /**< Links currently forwarded to the backend */
+    double next_check;              /**< Time of the next health probe */
+    unsigned long forwarded;        /**< Links forwarded since the start */
+    unsigned long failures;         /**< Failed connections and probes */
+    ProbeState probe_state;         /**< Step of the running health probe */
+    int probe_socket;               /**< Socket of the running health probe, -1 if none */
+    double probe_deadline;          /**< Time the running health probe fails if it has not completed */
+    ProbeInput probe_input;         /**< Message of the probe being received */
+    size_t probe_received;          /**< Bytes of `probe_input` received so far */
+} Backend;
+
+
+/**
+ * @enum ProxyDirection
+ * @brief Directions of the bytes forwarded by a link.
+ */
+typedef enum {
+    TO_BACKEND,     /**< From the client to the backend */
+    TO_CLIENT,      /**< From the backend to the client */
+    DIRECTION_COUNT /**< Number of directions */
+} ProxyDirection;
+
+
+/**
+ * @struct ProxyLink
+ * @brief A client connection and the backend connection it is forwarded to.
+ *
+ * Each direction keeps the bytes read from its source and not yet written to its destination:
+ * in a pipe on Linux, in a buffer elsewhere. A source is read again only once its bytes are gone.
+ * Nothing is forwarded while the backend connection is being established; the bytes of the
+ * client wait in its socket.
+ */
+typedef struct {
+    int sockets[DIRECTION_COUNT];       /**< Destination socket of each direction: backend, client */
+    Backend *backend;                   /**< Backend of the link, NULL if the slot is free */
+    size_t pending[DIRECTION_COUNT];    /**< Bytes read and not yet written, per direction */
+    bool closing;                       /**< Whether a side failed: the link ends once the pending bytes are written */
+    bool finished[DIRECTION_COUNT];     /**< Whether the source of each direction closed; both end the link */
+    bool connecting;                    /**< Whether the backend connection is being established */
+    double connect_deadline;            /**< Time the backend connection fails if it is not established */
+#if defined(__linux__)
+    int pipes[DIRECTION_COUNT][2];      /**< Pipe of each direction: read end, write end */
+#else
+    size_t offset[DIRECTION_COUNT];     /**< Bytes already written from the buffer, per direction */
+    char buffers[DIRECTION_COUNT][PROXY_BUFFER_SIZE];  /**< Copy buffer of each direction */
+#endif
+} ProxyLink;
+
+
+/**
+ * @struct Proxy
+ * @brief State of the proxy mode.
+ */
+typedef struct {
+    Backend backends[MAX_BACKENDS];     /**< Backend servers */
+    int backend_count;                  /**< Number of backend servers */
+    ProxyLink links[MAX_PROXY_LINKS];   /**< Forwarded connections */
+    int link_count;                     /**< Number of forwarded connections */
+    unsigned long long bytes[DIRECTION_COUNT];  /**< Bytes forwarded since the start, per direction */
+    unsigned long rejected;             /**< Clients closed because no backend was available */
+} Proxy;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - PROXY - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Parses a comma-separated list of `host:port` backends.
+ *
+ * A backend without a port uses `DEFAULT_PORT`.
+ *
+ * @param[out] proxy: the proxy, cleared before parsing.
+ * @param[in] list: the list of backends, e.g. "127.0.0.1:8081,127.0.0.1:8082".
+ * @return the number of backends parsed, or -1 if an entry is not valid or cannot be resolved.
+ */
+int parse_backends(Proxy *proxy, const char *list);
+
+
+/**
+ * @brief Starts the health probes that are due and fails the ones past `PROXY_CONNECT_TIMEOUT`.
+ * A backend is healthy if it answers a `HELLO_HEALTH` probe reporting it ready. The probes are
+ * advanced by `run_proxy` as their sockets become ready.
+ * @param[in/out] proxy: the proxy.
+ */
+void check_backends(Proxy *proxy);
+
+
+/**
+ * @brief Accepts a client connection and links it to the healthy backend with the fewest connections.
+ * The backend connection is only started: `run_proxy` completes it, or moves the link to the next
+ * healthy backend if it fails. The client is closed if no backend is available.
+ * @param[in/out] proxy: the proxy.
+ * @param[in] listen_socket: the listening socket.
+ */
+void accept_link(Proxy *proxy, int listen_socket);
+
+
+/**
+ * @brief Forwards connections until `running` is cleared or the select() call fails, then closes them.
+ * @param[in/out] proxy: the proxy, with its backends parsed.
+ * @param[in] listen_socket: the listening socket.
+ * @param[in] running: the stop flag of the server, cleared by SIGINT and SIGTERM.
+ */
+void run_proxy(Proxy *proxy, int listen_socket, volatile sig_atomic_t *running);
+
+/* - - - - - - - - - - - - - - - - - - - END PROXY - - - - - - - - - - - - - - - - - - - */
+
+#endif /* PROXY_H_ */
@@ -0,0 +1,308 @@
+/*
+ ============================================================================
+ Name        : session.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Table of the client sessions served by the event loop and pool
+               of their receive and send buffers.
+ ============================================================================
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "session.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - SESSIONS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Opens a session in the first free slot.
+ * @param[in/out] table: the session table.
+ * @param[in] socket: the socket connected to the client.
+ * @param[in] peer: the printable address of the client.
+ * @param[in] now: the current monotonic time.
+ * @return the slot of the session, or -1 if the table is full.
+ * @post The session is in the `SESSION_HANDSHAKE` state with zeroed counters.
+ */
+int open_session(SessionTable *table, int socket, const char *peer, double now) {
+    // The state column is one byte per slot: the scan stays within a few cache lines
+    const unsigned char *slot_state = memchr(table->states, SESSION_FREE, SESSION_SLOTS);
+    if (slot_state == NULL) {
+        return -1;
+    }
+
+    int slot = (int) (slot_state - table->states);
+    table->states[slot] = SESSION_HANDSHAKE;
+    table->sockets[slot] = socket;
+    table->credits[slot] = 0;
+    table->inputs[slot] = NULL;
+    table->input_lens[slot] = 0;
+    table->outputs[slot] = NULL;
+    table->bytes_in[slot] = 0;
+    table->bytes_out[slot] = 0;
+    table->requests[slot] = 0;
+    table->deadlines[slot] = now + SESSION_HANDSHAKE_SECONDS;
+
+    Session *session = &table->sessions[slot];
+    memset(session, 0, sizeof(*session));
+    snprintf(session->peer, sizeof(session->peer), "%s", peer);
+    session->opened = now;
+    table->count++;
+    return slot;
+}
+
+
+/**
+ * @brief Releases the slot of a session.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session to release.
+ * @post The slot is `SESSION_FREE` and can be reused by `open_session`; its generation has advanced.
+ */
+void release_session(SessionTable *table, int slot) {
+    if (table->states[slot] != SESSION_FREE) {
+        detach_buffer(table, slot);
+        detach_output(table, slot);
+        table->active -= table->states[slot] == SESSION_ACTIVE;
+        table->states[slot] = SESSION_FREE;
+        table->sockets[slot] = -1;
+        table->credits[slot] = 0;
+        table->generations[slot]++;
+        table->count--;
+    }
+}
+
+
+/**
+ * @brief Moves a session that completed its handshake to the `SESSION_ACTIVE` state.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @param[in] now: the current monotonic time.
+ * @param[in] idle_timeout: the seconds the session may stay silent, 0 for no limit.
+ */
+void activate_session(SessionTable *table, int slot, double now, double idle_timeout) {
+    table->states[slot] = SESSION_ACTIVE;
+    table->active++;
+    touch_session(table, slot, now, idle_timeout);
+}
+
+
+/**
+ * @brief Pushes back the idle deadline of a session.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @param[in] now: the current monotonic time.
+ * @param[in] idle_timeout: the seconds the session may stay silent, 0 for no limit.
+ */
+void touch_session(SessionTable *table, int slot, double now, double idle_timeout) {
+    if (table->states[slot] == SESSION_HANDSHAKE) {
+        return;
+    }
+    table->deadlines[slot] = (idle_timeout > 0) ? now + idle_timeout : HUGE_VAL;
+}
+
+
+/**
+ * @brief Finds the next session whose idle deadline has passed.
+ * @param[in] table: the session table.
+ * @param[in] from: the first slot to check.
+ * @param[in] now: the current monotonic time.
+ * @return the slot of the expired session, or -1.
+ */
+int next_expired_session(const SessionTable *table, int from, double now) {
+    for (int slot = from; slot < SESSION_SLOTS; slot++) {
+        if (table->deadlines[slot] < now && table->states[slot] != SESSION_FREE) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * @brief Returns the size of the message a session is waiting for.
+ * @param[in] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @return the size in bytes of the expected message.
+ */
+size_t expected_input(const SessionTable *table, int slot) {
+    return (table->states[slot] == SESSION_HANDSHAKE) ? sizeof(HelloResponse) : sizeof(PasswordRequest);
+}
+
+
+/**
+ * @brief Returns the handle of the session in a slot.
+ * @param[in] table: the session table.
+ * @param[in] slot: the slot of an open session.
+ * @return the handle of the session.
+ */
+SessionHandle session_handle(const SessionTable *table, int slot) {
+    return (SessionHandle) table->generations[slot] << SESSION_SLOT_BITS | (SessionHandle) slot;
+}
+
+
+/**
+ * @brief Resolves a handle to the slot of its session.
+ * @param[in] table: the session table.
+ * @param[in] handle: the handle.
+ * @return the slot, or -1 if the handle is stale or not valid.
+ */
+int session_slot(const SessionTable *table, SessionHandle handle) {
+    SessionHandle slot = handle & ((1u << SESSION_SLOT_BITS) - 1);
+    if (slot >= SESSION_SLOTS || table->states[slot] == SESSION_FREE
+        || table->generations[slot] != handle >> SESSION_SLOT_BITS) {
+        return -1;
+    }
+    return (int) slot;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END SESSIONS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - BUFFERS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Attaches a receive buffer to a session, if it has none.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @return the buffer of the session, or NULL if no memory is left.
+ */
+InputBuffer *attach_buffer(SessionTable *table, int slot) {
+    if (table->inputs[slot] != NULL) {
+        return table->inputs[slot];
+    }
+
+    BufferPool *pool = &table->buffers;
+    InputBuffer *buffer = pool->free_list;
+    if (buffer != NULL) {
+        pool->free_list = buffer->next;
+    } else {
+        buffer = malloc(sizeof(InputBuffer));
+        if (buffer == NULL) {
+            return NULL;
+        }
+        pool->allocated++;
+    }
+    pool->in_use++;
+    if (pool->in_use > pool->peak) {
+        pool->peak = pool->in_use;
+    }
+    table->inputs[slot] = buffer;
+    return buffer;
+}
+
+
+/**
+ * @brief Gives the receive buffer of a session back to the pool, if it has one.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ */
+void detach_buffer(SessionTable *table, int slot) {
+    InputBuffer *buffer = table->inputs[slot];
+    if (buffer != NULL) {
+        buffer->next = table->buffers.free_list;
+        table->buffers.free_list = buffer;
+        table->buffers.in_use--;
+        table->inputs[slot] = NULL;
+    }
+}
+
+
+/**
+ * @brief Queues bytes the socket of a session could not take.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @param[in] data: the bytes.
+ * @param[in] size: the number of bytes.
+ * @return `true` if the bytes were queued, `false` if the backlog is full or no memory is left.
+ */
+bool queue_output(SessionTable *table, int slot, const void *data, size_t size) {
+    OutputBuffer *buffer = table->outputs[slot];
+    if (buffer == NULL) {
+        OutputPool *pool = &table->output_buffers;
+        buffer = pool->free_list;
+        if (buffer != NULL) {
+            pool->free_list = buffer->next;
+        } else {
+            buffer = malloc(sizeof(OutputBuffer));
+            if (buffer == NULL) {
+                return false;
+            }
+            pool->allocated++;
+        }
+        pool->in_use++;
+        if (pool->in_use > pool->peak) {
+            pool->peak = pool->in_use;
+        }
+        table->outputs[slot] = buffer;
+        table->output_starts[slot] = 0;
+        table->output_ends[slot] = 0;
+    }
+
+    unsigned int pending = table->output_ends[slot] - table->output_starts[slot];
+    if (pending + size > SESSION_OUTPUT_SIZE) {
+        return false;
+    }
+    if (table->output_ends[slot] + size > SESSION_OUTPUT_SIZE) {
+        // Move the waiting bytes to the front to make room behind them
+        memmove(buffer->data, buffer->data + table->output_starts[slot], pending);
+        table->output_starts[slot] = 0;
+        table->output_ends[slot] = pending;
+    }
+    memcpy(buffer->data + table->output_ends[slot], data, size);
+    table->output_ends[slot] += (unsigned int) size;
+    return true;
+}
+
+
+/**
+ * @brief Gives the send buffer of a session back to the pool, if it has one.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ */
+void detach_output(SessionTable *table, int slot) {
+    OutputBuffer *buffer = table->outputs[slot];
+    if (buffer != NULL) {
+        buffer->next = table->output_buffers.free_list;
+        table->output_buffers.free_list = buffer;
+        table->output_buffers.in_use--;
+        table->outputs[slot] = NULL;
+    }
+}
+
+
+/**
+ * @brief Frees every buffer of both pools.
+ * @param[in/out] table: the session table.
+ */
+void free_buffers(SessionTable *table) {
+    while (table->buffers.free_list != NULL) {
+        InputBuffer *next = table->buffers.free_list->next;
+        free(table->buffers.free_list);
+        table->buffers.free_list = next;
+        table->buffers.allocated--;
+    }
+    while (table->output_buffers.free_list != NULL) {
+        OutputBuffer *next = table->output_buffers.free_list->next;
+        free(table->output_buffers.free_list);
+        table->output_buffers.free_list = next;
+        table->output_buffers.allocated--;
+    }
+}
+
+
+/**
+ * @brief Returns the average memory held by an open session.
+ * @param[in] table: the session table.
+ * @return the bytes per session.
+ */
+double bytes_per_session(const SessionTable *table) {
+    if (table->count == 0) {
+        return SESSION_SLOT_SIZE;
+    }
+    return SESSION_SLOT_SIZE + ((double) table->buffers.in_use * sizeof(InputBuffer)
+            + (double) table->output_buffers.in_use * sizeof(OutputBuffer)) / table->count;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END BUFFERS - - - - - - - - - - - - - - - - - - - */
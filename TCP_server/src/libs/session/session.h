@@ -0,0 +1,377 @@
+/*
+ ============================================================================
+ Name        : session.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the table of client sessions served by
+               the event loop. A session holds everything the server used to
+               keep in locals of `main()` for its single client: the socket,
+               the handshake nonce, the API key and the tenant. The table is
+               laid out as a structure of arrays: the fields the event loop
+               scans every turn (state, socket, credits, idle deadline) live
+               in dense arrays of their own, apart from the record read only
+               while a session is served. Sessions are referenced across turns
+               by generation-tagged handles, so a handle to a closed session
+               is detected even once its slot is reused. The buffer of a
+               message being received is borrowed from a shared pool, so an
+               idle session holds no buffer; so is the buffer of the
+               responses its client has not read yet.
+ ============================================================================
+ */
+
+#ifndef SESSION_H_
+#define SESSION_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../auth/auth.h"
+#include "../tenant/tenant.h"
+#include "../protocol/protocol.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Maximum number of client sessions served at once.
+ */
+#define MAX_SESSIONS 512        /**< Client session capacity */
+
+/**
+ * @brief Slots kept beyond the session limit for connections still in the handshake, so a health
+ * probe is answered even when every client session is taken.
+ */
+#define HANDSHAKE_SLOTS 16      /**< Handshake reserve */
+
+/**
+ * @brief Slots of the session table.
+ * Kept below `FD_SETSIZE` so every socket fits in the `select()` sets.
+ */
+#define SESSION_SLOTS (MAX_SESSIONS + HANDSHAKE_SLOTS)  /**< Session table capacity */
+
+/**
+ * @brief Maximum length of the printable peer address, null terminator included.
+ */
+#define PEER_SIZE 32            /**< Peer address size */
+
+/**
+ * @brief Stream items sent to a session in one event loop turn, so streams do not starve other sessions.
+ */
+#define STREAM_BURST 16         /**< Stream items per turn */
+
+/**
+ * @brief Bytes of responses a session may have waiting for its client to read them: twice the
+ * largest message, a full batch. A client falling further behind is disconnected.
+ */
+#define SESSION_OUTPUT_SIZE (2 * (sizeof(PasswordResponse) + sizeof(BatchHeader) \
+        + BATCH_MAX_PASSWORDS * MAX_PASSWORD_LENGTH))   /**< Output backlog limit */
+
+/**
+ * @brief Default seconds a session may stay silent before it is closed, 0 to never close it.
+ * Off by default, as before the timeout existed: `--idle` or the admin `idle` command turn it on.
+ */
+#define SESSION_IDLE_SECONDS 0      /**< Idle timeout */
+
+/**
+ * @brief Seconds a connection has to complete its handshake, whatever the idle timeout.
+ * The deadline is not pushed back by partial messages, so silent or trickling peers cannot hold
+ * the handshake slots.
+ */
+#define SESSION_HANDSHAKE_SECONDS 5 /**< Handshake timeout */
+
+/**
+ * @brief Bits of a session handle holding the slot; the bits above hold the generation of the slot.
+ */
+#define SESSION_SLOT_BITS 16    /**< Slot bits of a handle */
+
+/**
+ * @brief Handle that never refers to a session.
+ */
+#define NO_SESSION UINT32_MAX   /**< Invalid handle */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum SessionState
+ * @brief Enumerates the states of a session.
+ *
+ * - `SESSION_FREE`: The slot is unused.
+ * - `SESSION_HANDSHAKE`: The challenge was sent, the server waits for a `HelloResponse`.
+ * - `SESSION_ACTIVE`: The menu was sent, the server waits for `PasswordRequest` messages.
+ */
+typedef enum {
+    SESSION_FREE,       /**< Unused slot */
+    SESSION_HANDSHAKE,  /**< Waiting for the authentication proof */
+    SESSION_ACTIVE      /**< Serving password requests */
+} SessionState;
+
+
+/**
+ * @union SessionInput
+ * @brief A message received from a client.
+ */
+typedef union {
+    HelloResponse hello;                /**< Authentication proof */
+    PasswordRequest request;            /**< Password request */
+} SessionInput;
+
+
+/**
+ * @struct InputBuffer
+ * @brief A receive buffer of the shared pool.
+ */
+typedef struct InputBuffer {
+    SessionInput input;                 /**< Message being received */
+    struct InputBuffer *next;           /**< Next free buffer, while the buffer is in the pool */
+} InputBuffer;
+
+
+/**
+ * @struct BufferPool
+ * @brief Receive buffers shared by every session.
+ *
+ * Buffers are allocated on demand and never freed until shutdown: the pool grows to the largest
+ * number of messages received at once, which the event loop keeps close to one.
+ */
+typedef struct {
+    InputBuffer *free_list;             /**< Buffers available for borrowing */
+    int allocated;                      /**< Buffers allocated */
+    int in_use;                         /**< Buffers borrowed by sessions */
+    int peak;                           /**< Largest number of buffers borrowed at once */
+} BufferPool;
+
+
+/**
+ * @struct OutputBuffer
+ * @brief A send buffer of the shared pool, holding the responses the socket could not take yet.
+ */
+typedef struct OutputBuffer {
+    unsigned char data[SESSION_OUTPUT_SIZE];    /**< Bytes waiting to be sent */
+    struct OutputBuffer *next;          /**< Next free buffer, while the buffer is in the pool */
+} OutputBuffer;
+
+
+/**
+ * @struct OutputPool
+ * @brief Send buffers shared by every session.
+ *
+ * Like the receive buffers, send buffers are allocated on demand and kept until shutdown, so a
+ * slow client costs an allocation only the first time the pool runs dry.
+ */
+typedef struct {
+    OutputBuffer *free_list;            /**< Buffers available for borrowing */
+    int allocated;                      /**< Buffers allocated */
+    int in_use;                         /**< Buffers borrowed by sessions */
+    int peak;                           /**< Largest number of buffers borrowed at once */
+} OutputPool;
+
+
+/**
+ * @brief Reference to a session that stays safe after the session ends: the slot in the low
+ * `SESSION_SLOT_BITS` bits, the generation of the slot above. The generation wraps after 65536
+ * sessions in the same slot.
+ */
+typedef uint32_t SessionHandle;
+
+
+/**
+ * @struct Session
+ * @brief Record of a client connection: the fields read only while the session is served.
+ * The fields scanned by the event loop are the columns of `SessionTable`, at the same slot.
+ */
+typedef struct {
+    char peer[PEER_SIZE];               /**< Printable address of the client */
+    unsigned char nonce[NONCE_SIZE];    /**< Nonce of the authentication challenge */
+    ApiKey *key;                        /**< API key of the client, NULL if authentication is disabled */
+    Tenant *tenant;                     /**< Policy set of the client */
+    char stream_type;                   /**< Password type of the open stream, 0 if no stream is open */
+    unsigned char stream_length;        /**< Password length of the open stream */
+    double opened;                      /**< Time the connection was accepted */
+} Session;
+
+
+/**
+ * @struct SessionTable
+ * @brief Table of the sessions served by the event loop, one column per field.
+ *
+ * Messages may arrive in several segments: `inputs[slot]` accumulates the bytes of the message
+ * expected in the current state until `input_lens[slot]` reaches its size. The buffer is borrowed
+ * when bytes arrive and given back once the message is served, so an idle session holds no buffer.
+ * Responses the socket cannot take at once wait in `outputs[slot]`, from `output_starts[slot]` to
+ * `output_ends[slot]`; the event loop reads nothing more from the session until they are sent.
+ */
+typedef struct {
+    unsigned char states[SESSION_SLOTS];        /**< `SessionState` of every slot */
+    int sockets[SESSION_SLOTS];                 /**< Socket connected to the client */
+    unsigned short credits[SESSION_SLOTS];      /**< Stream items the client is ready to receive */
+    double deadlines[SESSION_SLOTS];            /**< Time the session is closed if nothing is received, or the handshake not completed, before */
+    uint16_t generations[SESSION_SLOTS];        /**< Generation of every slot, advanced when its session ends */
+    InputBuffer *inputs[SESSION_SLOTS];         /**< Buffer of the message being received, NULL when idle */
+    unsigned short input_lens[SESSION_SLOTS];   /**< Bytes of the message received so far */
+    OutputBuffer *outputs[SESSION_SLOTS];       /**< Buffer of the responses not sent yet, NULL when none */
+    unsigned int output_starts[SESSION_SLOTS];  /**< First byte of `outputs[slot]` not sent yet */
+    unsigned int output_ends[SESSION_SLOTS];    /**< Bytes queued in `outputs[slot]` */
+    unsigned long bytes_in[SESSION_SLOTS];      /**< Bytes received from the client */
+    unsigned long bytes_out[SESSION_SLOTS];     /**< Bytes sent to the client */
+    unsigned long requests[SESSION_SLOTS];      /**< Password requests served */
+    Session sessions[SESSION_SLOTS];            /**< Records of the sessions */
+    int count;                                  /**< Number of sessions in use */
+    int active;                                 /**< Number of sessions in the `SESSION_ACTIVE` state */
+    unsigned long expired;                      /**< Sessions closed by the idle or the handshake timeout */
+    BufferPool buffers;                         /**< Receive buffers lent to the sessions */
+    OutputPool output_buffers;                  /**< Send buffers lent to the sessions */
+    unsigned long overflows;                    /**< Sessions closed because their client stopped reading */
+} SessionTable;
+
+/**
+ * @brief Bytes of one slot across every column of the table.
+ */
+#define SESSION_SLOT_SIZE (offsetof(SessionTable, count) / SESSION_SLOTS)  /**< Slot size */
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - SESSIONS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Opens a session in the first free slot.
+ * @param[in/out] table: the session table.
+ * @param[in] socket: the socket connected to the client.
+ * @param[in] peer: the printable address of the client.
+ * @param[in] now: the current monotonic time.
+ * @return the slot of the session, in the `SESSION_HANDSHAKE` state with a deadline
+ *         `SESSION_HANDSHAKE_SECONDS` away, or -1 if the table is full.
+ */
+int open_session(SessionTable *table, int socket, const char *peer, double now);
+
+
+/**
+ * @brief Releases the slot of a session and gives its buffer back. The socket must be closed by the caller.
+ * Every handle to the session becomes stale.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session to release.
+ */
+void release_session(SessionTable *table, int slot);
+
+
+/**
+ * @brief Moves a session that completed its handshake to the `SESSION_ACTIVE` state.
+ * Its handshake deadline is replaced by the idle deadline.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session, in the `SESSION_HANDSHAKE` state.
+ * @param[in] now: the current monotonic time.
+ * @param[in] idle_timeout: the seconds the session may stay silent, 0 for no limit.
+ */
+void activate_session(SessionTable *table, int slot, double now, double idle_timeout);
+
+
+/**
+ * @brief Pushes back the idle deadline of a session, after it received bytes.
+ * A session still in its handshake keeps its fixed handshake deadline.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @param[in] now: the current monotonic time.
+ * @param[in] idle_timeout: the seconds the session may stay silent, 0 for no limit.
+ */
+void touch_session(SessionTable *table, int slot, double now, double idle_timeout);
+
+
+/**
+ * @brief Finds the next session whose idle deadline has passed, walking the deadline column.
+ * @param[in] table: the session table.
+ * @param[in] from: the first slot to check.
+ * @param[in] now: the current monotonic time.
+ * @return the slot of the expired session, or -1 if no slot from `from` on has expired.
+ */
+int next_expired_session(const SessionTable *table, int from, double now);
+
+
+/**
+ * @brief Returns the size of the message a session is waiting for.
+ * @param[in] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @return the size of a `HelloResponse` during the handshake, of a `PasswordRequest` afterwards.
+ */
+size_t expected_input(const SessionTable *table, int slot);
+
+
+/**
+ * @brief Returns the handle of the session in a slot.
+ * @param[in] table: the session table.
+ * @param[in] slot: the slot of an open session.
+ * @return the handle, which stays valid until the session ends.
+ */
+SessionHandle session_handle(const SessionTable *table, int slot);
+
+
+/**
+ * @brief Resolves a handle to the slot of its session.
+ * @param[in] table: the session table.
+ * @param[in] handle: the handle.
+ * @return the slot, or -1 if the session of the handle has ended or the handle is not valid.
+ */
+int session_slot(const SessionTable *table, SessionHandle handle);
+
+/* - - - - - - - - - - - - - - - - - - - END SESSIONS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - BUFFERS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Attaches a receive buffer to a session, if it has none.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @return the buffer of the session, or NULL if no memory is left.
+ */
+InputBuffer *attach_buffer(SessionTable *table, int slot);
+
+
+/**
+ * @brief Gives the receive buffer of a session back to the pool, if it has one.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ */
+void detach_buffer(SessionTable *table, int slot);
+
+
+/**
+ * @brief Queues bytes the socket of a session could not take, behind the bytes already waiting.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ * @param[in] data: the bytes.
+ * @param[in] size: the number of bytes.
+ * @return `true` if the bytes were queued, `false` if they would exceed `SESSION_OUTPUT_SIZE`
+ *         or no memory is left.
+ */
+bool queue_output(SessionTable *table, int slot, const void *data, size_t size);
+
+
+/**
+ * @brief Gives the send buffer of a session back to the pool, if it has one, dropping its bytes.
+ * @param[in/out] table: the session table.
+ * @param[in] slot: the slot of the session.
+ */
+void detach_output(SessionTable *table, int slot);
+
+
+/**
+ * @brief Frees every buffer of both pools.
+ * @param[in/out] table: the session table, whose sessions hold no buffer.
+ */
+void free_buffers(SessionTable *table);
+
+
+/**
+ * @brief Returns the average memory held by an open session: its share of every column and its
+ * borrowed buffers, if any.
+ * @param[in] table: the session table.
+ * @return the bytes per session, the size of a slot if no session is open.
+ */
+double bytes_per_session(const SessionTable *table);
+
+/* - - - - - - - - - - - - - - - - - - - END BUFFERS - - - - - - - - - - - - - - - - - - - */
+
+#endif /* SESSION_H_ */
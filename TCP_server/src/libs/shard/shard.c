@@ -0,0 +1,320 @@
+/*
+ ============================================================================
+ Name        : shard.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Sharded listeners and their CPU steering.
+ ============================================================================
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "shard.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - PROGRAM - - - - - - - - - - - - - - - - - - - - */
+
+#if defined(__linux__)
+/**
+ * @brief Builds one eBPF instruction.
+ */
+#define INSN(code, dst, src, off, imm) ((struct bpf_insn) { (code), (dst), (src), (off), (imm) })
+
+/**
+ * @brief Issues a bpf() command.
+ */
+static int bpf_command(int command, union bpf_attr *attr) {
+    return (int) syscall(SYS_bpf, command, attr, sizeof(*attr));
+}
+
+
+/**
+ * @brief Loads the SK_REUSEPORT program selecting the listener of the current CPU.
+ *
+ * Equivalent C:
+ *     __u32 shard = bpf_get_smp_processor_id() % count;
+ *     bpf_sk_select_reuseport(ctx, &listeners, &shard, 0);
+ *     return SK_PASS;
+ *
+ * If the selection fails, `SK_PASS` without a selected socket falls back to the kernel hash.
+ *
+ * @param[in] map: the REUSEPORT_SOCKARRAY of the listeners.
+ * @param[in] count: the number of shards.
+ * @return the program descriptor, or -1 on failure.
+ */
+static int load_program(int map, int count) {
+    struct bpf_insn program[] = {
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+        INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_get_smp_processor_id),
+        INSN(BPF_ALU64 | BPF_MOD | BPF_K, BPF_REG_0, 0, 0, count),
+        INSN(BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_0, -4, 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0),
+        INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_2, BPF_PSEUDO_MAP_FD, 0, map),
+        INSN(0, 0, 0, 0, 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_10, 0, 0),
+        INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, -4),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, 0),
+        INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_sk_select_reuseport),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, SK_PASS),
+        INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SK_REUSEPORT;
+    attr.expected_attach_type = BPF_SK_REUSEPORT_SELECT;
+    attr.insns = (uint64_t) (uintptr_t) program;
+    attr.insn_cnt = sizeof(program) / sizeof(program[0]);
+    attr.license = (uint64_t) (uintptr_t) "GPL";
+    return bpf_command(BPF_PROG_LOAD, &attr);
+}
+
+
+/**
+ * @brief Loads the eBPF steering: a map of the listeners and the program selecting among them.
+ * @param[in/out] group: the open group.
+ * @param[out] reason: receives the failing step.
+ * @param[in] size: the size of `reason`.
+ * @return `true` if the program is attached to the group.
+ */
+static bool attach_program(ShardGroup *group, char *reason, size_t size) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_REUSEPORT_SOCKARRAY;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint64_t);
+    attr.max_entries = group->count;
+    group->map = bpf_command(BPF_MAP_CREATE, &attr);
+    if (group->map < 0) {
+        snprintf(reason, size, "map: %s", strerror(errno));
+        return false;
+    }
+
+    for (int i = 0; i < group->count; i++) {
+        uint32_t key = i;
+        uint64_t value = group->sockets[i];
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = group->map;
+        attr.key = (uint64_t) (uintptr_t) &key;
+        attr.value = (uint64_t) (uintptr_t) &value;
+        if (bpf_command(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+            snprintf(reason, size, "map update: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    group->program = load_program(group->map, group->count);
+    if (group->program < 0) {
+        snprintf(reason, size, "program: %s", strerror(errno));
+        return false;
+    }
+
+    // The program of one listener applies to the whole group
+    if (setsockopt(group->sockets[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, &group->program,
+                   sizeof(group->program)) < 0) {
+        snprintf(reason, size, "attach: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Closes the eBPF descriptors of a group.
+ * @param[in/out] group: the group.
+ */
+static void release_program(ShardGroup *group) {
+    if (group->program >= 0) {
+        close(group->program);
+        group->program = -1;
+    }
+    if (group->map >= 0) {
+        close(group->map);
+        group->map = -1;
+    }
+}
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - END PROGRAM - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - SHARDS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Opens one listening socket per shard, all bound to the same address and port.
+ * @param[out] group: the group.
+ * @param[in] address: the IPv4 address.
+ * @param[in] port: the TCP port.
+ * @param[in] count: the number of shards.
+ * @param[in] backlog: the backlog of every listener.
+ * @return `true` if every listener is open.
+ */
+bool open_shard_listeners(ShardGroup *group, const char *address, int port, int count, int backlog) {
+    memset(group, 0, sizeof(*group));
+    group->map = -1;
+    group->program = -1;
+    group->steering = STEERING_HASH;
+#if defined(__linux__)
+    if (count < 1 || count > MAX_SHARDS) {
+        return false;
+    }
+
+    struct sockaddr_in sad;
+    memset(&sad, 0, sizeof(sad));
+    sad.sin_family = AF_INET;
+    sad.sin_addr.s_addr = inet_addr(address);
+    sad.sin_port = htons(port);
+    for (group->count = 0; group->count < count; group->count++) {
+        int listener = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+        int reuse = 1;
+        if (listener < 0
+            || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0
+            || setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0
+            || bind(listener, (struct sockaddr*) &sad, sizeof(sad)) < 0
+            || listen(listener, backlog) < 0) {
+            if (listener >= 0) {
+                close(listener);
+            }
+            keep_shard(group, -1);
+            return false;
+        }
+        group->sockets[group->count] = listener;
+    }
+    return true;
+#else
+    (void) address;
+    (void) port;
+    (void) count;
+    (void) backlog;
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Returns the CPU a shard is pinned to.
+ * @param[in] shard: the index of the shard.
+ * @return the index of the CPU.
+ */
+int shard_cpu(int shard) {
+#if defined(__linux__)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cpus > 0) ? (int) (shard % cpus) : 0;
+#else
+    (void) shard;
+    return 0;
+#endif
+}
+
+
+/**
+ * @brief Steers new connections to the shard of the CPU that received them.
+ * @param[in/out] group: the open group.
+ * @param[out] reason: receives why the eBPF steering is not used, empty if it is.
+ * @param[in] size: the size of `reason`.
+ * @return the steering in use.
+ */
+ShardSteering steer_shards(ShardGroup *group, char *reason, size_t size) {
+    snprintf(reason, size, "not supported");
+#if defined(__linux__)
+    if (attach_program(group, reason, size)) {
+        reason[0] = '\0';
+        group->steering = STEERING_BPF;
+        return group->steering;
+    }
+    release_program(group);
+
+    // Listeners tagged with a CPU are preferred by the group for connections received on that CPU
+    for (int i = 0; i < group->count; i++) {
+        int cpu = shard_cpu(i);
+        if (setsockopt(group->sockets[i], SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+            return group->steering;
+        }
+    }
+    group->steering = STEERING_INCOMING_CPU;
+#endif
+    return group->steering;
+}
+
+
+/**
+ * @brief Returns the name of a steering.
+ * @param[in] steering: the steering.
+ * @return the name of the steering.
+ */
+const char *steering_name(ShardSteering steering) {
+    switch (steering) {
+    case STEERING_BPF:
+        return "bpf";
+    case STEERING_INCOMING_CPU:
+        return "incoming_cpu";
+    default:
+        return "hash";
+    }
+}
+
+
+/**
+ * @brief Keeps the listener of one shard, closing the others and the eBPF descriptors.
+ * @param[in/out] group: the group.
+ * @param[in] shard: the shard to keep, -1 to close every listener.
+ * @return the listening socket of the shard, or -1.
+ */
+int keep_shard(ShardGroup *group, int shard) {
+    int kept = -1;
+#if defined(__linux__)
+    for (int i = 0; i < group->count; i++) {
+        if (i == shard) {
+            kept = group->sockets[i];
+        } else if (group->sockets[i] >= 0) {
+            close(group->sockets[i]);
+            group->sockets[i] = -1;
+        }
+    }
+    release_program(group);
+#else
+    (void) group;
+    (void) shard;
+#endif
+    return kept;
+}
+
+
+/**
+ * @brief Records whether an accepted connection was received by the CPU of the shard.
+ * @param[in/out] stats: the handoff metrics.
+ * @param[in] client_socket: the accepted socket.
+ * @param[in] cpu: the CPU of the shard.
+ */
+void record_handoff(HandoffStats *stats, int client_socket, int cpu) {
+    stats->accepted++;
+#if defined(__linux__)
+    int incoming = -1;
+    socklen_t size = sizeof(incoming);
+    if (getsockopt(client_socket, SOL_SOCKET, SO_INCOMING_CPU, &incoming, &size) < 0 || incoming < 0) {
+        stats->unknown++;
+    } else if (incoming == cpu) {
+        stats->local++;
+    } else {
+        stats->handoffs++;
+    }
+#else
+    (void) client_socket;
+    (void) cpu;
+    stats->unknown++;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - END SHARDS - - - - - - - - - - - - - - - - - - - */
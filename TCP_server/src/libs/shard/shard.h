@@ -0,0 +1,145 @@
+/*
+ ============================================================================
+ Name        : shard.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the sharded listener mode of the server.
+               The server forks one process per shard; every shard owns a
+               listening socket of the same SO_REUSEPORT group and is pinned
+               to its own CPU. New connections are steered to the shard of
+               the CPU that received their packets: by a SK_REUSEPORT eBPF
+               program if it can be loaded, by SO_INCOMING_CPU otherwise, so
+               the socket, the session and the generator buffers of a client
+               stay in the cache of one core. These are Linux features;
+               elsewhere the kernel hash of the group spreads the connections.
+ ============================================================================
+ */
+
+#ifndef SHARD_H_
+#define SHARD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Maximum number of shards.
+ */
+#define MAX_SHARDS 64           /**< Shard group capacity */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum ShardSteering
+ * @brief How new connections are spread over the shards.
+ */
+typedef enum {
+    STEERING_HASH,          /**< Kernel hash of the addresses: no CPU affinity */
+    STEERING_INCOMING_CPU,  /**< SO_INCOMING_CPU on every listener */
+    STEERING_BPF            /**< SK_REUSEPORT eBPF program selecting the listener of the current CPU */
+} ShardSteering;
+
+
+/**
+ * @struct ShardGroup
+ * @brief The listening sockets of the shards and the steering attached to them.
+ */
+typedef struct {
+    int sockets[MAX_SHARDS];    /**< Listening socket of every shard, -1 once closed */
+    int count;                  /**< Number of shards */
+    ShardSteering steering;     /**< Steering in use */
+    int map;                    /**< REUSEPORT_SOCKARRAY of the eBPF steering, -1 if none */
+    int program;                /**< SK_REUSEPORT program of the eBPF steering, -1 if none */
+} ShardGroup;
+
+
+/**
+ * @struct HandoffStats
+ * @brief Connections accepted by a shard, split by the CPU that received their packets.
+ */
+typedef struct {
+    unsigned long accepted;     /**< Connections accepted */
+    unsigned long local;        /**< Connections received by the CPU of the shard */
+    unsigned long handoffs;     /**< Connections received by another CPU */
+    unsigned long unknown;      /**< Connections whose receiving CPU is not reported */
+} HandoffStats;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - SHARDS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Opens one listening socket per shard, all bound to the same address and port.
+ * @param[out] group: the group, cleared before opening.
+ * @param[in] address: the IPv4 address to listen on.
+ * @param[in] port: the TCP port.
+ * @param[in] count: the number of shards, between 1 and `MAX_SHARDS`.
+ * @param[in] backlog: the backlog of every listener.
+ * @return `true` if every listener is open, `false` otherwise, with every socket closed.
+ */
+bool open_shard_listeners(ShardGroup *group, const char *address, int port, int count, int backlog);
+
+
+/**
+ * @brief Returns the CPU a shard is pinned to.
+ * Shards are spread round-robin over the online CPUs.
+ * @param[in] shard: the index of the shard.
+ * @return the index of the CPU.
+ */
+int shard_cpu(int shard);
+
+
+/**
+ * @brief Steers new connections to the shard of the CPU that received them.
+ *
+ * The eBPF steering maps CPU `c` to shard `c % count`, which is the shard pinned to `c` when
+ * there are as many shards as CPUs. If the program cannot be loaded or attached, every listener
+ * is tagged with the CPU of its shard through SO_INCOMING_CPU; if that fails too, the kernel
+ * hash is left in place.
+ *
+ * @param[in/out] group: the open group.
+ * @param[out] reason: receives why the eBPF steering is not used, empty if it is.
+ * @param[in] size: the size of `reason`.
+ * @return the steering in use.
+ */
+ShardSteering steer_shards(ShardGroup *group, char *reason, size_t size);
+
+
+/**
+ * @brief Returns the name of a steering.
+ * @param[in] steering: the steering.
+ * @return "bpf", "incoming_cpu" or "hash".
+ */
+const char *steering_name(ShardSteering steering);
+
+
+/**
+ * @brief Keeps the listener of one shard, closing the others and the eBPF descriptors.
+ *
+ * Called by every shard process after the fork. The program stays attached to the group,
+ * and the map keeps referencing the listeners, after their descriptors are closed.
+ *
+ * @param[in/out] group: the group.
+ * @param[in] shard: the shard to keep, -1 to close every listener.
+ * @return the listening socket of the shard, or -1.
+ */
+int keep_shard(ShardGroup *group, int shard);
+
+
+/**
+ * @brief Records whether an accepted connection was received by the CPU of the shard.
+ * @param[in/out] stats: the handoff metrics of the shard.
+ * @param[in] client_socket: the accepted socket.
+ * @param[in] cpu: the CPU of the shard.
+ */
+void record_handoff(HandoffStats *stats, int client_socket, int cpu);
+
+/* - - - - - - - - - - - - - - - - - - - END SHARDS - - - - - - - - - - - - - - - - - - - */
+
+#endif /* SHARD_H_ */
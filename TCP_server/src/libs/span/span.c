@@ -0,0 +1,316 @@
+/*
+ ============================================================================
+ Name        : span.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Spans of sampled requests and their OTLP/JSON export.
+ ============================================================================
+ */
+
+#if defined WIN32
+#include <winsock.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#define closesocket close
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "span.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - - SPANS - - - - - - - - - - - - - - - - - - - - */
+
+static const char *const SPAN_NAMES[SPAN_KINDS] = {
+    "request", "queue", "validate", "generate", "send"
+};  /**< Names of the spans, by kind */
+
+/**
+ * @brief Advances a splitmix64 state and returns its next output.
+ */
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+/**
+ * @brief Returns the wall clock time in nanoseconds since the Unix epoch.
+ */
+static uint64_t wall_clock_ns(void) {
+#if defined WIN32
+    return (uint64_t) time(NULL) * 1000000000ull;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+#endif
+}
+
+
+/**
+ * @brief Clears a span ring and seeds its identifier generator.
+ * @param[out] ring: the ring.
+ */
+void init_span_ring(SpanRing *ring) {
+    memset(ring, 0, sizeof(*ring));
+    // Shards are forked processes recording into their own rings: the process id keeps their identifiers apart
+    ring->id_state = wall_clock_ns() ^ ((uint64_t) getpid() << 32);
+}
+
+
+/**
+ * @brief Tells whether a request carries a sampled trace context.
+ * @param[in] context: the trace context of the request.
+ * @return `true` if the context is sampled and has a non-zero trace identifier.
+ */
+bool trace_sampled(const TraceContext *context) {
+    if ((context->flags & TRACE_SAMPLED) == 0) {
+        return false;
+    }
+    for (int i = 0; i < TRACE_ID_SIZE; i++) {
+        if (context->trace_id[i] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Draws a new span identifier.
+ * @param[in/out] ring: the ring.
+ * @param[out] span_id: receives a non-zero identifier.
+ */
+void new_span_id(SpanRing *ring, unsigned char span_id[SPAN_ID_SIZE]) {
+    uint64_t id;
+    do {
+        id = splitmix64(&ring->id_state);
+    } while (id == 0);
+    memcpy(span_id, &id, SPAN_ID_SIZE);
+}
+
+
+/**
+ * @brief Records a span.
+ * @param[in/out] ring: the ring.
+ * @param[in] span: the span.
+ * @return `true` if the span was recorded.
+ */
+bool record_span(SpanRing *ring, const Span *span) {
+    uint32_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= SPAN_RING_SIZE) {
+        ring->dropped++;
+        return false;
+    }
+    ring->spans[head & (SPAN_RING_SIZE - 1)] = *span;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    ring->recorded++;
+    return true;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END SPANS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - EXPORT - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Size of the buffer of an exported line.
+ */
+#define SPAN_LINE_SIZE 32768    /**< Exported line size */
+
+/**
+ * @brief Room kept at the end of a line for the span being written and the closing brackets.
+ */
+#define SPAN_LINE_SLACK 1024    /**< Line slack */
+
+static char line[SPAN_LINE_SIZE];  /**< Line being exported, static so exporting never allocates */
+
+/**
+ * @brief Writes bytes as lowercase hexadecimal, as OTLP/JSON encodes identifiers.
+ */
+static void hex_encode(const unsigned char *bytes, int size, char *text) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < size; i++) {
+        text[2 * i] = digits[bytes[i] >> 4];
+        text[2 * i + 1] = digits[bytes[i] & 0x0F];
+    }
+    text[2 * size] = '\0';
+}
+
+
+/**
+ * @brief Copies a label into a JSON string, leaving out the characters that would need escaping.
+ */
+static void json_label(const char *label, char *text, size_t size) {
+    size_t length = 0;
+    for (; *label != '\0' && length + 1 < size; label++) {
+        if (*label != '"' && *label != '\\' && (unsigned char) *label >= 0x20) {
+            text[length++] = *label;
+        }
+    }
+    text[length] = '\0';
+}
+
+
+/**
+ * @brief Appends one span to a line in OTLP/JSON.
+ * @return the number of characters written.
+ */
+static int format_span(const Span *span, uint64_t epoch_ns, char *text, size_t size) {
+    char trace_id[2 * TRACE_ID_SIZE + 1];
+    char span_id[2 * SPAN_ID_SIZE + 1];
+    char parent_id[2 * SPAN_ID_SIZE + 1];
+    char tenant[SPAN_LABEL_SIZE];
+    hex_encode(span->trace_id, TRACE_ID_SIZE, trace_id);
+    hex_encode(span->span_id, SPAN_ID_SIZE, span_id);
+    hex_encode(span->parent_id, SPAN_ID_SIZE, parent_id);
+    json_label(span->tenant, tenant, sizeof(tenant));
+    unsigned long long start = epoch_ns + (uint64_t) (span->start * 1e9);
+    unsigned long long end = epoch_ns + (uint64_t) (span->end * 1e9);
+
+    // Only the server span carries the attributes; its children are kind INTERNAL (1), it is SERVER (2)
+    int written = snprintf(text, size, "{\"traceId\":\"%s\",\"spanId\":\"%s\",\"parentSpanId\":\"%s\","
+                           "\"name\":\"%s\",\"kind\":%d,\"startTimeUnixNano\":\"%llu\",\"endTimeUnixNano\":\"%llu\"",
+                           trace_id, span_id, parent_id, SPAN_NAMES[span->kind], (span->kind == SPAN_REQUEST) ? 2 : 1,
+                           start, end);
+    if (span->kind == SPAN_REQUEST) {
+        written += snprintf(text + written, size - written, ",\"attributes\":["
+                            "{\"key\":\"pwgen.tenant\",\"value\":{\"stringValue\":\"%s\"}},"
+                            "{\"key\":\"pwgen.type\",\"value\":{\"stringValue\":\"%c\"}},"
+                            "{\"key\":\"pwgen.length\",\"value\":{\"intValue\":\"%d\"}},"
+                            "{\"key\":\"pwgen.session\",\"value\":{\"stringValue\":\"%08x\"}}]",
+                            tenant, (span->type > 0x20 && span->type < 0x7F && span->type != '"' && span->type != '\\')
+                            ? span->type : '?', span->length, (unsigned int) span->session);
+    }
+    written += snprintf(text + written, size - written, ",\"status\":{\"code\":%d}}", span->error ? 2 : 0);
+    return written;
+}
+
+
+/**
+ * @brief Opens the destination of the exported spans.
+ * @param[out] exporter: the exporter.
+ * @param[in] target: a file path or `udp:HOST:PORT`.
+ * @param[in] now: the current time of the monotonic clock.
+ * @return `true` if the destination is open.
+ */
+bool open_span_exporter(SpanExporter *exporter, const char *target, double now) {
+    memset(exporter, 0, sizeof(*exporter));
+    exporter->socket = -1;
+    snprintf(exporter->target, sizeof(exporter->target), "%s", target);
+    exporter->epoch_ns = wall_clock_ns() - (uint64_t) (now * 1e9);
+
+    if (strncmp(target, "udp:", 4) != 0) {
+        exporter->file = fopen(target, "a");
+        return exporter->file != NULL;
+    }
+
+    char host[SPAN_TARGET_SIZE];
+    int port = 0;
+    if (sscanf(target + 4, "%127[^:]:%d", host, &port) != 2 || port <= 0 || port > 65535) {
+        return false;
+    }
+    struct hostent *entry = gethostbyname(host);
+    if (entry == NULL || entry->h_addrtype != AF_INET) {
+        return false;
+    }
+    struct sockaddr_in collector;
+    memset(&collector, 0, sizeof(collector));
+    collector.sin_family = AF_INET;
+    memcpy(&collector.sin_addr, entry->h_addr_list[0], sizeof(collector.sin_addr));
+    collector.sin_port = htons(port);
+    exporter->socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (exporter->socket < 0 || connect(exporter->socket, (struct sockaddr*) &collector, sizeof(collector)) < 0) {
+        close_span_exporter(exporter);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Tells whether an exporter is open.
+ * @param[in] exporter: the exporter.
+ * @return `true` if spans are exported.
+ */
+bool span_exporter_open(const SpanExporter *exporter) {
+    return exporter->file != NULL || exporter->socket >= 0;
+}
+
+
+/**
+ * @brief Exports up to `SPAN_EXPORT_BATCH` spans as one OTLP/JSON line.
+ * @param[in/out] ring: the ring.
+ * @param[in/out] exporter: the exporter.
+ * @param[in] service: the `service.name` of the resource.
+ * @return the number of spans drained.
+ */
+int export_spans(SpanRing *ring, SpanExporter *exporter, const char *service) {
+    uint32_t tail = ring->tail;
+    uint32_t available = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    if (available == 0) {
+        return 0;
+    }
+    int count = (available < SPAN_EXPORT_BATCH) ? (int) available : SPAN_EXPORT_BATCH;
+    if (!span_exporter_open(exporter)) {
+        __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    int length = snprintf(line, sizeof(line), "{\"resourceSpans\":[{\"resource\":{\"attributes\":["
+                          "{\"key\":\"service.name\",\"value\":{\"stringValue\":\"%s\"}},"
+                          "{\"key\":\"process.pid\",\"value\":{\"intValue\":\"%d\"}}]},"
+                          "\"scopeSpans\":[{\"scope\":{\"name\":\"pwgen.span\"},\"spans\":[",
+                          service, (int) getpid());
+    int exported = 0;
+    for (; exported < count && length + SPAN_LINE_SLACK < (int) sizeof(line); exported++) {
+        if (exported > 0) {
+            line[length++] = ',';
+        }
+        length += format_span(&ring->spans[(tail + exported) & (SPAN_RING_SIZE - 1)], exporter->epoch_ns,
+                              line + length, sizeof(line) - length);
+    }
+    __atomic_store_n(&ring->tail, tail + exported, __ATOMIC_RELEASE);
+    length += snprintf(line + length, sizeof(line) - length, "]}]}]}\n");
+
+    bool written;
+    if (exporter->file != NULL) {
+        written = fwrite(line, 1, length, exporter->file) == (size_t) length && fflush(exporter->file) == 0;
+    } else {
+        written = send(exporter->socket, line, length, 0) == length;  /**< A collector that is down loses the batch */
+    }
+    if (written) {
+        exporter->exported += exported;
+    } else {
+        exporter->failed += exported;
+    }
+    return exported;
+}
+
+
+/**
+ * @brief Closes the destination of the exported spans.
+ * @param[in/out] exporter: the exporter.
+ */
+void close_span_exporter(SpanExporter *exporter) {
+    if (exporter->file != NULL) {
+        fclose(exporter->file);
+        exporter->file = NULL;
+    }
+    if (exporter->socket >= 0) {
+        closesocket(exporter->socket);
+        exporter->socket = -1;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - END EXPORT - - - - - - - - - - - - - - - - - - - */
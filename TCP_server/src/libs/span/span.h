@@ -0,0 +1,205 @@
+/*
+ ============================================================================
+ Name        : span.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the spans of sampled requests. A client
+               that propagates a sampled `TraceContext` gets the queueing,
+               validation, generation and send of its request recorded as
+               child spans of a server span. Spans go into a single-producer,
+               single-consumer ring that never blocks the event loop, and are
+               exported in batches as OTLP/JSON lines, one
+               ExportTraceServiceRequest per line, to a file or to a local
+               collector listening on UDP.
+ ============================================================================
+ */
+
+#ifndef SPAN_H_
+#define SPAN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../protocol/protocol.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Capacity of the span ring, a power of two.
+ * A full ring drops new spans rather than waiting for the exporter.
+ */
+#define SPAN_RING_SIZE 4096     /**< Span ring capacity */
+
+/**
+ * @brief Largest number of spans exported per line.
+ * Keeps a line within one UDP datagram.
+ */
+#define SPAN_EXPORT_BATCH 32    /**< Spans per exported line */
+
+/**
+ * @brief Size of the label of a span, null terminator included.
+ */
+#define SPAN_LABEL_SIZE 32      /**< Span label size */
+
+/**
+ * @brief Size of the description of an export target, null terminator included.
+ */
+#define SPAN_TARGET_SIZE 128    /**< Export target size */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum SpanKind
+ * @brief Enumerates the spans of a sampled request.
+ *
+ * - `SPAN_REQUEST`: The whole request on the server, parent of the others.
+ * - `SPAN_QUEUE`: From the event loop waking up to the request being picked up.
+ * - `SPAN_VALIDATE`: Rate limiting and validation against the tenant policy.
+ * - `SPAN_GENERATE`: Generation of the password.
+ * - `SPAN_SEND`: Sending of the response.
+ */
+typedef enum {
+    SPAN_REQUEST,
+    SPAN_QUEUE,
+    SPAN_VALIDATE,
+    SPAN_GENERATE,
+    SPAN_SEND,
+    SPAN_KINDS
+} SpanKind;
+
+
+/**
+ * @struct Span
+ * @brief A timed operation of a sampled request.
+ */
+typedef struct {
+    unsigned char trace_id[TRACE_ID_SIZE];  /**< Trace of the request */
+    unsigned char span_id[SPAN_ID_SIZE];    /**< Identifier of the span */
+    unsigned char parent_id[SPAN_ID_SIZE];  /**< Parent span, the span of the client for `SPAN_REQUEST` */
+    unsigned char kind;                     /**< `SpanKind` of the span */
+    bool error;                             /**< Whether the request was answered with an error */
+    char type;                              /**< Password type requested */
+    int length;                             /**< Password length requested, 0 if invalid */
+    uint32_t session;                       /**< Handle of the session */
+    char tenant[SPAN_LABEL_SIZE];           /**< Tenant of the session */
+    double start;                           /**< Start, in seconds of the monotonic clock */
+    double end;                             /**< End, in seconds of the monotonic clock */
+} Span;
+
+
+/**
+ * @struct SpanRing
+ * @brief Lock-free ring of spans between the event loop and the exporter.
+ *
+ * `head` is only written by the producer and `tail` only by the consumer, each published with
+ * release semantics, so the two sides may run on different threads without locks.
+ */
+typedef struct {
+    Span spans[SPAN_RING_SIZE];             /**< Recorded spans, indexed modulo `SPAN_RING_SIZE` */
+    uint32_t head;                          /**< Spans recorded, written by the producer */
+    uint32_t tail;                          /**< Spans consumed, written by the consumer */
+    uint64_t id_state;                      /**< State of the span identifier generator */
+    unsigned long recorded;                 /**< Spans recorded since the start */
+    unsigned long dropped;                  /**< Spans dropped on a full ring */
+} SpanRing;
+
+
+/**
+ * @struct SpanExporter
+ * @brief Destination of the exported spans.
+ */
+typedef struct {
+    FILE *file;                             /**< Export file, NULL if none */
+    int socket;                             /**< Connected UDP socket of the collector, -1 if none */
+    char target[SPAN_TARGET_SIZE];          /**< Description of the target */
+    uint64_t epoch_ns;                      /**< Wall clock time of monotonic time 0, in nanoseconds */
+    unsigned long exported;                 /**< Spans exported */
+    unsigned long failed;                   /**< Spans lost on a failed write */
+} SpanExporter;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - SPANS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Clears a span ring and seeds its identifier generator.
+ * @param[out] ring: the ring.
+ */
+void init_span_ring(SpanRing *ring);
+
+
+/**
+ * @brief Tells whether a request carries a sampled trace context.
+ * @param[in] context: the trace context of the request.
+ * @return `true` if the context is sampled and has a non-zero trace identifier.
+ */
+bool trace_sampled(const TraceContext *context);
+
+
+/**
+ * @brief Draws a new span identifier.
+ * @param[in/out] ring: the ring, whose generator is advanced.
+ * @param[out] span_id: receives a non-zero identifier.
+ */
+void new_span_id(SpanRing *ring, unsigned char span_id[SPAN_ID_SIZE]);
+
+
+/**
+ * @brief Records a span.
+ * @param[in/out] ring: the ring; only one thread may record into it.
+ * @param[in] span: the span, copied into the ring.
+ * @return `true` if the span was recorded, `false` if the ring is full and the span dropped.
+ */
+bool record_span(SpanRing *ring, const Span *span);
+
+/* - - - - - - - - - - - - - - - - - - - END SPANS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - EXPORT - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Opens the destination of the exported spans.
+ * @param[out] exporter: the exporter.
+ * @param[in] target: a file path, appended to, or `udp:HOST:PORT` for a local collector.
+ * @param[in] now: the current time of the monotonic clock, to convert span times to wall clock.
+ * @return `true` if the destination is open.
+ */
+bool open_span_exporter(SpanExporter *exporter, const char *target, double now);
+
+
+/**
+ * @brief Tells whether an exporter is open.
+ * @param[in] exporter: the exporter.
+ * @return `true` if spans are exported.
+ */
+bool span_exporter_open(const SpanExporter *exporter);
+
+
+/**
+ * @brief Exports up to `SPAN_EXPORT_BATCH` spans as one OTLP/JSON line.
+ *
+ * Called by the consumer of the ring; returns at once if the ring is empty. Spans drained
+ * while the exporter is closed are discarded.
+ *
+ * @param[in/out] ring: the ring.
+ * @param[in/out] exporter: the exporter.
+ * @param[in] service: the `service.name` of the resource.
+ * @return the number of spans drained.
+ */
+int export_spans(SpanRing *ring, SpanExporter *exporter, const char *service);
+
+
+/**
+ * @brief Closes the destination of the exported spans.
+ * @param[in/out] exporter: the exporter.
+ */
+void close_span_exporter(SpanExporter *exporter);
+
+/* - - - - - - - - - - - - - - - - - - - END EXPORT - - - - - - - - - - - - - - - - - - - */
+
+#endif /* SPAN_H_ */
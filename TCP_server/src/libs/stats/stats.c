@@ -0,0 +1,149 @@
+/*
+ ============================================================================
+ Name        : stats.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Latency histograms for the stages of request processing and
+               event loop counters.
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include "stats.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - HISTOGRAMS - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns the printable name of a stage.
+ * @param[in] stage: the stage.
+ * @return a static string naming the stage.
+ */
+const char *stage_name(Stage stage) {
+    switch(stage) {
+        case STAGE_HANDSHAKE:
+            return "handshake";
+        case STAGE_VALIDATE:
+            return "validate";
+        case STAGE_GENERATE:
+            return "generate";
+        case STAGE_SEND:
+            return "send";
+        case STAGE_REQUEST:
+            return "request";
+        default:
+            return "unknown";
+    }
+}
+
+
+/**
+ * @brief Records a sample in a histogram.
+ * @param[in/out] histogram: the histogram.
+ * @param[in] seconds: the duration of the sample.
+ * @post The bucket of the smallest power of two nanoseconds above the sample is incremented.
+ */
+void record_sample(Histogram *histogram, double seconds) {
+    unsigned long long nanoseconds = (seconds > 0) ? (unsigned long long) (seconds * 1e9) : 0;
+    int bucket = 0;
+    while (nanoseconds > 0 && bucket < HISTOGRAM_BUCKETS - 1) {
+        nanoseconds >>= 1;
+        bucket++;
+    }
+    histogram->counts[bucket]++;
+    histogram->total++;
+    histogram->sum += seconds;
+    if (seconds > histogram->max) {
+        histogram->max = seconds;
+    }
+}
+
+
+/**
+ * @brief Estimates a percentile of a histogram.
+ * @param[in] histogram: the histogram.
+ * @param[in] percentile: the percentile, between 0 and 100.
+ * @return the upper bound in seconds of the bucket holding the percentile.
+ */
+double histogram_percentile(const Histogram *histogram, double percentile) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    double rank = histogram->total * percentile / 100.0;
+    unsigned long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank && seen > 0) {
+            return (double) (1ULL << i) / 1e9;
+        }
+    }
+    return histogram->max;
+}
+
+
+/**
+ * @brief Formats a summary line and the non-empty buckets of a histogram.
+ * @param[in] histogram: the histogram.
+ * @param[in] name: the label of the histogram.
+ * @param[out] buffer: receives the text.
+ * @param[in] size: the size of `buffer`.
+ * @return the number of characters written.
+ */
+int format_histogram(const Histogram *histogram, const char *name, char *buffer, size_t size) {
+    double mean = (histogram->total > 0) ? histogram->sum / histogram->total : 0;
+    int written = snprintf(buffer, size, "%-10s count=%lu mean_us=%.2f p50_us<=%.2f p99_us<=%.2f max_us=%.2f\n", name,
+                           histogram->total, mean * 1e6, histogram_percentile(histogram, 50) * 1e6,
+                           histogram_percentile(histogram, 99) * 1e6, histogram->max * 1e6);
+    size_t used = (written > 0) ? (size_t) written : 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS && used < size; i++) {
+        if (histogram->counts[i] > 0) {
+            written = snprintf(buffer + used, size - used, "    <%12.3f us: %lu\n",
+                               (double) (1ULL << i) / 1e3, histogram->counts[i]);
+            used += (written > 0) ? (size_t) written : 0;
+        }
+    }
+    return (int) (used < size ? used : size - 1);
+}
+
+/* - - - - - - - - - - - - - - - - - - END HISTOGRAMS - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - LOOP - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Records a turn of the event loop.
+ * @param[in/out] stats: the loop counters.
+ * @param[in] waited: the seconds spent in `select()`.
+ * @param[in] worked: the seconds spent handling the ready sockets.
+ * @param[in] ready: the number of ready sockets returned by `select()`.
+ * @post An empty turn counts entirely as waiting.
+ */
+void record_turn(LoopStats *stats, double waited, double worked, int ready) {
+    stats->turns++;
+    if (ready <= 0) {
+        stats->empty_turns++;
+        stats->waiting += waited + worked;
+    } else {
+        stats->waiting += waited;
+        stats->working += worked;
+    }
+}
+
+
+/**
+ * @brief Formats the loop counters as a single line.
+ * @param[in] stats: the loop counters.
+ * @param[in] busy_poll: whether the loop is spinning.
+ * @param[out] buffer: receives the null-terminated text, truncated if needed.
+ * @param[in] size: the size of `buffer`.
+ * @return the number of characters written, without the null terminator.
+ */
+int format_loop_stats(const LoopStats *stats, bool busy_poll, char *buffer, size_t size) {
+    double total = stats->waiting + stats->working;
+    return snprintf(buffer, size, "loop mode=%s turns=%llu empty=%llu spin_ratio=%.4f idle_ratio=%.4f busy_s=%.3f\n",
+                    busy_poll ? "busy-poll" : "blocking", stats->turns, stats->empty_turns,
+                    (stats->turns > 0) ? (double) stats->empty_turns / stats->turns : 0,
+                    (total > 0) ? stats->waiting / total : 0, stats->working);
+}
+
+/* - - - - - - - - - - - - - - - - - - - END LOOP - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,152 @@
+/*
+ ============================================================================
+ Name        : stats.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing latency histograms for the stages of
+               request processing. Histograms use power-of-two buckets so
+               recording a sample is a handful of instructions. Loop
+               counters split the time of the event loop between waiting
+               for events and serving them.
+ ============================================================================
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Number of buckets of a histogram.
+ * Bucket `i` counts the samples lasting less than 2^i nanoseconds, so 40 buckets
+ * reach about 18 minutes.
+ */
+#define HISTOGRAM_BUCKETS 40    /**< Number of histogram buckets */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum Stage
+ * @brief Enumerates the measured stages of request processing.
+ *
+ * - `STAGE_HANDSHAKE`: Verification of the authentication proof.
+ * - `STAGE_VALIDATE`: Rate limiting and validation of the request against the tenant policy.
+ * - `STAGE_GENERATE`: Password generation.
+ * - `STAGE_SEND`: Sending of the response.
+ * - `STAGE_REQUEST`: Whole request, from the last byte received to the response sent.
+ */
+typedef enum {
+    STAGE_HANDSHAKE,    /**< Authentication proof verification */
+    STAGE_VALIDATE,     /**< Request validation */
+    STAGE_GENERATE,     /**< Password generation */
+    STAGE_SEND,         /**< Response send */
+    STAGE_REQUEST,      /**< Whole request */
+    STAGE_COUNT         /**< Number of stages */
+} Stage;
+
+
+/**
+ * @struct Histogram
+ * @brief Latency histogram with power-of-two nanosecond buckets.
+ */
+typedef struct {
+    unsigned long counts[HISTOGRAM_BUCKETS];    /**< Samples per bucket */
+    unsigned long total;                        /**< Number of samples */
+    double sum;                                 /**< Sum of the samples, in seconds */
+    double max;                                 /**< Largest sample, in seconds */
+} Histogram;
+
+
+/**
+ * @struct LoopStats
+ * @brief Turns and time of the event loop.
+ *
+ * A turn is one `select()` call followed by the handling of the ready sockets. An empty turn
+ * found no ready socket: in busy-poll mode these are the spins.
+ */
+typedef struct {
+    unsigned long long turns;           /**< Turns since the start */
+    unsigned long long empty_turns;     /**< Turns that found no ready socket */
+    double waiting;                     /**< Seconds spent in `select()` and in empty turns */
+    double working;                     /**< Seconds spent handling ready sockets */
+} LoopStats;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - HISTOGRAMS - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns the printable name of a stage.
+ * @param[in] stage: the stage.
+ * @return a static string naming the stage.
+ */
+const char *stage_name(Stage stage);
+
+
+/**
+ * @brief Records a sample in a histogram.
+ * @param[in/out] histogram: the histogram.
+ * @param[in] seconds: the duration of the sample.
+ */
+void record_sample(Histogram *histogram, double seconds);
+
+
+/**
+ * @brief Estimates a percentile of a histogram.
+ * @param[in] histogram: the histogram.
+ * @param[in] percentile: the percentile, between 0 and 100.
+ * @return the upper bound in seconds of the bucket holding the percentile, 0 if the histogram is empty.
+ */
+double histogram_percentile(const Histogram *histogram, double percentile);
+
+
+/**
+ * @brief Formats a summary line and the non-empty buckets of a histogram.
+ * @param[in] histogram: the histogram.
+ * @param[in] name: the label of the histogram.
+ * @param[out] buffer: receives the null-terminated text, truncated if needed.
+ * @param[in] size: the size of `buffer`.
+ * @return the number of characters written, without the null terminator.
+ */
+int format_histogram(const Histogram *histogram, const char *name, char *buffer, size_t size);
+
+/* - - - - - - - - - - - - - - - - - - END HISTOGRAMS - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - LOOP - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Records a turn of the event loop.
+ * @param[in/out] stats: the loop counters.
+ * @param[in] waited: the seconds spent in `select()`.
+ * @param[in] worked: the seconds spent handling the ready sockets.
+ * @param[in] ready: the number of ready sockets returned by `select()`.
+ */
+void record_turn(LoopStats *stats, double waited, double worked, int ready);
+
+
+/**
+ * @brief Formats the loop counters as a single line.
+ *
+ * The spin ratio is the fraction of turns that found nothing to do; the idle ratio is the
+ * fraction of the loop time not spent serving sockets.
+ *
+ * @param[in] stats: the loop counters.
+ * @param[in] busy_poll: whether the loop is spinning.
+ * @param[out] buffer: receives the null-terminated text, truncated if needed.
+ * @param[in] size: the size of `buffer`.
+ * @return the number of characters written, without the null terminator.
+ */
+int format_loop_stats(const LoopStats *stats, bool busy_poll, char *buffer, size_t size);
+
+/* - - - - - - - - - - - - - - - - - - - END LOOP - - - - - - - - - - - - - - - - - - - - */
+
+#endif /* STATS_H_ */
@@ -0,0 +1,164 @@
+/*
+ ============================================================================
+ Name        : tenant.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Tenant policy sets, rate limits and metrics.
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "tenant.h"
+#include "../protocol/protocol.h"
+#include "../utils/utils.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - TENANTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Clamps a length range to the lengths the generator supports, 1 to `MAX_PASSWORD_LENGTH`.
+ * @param[in/out] min_length: the minimum length.
+ * @param[in/out] max_length: the maximum length.
+ */
+static void clamp_lengths(int *min_length, int *max_length) {
+    *min_length = (*min_length < 1) ? 1 : *min_length;
+    *max_length = (*max_length > MAX_PASSWORD_LENGTH) ? MAX_PASSWORD_LENGTH : *max_length;
+}
+
+
+/**
+ * @brief Initializes a tenant.
+ * @param[out] tenant: the tenant to initialize.
+ * @param[in] name: the name of the tenant.
+ * @param[in] types: a string containing all allowed types.
+ * @param[in] min_length: the minimum allowable password length.
+ * @param[in] max_length: the maximum allowable password length.
+ * @param[in] rate: the allowed requests per second, 0 for unlimited.
+ * @param[in] burst: the capacity of the token bucket.
+ * @post The tenant starts with a full token bucket and zeroed metrics.
+ */
+void init_tenant(Tenant *tenant, const char *name, const char *types, int min_length, int max_length,
+                 double rate, double burst) {
+    memset(tenant, 0, sizeof(*tenant));
+    snprintf(tenant->name, sizeof(tenant->name), "%s", name);
+    for (int i = 0; types[i] != '\0'; i++) {
+        tenant->allowed_type[(unsigned char) types[i]] = true;
+    }
+    clamp_lengths(&min_length, &max_length);
+    tenant->min_length = min_length;
+    tenant->max_length = max_length;
+    tenant->rate = (rate > 0) ? rate : 0;
+    tenant->burst = (burst >= 1) ? burst : 1;
+    tenant->tokens = tenant->burst;
+    tenant->last_refill = monotonic_seconds();
+}
+
+
+/**
+ * @brief Loads tenants from a file.
+ * @param[out] table: the tenant table.
+ * @param[in] path: the path of the tenant file.
+ * @param[in] default_types: the allowed types of the default tenant, also the types a tenant may list.
+ * @return the number of tenants loaded from the file, -1 if the file cannot be opened, or -2 if
+ *         an entry lists an unknown type.
+ * @post `table` holds at least the default tenant, even if the file cannot be opened.
+ */
+int load_tenants(TenantTable *table, const char *path, const char *default_types) {
+    table->count = 1;
+    init_tenant(&table->tenants[DEFAULT_TENANT], "default", default_types,
+                MIN_PASSWORD_LENGTH, MAX_PASSWORD_LENGTH, 0, 1);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int loaded = 0;
+    char line[256];
+    char name[TENANT_NAME_SIZE];
+    char types[64];
+    int min_length, max_length;
+    double rate, burst;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        rate = 0;
+        burst = 1;
+        if (sscanf(line, "%31s %63s %d %d %lf %lf", name, types, &min_length, &max_length, &rate, &burst) < 4) {
+            continue;
+        }
+        // A typo must not become a request type that the generator maps to some other type
+        size_t known = strspn(types, default_types);
+        if (types[known] != '\0') {
+            printf("Tenant %s in %s allows the unknown type '%c' (known types: %s)\n",
+                   name, path, types[known], default_types);
+            fclose(file);
+            return -2;
+        }
+        // Checked after clamping: "40 50" becomes 40 to 32, a tenant that could never be served
+        clamp_lengths(&min_length, &max_length);
+        if (min_length > max_length) {
+            printf("Tenant %s in %s has no valid length (%d to %d after clamping to 1-%d), line ignored\n",
+                   name, path, min_length, max_length, MAX_PASSWORD_LENGTH);
+            continue;
+        }
+
+        int index = find_tenant(table, name);
+        if (index < 0) {
+            if (table->count >= MAX_TENANTS) {
+                continue;
+            }
+            index = table->count++;
+        }
+        init_tenant(&table->tenants[index], name, types, min_length, max_length, rate, burst);
+        loaded++;
+    }
+    fclose(file);
+    return loaded;
+}
+
+
+/**
+ * @brief Looks up a tenant by name.
+ * @param[in] table: the tenant table.
+ * @param[in] name: the name to look up.
+ * @return the index of the tenant, or -1 if it is not present.
+ */
+int find_tenant(const TenantTable *table, const char *name) {
+    for (int i = 0; i < table->count; i++) {
+        if (strcmp(table->tenants[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * @brief Consumes one request from the rate limit of a tenant.
+ * @param[in/out] tenant: the tenant.
+ * @return `true` if the request may be served, `false` otherwise.
+ */
+bool take_tenant_token(Tenant *tenant) {
+    if (tenant->rate == 0) {
+        return true;
+    }
+
+    // Refill the bucket for the time elapsed since the last request
+    double now = monotonic_seconds();
+    tenant->tokens += (now - tenant->last_refill) * tenant->rate;
+    if (tenant->tokens > tenant->burst) {
+        tenant->tokens = tenant->burst;
+    }
+    tenant->last_refill = now;
+
+    if (tenant->tokens < 1) {
+        return false;
+    }
+    tenant->tokens -= 1;
+    return true;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END TENANTS - - - - - - - - - - - - - - - - - - - */
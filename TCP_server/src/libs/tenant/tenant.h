@@ -0,0 +1,140 @@
+/*
+ ============================================================================
+ Name        : tenant.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing tenants: isolated policy sets with their
+               own allowed password types, length bounds, rate limit and
+               metrics. Connections are bound to a tenant once, and every
+               request resolves its policy with a single array index.
+ ============================================================================
+ */
+
+#ifndef TENANT_H_
+#define TENANT_H_
+
+#include <stdbool.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Maximum number of tenants, the default tenant included.
+ */
+#define MAX_TENANTS 64          /**< Tenant table capacity */
+
+/**
+ * @brief Maximum length of a tenant name, null terminator included.
+ */
+#define TENANT_NAME_SIZE 32     /**< Tenant name size */
+
+/**
+ * @brief Index of the default tenant, used by connections without an API key
+ * and by keys that do not name a tenant.
+ */
+#define DEFAULT_TENANT 0        /**< Default tenant index */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @struct TenantMetrics
+ * @brief Counters of the requests handled on behalf of a tenant.
+ */
+typedef struct {
+    unsigned long requests;         /**< Password requests received */
+    unsigned long generated;        /**< Passwords generated */
+    unsigned long rejected;         /**< Requests rejected for an invalid type or length */
+    unsigned long rate_limited;     /**< Requests rejected by the rate limit */
+} TenantMetrics;
+
+
+/**
+ * @struct Tenant
+ * @brief Policy set of a tenant.
+ *
+ * `allowed_type` is indexed directly by the type character of the request, so type
+ * validation is a single load. The rate limit is a token bucket refilled at `rate`
+ * tokens per second up to `burst`; a `rate` of zero disables it.
+ */
+typedef struct {
+    char name[TENANT_NAME_SIZE];    /**< Name of the tenant */
+    bool allowed_type[256];         /**< Allowed password types, indexed by type character */
+    int min_length;                 /**< Minimum password length */
+    int max_length;                 /**< Maximum password length */
+    double rate;                    /**< Requests per second, 0 for unlimited */
+    double burst;                   /**< Capacity of the token bucket */
+    double tokens;                  /**< Tokens currently available */
+    double last_refill;             /**< Time of the last refill, in seconds */
+    TenantMetrics metrics;          /**< Request counters */
+} Tenant;
+
+
+/**
+ * @struct TenantTable
+ * @brief Table of the configured tenants.
+ */
+typedef struct {
+    Tenant tenants[MAX_TENANTS];    /**< Tenants, `DEFAULT_TENANT` first */
+    int count;                      /**< Number of tenants */
+} TenantTable;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - TENANTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Initializes a tenant.
+ *
+ * @param[out] tenant: the tenant to initialize.
+ * @param[in] name: the name of the tenant.
+ * @param[in] types: a string containing all allowed types (e.g., "nams").
+ * @param[in] min_length: the minimum allowable password length.
+ * @param[in] max_length: the maximum allowable password length, clamped to `MAX_PASSWORD_LENGTH`.
+ * @param[in] rate: the allowed requests per second, 0 for unlimited.
+ * @param[in] burst: the number of requests that may be served at once above `rate`.
+ */
+void init_tenant(Tenant *tenant, const char *name, const char *types, int min_length, int max_length,
+                 double rate, double burst);
+
+
+/**
+ * @brief Loads tenants from a file with one `<name> <types> <min> <max> [rate] [burst]` entry per line.
+ *
+ * The table always starts with the default tenant, built from `default_types` and the
+ * global length bounds; a line named `default` overrides it. Empty lines and lines starting
+ * with `#` are ignored.
+ *
+ * @param[out] table: the tenant table.
+ * @param[in] path: the path of the tenant file.
+ * @param[in] default_types: the allowed types of the default tenant; an entry listing any other
+ *            type fails the whole load.
+ * @return the number of tenants loaded from the file, -1 if the file cannot be opened, or -2 if
+ *         an entry lists an unknown type.
+ */
+int load_tenants(TenantTable *table, const char *path, const char *default_types);
+
+
+/**
+ * @brief Looks up a tenant by name.
+ * @param[in] table: the tenant table.
+ * @param[in] name: the name to look up.
+ * @return the index of the tenant, or -1 if it is not present.
+ */
+int find_tenant(const TenantTable *table, const char *name);
+
+
+/**
+ * @brief Consumes one request from the rate limit of a tenant.
+ * @param[in/out] tenant: the tenant.
+ * @return `true` if the request may be served.
+ * @return `false` if the tenant exceeded its rate limit.
+ */
+bool take_tenant_token(Tenant *tenant);
+
+/* - - - - - - - - - - - - - - - - - - - END TENANTS - - - - - - - - - - - - - - - - - - - */
+
+#endif /* TENANT_H_ */
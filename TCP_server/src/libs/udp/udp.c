@@ -0,0 +1,158 @@
+/*
+ ============================================================================
+ Name        : udp.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : UDP request mode, batched with recvmmsg() and sendmmsg().
+ ============================================================================
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE     /**< Required for recvmmsg() and sendmmsg() */
+#endif
+
+#if defined WIN32
+#include <winsock.h>
+#else
+#include <unistd.h>
+#include <arpa/inet.h>
+#define closesocket close
+#endif
+
+#include <string.h>
+#include "udp.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - - UDP - - - - - - - - - - - - - - - - - - - - - */
+
+#if defined(__linux__)
+static struct mmsghdr inbound[UDP_BATCH];           /**< recvmmsg() headers, pointing into the requests */
+static struct mmsghdr outbound[UDP_BATCH];          /**< sendmmsg() headers, pointing into the responses */
+static struct iovec inbound_vectors[UDP_BATCH];     /**< Buffers of the received datagrams */
+static struct iovec outbound_vectors[UDP_BATCH];    /**< Buffers of the answers */
+#endif
+
+
+/**
+ * @brief Opens the UDP socket and prepares the batch buffers.
+ * @param[out] server: the UDP server.
+ * @param[in] address: the IPv4 address to bind.
+ * @param[in] port: the UDP port.
+ * @return `true` if the socket is bound.
+ */
+bool open_udp_server(UdpServer *server, const char *address, int port) {
+    memset(server, 0, sizeof(*server));
+    server->socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (server->socket < 0) {
+        server->socket = -1;
+        return false;
+    }
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = inet_addr(address);
+    local.sin_port = htons(port);
+    if (bind(server->socket, (struct sockaddr*) &local, sizeof(local)) < 0) {
+        closesocket(server->socket);
+        server->socket = -1;
+        return false;
+    }
+
+#if defined(__linux__)
+    // The headers never change: every call reuses the same buffers and peer slots
+    for (int i = 0; i < UDP_BATCH; i++) {
+        inbound_vectors[i].iov_base = &server->requests[i];
+        inbound_vectors[i].iov_len = sizeof(UdpRequest);
+        inbound[i].msg_hdr.msg_iov = &inbound_vectors[i];
+        inbound[i].msg_hdr.msg_iovlen = 1;
+        inbound[i].msg_hdr.msg_name = &server->peers[i];
+        outbound_vectors[i].iov_base = &server->responses[i];
+        outbound_vectors[i].iov_len = sizeof(UdpResponse);
+        outbound[i].msg_hdr.msg_iov = &outbound_vectors[i];
+        outbound[i].msg_hdr.msg_iovlen = 1;
+        outbound[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+#endif
+    return true;
+}
+
+
+/**
+ * @brief Receives the pending datagrams, up to `UDP_BATCH`, and answers them.
+ * @param[in/out] server: the UDP server, whose socket is readable.
+ * @param[in] handler: the function answering every request.
+ * @return the number of requests answered.
+ */
+int serve_udp_batch(UdpServer *server, UdpHandler handler) {
+#if defined(__linux__)
+    for (int i = 0; i < UDP_BATCH; i++) {
+        inbound[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    int received = recvmmsg(server->socket, inbound, UDP_BATCH, MSG_DONTWAIT, NULL);
+    if (received <= 0) {
+        return 0;
+    }
+    server->calls++;
+
+    // Answer the valid requests, compacting their answers at the front of the outbound headers
+    int answers = 0;
+    for (int i = 0; i < received; i++) {
+        // A longer datagram is cut to the size of a request and flagged: it is not a request either
+        if (inbound[i].msg_len != sizeof(UdpRequest) || (inbound[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+            server->dropped++;
+            continue;
+        }
+        handler(&server->requests[i], &server->responses[answers]);
+        outbound[answers].msg_hdr.msg_name = &server->peers[i];
+        outbound_vectors[answers].iov_base = &server->responses[answers];
+        answers++;
+    }
+    server->received += answers;
+
+    // A full send buffer drops the rest of the batch, as the network may drop any datagram
+    int sent = 0;
+    while (sent < answers) {
+        int count = sendmmsg(server->socket, outbound + sent, answers - sent, MSG_DONTWAIT);
+        if (count <= 0) {
+            break;
+        }
+        sent += count;
+    }
+    server->sent += sent;
+    return answers;
+#else
+    struct sockaddr_in peer;
+    int peer_len = sizeof(peer);
+    int received = recvfrom(server->socket, (char *) &server->requests[0], sizeof(UdpRequest), 0,
+                            (struct sockaddr*) &peer, &peer_len);
+    if (received <= 0) {
+        return 0;
+    }
+    server->calls++;
+    if (received != sizeof(UdpRequest)) {
+        server->dropped++;
+        return 0;
+    }
+    server->received++;
+    handler(&server->requests[0], &server->responses[0]);
+    if (sendto(server->socket, (const char *) &server->responses[0], sizeof(UdpResponse), 0,
+               (struct sockaddr*) &peer, sizeof(peer)) == sizeof(UdpResponse)) {
+        server->sent++;
+    }
+    return 1;
+#endif
+}
+
+
+/**
+ * @brief Closes the UDP socket.
+ * @param[in/out] server: the UDP server.
+ */
+void close_udp_server(UdpServer *server) {
+    if (server->socket >= 0) {
+        closesocket(server->socket);
+        server->socket = -1;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - END UDP - - - - - - - - - - - - - - - - - - - */
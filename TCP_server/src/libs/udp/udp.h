@@ -0,0 +1,97 @@
+/*
+ ============================================================================
+ Name        : udp.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the UDP request mode of the server.
+               Every datagram carries one `UdpRequest` and is answered by one
+               `UdpResponse`. On Linux a batch of datagrams is received with a
+               single recvmmsg() call and the answers are sent with a single
+               sendmmsg() call; elsewhere datagrams are served one at a time.
+ ============================================================================
+ */
+
+#ifndef UDP_H_
+#define UDP_H_
+
+#if defined WIN32
+#include <winsock.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <stdbool.h>
+#include "../protocol/protocol.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Largest number of full batches served in one turn of the event loop.
+ */
+#define UDP_TURN_BATCHES 8      /**< Batches per turn */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Answers one UDP request.
+ * @param[in] request: the request.
+ * @param[out] response: receives the answer, with the identifier of the request.
+ */
+typedef void (*UdpHandler)(const UdpRequest *request, UdpResponse *response);
+
+
+/**
+ * @struct UdpServer
+ * @brief Buffers and counters of the UDP request mode.
+ * A process runs at most one UDP server: the recvmmsg() and sendmmsg() headers pointing into
+ * its buffers are kept by udp.c.
+ */
+typedef struct {
+    int socket;                                 /**< UDP socket, -1 if the mode is off */
+    UdpRequest requests[UDP_BATCH];             /**< Received datagrams */
+    UdpResponse responses[UDP_BATCH];           /**< Answers, in the order of the requests */
+    struct sockaddr_in peers[UDP_BATCH];        /**< Sender of every request */
+    unsigned long long received;                /**< Valid requests received */
+    unsigned long long sent;                    /**< Answers sent */
+    unsigned long long dropped;                 /**< Datagrams that are not a `UdpRequest` */
+    unsigned long long calls;                   /**< Receive system calls that returned datagrams */
+} UdpServer;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - UDP - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Opens the UDP socket and prepares the batch buffers.
+ * @param[out] server: the UDP server.
+ * @param[in] address: the IPv4 address to bind.
+ * @param[in] port: the UDP port.
+ * @return `true` if the socket is bound.
+ */
+bool open_udp_server(UdpServer *server, const char *address, int port);
+
+
+/**
+ * @brief Receives the pending datagrams, up to `UDP_BATCH`, and answers them.
+ * @param[in/out] server: the UDP server, whose socket is readable.
+ * @param[in] handler: the function answering every request.
+ * @return the number of requests answered.
+ */
+int serve_udp_batch(UdpServer *server, UdpHandler handler);
+
+
+/**
+ * @brief Closes the UDP socket.
+ * @param[in/out] server: the UDP server.
+ */
+void close_udp_server(UdpServer *server);
+
+/* - - - - - - - - - - - - - - - - - - - END UDP - - - - - - - - - - - - - - - - - - - */
+
+#endif /* UDP_H_ */
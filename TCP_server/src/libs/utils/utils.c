@@ -8,9 +8,20 @@
  Utilities included:
      - COLORS:
           1. print_with_color: Prints the specified text in the specified color.
+     - LOGGING:
+          1. set_log_level: Selects which messages are printed.
+          2. log_with_color: Prints the specified text if its level is enabled.
+     - TIME:
+          1. monotonic_seconds: Returns a monotonic timestamp in seconds.
  ============================================================================
  */
 
+#if defined WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include <stdio.h>
 #include "utils.h"
 
@@ -59,3 +70,68 @@ void print_with_color(const char *text, textColor color) {
 }
 
 /* - - - - - - - - - - - - - - - - END COLORS - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - LOGGING - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Most verbose level currently printed.
+ */
+static LogLevel current_log_level = LEVEL_INFO;
+
+
+/**
+ * @brief Selects which messages are printed.
+ * @param[in] level: the most verbose level to print.
+ * @post Messages above `level` are discarded by `log_with_color`.
+ */
+void set_log_level(LogLevel level) {
+    current_log_level = level;
+}
+
+
+/**
+ * @brief Returns the current log level.
+ * @return the most verbose level printed.
+ */
+LogLevel get_log_level(void) {
+    return current_log_level;
+}
+
+
+/**
+ * @brief Prints the specified text in the specified color if its level is enabled.
+ * @param[in] level: the level of the message.
+ * @param[in] text: a pointer to the text to print.
+ * @param[in] color: the textColor to apply to the text.
+ * @pre `text` should be a non-null pointer to a valid string.
+ */
+void log_with_color(LogLevel level, const char *text, textColor color) {
+    if (level <= current_log_level) {
+        print_with_color(text, color);
+    }
+}
+
+/* - - - - - - - - - - - - - - - - END LOGGING - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - TIME - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns a monotonic timestamp.
+ * @return the number of seconds elapsed since an arbitrary fixed point.
+ */
+double monotonic_seconds(void) {
+#if defined WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double) counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - END TIME - - - - - - - - - - - - - - - - - */
@@ -8,6 +8,11 @@
  Utilities included:
      - COLORS:
           1. print_with_color: Prints the specified text in the specified color.
+     - LOGGING:
+          1. set_log_level: Selects which messages are printed.
+          2. log_with_color: Prints the specified text if its level is enabled.
+     - TIME:
+          1. monotonic_seconds: Returns a monotonic timestamp in seconds.
  ============================================================================
  */
 
@@ -48,4 +53,62 @@ void print_with_color(const char *text, textColor color);
 
 /* - - - - - - - - - - - - - - - - END COLORS - - - - - - - - - - - - - - - - */
 
+
+/* - - - - - - - - - - - - - - - - - LOGGING - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum LogLevel
+ * @brief Defines the verbosity levels of the server output.
+ */
+typedef enum {
+    LEVEL_ERROR,  /**< Only errors */
+    LEVEL_INFO,   /**< Errors and connection events */
+    LEVEL_DEBUG   /**< Everything, including every request */
+} LogLevel;
+
+
+/**
+ * @brief Selects which messages are printed.
+ *
+ * Messages with a level above `level` are discarded by `log_with_color`.
+ *
+ * @param[in] level The most verbose LogLevel to print.
+ */
+void set_log_level(LogLevel level);
+
+
+/**
+ * @brief Returns the current log level.
+ *
+ * @return The most verbose LogLevel printed.
+ */
+LogLevel get_log_level(void);
+
+
+/**
+ * @brief Prints the specified text in the specified color if its level is enabled.
+ *
+ * @param[in] level The LogLevel of the message.
+ * @param[in] text Pointer to the string to print.
+ * @param[in] color The textColor to apply to the text.
+ */
+void log_with_color(LogLevel level, const char *text, textColor color);
+
+/* - - - - - - - - - - - - - - - - END LOGGING - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - TIME - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Returns a monotonic timestamp.
+ *
+ * The value is not related to the wall clock and is only meaningful as a
+ * difference between two calls.
+ *
+ * @return The number of seconds elapsed since an arbitrary fixed point.
+ */
+double monotonic_seconds(void);
+
+/* - - - - - - - - - - - - - - - - - END TIME - - - - - - - - - - - - - - - - - */
+
 #endif /* UTILS_H_ */
@@ -0,0 +1,450 @@
+/*
+ ============================================================================
+ Name        : xdp.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : AF_XDP fast path of the UDP request mode.
+ ============================================================================
+ */
+
+#if defined(__linux__)
+#include <errno.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "xdp.h"
+
+#if defined(__linux__) && !defined(SOL_XDP)
+#define SOL_XDP 283     /**< Socket level of the AF_XDP options, missing from older C libraries */
+#endif
+
+
+/* - - - - - - - - - - - - - - - - - - - - FRAMES - - - - - - - - - - - - - - - - - - - - */
+
+#define ETH_HEADER 14                       /**< Ethernet header size */
+#define IP_HEADER 20                        /**< IPv4 header size, without options */
+#define UDP_HEADER 8                        /**< UDP header size */
+#define PAYLOAD (ETH_HEADER + IP_HEADER + UDP_HEADER)   /**< Offset of the datagram payload */
+#define XSKMAP_ENTRIES 64                   /**< Receive queues the program can redirect */
+
+#if defined(__linux__)
+/**
+ * @brief Reads a 16-bit big-endian field of a frame.
+ */
+static uint16_t read_be16(const unsigned char *field) {
+    return (uint16_t) (field[0] << 8 | field[1]);
+}
+
+
+/**
+ * @brief Writes a 16-bit big-endian field of a frame.
+ */
+static void write_be16(unsigned char *field, uint16_t value) {
+    field[0] = (unsigned char) (value >> 8);
+    field[1] = (unsigned char) value;
+}
+
+
+/**
+ * @brief Swaps two fields of a frame.
+ */
+static void swap_fields(unsigned char *a, unsigned char *b, size_t size) {
+    unsigned char copy[6];
+    memcpy(copy, a, size);
+    memcpy(a, b, size);
+    memcpy(b, copy, size);
+}
+
+
+/**
+ * @brief Checks that a frame holds exactly one `UdpRequest` for the server port.
+ * @param[in] frame: the frame.
+ * @param[in] length: the length of the frame.
+ * @param[in] udp_port: the server port.
+ * @return `true` if the frame is a request.
+ */
+static bool is_request(const unsigned char *frame, uint32_t length, int udp_port) {
+    const unsigned char *ip = frame + ETH_HEADER;
+    const unsigned char *udp = ip + IP_HEADER;
+    return length >= PAYLOAD + sizeof(UdpRequest)
+           && read_be16(frame + 12) == 0x0800                   /* IPv4 */
+           && ip[0] == 0x45                                     /* Version 4, no options */
+           && (read_be16(ip + 6) & 0x3fff) == 0                 /* Not a fragment */
+           && ip[9] == IPPROTO_UDP
+           && read_be16(udp + 2) == udp_port
+           && read_be16(udp + 4) == UDP_HEADER + sizeof(UdpRequest);
+}
+
+
+/**
+ * @brief Rewrites a request frame into the frame of its answer: addresses and ports are swapped,
+ * lengths and the IPv4 checksum recomputed, and the UDP checksum left out as IPv4 allows.
+ * @param[in/out] frame: the request frame, which receives the answer.
+ * @param[in] response: the answer.
+ * @return the length of the answer frame.
+ */
+static uint32_t write_response(unsigned char *frame, const UdpResponse *response) {
+    unsigned char *ip = frame + ETH_HEADER;
+    unsigned char *udp = ip + IP_HEADER;
+    swap_fields(frame, frame + 6, 6);
+    swap_fields(ip + 12, ip + 16, 4);
+    swap_fields(udp, udp + 2, 2);
+
+    write_be16(ip + 2, IP_HEADER + UDP_HEADER + sizeof(UdpResponse));
+    write_be16(ip + 4, 0);          /* Identification */
+    write_be16(ip + 6, 0x4000);     /* Don't fragment */
+    ip[8] = 64;                     /* TTL */
+    write_be16(ip + 10, 0);
+    uint32_t sum = 0;
+    for (int i = 0; i < IP_HEADER; i += 2) {
+        sum += read_be16(ip + i);
+    }
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum += sum >> 16;
+    write_be16(ip + 10, (uint16_t) ~sum);
+
+    write_be16(udp + 4, UDP_HEADER + sizeof(UdpResponse));
+    write_be16(udp + 6, 0);
+    memcpy(frame + PAYLOAD, response, sizeof(UdpResponse));
+    return PAYLOAD + sizeof(UdpResponse);
+}
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - END FRAMES - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - PROGRAM - - - - - - - - - - - - - - - - - - - - */
+
+#if defined(__linux__)
+/**
+ * @brief Builds one eBPF instruction.
+ */
+#define INSN(code, dst, src, off, imm) ((struct bpf_insn) { (code), (dst), (src), (off), (imm) })
+
+/**
+ * @brief Issues a bpf() command.
+ */
+static int bpf_command(int command, union bpf_attr *attr) {
+    return (int) syscall(SYS_bpf, command, attr, sizeof(*attr));
+}
+
+
+/**
+ * @brief Loads the XDP program redirecting the UDP frames of a port to the AF_XDP socket of their queue.
+ *
+ * Equivalent C:
+ *     if (eth->type == IPv4 && ip->ihl == 5 && ip->protocol == UDP && udp->dest == port)
+ *         return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+ *     return XDP_PASS;
+ *
+ * @param[in] map: the XSKMAP.
+ * @param[in] udp_port: the server port.
+ * @return the program descriptor, or -1 on failure.
+ */
+static int load_program(int map, int udp_port) {
+    // Loads are in host byte order, so compare with the network order constants as loaded
+    const int ipv4 = htons(0x0800);
+    const int port = htons((uint16_t) udp_port);
+    enum { PASS = 19 };     /**< Index of the XDP_PASS exit */
+    struct bpf_insn program[] = {
+        INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0),
+        INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, PAYLOAD),
+        INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, PASS - 5, 0),
+        INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, PASS - 7, ipv4),
+        INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HEADER, 0),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, PASS - 9, 0x45),
+        INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HEADER + 9, 0),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, PASS - 11, IPPROTO_UDP),
+        INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, ETH_HEADER + IP_HEADER + 2, 0),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, PASS - 13, port),
+        INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, rx_queue_index), 0),
+        INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map),
+        INSN(0, 0, 0, 0, 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+        INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),   /* PASS */
+        INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t) (uintptr_t) program;
+    attr.insn_cnt = sizeof(program) / sizeof(program[0]);
+    attr.license = (uint64_t) (uintptr_t) "GPL";
+    return bpf_command(BPF_PROG_LOAD, &attr);
+}
+
+
+/**
+ * @brief Maps one ring of an AF_XDP socket.
+ * @param[out] ring: the ring.
+ * @param[in] socket: the AF_XDP socket.
+ * @param[in] offsets: the offsets of the ring fields in the mapping.
+ * @param[in] size: the number of entries.
+ * @param[in] entry_size: the size of an entry.
+ * @param[in] page_offset: the mapping offset selecting the ring.
+ * @return `true` if the ring is mapped.
+ */
+static bool map_ring(XdpRing *ring, int socket, const struct xdp_ring_offset *offsets, uint32_t size,
+                     size_t entry_size, off_t page_offset) {
+    ring->map_size = offsets->desc + size * entry_size;
+    ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, socket, page_offset);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return false;
+    }
+    ring->producer = (uint32_t *) ((char *) ring->map + offsets->producer);
+    ring->consumer = (uint32_t *) ((char *) ring->map + offsets->consumer);
+    ring->entries = (char *) ring->map + offsets->desc;
+    ring->mask = size - 1;
+    return true;
+}
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - END PROGRAM - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - XDP - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Creates the AF_XDP socket, loads the XDP program and attaches it to an interface.
+ * @param[out] port: the port.
+ * @param[in] interface: the name of the interface.
+ * @param[in] queue: the receive queue of the interface.
+ * @param[in] udp_port: the UDP port whose frames are redirected.
+ * @param[out] error: receives the reason of a failure.
+ * @param[in] size: the size of `error`.
+ * @return `true` if the port is ready.
+ */
+bool open_xdp_port(XdpPort *port, const char *interface, int queue, int udp_port, char *error, size_t size) {
+    memset(port, 0, sizeof(*port));
+    port->socket = port->map = port->program = port->link = -1;
+#if defined(__linux__)
+    const char *step;
+    port->ifindex = (int) if_nametoindex(interface);
+    port->queue = queue;
+    port->udp_port = udp_port;
+    if (port->ifindex == 0 || queue < 0 || queue >= XSKMAP_ENTRIES) {
+        snprintf(error, size, "unknown interface %s or queue %d", interface, queue);
+        return false;
+    }
+
+    // Socket and UMEM: every frame starts in the fill ring
+    step = "AF_XDP socket";
+    port->socket = socket(AF_XDP, SOCK_RAW, 0);
+    if (port->socket < 0) {
+        goto failed;
+    }
+    step = "UMEM";
+    port->umem = mmap(NULL, (size_t) XDP_FRAMES * XDP_FRAME_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (port->umem == MAP_FAILED) {
+        port->umem = NULL;
+        goto failed;
+    }
+    struct xdp_umem_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.addr = (uint64_t) (uintptr_t) port->umem;
+    registration.len = (uint64_t) XDP_FRAMES * XDP_FRAME_SIZE;
+    registration.chunk_size = XDP_FRAME_SIZE;
+    int fill_size = XDP_FRAMES;
+    int ring_size = XDP_RING_SIZE;
+    if (setsockopt(port->socket, SOL_XDP, XDP_UMEM_REG, &registration, sizeof(registration)) < 0
+            || setsockopt(port->socket, SOL_XDP, XDP_UMEM_FILL_RING, &fill_size, sizeof(fill_size)) < 0
+            || setsockopt(port->socket, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0
+            || setsockopt(port->socket, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0
+            || setsockopt(port->socket, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) < 0) {
+        goto failed;
+    }
+
+    step = "rings";
+    struct xdp_mmap_offsets offsets;
+    socklen_t offsets_size = sizeof(offsets);
+    if (getsockopt(port->socket, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &offsets_size) < 0
+            || !map_ring(&port->fill, port->socket, &offsets.fr, XDP_FRAMES, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING)
+            || !map_ring(&port->completion, port->socket, &offsets.cr, XDP_RING_SIZE, sizeof(uint64_t),
+                         XDP_UMEM_PGOFF_COMPLETION_RING)
+            || !map_ring(&port->rx, port->socket, &offsets.rx, XDP_RING_SIZE, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING)
+            || !map_ring(&port->tx, port->socket, &offsets.tx, XDP_RING_SIZE, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING)) {
+        goto failed;
+    }
+    uint64_t *free_frames = port->fill.entries;
+    for (uint32_t i = 0; i < XDP_FRAMES; i++) {
+        free_frames[i] = (uint64_t) i * XDP_FRAME_SIZE;
+    }
+    __atomic_store_n(port->fill.producer, XDP_FRAMES, __ATOMIC_RELEASE);
+
+    // Copy mode is the one generic XDP supports, on every driver
+    step = "bind";
+    struct sockaddr_xdp address;
+    memset(&address, 0, sizeof(address));
+    address.sxdp_family = AF_XDP;
+    address.sxdp_ifindex = port->ifindex;
+    address.sxdp_queue_id = queue;
+    address.sxdp_flags = XDP_COPY;
+    if (bind(port->socket, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        goto failed;
+    }
+
+    // XSKMAP entry of the queue, program and its generic-mode attachment
+    step = "XSKMAP";
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(int);
+    attr.value_size = sizeof(int);
+    attr.max_entries = XSKMAP_ENTRIES;
+    port->map = bpf_command(BPF_MAP_CREATE, &attr);
+    if (port->map < 0) {
+        goto failed;
+    }
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = port->map;
+    attr.key = (uint64_t) (uintptr_t) &port->queue;
+    attr.value = (uint64_t) (uintptr_t) &port->socket;
+    if (bpf_command(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        goto failed;
+    }
+    step = "XDP program";
+    port->program = load_program(port->map, udp_port);
+    if (port->program < 0) {
+        goto failed;
+    }
+    step = "XDP attach";
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = port->program;
+    attr.link_create.target_ifindex = port->ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    port->link = bpf_command(BPF_LINK_CREATE, &attr);
+    if (port->link < 0) {
+        goto failed;
+    }
+    return true;
+
+failed:
+    snprintf(error, size, "%s: %s", step, strerror(errno));
+    close_xdp_port(port);
+    return false;
+#else
+    (void) interface;
+    (void) queue;
+    (void) udp_port;
+    snprintf(error, size, "AF_XDP is only available on Linux");
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Answers the received requests, up to `UDP_BATCH`, and recycles the transmitted frames.
+ * @param[in/out] port: the open port, whose socket is readable.
+ * @param[in] handler: the function answering every request.
+ * @return the number of requests answered.
+ */
+int serve_xdp_batch(XdpPort *port, UdpHandler handler) {
+#if defined(__linux__)
+    uint64_t *fill = port->fill.entries;
+    uint32_t fill_producer = *port->fill.producer;
+
+    // Frames the kernel finished transmitting go back to the fill ring, which has room for every frame
+    const uint64_t *completed = port->completion.entries;
+    uint32_t completion_consumer = *port->completion.consumer;
+    uint32_t completion_producer = __atomic_load_n(port->completion.producer, __ATOMIC_ACQUIRE);
+    for (; completion_consumer != completion_producer; completion_consumer++) {
+        fill[fill_producer++ & port->fill.mask] = completed[completion_consumer & port->completion.mask];
+    }
+    __atomic_store_n(port->completion.consumer, completion_consumer, __ATOMIC_RELEASE);
+
+    // Received frames are rewritten in place into their answers and queued for transmission
+    const struct xdp_desc *received = port->rx.entries;
+    struct xdp_desc *transmit = port->tx.entries;
+    uint32_t rx_consumer = *port->rx.consumer;
+    uint32_t rx_producer = __atomic_load_n(port->rx.producer, __ATOMIC_ACQUIRE);
+    uint32_t tx_producer = *port->tx.producer;
+    uint32_t tx_free = XDP_RING_SIZE - (tx_producer - __atomic_load_n(port->tx.consumer, __ATOMIC_ACQUIRE));
+    int answers = 0;
+    for (int i = 0; i < UDP_BATCH && rx_consumer != rx_producer; i++, rx_consumer++) {
+        struct xdp_desc frame = received[rx_consumer & port->rx.mask];
+        unsigned char *data = port->umem + frame.addr;
+        if (tx_free == 0 || !is_request(data, frame.len, port->udp_port)) {
+            fill[fill_producer++ & port->fill.mask] = frame.addr & ~(uint64_t) (XDP_FRAME_SIZE - 1);
+            port->dropped++;
+            continue;
+        }
+        UdpRequest request;
+        UdpResponse response;
+        memcpy(&request, data + PAYLOAD, sizeof(request));
+        handler(&request, &response);
+        transmit[tx_producer & port->tx.mask].addr = frame.addr;
+        transmit[tx_producer & port->tx.mask].len = write_response(data, &response);
+        transmit[tx_producer & port->tx.mask].options = 0;
+        tx_producer++;
+        tx_free--;
+        answers++;
+    }
+    __atomic_store_n(port->fill.producer, fill_producer, __ATOMIC_RELEASE);
+    __atomic_store_n(port->rx.consumer, rx_consumer, __ATOMIC_RELEASE);
+    __atomic_store_n(port->tx.producer, tx_producer, __ATOMIC_RELEASE);
+    if (answers == 0) {
+        return 0;
+    }
+
+    // In copy mode the kernel transmits only when asked
+    port->calls++;
+    port->received += answers;
+    if (sendto(port->socket, NULL, 0, MSG_DONTWAIT, NULL, 0) >= 0 || errno == EAGAIN || errno == EBUSY
+            || errno == ENOBUFS) {
+        port->sent += answers;
+    }
+    return answers;
+#else
+    (void) port;
+    (void) handler;
+    return 0;
+#endif
+}
+
+
+/**
+ * @brief Detaches the program and releases the socket, the rings and the UMEM.
+ * @param[in/out] port: the port.
+ */
+void close_xdp_port(XdpPort *port) {
+#if defined(__linux__)
+    int descriptors[] = { port->link, port->program, port->map, port->socket };
+    for (size_t i = 0; i < sizeof(descriptors) / sizeof(descriptors[0]); i++) {
+        if (descriptors[i] >= 0) {
+            close(descriptors[i]);
+        }
+    }
+    XdpRing *rings[] = { &port->fill, &port->completion, &port->rx, &port->tx };
+    for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+        if (rings[i]->map != NULL) {
+            munmap(rings[i]->map, rings[i]->map_size);
+        }
+    }
+    if (port->umem != NULL) {
+        munmap(port->umem, (size_t) XDP_FRAMES * XDP_FRAME_SIZE);
+    }
+#endif
+    memset(port, 0, sizeof(*port));
+    port->socket = port->map = port->program = port->link = -1;
+}
+
+/* - - - - - - - - - - - - - - - - - - - END XDP - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,120 @@
+/*
+ ============================================================================
+ Name        : xdp.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the AF_XDP fast path of the UDP request
+               mode. A small XDP program, attached in generic (skb) mode so it
+               runs on any interface including veth, redirects the UDP frames
+               sent to the server port into an AF_XDP socket. Requests are read
+               from the frames in the shared UMEM area and every frame is
+               rewritten in place into its answer and transmitted, so neither
+               direction goes through the socket layer. Linux only.
+ ============================================================================
+ */
+
+#ifndef XDP_H_
+#define XDP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../udp/udp.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Size of a UMEM frame; every frame holds one packet.
+ */
+#define XDP_FRAME_SIZE 2048     /**< UMEM frame size */
+
+/**
+ * @brief Number of UMEM frames, all owned by the fill ring while no packet is in flight.
+ */
+#define XDP_FRAMES 4096         /**< UMEM frame count */
+
+/**
+ * @brief Size of the receive, transmit and completion rings.
+ */
+#define XDP_RING_SIZE 2048      /**< Ring size */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @struct XdpRing
+ * @brief A single-producer single-consumer ring shared with the kernel.
+ */
+typedef struct {
+    uint32_t *producer;     /**< Producer index, written by the producer side */
+    uint32_t *consumer;     /**< Consumer index, written by the consumer side */
+    void *entries;          /**< Ring entries: frame addresses or packet descriptors */
+    uint32_t mask;          /**< Ring size minus one */
+    void *map;              /**< Start of the mapping */
+    size_t map_size;        /**< Size of the mapping */
+} XdpRing;
+
+
+/**
+ * @struct XdpPort
+ * @brief An AF_XDP socket bound to one queue of an interface, with its UMEM and XDP program.
+ */
+typedef struct {
+    int socket;                 /**< AF_XDP socket, -1 if the port is closed */
+    int map;                    /**< XSKMAP the program redirects through */
+    int program;                /**< XDP program */
+    int link;                   /**< Attachment of the program to the interface */
+    int ifindex;                /**< Interface index */
+    int queue;                  /**< Receive queue */
+    int udp_port;               /**< UDP port of the requests */
+    unsigned char *umem;        /**< Frame area shared with the kernel */
+    XdpRing fill;               /**< Free frames handed to the kernel for reception */
+    XdpRing completion;         /**< Frames the kernel finished transmitting */
+    XdpRing rx;                 /**< Received packets */
+    XdpRing tx;                 /**< Packets to transmit */
+    unsigned long long received;    /**< Valid requests received */
+    unsigned long long sent;        /**< Answers transmitted */
+    unsigned long long dropped;     /**< Frames that are not a `UdpRequest`, or found no transmit slot */
+    unsigned long long calls;       /**< Batches that found packets */
+} XdpPort;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - - XDP - - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Creates the AF_XDP socket, loads the XDP program and attaches it to an interface.
+ * @param[out] port: the port.
+ * @param[in] interface: the name of the interface, e.g. "veth0".
+ * @param[in] queue: the receive queue of the interface.
+ * @param[in] udp_port: the UDP port whose frames are redirected.
+ * @param[out] error: receives the reason of a failure.
+ * @param[in] size: the size of `error`.
+ * @return `true` if the port is ready.
+ * @pre The process needs CAP_NET_ADMIN and CAP_BPF (usually root).
+ */
+bool open_xdp_port(XdpPort *port, const char *interface, int queue, int udp_port, char *error, size_t size);
+
+
+/**
+ * @brief Answers the received requests, up to `UDP_BATCH`, and recycles the transmitted frames.
+ * @param[in/out] port: the open port, whose socket is readable.
+ * @param[in] handler: the function answering every request.
+ * @return the number of requests answered.
+ */
+int serve_xdp_batch(XdpPort *port, UdpHandler handler);
+
+
+/**
+ * @brief Detaches the program and releases the socket, the rings and the UMEM.
+ * @param[in/out] port: the port.
+ */
+void close_xdp_port(XdpPort *port);
+
+/* - - - - - - - - - - - - - - - - - - - END XDP - - - - - - - - - - - - - - - - - - - */
+
+#endif /* XDP_H_ */
@@ -0,0 +1,332 @@
+/*
+ ============================================================================
+ Name        : bench_compare.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Compares benchmark results: the `key=value` lines printed by the
+               load generator, the soak test and the generation benchmark of
+               the server, or flat JSON objects, one run per line. Every
+               numeric metric of a candidate file is compared with the same
+               metric of the baseline file, with a bootstrap confidence
+               interval of the change of its median and a Mann-Whitney U test,
+               and significant changes for the worse beyond a threshold are
+               flagged as regressions.
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "libs/compare/compare.h"  /**< Include the header for the statistics of the comparison */
+
+
+/**
+ * @brief Longest metric name, prefix and null terminator included.
+ */
+#define METRIC_NAME_SIZE 96     /**< Metric name size */
+
+/**
+ * @brief Longest key of a line, null terminator included; a tag and a key always fit in a name.
+ */
+#define METRIC_KEY_SIZE 40      /**< Key size */
+
+/**
+ * @brief Longest line of a result file.
+ */
+#define RESULT_LINE_SIZE 8192   /**< Result line size */
+
+/**
+ * @brief Characters between the tokens of a line: blanks and JSON punctuation.
+ */
+#define SEPARATORS " \t\r\n,{}[]"   /**< Token separators */
+
+
+/**
+ * @struct Metric
+ * @brief The values of one metric over the runs of a result file.
+ */
+typedef struct {
+    char name[METRIC_NAME_SIZE];    /**< Name, prefixed by the tag of its line if it has one */
+    double *values;                 /**< Value of every run */
+    int count;                      /**< Number of values */
+    int capacity;                   /**< Values `values` can hold */
+} Metric;
+
+
+/**
+ * @struct ResultFile
+ * @brief The metrics of a result file, in the order they first appear.
+ */
+typedef struct {
+    const char *path;               /**< Path of the file */
+    Metric *metrics;                /**< Metrics */
+    int count;                      /**< Number of metrics */
+    int capacity;                   /**< Metrics `metrics` can hold */
+} ResultFile;
+
+
+/**
+ * @brief Prints an error message to the console.
+ * @param[in] errorMessage: the error message to be printed.
+ */
+static void errorhandler(const char *errorMessage) {
+    fprintf(stderr, "%s", errorMessage);
+}
+
+
+/**
+ * @brief Finds a metric of a result file by name.
+ * @return the metric, or NULL if the file has none by that name.
+ */
+static Metric *find_metric(const ResultFile *result, const char *name) {
+    for (int i = 0; i < result->count; i++) {
+        if (strcmp(result->metrics[i].name, name) == 0) {
+            return &result->metrics[i];
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Appends a run value to a metric, creating the metric on its first value.
+ * @return `true` on success, `false` if memory ran out.
+ */
+static bool add_value(ResultFile *result, const char *name, double value) {
+    Metric *metric = find_metric(result, name);
+    if (metric == NULL) {
+        if (result->count == result->capacity) {
+            int capacity = (result->capacity > 0) ? 2 * result->capacity : 16;
+            Metric *metrics = realloc(result->metrics, capacity * sizeof(Metric));
+            if (metrics == NULL) {
+                return false;
+            }
+            result->metrics = metrics;
+            result->capacity = capacity;
+        }
+        metric = &result->metrics[result->count++];
+        memset(metric, 0, sizeof(*metric));
+        snprintf(metric->name, sizeof(metric->name), "%s", name);
+    }
+    if (metric->count == metric->capacity) {
+        int capacity = (metric->capacity > 0) ? 2 * metric->capacity : 16;
+        double *values = realloc(metric->values, capacity * sizeof(double));
+        if (values == NULL) {
+            return false;
+        }
+        metric->values = values;
+        metric->capacity = capacity;
+    }
+    metric->values[metric->count++] = value;
+    return true;
+}
+
+
+/**
+ * @brief Reads a token: a quoted string, or the characters up to a separator or one of `stops`.
+ * @param[in/out] cursor: the position in the line, advanced past the token.
+ * @param[out] token: receives the token, truncated to `size`.
+ * @param[in] size: the size of `token`.
+ * @param[in] stops: the characters that end an unquoted token besides the separators.
+ */
+static void read_token(char **cursor, char *token, size_t size, const char *stops) {
+    size_t length;
+    if (**cursor == '"') {
+        (*cursor)++;
+        length = strcspn(*cursor, "\"");
+    } else {
+        char ends[32];
+        snprintf(ends, sizeof(ends), "%s%s", SEPARATORS, stops);
+        length = strcspn(*cursor, ends);
+    }
+    snprintf(token, size, "%.*s", (int) ((length < size) ? length : size - 1), *cursor);
+    *cursor += length;
+    if (**cursor == '"') {
+        (*cursor)++;
+    }
+}
+
+
+/**
+ * @brief Adds the numeric `key=value` or `"key": value` pairs of a line to a result file.
+ *
+ * A bare word at the start of the line, like `bench` or `soak`, tags the metrics of the line
+ * so lines of different kinds sharing a key stay apart. Values that are not numbers are ignored.
+ *
+ * @return `true` on success, `false` if memory ran out.
+ */
+static bool parse_line(char *line, ResultFile *result) {
+    char prefix[METRIC_KEY_SIZE + 1] = "";
+    char key[METRIC_KEY_SIZE];
+    char value[64];
+    char name[METRIC_NAME_SIZE];
+    bool first = true;
+    char *cursor = line;
+    for (;;) {
+        cursor += strspn(cursor, SEPARATORS);
+        if (*cursor == '\0') {
+            return true;
+        }
+        char *start = cursor;
+        read_token(&cursor, key, sizeof(key), "=:\"");
+        cursor += strspn(cursor, " \t");
+        if (*cursor != '=' && *cursor != ':') {
+            if (first && key[0] != '\0') {
+                snprintf(prefix, sizeof(prefix), "%s.", key);
+            }
+            first = false;
+            if (cursor == start) {
+                cursor++;   /**< A stray character: step over it */
+            }
+            continue;
+        }
+        first = false;
+        cursor++;
+        cursor += strspn(cursor, " \t");
+        read_token(&cursor, value, sizeof(value), "");
+
+        char *end;
+        double number = strtod(value, &end);
+        if (key[0] != '\0' && value[0] != '\0' && *end == '\0' && isfinite(number)) {
+            snprintf(name, sizeof(name), "%s%s", prefix, key);
+            if (!add_value(result, name, number)) {
+                return false;
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Reads the runs of a result file.
+ * @param[in] path: the path of the file.
+ * @param[out] result: receives the metrics.
+ * @return `true` if the file was read and holds at least one metric.
+ */
+static bool read_result(const char *path, ResultFile *result) {
+    memset(result, 0, sizeof(*result));
+    result->path = path;
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    static char line[RESULT_LINE_SIZE];
+    bool parsed = true;
+    while (parsed && fgets(line, sizeof(line), file) != NULL) {
+        parsed = parse_line(line, result);
+    }
+    fclose(file);
+    return parsed && result->count > 0;
+}
+
+
+/**
+ * @brief Frees the metrics of a result file.
+ */
+static void free_result(ResultFile *result) {
+    for (int i = 0; i < result->count; i++) {
+        free(result->metrics[i].values);
+    }
+    free(result->metrics);
+}
+
+
+/**
+ * @brief Usage:
+ *   bench_compare [--threshold PCT] [--alpha A] [--resamples N] [--metric TEXT] BASELINE CANDIDATE...
+ *
+ * Every file holds the runs of one build or configuration, one result line per run, e.g. the
+ * output of `scripts/bench_loopback.sh` repeated ten times. Each candidate is compared with the
+ * baseline on every metric they share (only the metrics whose name contains TEXT with `--metric`),
+ * one `key=value` line per metric:
+ *   metric=p99_us n=10/10 baseline=23.9 candidate=25.1 delta_pct=+5.02 ci_pct=[+2.10,+8.20] p=0.003 verdict=regression
+ * The interval has confidence 1 - A (0.95 by default); a change is significant when p < A and
+ * the interval excludes zero, and a significant change for the worse of at least PCT percent
+ * (5 by default) is a regression. The exit status is 1 if any candidate regressed, so the tool
+ * can gate a change.
+ */
+int main(int argc, char *argv[]) {
+    double threshold = 5;  /**< Change for the worse tolerated, in percent */
+    double alpha = 0.05;  /**< Significance level */
+    int resamples = COMPARE_RESAMPLES;  /**< Bootstrap resamples */
+    const char *filter = NULL;  /**< Text the compared metric names contain, NULL for every metric */
+    const char *paths[argc];  /**< Result files, the baseline first */
+    int files = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc) {
+            alpha = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--resamples") == 0 && i + 1 < argc) {
+            resamples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--metric") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            paths[files++] = argv[i];
+        }
+    }
+    if (files < 2 || alpha <= 0 || alpha >= 1 || resamples < 100 || threshold < 0) {
+        fprintf(stderr, "Usage: %s [--threshold PCT] [--alpha A] [--resamples N] [--metric TEXT] "
+                "BASELINE CANDIDATE...\n", argv[0]);
+        return -1;
+    }
+
+    ResultFile baseline;
+    if (!read_result(paths[0], &baseline)) {
+        errorhandler("Cannot read any metric from the baseline.\n");
+        free_result(&baseline);
+        return -1;
+    }
+
+    int regressions = 0;
+    for (int f = 1; f < files; f++) {
+        ResultFile candidate;
+        if (!read_result(paths[f], &candidate)) {
+            fprintf(stderr, "Cannot read any metric from %s.\n", paths[f]);
+            free_result(&candidate);
+            free_result(&baseline);
+            return -1;
+        }
+        printf("baseline=%s candidate=%s\n", baseline.path, candidate.path);
+
+        int compared = 0;
+        int improvements = 0;
+        int regressed = 0;
+        for (int m = 0; m < baseline.count; m++) {
+            const Metric *before = &baseline.metrics[m];
+            if (filter != NULL && strstr(before->name, filter) == NULL) {
+                continue;
+            }
+            const Metric *after = find_metric(&candidate, before->name);
+            if (after == NULL) {
+                printf("metric=%s verdict=missing\n", before->name);
+                continue;
+            }
+
+            Comparison comparison;
+            if (!compare_samples(before->values, before->count, after->values, after->count, resamples,
+                    1 - alpha, &comparison)) {
+                errorhandler("Out of memory.\n");
+                free_result(&candidate);
+                free_result(&baseline);
+                return -1;
+            }
+            Verdict verdict = judge_comparison(&comparison, metric_direction(before->name), alpha, threshold);
+            const char *unit = comparison.relative ? "_pct" : "";
+            printf("metric=%s n=%d/%d baseline=%.6g candidate=%.6g delta%s=%+.2f ci%s=[%+.2f,%+.2f] p=%.3g verdict=%s\n",
+                   before->name, comparison.baseline_count, comparison.candidate_count, comparison.baseline_median,
+                   comparison.candidate_median, unit, comparison.delta, unit, comparison.ci_low, comparison.ci_high,
+                   comparison.p_value, verdict_name(verdict));
+            compared++;
+            improvements += verdict == VERDICT_IMPROVEMENT;
+            regressed += verdict == VERDICT_REGRESSION;
+        }
+        printf("compared=%d improvements=%d regressions=%d\n", compared, improvements, regressed);
+        regressions += regressed;
+        free_result(&candidate);
+    }
+    free_result(&baseline);
+    return (regressions > 0) ? 1 : 0;
+}
@@ -0,0 +1,317 @@
+/*
+ ============================================================================
+ Name        : compare.c
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Medians, bootstrap confidence intervals and Mann-Whitney U test
+               of the benchmark comparison.
+ ============================================================================
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compare.h"
+
+
+/* - - - - - - - - - - - - - - - - - - - - COMPARE - - - - - - - - - - - - - - - - - - - - */
+
+static const char *const HIGHER_BETTER[] = {
+    "throughput", "completed", "saved_pct", "ipc", "per_s", "exported"
+};  /**< Name fragments of the metrics that should rise */
+
+static const char *const LOWER_BETTER[] = {
+    "_us", "_ns", "_ms", "seconds", "ns_per", "error", "lost", "miss", "cycles", "instructions", "alloc",
+    "rss", "fds", "failure", "failed", "dropped", "payload_bytes"
+};  /**< Name fragments of the metrics that should fall */
+
+/**
+ * @brief Guesses the direction of a metric from its name.
+ * @param[in] name: the name of the metric.
+ * @return the direction.
+ */
+MetricDirection metric_direction(const char *name) {
+    // Only the last component counts: `generate.cycles` is a cycle count
+    const char *base = strrchr(name, '.');
+    base = (base != NULL) ? base + 1 : name;
+    for (size_t i = 0; i < sizeof(HIGHER_BETTER) / sizeof(HIGHER_BETTER[0]); i++) {
+        if (strstr(base, HIGHER_BETTER[i]) != NULL) {
+            return DIRECTION_HIGHER;
+        }
+    }
+    for (size_t i = 0; i < sizeof(LOWER_BETTER) / sizeof(LOWER_BETTER[0]); i++) {
+        if (strstr(base, LOWER_BETTER[i]) != NULL) {
+            return DIRECTION_LOWER;
+        }
+    }
+    return DIRECTION_NEUTRAL;
+}
+
+
+/**
+ * @brief Orders two values for `qsort`.
+ */
+static int compare_values(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Returns the median of values.
+ * @param[in/out] values: the values, sorted in place.
+ * @param[in] count: the number of values.
+ * @return the median.
+ */
+double median_of(double *values, int count) {
+    qsort(values, count, sizeof(double), compare_values);
+    return (count % 2 == 1) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+
+/**
+ * @struct RankedValue
+ * @brief A value of the pooled samples of the U test and the sample it comes from.
+ */
+typedef struct {
+    double value;           /**< Value */
+    bool first;             /**< Whether the value belongs to the first sample */
+} RankedValue;
+
+
+/**
+ * @brief Orders two ranked values for `qsort`.
+ */
+static int compare_ranked(const void *a, const void *b) {
+    return compare_values(&((const RankedValue *) a)->value, &((const RankedValue *) b)->value);
+}
+
+
+/**
+ * @brief Computes the exact two-sided p-value of a U statistic without ties.
+ *
+ * The arrangements of `nx` and `ny` values giving every U are counted with the recurrence
+ * c(i, j, u) = c(i - 1, j, u - j) + c(i, j - 1, u): the largest value either belongs to the
+ * first sample and beats the `j` values of the second, or to the second and beats none.
+ *
+ * @return the p-value, or -1 if memory ran out.
+ */
+static double exact_u_p(double u, int nx, int ny) {
+    int pairs = nx * ny;
+    double *previous = calloc((size_t) (ny + 1) * (pairs + 1), sizeof(double));
+    double *current = calloc((size_t) (ny + 1) * (pairs + 1), sizeof(double));
+    if (previous == NULL || current == NULL) {
+        free(previous);
+        free(current);
+        return -1;
+    }
+    for (int i = 0; i <= nx; i++) {
+        for (int j = 0; j <= ny; j++) {
+            double *row = current + (size_t) j * (pairs + 1);
+            for (int k = 0; k <= pairs; k++) {
+                row[k] = (i == 0 && j == 0 && k == 0) ? 1 : 0;
+                if (i > 0 && k >= j) {
+                    row[k] += previous[(size_t) j * (pairs + 1) + k - j];
+                }
+                if (j > 0) {
+                    row[k] += current[(size_t) (j - 1) * (pairs + 1) + k];
+                }
+            }
+        }
+        double *swap = previous;
+        previous = current;
+        current = swap;
+    }
+
+    // The distribution is symmetric around pairs / 2: double the tail on the side of u
+    const double *counts = previous + (size_t) ny * (pairs + 1);
+    double total = 0;
+    double tail = 0;
+    double low = (u < pairs - u) ? u : pairs - u;
+    for (int k = 0; k <= pairs; k++) {
+        total += counts[k];
+        tail += (k <= low + 1e-9) ? counts[k] : 0;
+    }
+    free(previous);
+    free(current);
+    double p = 2 * tail / total;
+    return (p > 1) ? 1 : p;
+}
+
+
+/**
+ * @brief Runs the two-sided Mann-Whitney U test.
+ * @param[in] x: the first sample.
+ * @param[in] nx: the size of `x`.
+ * @param[in] y: the second sample.
+ * @param[in] ny: the size of `y`.
+ * @return the p-value, or -1 if memory ran out.
+ */
+double mann_whitney_p(const double *x, int nx, const double *y, int ny) {
+    int n = nx + ny;
+    RankedValue *pooled = malloc(n * sizeof(RankedValue));
+    if (pooled == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < nx; i++) {
+        pooled[i] = (RankedValue) { x[i], true };
+    }
+    for (int i = 0; i < ny; i++) {
+        pooled[nx + i] = (RankedValue) { y[i], false };
+    }
+    qsort(pooled, n, sizeof(RankedValue), compare_ranked);
+
+    // Tied values share the mean of their ranks; the ties shrink the variance of U
+    double rank_sum = 0;
+    double ties = 0;
+    for (int i = 0; i < n;) {
+        int j = i;
+        while (j < n && pooled[j].value == pooled[i].value) {
+            j++;
+        }
+        double rank = (i + 1 + j) / 2.0;
+        for (int k = i; k < j; k++) {
+            rank_sum += pooled[k].first ? rank : 0;
+        }
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    free(pooled);
+    double u = rank_sum - nx * (nx + 1) / 2.0;
+
+    if (ties == 0 && nx * ny <= COMPARE_EXACT_PAIRS) {
+        return exact_u_p(u, nx, ny);
+    }
+    double mean = nx * (double) ny / 2;
+    double variance = nx * (double) ny / 12 * ((n + 1) - ties / ((double) n * (n - 1)));
+    if (variance <= 0) {
+        return 1;   /**< Every value is the same */
+    }
+    double z = (fabs(u - mean) - 0.5) / sqrt(variance);
+    return (z <= 0) ? 1 : erfc(z / sqrt(2));
+}
+
+
+/**
+ * @brief Advances a xorshift64* state and returns its next output.
+ */
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+
+/**
+ * @brief Returns the median of a bootstrap resample of values.
+ * @param[in] values: the sample.
+ * @param[in] count: the size of the sample.
+ * @param[out] scratch: room for `count` values.
+ * @param[in/out] state: the state of the generator.
+ */
+static double resample_median(const double *values, int count, double *scratch, uint64_t *state) {
+    for (int i = 0; i < count; i++) {
+        scratch[i] = values[next_random(state) % count];
+    }
+    return median_of(scratch, count);
+}
+
+
+/**
+ * @brief Compares the candidate runs of a metric with the baseline runs.
+ * @param[in] baseline: the baseline runs.
+ * @param[in] baseline_count: the number of baseline runs.
+ * @param[in] candidate: the candidate runs.
+ * @param[in] candidate_count: the number of candidate runs.
+ * @param[in] resamples: the bootstrap resamples.
+ * @param[in] confidence: the confidence level of the interval.
+ * @param[out] comparison: receives the change.
+ * @return `true` on success.
+ */
+bool compare_samples(const double *baseline, int baseline_count, const double *candidate, int candidate_count,
+                     int resamples, double confidence, Comparison *comparison) {
+    memset(comparison, 0, sizeof(*comparison));
+    comparison->baseline_count = baseline_count;
+    comparison->candidate_count = candidate_count;
+    comparison->p_value = 1;
+    double *scratch = malloc((baseline_count + candidate_count) * sizeof(double));
+    double *deltas = malloc(resamples * sizeof(double));
+    if (scratch == NULL || deltas == NULL) {
+        free(scratch);
+        free(deltas);
+        return false;
+    }
+
+    memcpy(scratch, baseline, baseline_count * sizeof(double));
+    comparison->baseline_median = median_of(scratch, baseline_count);
+    memcpy(scratch, candidate, candidate_count * sizeof(double));
+    comparison->candidate_median = median_of(scratch, candidate_count);
+    comparison->relative = comparison->baseline_median != 0;
+    double scale = comparison->relative ? 100 / fabs(comparison->baseline_median) : 1;
+    comparison->delta = (comparison->candidate_median - comparison->baseline_median) * scale;
+    comparison->ci_low = comparison->delta;
+    comparison->ci_high = comparison->delta;
+
+    if (baseline_count >= 2 && candidate_count >= 2) {
+        // Percentile interval of the change, both samples resampled independently
+        uint64_t state = COMPARE_SEED;
+        for (int i = 0; i < resamples; i++) {
+            double base = resample_median(baseline, baseline_count, scratch, &state);
+            double cand = resample_median(candidate, candidate_count, scratch, &state);
+            deltas[i] = (cand - base) * scale;
+        }
+        qsort(deltas, resamples, sizeof(double), compare_values);
+        int low = (int) ((1 - confidence) / 2 * resamples);
+        int high = resamples - 1 - low;
+        comparison->ci_low = deltas[low];
+        comparison->ci_high = deltas[high];
+        comparison->p_value = mann_whitney_p(baseline, baseline_count, candidate, candidate_count);
+    }
+    free(scratch);
+    free(deltas);
+    return comparison->p_value >= 0;
+}
+
+
+/**
+ * @brief Judges a comparison.
+ * @param[in] comparison: the comparison.
+ * @param[in] direction: the direction of the metric.
+ * @param[in] alpha: the significance level.
+ * @param[in] threshold: the relative change tolerated for the worse.
+ * @return the verdict.
+ */
+Verdict judge_comparison(const Comparison *comparison, MetricDirection direction, double alpha, double threshold) {
+    if (comparison->baseline_count < 2 || comparison->candidate_count < 2) {
+        return VERDICT_INSUFFICIENT;
+    }
+    bool significant = comparison->p_value < alpha && (comparison->ci_low > 0 || comparison->ci_high < 0);
+    if (!significant) {
+        return VERDICT_SAME;
+    }
+    if (direction == DIRECTION_NEUTRAL) {
+        return VERDICT_CHANGED;
+    }
+    bool better = (direction == DIRECTION_HIGHER) == (comparison->delta > 0);
+    if (better) {
+        return VERDICT_IMPROVEMENT;
+    }
+    return (!comparison->relative || fabs(comparison->delta) >= threshold) ? VERDICT_REGRESSION : VERDICT_WORSE;
+}
+
+
+/**
+ * @brief Returns the name of a verdict.
+ * @param[in] verdict: the verdict.
+ * @return a lowercase name.
+ */
+const char *verdict_name(Verdict verdict) {
+    static const char *const names[] = { "insufficient", "same", "changed", "improvement", "worse", "regression" };
+    return names[verdict];
+}
+
+/* - - - - - - - - - - - - - - - - - - - END COMPARE - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,182 @@
+/*
+ ============================================================================
+ Name        : compare.h
+ Author      : Cristian Biallo
+ Version     : 1.0.0
+ Description : Header file providing the statistics of the benchmark
+               comparison: medians, a bootstrap confidence interval of the
+               change of the median, the two-sided Mann-Whitney U test and
+               the verdict on a metric given the direction it should move.
+               Medians and rank tests are used rather than means and t tests
+               because benchmark runs on a shared host have long tails.
+ ============================================================================
+ */
+
+#ifndef COMPARE_H_
+#define COMPARE_H_
+
+#include <stdbool.h>
+
+
+/* - - - - - - - - - - - - - - - - - - - DEFINES - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Bootstrap resamples drawn by default.
+ */
+#define COMPARE_RESAMPLES 10000     /**< Default bootstrap resamples */
+
+/**
+ * @brief Largest product of the sample sizes for which the Mann-Whitney p-value is exact.
+ * Larger samples, or samples with ties, use the normal approximation.
+ */
+#define COMPARE_EXACT_PAIRS 900     /**< Exact Mann-Whitney limit */
+
+/**
+ * @brief Seed of the bootstrap, fixed so a comparison always prints the same intervals.
+ */
+#define COMPARE_SEED 0x5EED5EEDull  /**< Bootstrap seed */
+
+/* - - - - - - - - - - - - - - - - - - - END DEFINES - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - STRUCTS - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @enum MetricDirection
+ * @brief The way a metric moves when the server gets better.
+ *
+ * - `DIRECTION_NEUTRAL`: Neither, e.g. a request count; changes are reported, never flagged.
+ * - `DIRECTION_HIGHER`: Higher is better, e.g. throughput.
+ * - `DIRECTION_LOWER`: Lower is better, e.g. latency, errors or memory.
+ */
+typedef enum {
+    DIRECTION_NEUTRAL,
+    DIRECTION_HIGHER,
+    DIRECTION_LOWER
+} MetricDirection;
+
+
+/**
+ * @enum Verdict
+ * @brief Outcome of the comparison of one metric.
+ *
+ * - `VERDICT_INSUFFICIENT`: Fewer than two runs on a side.
+ * - `VERDICT_SAME`: No significant change.
+ * - `VERDICT_CHANGED`: A significant change of a neutral metric.
+ * - `VERDICT_IMPROVEMENT`: A significant change for the better.
+ * - `VERDICT_WORSE`: A significant change for the worse, within the threshold.
+ * - `VERDICT_REGRESSION`: A significant change for the worse, beyond the threshold.
+ */
+typedef enum {
+    VERDICT_INSUFFICIENT,
+    VERDICT_SAME,
+    VERDICT_CHANGED,
+    VERDICT_IMPROVEMENT,
+    VERDICT_WORSE,
+    VERDICT_REGRESSION
+} Verdict;
+
+
+/**
+ * @struct Comparison
+ * @brief Change of a metric from the baseline runs to the candidate runs.
+ *
+ * The change is relative, in percent of the baseline median, unless the baseline median is
+ * zero, in which case it is the absolute difference of the medians.
+ */
+typedef struct {
+    int baseline_count;             /**< Runs of the baseline */
+    int candidate_count;            /**< Runs of the candidate */
+    double baseline_median;         /**< Median of the baseline */
+    double candidate_median;        /**< Median of the candidate */
+    bool relative;                  /**< Whether `delta` and its interval are in percent */
+    double delta;                   /**< Change of the median */
+    double ci_low;                  /**< Lower bound of the confidence interval of `delta` */
+    double ci_high;                 /**< Upper bound of the confidence interval of `delta` */
+    double p_value;                 /**< Two-sided Mann-Whitney p-value, 1 with fewer than two runs */
+} Comparison;
+
+/* - - - - - - - - - - - - - - - - - - - END STRUCTS - - - - - - - - - - - - - - - - - - - */
+
+
+/* - - - - - - - - - - - - - - - - - - - - COMPARE - - - - - - - - - - - - - - - - - - - - */
+
+/**
+ * @brief Guesses the direction of a metric from its name.
+ * @param[in] name: the name of the metric, e.g. `p99_us` or `generate.cycles`.
+ * @return the direction; names that are not recognized are neutral.
+ */
+MetricDirection metric_direction(const char *name);
+
+
+/**
+ * @brief Returns the median of values.
+ * @param[in/out] values: the values, sorted in place.
+ * @param[in] count: the number of values, at least one.
+ * @return the median, the mean of the two middle values for an even count.
+ */
+double median_of(double *values, int count);
+
+
+/**
+ * @brief Runs the two-sided Mann-Whitney U test.
+ *
+ * The p-value is exact for samples without ties whose sizes multiply to at most
+ * `COMPARE_EXACT_PAIRS`, otherwise it comes from the normal approximation with tie and
+ * continuity corrections.
+ *
+ * @param[in] x: the first sample.
+ * @param[in] nx: the size of `x`, at least one.
+ * @param[in] y: the second sample.
+ * @param[in] ny: the size of `y`, at least one.
+ * @return the probability of a difference at least as large between samples of one distribution,
+ *         or -1 if memory ran out.
+ */
+double mann_whitney_p(const double *x, int nx, const double *y, int ny);
+
+
+/**
+ * @brief Compares the candidate runs of a metric with the baseline runs.
+ *
+ * The confidence interval is the percentile interval of the change of the median over
+ * `resamples` bootstrap resamples of both samples.
+ *
+ * @param[in] baseline: the baseline runs.
+ * @param[in] baseline_count: the number of baseline runs, at least one.
+ * @param[in] candidate: the candidate runs.
+ * @param[in] candidate_count: the number of candidate runs, at least one.
+ * @param[in] resamples: the bootstrap resamples.
+ * @param[in] confidence: the confidence level of the interval, e.g. 0.95.
+ * @param[out] comparison: receives the change.
+ * @return `true` on success, `false` if memory ran out.
+ */
+bool compare_samples(const double *baseline, int baseline_count, const double *candidate, int candidate_count,
+                     int resamples, double confidence, Comparison *comparison);
+
+
+/**
+ * @brief Judges a comparison.
+ *
+ * A change is significant when its p-value is below `alpha` and its confidence interval
+ * excludes zero. A significant change for the worse is a regression when the relative change
+ * reaches `threshold` percent, or for an absolute change, always.
+ *
+ * @param[in] comparison: the comparison.
+ * @param[in] direction: the direction of the metric.
+ * @param[in] alpha: the significance level.
+ * @param[in] threshold: the relative change, in percent, tolerated for the worse.
+ * @return the verdict.
+ */
+Verdict judge_comparison(const Comparison *comparison, MetricDirection direction, double alpha, double threshold);
+
+
+/**
+ * @brief Returns the name of a verdict.
+ * @param[in] verdict: the verdict.
+ * @return a lowercase name, e.g. `regression`.
+ */
+const char *verdict_name(Verdict verdict);
+
+/* - - - - - - - - - - - - - - - - - - - END COMPARE - - - - - - - - - - - - - - - - - - - */
+
+#endif /* COMPARE_H_ */
@@ -0,0 +1,20 @@
+#!/bin/sh
+#
+# Loopback throughput of one build: starts its server and prints the report of its load
+# generator for a single request type.
+#
+# Usage: scripts/bench_loopback.sh BUILD_DIR PORT REQUESTS [REQUEST]
+#
+set -e
+dir=$1
+port=$2
+requests=$3
+request=${4:-m 16}
+
+cd "$dir"
+rm -f pwgen_admin.sock
+./TCP_server --port "$port" > bench_server.log 2>&1 &
+server=$!
+trap 'kill -TERM $server 2>/dev/null || true' EXIT
+sleep 1
+./TCP_client --load "$requests" --request "$request" "127.0.0.1:$port"
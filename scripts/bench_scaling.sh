@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+# Core scaling sweep of one build: starts its server with 1, 2, 4, ... shards up to MAX_SHARDS
+# (the online CPUs by default), runs CLIENTS load generators per shard in parallel against each
+# configuration and prints one CSV row per configuration. The clients cycle through the request
+# types of MIX, so every configuration serves the same mix.
+#
+# Columns: shards, clients, requests, wall seconds, throughput in requests per second, worst p99
+# latency of the clients in microseconds, CPU used by the server processes and by the whole host
+# in percent of one CPU (so up to 100 times the CPUs).
+#
+# Usage: scripts/bench_scaling.sh BUILD_DIR PORT REQUESTS [MAX_SHARDS] [CLIENTS] [MIX]
+#
+set -e
+dir=$1
+port=$2
+requests=$3
+cpus=$(getconf _NPROCESSORS_ONLN)
+max_shards=${4:-$cpus}
+clients_per_shard=${5:-2}
+mix=${6:-m 16,n 6,a 12,s 20}
+ticks=$(getconf CLK_TCK)
+
+# CPU ticks of a process and its shards: utime and stime, fields 14 and 15 of /proc/PID/stat
+server_ticks() {
+    total=0
+    for pid in $1 $(pgrep -P "$1" || true); do
+        if [ -r "/proc/$pid/stat" ]; then
+            total=$((total + $(sed 's/^.*) //' "/proc/$pid/stat" | awk '{print $12 + $13}')))
+        fi
+    done
+    echo "$total"
+}
+
+# Busy and total ticks of the host, from the first line of /proc/stat
+host_ticks() {
+    awk '/^cpu / {print $2 + $3 + $4 + $7 + $8 + $9, $2 + $3 + $4 + $5 + $6 + $7 + $8 + $9}' /proc/stat
+}
+
+cd "$dir"
+trap '[ -n "$server" ] && kill -TERM "$server" 2>/dev/null || true' EXIT
+echo "shards,clients,requests,seconds,throughput,p99_us_max,server_cpu_pct,host_cpu_pct"
+
+shards=1
+while [ "$shards" -le "$max_shards" ]; do
+    rm -f pwgen_admin.sock pwgen_admin.sock.*
+    ./TCP_server --port "$port" --shards "$shards" > bench_scaling_server.log 2>&1 &
+    server=$!
+    sleep 1
+
+    clients=$((shards * clients_per_shard))
+    per_client=$((requests / clients))
+    server_before=$(server_ticks "$server")
+    set -- $(host_ticks)
+    busy_before=$1
+    total_before=$2
+    begin=$(date +%s%N)
+    pids=
+    c=0
+    while [ "$c" -lt "$clients" ]; do
+        request=$(echo "$mix" | awk -F, -v i="$c" '{print $(i % NF + 1)}')
+        ./TCP_client --load "$per_client" --request "$request" "127.0.0.1:$port" > "bench_scaling_client.$c.log" 2>&1 &
+        pids="$pids $!"
+        c=$((c + 1))
+    done
+    for pid in $pids; do
+        wait "$pid" || true
+    done
+    end=$(date +%s%N)
+    server_after=$(server_ticks "$server")
+    set -- $(host_ticks)
+    busy_after=$1
+    total_after=$2
+
+    kill -TERM "$server" 2>/dev/null || true
+    wait "$server" 2>/dev/null || true
+    server=
+
+    # Only the requests of the clients that completed count
+    cat bench_scaling_client.*.log | awk -F'[ =]' -v shards="$shards" -v clients="$clients" \
+        -v ns=$((end - begin)) -v server=$((server_after - server_before)) -v ticks="$ticks" -v cpus="$cpus" \
+        -v busy=$((busy_after - busy_before)) -v total=$((total_after - total_before)) '
+        /^requests=/ {
+            for (i = 1; i < NF; i++) {
+                if ($i == "completed") done += $(i + 1)
+                if ($i == "p99_us" && $(i + 1) > p99) p99 = $(i + 1)
+            }
+        }
+        END {
+            seconds = ns / 1e9
+            printf "%d,%d,%d,%.3f,%.0f,%.1f,%.1f,%.1f\n", shards, clients, done, seconds, done / seconds, p99,
+                   100 * server / ticks / seconds, (total > 0) ? 100 * cpus * busy / total : 0
+        }'
+    rm -f bench_scaling_client.*.log
+
+    # Powers of two, ending with MAX_SHARDS itself
+    if [ "$shards" -lt "$max_shards" ] && [ $((shards * 2)) -gt "$max_shards" ]; then
+        shards=$max_shards
+    else
+        shards=$((shards * 2))
+    fi
+done
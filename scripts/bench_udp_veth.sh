@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# UDP request mode over a veth pair: the server runs in the root namespace on one end, the
+# load generator in a private namespace on the other. The same run is made with the server
+# reading its socket (--udp) and with AF_XDP on the veth end (--xdp). Needs root.
+#
+# Usage: scripts/bench_udp_veth.sh BUILD_DIR PORT REQUESTS [WINDOW] [REQUEST]
+#
+set -e
+dir=$1
+port=$2
+requests=$3
+window=${4:-32}
+request=${5:-m 16}
+ns=pwgen_bench
+host=pwgen0
+peer=pwgen1
+
+cleanup() {
+    [ -n "$server" ] && kill -TERM "$server" 2>/dev/null || true
+    ip link del "$host" 2>/dev/null || true
+    ip netns del "$ns" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+# The peer end is the client side; one RX queue keeps the AF_XDP socket on every packet
+ip netns add "$ns"
+ip link add "$host" numtxqueues 1 numrxqueues 1 type veth peer name "$peer" numtxqueues 1 numrxqueues 1
+ip link set "$peer" netns "$ns"
+ip addr add 10.77.0.1/24 dev "$host"
+ip link set "$host" up
+ip netns exec "$ns" ip addr add 10.77.0.2/24 dev "$peer"
+ip netns exec "$ns" ip link set "$peer" up
+ip netns exec "$ns" ip link set lo up
+
+cd "$dir"
+for mode in "--udp" "--xdp $host"; do
+    rm -f pwgen_admin.sock
+    # shellcheck disable=SC2086
+    ./TCP_server --port "$port" --address 10.77.0.1 $mode > bench_udp_server.log 2>&1 &
+    server=$!
+    sleep 1
+    printf '%s: ' "${mode%% *}"
+    ip netns exec "$ns" ./TCP_client --udp "$requests" --window "$window" --request "$request" "10.77.0.1:$port"
+    kill -TERM "$server"
+    wait "$server" || true
+    server=
+done
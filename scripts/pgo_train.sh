@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# Training run of the pgo build: starts the instrumented server, drives it with the
+# instrumented load generator over a representative request mix, then stops the server
+# with SIGTERM so both programs write their profiles at exit.
+#
+# Usage: scripts/pgo_train.sh BUILD_DIR PORT REQUESTS
+#
+set -e
+dir=$1
+port=$2
+requests=$3
+
+cd "$dir"
+rm -f pwgen_admin.sock
+./TCP_server --port "$port" > train_server.log 2>&1 &
+server=$!
+trap 'kill -TERM $server 2>/dev/null || true' EXIT
+sleep 1
+
+# Request mix: every password type, short and long passwords, then a stream
+for request in "m 16" "s 32" "a 12" "n 8" "l 16" "i 20" "s 8" "m 32"; do
+	./TCP_client --load "$requests" --request "$request" "127.0.0.1:$port"
+done
+./TCP_client --stream "$requests" --request "s 16" "127.0.0.1:$port" > /dev/null
+
+kill -TERM $server
+wait $server || true
+trap - EXIT
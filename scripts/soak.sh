@@ -0,0 +1,24 @@
+#!/bin/sh
+#
+# Soak test of one build: starts its server, keeps SESSIONS sessions churning against it for
+# SECONDS and samples the memory, descriptors and latency of the server every INTERVAL seconds.
+# Exits with 1 if the soak test flagged a leak, drift or the end of the server.
+#
+# Usage: scripts/soak.sh BUILD_DIR PORT SECONDS [SESSIONS] [INTERVAL] [REQUEST]
+#
+set -e
+dir=$1
+port=$2
+seconds=$3
+sessions=${4:-16}
+interval=${5:-60}
+request=${6:-m 16}
+
+cd "$dir"
+rm -f pwgen_admin.sock
+./TCP_server --port "$port" > soak_server.log 2>&1 &
+server=$!
+trap 'kill -TERM $server 2>/dev/null || true' EXIT
+sleep 1
+./TCP_client --soak "$seconds" --sessions "$sessions" --interval "$interval" --server-pid "$server" \
+    --request "$request" "127.0.0.1:$port"